@@ -0,0 +1,387 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2018 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "ngtcp2_bench_helper.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#include "ngtcp2_macro.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define NGTCP2_BENCH_HAVE_CYCLES 1
+#endif /* __x86_64__ || __i386__ */
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#define NGTCP2_BENCH_HAVE_PERF 1
+#endif /* __linux__ */
+
+static uint64_t read_cycles(void) {
+#ifdef NGTCP2_BENCH_HAVE_CYCLES
+  return (uint64_t)__rdtsc();
+#else  /* !NGTCP2_BENCH_HAVE_CYCLES */
+  return 0;
+#endif /* !NGTCP2_BENCH_HAVE_CYCLES */
+}
+
+/*
+ * open_cache_miss_counter starts counting the cache misses of the
+ * calling thread in user space.  It returns the file descriptor of
+ * the counter, or -1.
+ */
+static int open_cache_miss_counter(void) {
+#ifdef NGTCP2_BENCH_HAVE_PERF
+  struct perf_event_attr attr;
+  int fd;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = PERF_COUNT_HW_CACHE_MISSES;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+
+  fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  if (fd == -1) {
+    return -1;
+  }
+
+  ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+  ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+
+  return fd;
+#else  /* !NGTCP2_BENCH_HAVE_PERF */
+  return -1;
+#endif /* !NGTCP2_BENCH_HAVE_PERF */
+}
+
+/*
+ * close_cache_miss_counter closes |fd| opened by
+ * open_cache_miss_counter, and assigns the counted number of cache
+ * misses to |*pnmisses|.  It returns 0 if it succeeds, or -1.
+ */
+static int close_cache_miss_counter(int fd, uint64_t *pnmisses) {
+#ifdef NGTCP2_BENCH_HAVE_PERF
+  ssize_t nread;
+
+  if (fd == -1) {
+    return -1;
+  }
+
+  ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+  nread = read(fd, pnmisses, sizeof(*pnmisses));
+  close(fd);
+
+  return nread == (ssize_t)sizeof(*pnmisses) ? 0 : -1;
+#else  /* !NGTCP2_BENCH_HAVE_PERF */
+  (void)fd;
+  (void)pnmisses;
+  return -1;
+#endif /* !NGTCP2_BENCH_HAVE_PERF */
+}
+
+void ngtcp2_bench_timer_start(ngtcp2_bench_timer *timer) {
+  timer->perf_fd = open_cache_miss_counter();
+  clock_gettime(CLOCK_MONOTONIC, &timer->start);
+  timer->start_cycles = read_cycles();
+  timer->elapsed = 0;
+  timer->cycles = 0;
+  timer->cache_misses = 0;
+  timer->has_cache_misses = 0;
+}
+
+void ngtcp2_bench_timer_stop(ngtcp2_bench_timer *timer) {
+  struct timespec end;
+  uint64_t end_cycles = read_cycles();
+
+  timer->has_cache_misses =
+      close_cache_miss_counter(timer->perf_fd, &timer->cache_misses) == 0;
+  timer->perf_fd = -1;
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  timer->elapsed = (double)(end.tv_sec - timer->start.tv_sec) +
+                   (double)(end.tv_nsec - timer->start.tv_nsec) / 1e9;
+  timer->cycles = end_cycles - timer->start_cycles;
+}
+
+int ngtcp2_bench_have_cycles(void) {
+#ifdef NGTCP2_BENCH_HAVE_CYCLES
+  return 1;
+#else  /* !NGTCP2_BENCH_HAVE_CYCLES */
+  return 0;
+#endif /* !NGTCP2_BENCH_HAVE_CYCLES */
+}
+
+static void *bench_malloc(size_t size, void *mem_user_data) {
+  ngtcp2_bench_mem *bmem = mem_user_data;
+
+  ++bmem->nalloc;
+
+  return malloc(size);
+}
+
+static void bench_free(void *ptr, void *mem_user_data) {
+  ngtcp2_bench_mem *bmem = mem_user_data;
+
+  if (ptr) {
+    ++bmem->nfree;
+  }
+
+  free(ptr);
+}
+
+static void *bench_calloc(size_t nmemb, size_t size, void *mem_user_data) {
+  ngtcp2_bench_mem *bmem = mem_user_data;
+
+  ++bmem->nalloc;
+
+  return calloc(nmemb, size);
+}
+
+static void *bench_realloc(void *ptr, size_t size, void *mem_user_data) {
+  ngtcp2_bench_mem *bmem = mem_user_data;
+
+  ++bmem->nalloc;
+
+  return realloc(ptr, size);
+}
+
+void ngtcp2_bench_mem_init(ngtcp2_bench_mem *bmem) {
+  bmem->mem.mem_user_data = bmem;
+  bmem->mem.malloc = bench_malloc;
+  bmem->mem.free = bench_free;
+  bmem->mem.calloc = bench_calloc;
+  bmem->mem.realloc = bench_realloc;
+  bmem->nalloc = 0;
+  bmem->nfree = 0;
+}
+
+/*
+ * null_tag writes the tag of the null AEAD to |tag|.  The tag is the
+ * nonce, which is derived from the packet number, so that a packet
+ * whose packet number is recovered incorrectly fails to decrypt as
+ * it does with a real AEAD.
+ */
+static void null_tag(uint8_t *tag, const uint8_t *nonce, size_t noncelen) {
+  size_t n = ngtcp2_min(noncelen, NGTCP2_BENCH_AEAD_OVERHEAD);
+
+  memcpy(tag, nonce, n);
+  memset(tag + n, 0, NGTCP2_BENCH_AEAD_OVERHEAD - n);
+}
+
+ssize_t ngtcp2_bench_null_encrypt(ngtcp2_conn *conn, uint8_t *dest,
+                                  size_t destlen, const uint8_t *plaintext,
+                                  size_t plaintextlen, const uint8_t *key,
+                                  size_t keylen, const uint8_t *nonce,
+                                  size_t noncelen, const uint8_t *ad,
+                                  size_t adlen, void *user_data) {
+  (void)conn;
+  (void)key;
+  (void)keylen;
+  (void)ad;
+  (void)adlen;
+  (void)user_data;
+
+  if (destlen < plaintextlen + NGTCP2_BENCH_AEAD_OVERHEAD) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  if (dest != plaintext) {
+    memmove(dest, plaintext, plaintextlen);
+  }
+  null_tag(dest + plaintextlen, nonce, noncelen);
+
+  return (ssize_t)(plaintextlen + NGTCP2_BENCH_AEAD_OVERHEAD);
+}
+
+ssize_t ngtcp2_bench_null_decrypt(ngtcp2_conn *conn, uint8_t *dest,
+                                  size_t destlen, const uint8_t *ciphertext,
+                                  size_t ciphertextlen, const uint8_t *key,
+                                  size_t keylen, const uint8_t *nonce,
+                                  size_t noncelen, const uint8_t *ad,
+                                  size_t adlen, void *user_data) {
+  uint8_t tag[NGTCP2_BENCH_AEAD_OVERHEAD];
+  (void)conn;
+  (void)key;
+  (void)keylen;
+  (void)ad;
+  (void)adlen;
+  (void)user_data;
+
+  if (ciphertextlen < NGTCP2_BENCH_AEAD_OVERHEAD ||
+      destlen < ciphertextlen - NGTCP2_BENCH_AEAD_OVERHEAD) {
+    return NGTCP2_ERR_TLS_DECRYPT;
+  }
+
+  null_tag(tag, nonce, noncelen);
+  if (memcmp(tag, ciphertext + ciphertextlen - NGTCP2_BENCH_AEAD_OVERHEAD,
+             sizeof(tag)) != 0) {
+    return NGTCP2_ERR_TLS_DECRYPT;
+  }
+
+  memmove(dest, ciphertext, ciphertextlen - NGTCP2_BENCH_AEAD_OVERHEAD);
+
+  return (ssize_t)(ciphertextlen - NGTCP2_BENCH_AEAD_OVERHEAD);
+}
+
+ssize_t ngtcp2_bench_null_encrypt_pn(ngtcp2_conn *conn, uint8_t *dest,
+                                     size_t destlen, const uint8_t *ciphertext,
+                                     size_t ciphertextlen, const uint8_t *key,
+                                     size_t keylen, const uint8_t *nonce,
+                                     size_t noncelen, void *user_data) {
+  (void)conn;
+  (void)key;
+  (void)keylen;
+  (void)nonce;
+  (void)noncelen;
+  (void)user_data;
+
+  assert(destlen >= ciphertextlen);
+
+  memmove(dest, ciphertext, ciphertextlen);
+
+  return (ssize_t)ciphertextlen;
+}
+
+void ngtcp2_bench_null_callbacks(ngtcp2_conn_callbacks *cb) {
+  cb->in_encrypt = ngtcp2_bench_null_encrypt;
+  cb->in_decrypt = ngtcp2_bench_null_decrypt;
+  cb->encrypt = ngtcp2_bench_null_encrypt;
+  cb->decrypt = ngtcp2_bench_null_decrypt;
+  cb->in_encrypt_pn = ngtcp2_bench_null_encrypt_pn;
+  cb->encrypt_pn = ngtcp2_bench_null_encrypt_pn;
+}
+
+static const uint8_t null_key[16];
+static const uint8_t null_iv[16];
+static const uint8_t null_pn[16];
+
+void ngtcp2_bench_install_null_keys(ngtcp2_conn *conn) {
+  ngtcp2_conn_set_handshake_tx_keys(conn, null_key, sizeof(null_key), null_iv,
+                                    sizeof(null_iv), null_pn, sizeof(null_pn));
+  ngtcp2_conn_set_handshake_rx_keys(conn, null_key, sizeof(null_key), null_iv,
+                                    sizeof(null_iv), null_pn, sizeof(null_pn));
+  ngtcp2_conn_update_tx_keys(conn, null_key, sizeof(null_key), null_iv,
+                             sizeof(null_iv), null_pn, sizeof(null_pn));
+  ngtcp2_conn_update_rx_keys(conn, null_key, sizeof(null_key), null_iv,
+                             sizeof(null_iv), null_pn, sizeof(null_pn));
+  ngtcp2_conn_set_aead_overhead(conn, NGTCP2_BENCH_AEAD_OVERHEAD);
+}
+
+int ngtcp2_bench_write_trace(FILE *fp, const ngtcp2_trace_ring *ring,
+                             ngtcp2_tstamp base_ts) {
+  ngtcp2_bench_trace_hd hd;
+  size_t i, len = ngtcp2_trace_ring_len(ring);
+
+  memset(&hd, 0, sizeof(hd));
+  memcpy(hd.magic, NGTCP2_BENCH_TRACE_MAGIC, sizeof(hd.magic));
+  hd.reclen = sizeof(ngtcp2_trace_record);
+  hd.base_ts = base_ts;
+
+  if (fwrite(&hd, sizeof(hd), 1, fp) != 1) {
+    return -1;
+  }
+
+  for (i = 0; i < len; ++i) {
+    if (fwrite(ngtcp2_trace_ring_get(ring, i), sizeof(ngtcp2_trace_record), 1,
+               fp) != 1) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static const char *phase_names[] = {
+    "recv",
+    "recv_decrypt_pn",
+    "recv_decrypt",
+    "recv_decode_frame",
+    "recv_ack",
+    "recv_stream",
+    "write_pkt",
+    "write_ack",
+    "write_encrypt",
+    "rtb_recv_ack",
+    "rtb_acked_stream_data",
+    "rtb_detect_lost",
+};
+
+/*
+ * phase_hist_percentile returns the upper bound of the bucket of
+ * |hist| which contains |p| percentile.
+ */
+static uint64_t phase_hist_percentile(const ngtcp2_phase_hist *hist,
+                                      double p) {
+  uint64_t n = 0, target = (uint64_t)((double)hist->count * p);
+  size_t i;
+
+  for (i = 0; i < NGTCP2_PHASE_HIST_NBUCKETS; ++i) {
+    n += hist->buckets[i];
+    if (n > target) {
+      break;
+    }
+  }
+
+  if (i >= NGTCP2_PHASE_HIST_NBUCKETS - 1) {
+    return hist->max;
+  }
+
+  return ngtcp2_min((uint64_t)1 << (i + 1), hist->max);
+}
+
+int ngtcp2_bench_print_phase_hist(FILE *fp, ngtcp2_conn *conn,
+                                  const char *name) {
+  ngtcp2_phase_hist hist;
+  size_t i;
+
+  for (i = 0; i < NGTCP2_PHASE_MAX; ++i) {
+    if (ngtcp2_conn_get_phase_hist(conn, (int)i, &hist) != 0) {
+      return -1;
+    }
+
+    if (hist.count == 0) {
+      continue;
+    }
+
+    fprintf(fp,
+            "  %-6s %-22s %10" PRIu64 " mean=%-8.0f min=%-8" PRIu64
+            " p50<=%-8" PRIu64 " p99<=%-8" PRIu64 " max=%" PRIu64 "\n",
+            name, phase_names[i], hist.count,
+            (double)hist.sum / (double)hist.count, hist.min,
+            phase_hist_percentile(&hist, 0.5),
+            phase_hist_percentile(&hist, 0.99), hist.max);
+  }
+
+  return 0;
+}
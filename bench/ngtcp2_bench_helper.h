@@ -0,0 +1,178 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2018 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NGTCP2_BENCH_HELPER_H
+#define NGTCP2_BENCH_HELPER_H
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <time.h>
+
+#include <ngtcp2/ngtcp2.h>
+
+/*
+ * ngtcp2_bench_timer measures wall clock time and, where available,
+ * CPU cycles and cache misses spent between ngtcp2_bench_timer_start
+ * and ngtcp2_bench_timer_stop.
+ */
+typedef struct {
+  struct timespec start;
+  uint64_t start_cycles;
+  /* perf_fd is the file descriptor of the cache miss counter, or -1
+     if it is not available. */
+  int perf_fd;
+  /* elapsed is the measured wall clock time in seconds. */
+  double elapsed;
+  /* cycles is the number of elapsed CPU cycles.  It is 0 if the
+     platform has no cycle counter. */
+  uint64_t cycles;
+  /* cache_misses is the number of last level cache misses in user
+     space.  It is only valid if has_cache_misses is nonzero. */
+  uint64_t cache_misses;
+  /* has_cache_misses is nonzero if cache misses are measured.  It
+     requires Linux perf events, and hardware counters which are
+     often not exposed to virtual machines. */
+  int has_cache_misses;
+} ngtcp2_bench_timer;
+
+void ngtcp2_bench_timer_start(ngtcp2_bench_timer *timer);
+
+void ngtcp2_bench_timer_stop(ngtcp2_bench_timer *timer);
+
+/*
+ * ngtcp2_bench_have_cycles returns nonzero if CPU cycles are
+ * measured.  On x86, the time stamp counter is used, which ticks at
+ * the nominal clock rate regardless of frequency scaling.
+ */
+int ngtcp2_bench_have_cycles(void);
+
+/*
+ * ngtcp2_bench_mem is an allocator which counts allocations made
+ * through |mem|.
+ */
+typedef struct {
+  ngtcp2_mem mem;
+  /* nalloc is the number of malloc, calloc and realloc calls. */
+  uint64_t nalloc;
+  /* nfree is the number of free calls with non-NULL pointer. */
+  uint64_t nfree;
+} ngtcp2_bench_mem;
+
+/*
+ * ngtcp2_bench_mem_init initializes |bmem|.  Pass &bmem->mem to the
+ * library.
+ */
+void ngtcp2_bench_mem_init(ngtcp2_bench_mem *bmem);
+
+/*
+ * NGTCP2_BENCH_AEAD_OVERHEAD is the AEAD overhead of the null AEAD
+ * below.  It matches AEAD_AES_128_GCM so that packets have the same
+ * size as real ones.
+ */
+#define NGTCP2_BENCH_AEAD_OVERHEAD 16
+
+/*
+ * ngtcp2_bench_null_encrypt is an identity AEAD which copies
+ * |plaintext| to |dest|, and appends NGTCP2_BENCH_AEAD_OVERHEAD bytes
+ * tag which carries |nonce|.
+ */
+ssize_t ngtcp2_bench_null_encrypt(ngtcp2_conn *conn, uint8_t *dest,
+                                  size_t destlen, const uint8_t *plaintext,
+                                  size_t plaintextlen, const uint8_t *key,
+                                  size_t keylen, const uint8_t *nonce,
+                                  size_t noncelen, const uint8_t *ad,
+                                  size_t adlen, void *user_data);
+
+/*
+ * ngtcp2_bench_null_decrypt reverses ngtcp2_bench_null_encrypt.  It
+ * returns NGTCP2_ERR_TLS_DECRYPT if the tag does not match |nonce|.
+ */
+ssize_t ngtcp2_bench_null_decrypt(ngtcp2_conn *conn, uint8_t *dest,
+                                  size_t destlen, const uint8_t *ciphertext,
+                                  size_t ciphertextlen, const uint8_t *key,
+                                  size_t keylen, const uint8_t *nonce,
+                                  size_t noncelen, const uint8_t *ad,
+                                  size_t adlen, void *user_data);
+
+/*
+ * ngtcp2_bench_null_encrypt_pn is an identity packet number
+ * protection.
+ */
+ssize_t ngtcp2_bench_null_encrypt_pn(ngtcp2_conn *conn, uint8_t *dest,
+                                     size_t destlen, const uint8_t *ciphertext,
+                                     size_t ciphertextlen, const uint8_t *key,
+                                     size_t keylen, const uint8_t *nonce,
+                                     size_t noncelen, void *user_data);
+
+/*
+ * ngtcp2_bench_null_callbacks fills the crypto callbacks in |cb| with
+ * the null AEAD functions above.  The other fields are left
+ * untouched.
+ */
+void ngtcp2_bench_null_callbacks(ngtcp2_conn_callbacks *cb);
+
+/*
+ * ngtcp2_bench_install_null_keys installs null keys for Handshake and
+ * 1-RTT packets in |conn|, and sets AEAD overhead.
+ */
+void ngtcp2_bench_install_null_keys(ngtcp2_conn *conn);
+
+/*
+ * A trace file starts with ngtcp2_bench_trace_hd, which is followed
+ * by ngtcp2_trace_record in the order of oldest first.  Everything is
+ * in host byte order, so a trace file must be decoded on the same
+ * kind of machine which wrote it.
+ */
+#define NGTCP2_BENCH_TRACE_MAGIC "NGTCP2TR"
+
+typedef struct {
+  uint8_t magic[8];
+  /* reclen is sizeof(ngtcp2_trace_record) of the writer. */
+  uint32_t reclen;
+  uint32_t reserved;
+  /* base_ts is the timestamp which the time of each record is
+     relative to. */
+  uint64_t base_ts;
+} ngtcp2_bench_trace_hd;
+
+/*
+ * ngtcp2_bench_write_trace writes the records in |ring| to |fp| as a
+ * trace file.  It returns 0 if it succeeds, or -1.
+ */
+int ngtcp2_bench_write_trace(FILE *fp, const ngtcp2_trace_ring *ring,
+                             ngtcp2_tstamp base_ts);
+
+/*
+ * ngtcp2_bench_print_phase_hist prints the phase histograms of |conn|
+ * to |fp|, labelled with |name|.  The percentiles are the upper bound
+ * of the bucket they fall in.  It returns 0 if it succeeds, or -1 if
+ * the library is built without phase timing.
+ */
+int ngtcp2_bench_print_phase_hist(FILE *fp, ngtcp2_conn *conn,
+                                  const char *name);
+
+#endif /* NGTCP2_BENCH_HELPER_H */
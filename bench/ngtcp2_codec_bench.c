@@ -0,0 +1,517 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2018 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * codec_bench measures packet header and frame encoding and
+ * decoding, and the varint helpers.  Each workload is a set of
+ * packets filled with one of the following frame mixes:
+ *
+ *   stream   STREAM frames of various sizes at large offsets
+ *   ack      ACK frames with 16 to 128 ACK blocks
+ *   control  small control frames, such as MAX_STREAM_DATA, and
+ *            PING
+ *   initial  long header packets carrying a CRYPTO frame and
+ *            PADDING
+ *
+ * Encoding writes the header and the frames of each packet from
+ * ngtcp2_frame, and decoding parses them back, including the packet
+ * number.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ngtcp2_pkt.h"
+#include "ngtcp2_conv.h"
+#include "ngtcp2_conn.h"
+#include "ngtcp2_macro.h"
+#include "ngtcp2_bench_helper.h"
+
+/* NPKTS is the number of distinct packets in a workload. */
+#define NPKTS 1024
+/* NROUNDS is the number of times each workload is processed. */
+#define NROUNDS 200
+/* MAX_PKT_FRAMES is the maximum number of frames in a packet. */
+#define MAX_PKT_FRAMES 256
+/* NVARINTS is the number of integers in the varint workload. */
+#define NVARINTS (1024 * 1024)
+
+typedef struct {
+  ngtcp2_pkt_hd hd;
+  ngtcp2_frame *frs[MAX_PKT_FRAMES];
+  size_t nfrs;
+  /* payloadoff is the offset to the first frame in buf. */
+  size_t payloadoff;
+  uint8_t buf[NGTCP2_MAX_PKTLEN_IPV4];
+  size_t buflen;
+} packet;
+
+typedef struct {
+  const char *name;
+  /* build fills |pkt| with frames. */
+  void (*build)(packet *pkt, uint64_t *rnd);
+  /* long_hd is nonzero if the mix uses long header. */
+  int long_hd;
+} mix;
+
+static uint8_t data[NGTCP2_MAX_PKTLEN_IPV4];
+static ngtcp2_cid dcid, scid;
+static uint64_t next_pkt_num;
+/* sink keeps the compiler from optimizing away decoding. */
+static volatile uint64_t sink;
+
+static uint64_t xorshift(uint64_t *state) {
+  uint64_t x = *state;
+
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+
+  return *state = x;
+}
+
+static uint64_t rand_range(uint64_t *rnd, uint64_t lo, uint64_t hi) {
+  return lo + xorshift(rnd) % (hi - lo + 1);
+}
+
+static ngtcp2_frame *frame_new(size_t nblks) {
+  ngtcp2_frame *fr =
+      calloc(1, sizeof(ngtcp2_frame) + sizeof(ngtcp2_ack_blk) * nblks);
+
+  if (fr == NULL) {
+    fprintf(stderr, "calloc failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  return fr;
+}
+
+/*
+ * add_frame appends |fr| to |pkt|.  It returns 0 if |fr| does not
+ * fit, in which case |fr| is freed.
+ */
+static int add_frame(packet *pkt, ngtcp2_frame *fr) {
+  ssize_t nwrite;
+
+  if (pkt->nfrs == MAX_PKT_FRAMES) {
+    free(fr);
+    return 0;
+  }
+
+  nwrite = ngtcp2_pkt_encode_frame(pkt->buf + pkt->buflen,
+                                   sizeof(pkt->buf) - pkt->buflen, fr);
+  if (nwrite < 0) {
+    free(fr);
+    return 0;
+  }
+
+  pkt->buflen += (size_t)nwrite;
+  pkt->frs[pkt->nfrs++] = fr;
+
+  return 1;
+}
+
+static size_t room(const packet *pkt) {
+  return sizeof(pkt->buf) - pkt->buflen;
+}
+
+static void build_stream(packet *pkt, uint64_t *rnd) {
+  ngtcp2_frame *fr;
+  size_t datalen;
+
+  for (; room(pkt) > 32;) {
+    datalen = (size_t)rand_range(rnd, 50, 1100);
+    datalen = ngtcp2_min(datalen, room(pkt) - 24);
+
+    fr = frame_new(0);
+    fr->type = NGTCP2_FRAME_STREAM;
+    fr->stream.stream_id = rand_range(rnd, 0, 99) * 4;
+    fr->stream.offset = rand_range(rnd, 0, 1 << 30);
+    fr->stream.fin = rand_range(rnd, 0, 15) == 0;
+    fr->stream.datalen = datalen;
+    fr->stream.data = data;
+
+    if (!add_frame(pkt, fr)) {
+      break;
+    }
+  }
+}
+
+static void build_ack(packet *pkt, uint64_t *rnd) {
+  ngtcp2_frame *fr;
+  size_t i, nblks;
+
+  for (;;) {
+    nblks = (size_t)rand_range(rnd, 16, 128);
+
+    fr = frame_new(nblks);
+    fr->type = NGTCP2_FRAME_ACK;
+    fr->ack.largest_ack = rand_range(rnd, 1 << 20, 1 << 30);
+    fr->ack.ack_delay = rand_range(rnd, 0, 25000);
+    fr->ack.first_ack_blklen = rand_range(rnd, 0, 10);
+    fr->ack.num_blks = nblks;
+    for (i = 0; i < nblks; ++i) {
+      fr->ack.blks[i].gap = rand_range(rnd, 0, 3);
+      fr->ack.blks[i].blklen = rand_range(rnd, 0, 20);
+    }
+
+    if (!add_frame(pkt, fr)) {
+      break;
+    }
+  }
+}
+
+static void build_control(packet *pkt, uint64_t *rnd) {
+  ngtcp2_frame *fr;
+
+  for (;;) {
+    fr = frame_new(0);
+
+    switch (rand_range(rnd, 0, 9)) {
+    case 0:
+      fr->type = NGTCP2_FRAME_MAX_DATA;
+      fr->max_data.max_data = rand_range(rnd, 0, 1 << 30);
+      break;
+    case 1:
+    case 2:
+      fr->type = NGTCP2_FRAME_MAX_STREAM_DATA;
+      fr->max_stream_data.stream_id = rand_range(rnd, 0, 99) * 4;
+      fr->max_stream_data.max_stream_data = rand_range(rnd, 0, 1 << 30);
+      break;
+    case 3:
+      fr->type = NGTCP2_FRAME_MAX_STREAM_ID;
+      fr->max_stream_id.max_stream_id = rand_range(rnd, 0, 9999) * 4;
+      break;
+    case 4:
+      fr->type = NGTCP2_FRAME_PING;
+      break;
+    case 5:
+      fr->type = NGTCP2_FRAME_BLOCKED;
+      fr->blocked.offset = rand_range(rnd, 0, 1 << 30);
+      break;
+    case 6:
+      fr->type = NGTCP2_FRAME_STREAM_BLOCKED;
+      fr->stream_blocked.stream_id = rand_range(rnd, 0, 99) * 4;
+      fr->stream_blocked.offset = rand_range(rnd, 0, 1 << 30);
+      break;
+    case 7:
+      fr->type = NGTCP2_FRAME_RST_STREAM;
+      fr->rst_stream.stream_id = rand_range(rnd, 0, 99) * 4;
+      fr->rst_stream.app_error_code = 1;
+      fr->rst_stream.final_offset = rand_range(rnd, 0, 1 << 20);
+      break;
+    case 8:
+      fr->type = NGTCP2_FRAME_STOP_SENDING;
+      fr->stop_sending.stream_id = rand_range(rnd, 0, 99) * 4;
+      fr->stop_sending.app_error_code = 1;
+      break;
+    default:
+      fr->type = NGTCP2_FRAME_PATH_CHALLENGE;
+      memset(fr->path_challenge.data, 0xde, sizeof(fr->path_challenge.data));
+      break;
+    }
+
+    if (!add_frame(pkt, fr)) {
+      break;
+    }
+  }
+}
+
+static void build_initial(packet *pkt, uint64_t *rnd) {
+  ngtcp2_frame *fr;
+
+  fr = frame_new(0);
+  fr->type = NGTCP2_FRAME_CRYPTO;
+  fr->crypto.offset = rand_range(rnd, 0, 4096);
+  fr->crypto.datacnt = 1;
+  fr->crypto.data[0].base = data;
+  fr->crypto.data[0].len = (size_t)rand_range(rnd, 200, 600);
+
+  add_frame(pkt, fr);
+
+  fr = frame_new(0);
+  fr->type = NGTCP2_FRAME_PADDING;
+  fr->padding.len = room(pkt);
+
+  add_frame(pkt, fr);
+}
+
+static void encode_hd(packet *pkt) {
+  ssize_t nwrite;
+
+  if (pkt->hd.flags & NGTCP2_PKT_FLAG_LONG_FORM) {
+    nwrite = ngtcp2_pkt_encode_hd_long(pkt->buf, sizeof(pkt->buf), &pkt->hd);
+  } else {
+    nwrite = ngtcp2_pkt_encode_hd_short(pkt->buf, sizeof(pkt->buf), &pkt->hd);
+  }
+
+  if (nwrite < 0) {
+    fprintf(stderr, "could not encode header: %s\n",
+            ngtcp2_strerror((int)nwrite));
+    exit(EXIT_FAILURE);
+  }
+
+  pkt->payloadoff = (size_t)nwrite;
+}
+
+static void build_pkt(packet *pkt, const mix *m, uint64_t *rnd) {
+  memset(pkt, 0, sizeof(*pkt));
+
+  if (m->long_hd) {
+    ngtcp2_pkt_hd_init(&pkt->hd, NGTCP2_PKT_FLAG_LONG_FORM, NGTCP2_PKT_INITIAL,
+                       &dcid, &scid, next_pkt_num++, 4, NGTCP2_PROTO_VER_MAX,
+                       0);
+  } else {
+    ngtcp2_pkt_hd_init(&pkt->hd, NGTCP2_PKT_FLAG_NONE, NGTCP2_PKT_SHORT,
+                       &dcid, NULL, next_pkt_num++, 4, NGTCP2_PROTO_VER_MAX,
+                       0);
+  }
+
+  encode_hd(pkt);
+
+  pkt->buflen = pkt->payloadoff;
+
+  m->build(pkt, rnd);
+
+  if (m->long_hd) {
+    /* Length covers the packet number and the payload. */
+    pkt->hd.len = pkt->buflen - pkt->payloadoff + pkt->hd.pkt_numlen;
+    encode_hd(pkt);
+  }
+}
+
+static void report(const char *name, const char *op, uint64_t nframes,
+                   uint64_t nbytes, const ngtcp2_bench_timer *timer) {
+  printf("%-8s %-7s %14.0f %10.1f\n", name, op,
+         (double)nframes / timer->elapsed,
+         (double)nbytes / timer->elapsed / 1e6);
+}
+
+static void bench_encode(const mix *m, packet *pkts) {
+  static uint8_t out[NGTCP2_MAX_PKTLEN_IPV4];
+  ngtcp2_bench_timer timer;
+  packet *pkt;
+  uint64_t nframes = 0, nbytes = 0;
+  size_t i, j, r, len;
+  ssize_t nwrite;
+
+  ngtcp2_bench_timer_start(&timer);
+
+  for (r = 0; r < NROUNDS; ++r) {
+    for (i = 0; i < NPKTS; ++i) {
+      pkt = &pkts[i];
+
+      if (m->long_hd) {
+        nwrite = ngtcp2_pkt_encode_hd_long(out, sizeof(out), &pkt->hd);
+      } else {
+        nwrite = ngtcp2_pkt_encode_hd_short(out, sizeof(out), &pkt->hd);
+      }
+      len = (size_t)nwrite;
+
+      for (j = 0; j < pkt->nfrs; ++j) {
+        nwrite = ngtcp2_pkt_encode_frame(out + len, sizeof(out) - len,
+                                         pkt->frs[j]);
+        if (nwrite < 0) {
+          fprintf(stderr, "%s: could not encode frame: %s\n", m->name,
+                  ngtcp2_strerror((int)nwrite));
+          exit(EXIT_FAILURE);
+        }
+        len += (size_t)nwrite;
+      }
+
+      nframes += pkt->nfrs;
+      nbytes += len;
+    }
+  }
+
+  ngtcp2_bench_timer_stop(&timer);
+
+  report(m->name, "encode", nframes, nbytes, &timer);
+}
+
+static void bench_decode(const mix *m, packet *pkts) {
+  ngtcp2_bench_timer timer;
+  ngtcp2_max_frame mfr;
+  ngtcp2_pkt_hd hd;
+  const packet *pkt;
+  const uint8_t *p, *end;
+  uint64_t nframes = 0, nbytes = 0, s = 0;
+  size_t i, r, pnlen;
+  ssize_t nread;
+
+  ngtcp2_bench_timer_start(&timer);
+
+  for (r = 0; r < NROUNDS; ++r) {
+    for (i = 0; i < NPKTS; ++i) {
+      pkt = &pkts[i];
+
+      if (m->long_hd) {
+        nread = ngtcp2_pkt_decode_hd_long(&hd, pkt->buf, pkt->buflen);
+      } else {
+        nread = ngtcp2_pkt_decode_hd_short(&hd, pkt->buf, pkt->buflen,
+                                           dcid.datalen);
+      }
+      if (nread < 0) {
+        fprintf(stderr, "%s: could not decode header: %s\n", m->name,
+                ngtcp2_strerror((int)nread));
+        exit(EXIT_FAILURE);
+      }
+
+      p = pkt->buf + nread;
+      end = pkt->buf + pkt->buflen;
+
+      s += ngtcp2_get_pkt_num(&pnlen, p);
+      p += pnlen;
+
+      for (; p != end; p += nread) {
+        nread = ngtcp2_pkt_decode_frame(&mfr.fr, p, (size_t)(end - p));
+        if (nread < 0) {
+          fprintf(stderr, "%s: could not decode frame: %s\n", m->name,
+                  ngtcp2_strerror((int)nread));
+          exit(EXIT_FAILURE);
+        }
+        s += mfr.fr.type;
+        ++nframes;
+      }
+
+      nbytes += pkt->buflen;
+    }
+  }
+
+  ngtcp2_bench_timer_stop(&timer);
+
+  sink = s;
+
+  report(m->name, "decode", nframes, nbytes, &timer);
+}
+
+static void bench_varint(void) {
+  ngtcp2_bench_timer timer;
+  uint64_t *vals;
+  uint8_t *buf, *p;
+  const uint8_t *q;
+  uint64_t rnd = 0x9e3779b97f4a7c15ull, s = 0;
+  size_t i, r, n, buflen;
+  static const uint64_t maxv[] = {63, 16383, 1073741823,
+                                  4611686018427387903ull};
+
+  vals = malloc(sizeof(uint64_t) * NVARINTS);
+  buf = malloc(NVARINTS * 8);
+  if (vals == NULL || buf == NULL) {
+    fprintf(stderr, "malloc failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  /* All 4 encoded lengths are equally likely. */
+  for (i = 0; i < NVARINTS; ++i) {
+    vals[i] = rand_range(&rnd, 0, maxv[xorshift(&rnd) % 4]);
+  }
+
+  ngtcp2_bench_timer_start(&timer);
+  for (r = 0; r < NROUNDS / 10; ++r) {
+    p = buf;
+    for (i = 0; i < NVARINTS; ++i) {
+      p = ngtcp2_put_varint(p, vals[i]);
+    }
+  }
+  ngtcp2_bench_timer_stop(&timer);
+
+  buflen = (size_t)(p - buf);
+
+  report("varint", "encode", (uint64_t)NVARINTS * (NROUNDS / 10),
+         (uint64_t)buflen * (NROUNDS / 10), &timer);
+
+  ngtcp2_bench_timer_start(&timer);
+  for (r = 0; r < NROUNDS / 10; ++r) {
+    q = buf;
+    for (i = 0; i < NVARINTS; ++i) {
+      s += ngtcp2_get_varint(&n, q);
+      q += n;
+    }
+  }
+  ngtcp2_bench_timer_stop(&timer);
+
+  sink = s;
+
+  report("varint", "decode", (uint64_t)NVARINTS * (NROUNDS / 10),
+         (uint64_t)buflen * (NROUNDS / 10), &timer);
+
+  free(buf);
+  free(vals);
+}
+
+static const mix mixes[] = {
+    {"stream", build_stream, 0},
+    {"ack", build_ack, 0},
+    {"control", build_control, 0},
+    {"initial", build_initial, 1},
+};
+
+int main(void) {
+  packet *pkts;
+  uint8_t cidbuf[8];
+  uint64_t rnd;
+  size_t i, j;
+
+  pkts = malloc(sizeof(packet) * NPKTS);
+  if (pkts == NULL) {
+    fprintf(stderr, "malloc failed\n");
+    return EXIT_FAILURE;
+  }
+
+  memset(cidbuf, 0xd, sizeof(cidbuf));
+  ngtcp2_cid_init(&dcid, cidbuf, sizeof(cidbuf));
+  memset(cidbuf, 0x5, sizeof(cidbuf));
+  ngtcp2_cid_init(&scid, cidbuf, sizeof(cidbuf));
+
+  printf("%-8s %-7s %14s %10s\n", "mix", "op", "frames/s", "MB/s");
+
+  for (i = 0; i < sizeof(mixes) / sizeof(mixes[0]); ++i) {
+    rnd = 0x9e3779b97f4a7c15ull;
+    next_pkt_num = 1000000007;
+
+    for (j = 0; j < NPKTS; ++j) {
+      build_pkt(&pkts[j], &mixes[i], &rnd);
+    }
+
+    bench_encode(&mixes[i], pkts);
+    bench_decode(&mixes[i], pkts);
+
+    for (j = 0; j < NPKTS; ++j) {
+      for (; pkts[j].nfrs;) {
+        free(pkts[j].frs[--pkts[j].nfrs]);
+      }
+    }
+  }
+
+  bench_varint();
+
+  free(pkts);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,617 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2018 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * ds_bench measures the internal data structures in isolation.  Each
+ * structure is filled with N elements, looked up, iterated, and
+ * drained, with keys in one of the following orders:
+ *
+ *   seq          0, 1, 2, ...
+ *   random       a fixed pseudo random permutation of 0..N-1
+ *   adversarial  all even keys, and then all odd keys.  This leaves
+ *                the maximum number of gaps in range based
+ *                structures, and keeps inserting into the middle of
+ *                full blocks in the skip lists.
+ *
+ * It reports ns/op and allocations/op through ngtcp2_mem for each
+ * operation.  With -a, each run allocates from its own ngtcp2_arena,
+ * and allocations/op counts the slabs and large objects which the
+ * arena takes from the backing allocator.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ngtcp2_ksl.h"
+#include "ngtcp2_psl.h"
+#include "ngtcp2_map.h"
+#include "ngtcp2_rob.h"
+#include "ngtcp2_gaptr.h"
+#include "ngtcp2_idtr.h"
+#include "ngtcp2_acktr.h"
+#include "ngtcp2_rtb.h"
+#include "ngtcp2_log.h"
+#include "ngtcp2_cid.h"
+#include "ngtcp2_pkt.h"
+#include "ngtcp2_conn.h"
+#include "ngtcp2_bench_helper.h"
+
+/* SEGLEN is the length of data which one rob and gaptr element
+   covers. */
+#define SEGLEN 64
+
+typedef enum {
+  PATTERN_SEQ,
+  PATTERN_RANDOM,
+  PATTERN_ADVERSARIAL,
+} pattern;
+
+static const char *pattern_names[] = {"seq", "random", "adversarial"};
+
+typedef struct {
+  const char *name;
+  void (*run)(const uint64_t *keys, size_t n, pattern pat);
+  /* max_unordered is the largest N for random and adversarial
+     patterns.  The list based structures are quadratic there. */
+  size_t max_unordered;
+} bench;
+
+static ngtcp2_bench_mem bmem;
+/* mem is the allocator given to the structures.  It is either
+   &bmem.mem or the allocator of the arena for the current run. */
+static ngtcp2_mem *mem;
+static ngtcp2_bench_timer timer;
+static uint64_t nalloc_start;
+/* sink keeps the compiler from optimizing away lookups. */
+static volatile uint64_t sink;
+
+static void op_start(void) {
+  nalloc_start = bmem.nalloc;
+  ngtcp2_bench_timer_start(&timer);
+}
+
+static void op_end(const char *name, const char *op, pattern pat, size_t n) {
+  ngtcp2_bench_timer_stop(&timer);
+
+  printf("%-6s %-8s %-11s %8zu %10.1f %8.3f\n", name, op, pattern_names[pat],
+         n, timer.elapsed * 1e9 / (double)n,
+         (double)(bmem.nalloc - nalloc_start) / (double)n);
+}
+
+static void fail(const char *name, int rv) {
+  fprintf(stderr, "%s: %s\n", name, ngtcp2_strerror(rv));
+  exit(EXIT_FAILURE);
+}
+
+static uint64_t xorshift(uint64_t *state) {
+  uint64_t x = *state;
+
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+
+  return *state = x;
+}
+
+static void make_keys(uint64_t *keys, size_t n, pattern pat) {
+  uint64_t state = 0x9e3779b97f4a7c15ull, t;
+  size_t i, j, half;
+
+  switch (pat) {
+  case PATTERN_SEQ:
+    for (i = 0; i < n; ++i) {
+      keys[i] = i;
+    }
+    break;
+  case PATTERN_RANDOM:
+    for (i = 0; i < n; ++i) {
+      keys[i] = i;
+    }
+    for (i = n; i > 1; --i) {
+      j = (size_t)(xorshift(&state) % i);
+      t = keys[i - 1];
+      keys[i - 1] = keys[j];
+      keys[j] = t;
+    }
+    break;
+  case PATTERN_ADVERSARIAL:
+    half = (n + 1) / 2;
+    for (i = 0; i < half; ++i) {
+      keys[i] = i * 2;
+    }
+    for (i = half; i < n; ++i) {
+      keys[i] = (i - half) * 2 + 1;
+    }
+    break;
+  }
+}
+
+static int less(int64_t lhs, int64_t rhs) { return lhs < rhs; }
+
+static void bench_ksl(const uint64_t *keys, size_t n, pattern pat) {
+  ngtcp2_ksl ksl;
+  ngtcp2_ksl_it it;
+  uint64_t s = 0;
+  size_t i;
+  int rv;
+
+  rv = ngtcp2_ksl_init(&ksl, less, INT64_MAX, mem);
+  if (rv != 0) {
+    fail("ksl", rv);
+  }
+
+  op_start();
+  for (i = 0; i < n; ++i) {
+    rv = ngtcp2_ksl_insert(&ksl, NULL, (int64_t)keys[i], NULL);
+    if (rv != 0) {
+      fail("ksl", rv);
+    }
+  }
+  op_end("ksl", "insert", pat, n);
+
+  op_start();
+  for (i = 0; i < n; ++i) {
+    it = ngtcp2_ksl_lower_bound(&ksl, (int64_t)keys[i]);
+    s += (uint64_t)ngtcp2_ksl_it_key(&it);
+  }
+  op_end("ksl", "lookup", pat, n);
+
+  op_start();
+  for (it = ngtcp2_ksl_begin(&ksl); !ngtcp2_ksl_it_end(&it);
+       ngtcp2_ksl_it_next(&it)) {
+    s += (uint64_t)ngtcp2_ksl_it_key(&it);
+  }
+  op_end("ksl", "iterate", pat, n);
+
+  op_start();
+  for (i = 0; i < n; ++i) {
+    rv = ngtcp2_ksl_remove(&ksl, NULL, (int64_t)keys[i]);
+    if (rv != 0) {
+      fail("ksl", rv);
+    }
+  }
+  op_end("ksl", "remove", pat, n);
+
+  sink = s;
+
+  ngtcp2_ksl_free(&ksl);
+}
+
+static void bench_psl(const uint64_t *keys, size_t n, pattern pat) {
+  ngtcp2_psl psl;
+  ngtcp2_psl_it it;
+  ngtcp2_range r;
+  uint64_t s = 0;
+  size_t i;
+  int rv;
+
+  rv = ngtcp2_psl_init(&psl, mem);
+  if (rv != 0) {
+    fail("psl", rv);
+  }
+
+  op_start();
+  for (i = 0; i < n; ++i) {
+    ngtcp2_range_init(&r, keys[i], keys[i] + 1);
+    rv = ngtcp2_psl_insert(&psl, NULL, &r, NULL);
+    if (rv != 0) {
+      fail("psl", rv);
+    }
+  }
+  op_end("psl", "insert", pat, n);
+
+  op_start();
+  for (i = 0; i < n; ++i) {
+    ngtcp2_range_init(&r, keys[i], keys[i] + 1);
+    it = ngtcp2_psl_lower_bound(&psl, &r);
+    s += ngtcp2_psl_it_range(&it)->begin;
+  }
+  op_end("psl", "lookup", pat, n);
+
+  op_start();
+  for (it = ngtcp2_psl_begin(&psl); !ngtcp2_psl_it_end(&it);
+       ngtcp2_psl_it_next(&it)) {
+    s += ngtcp2_psl_it_range(&it)->begin;
+  }
+  op_end("psl", "iterate", pat, n);
+
+  op_start();
+  for (i = 0; i < n; ++i) {
+    ngtcp2_range_init(&r, keys[i], keys[i] + 1);
+    rv = ngtcp2_psl_remove(&psl, NULL, &r);
+    if (rv != 0) {
+      fail("psl", rv);
+    }
+  }
+  op_end("psl", "remove", pat, n);
+
+  sink = s;
+
+  ngtcp2_psl_free(&psl);
+}
+
+static int map_count(ngtcp2_map_entry *entry, void *ptr) {
+  *(uint64_t *)ptr += entry->key;
+  return 0;
+}
+
+static void bench_map(const uint64_t *keys, size_t n, pattern pat) {
+  ngtcp2_map map;
+  ngtcp2_map_entry *ents, *ent;
+  uint64_t s = 0;
+  size_t i;
+  int rv;
+
+  ents = malloc(sizeof(ngtcp2_map_entry) * n);
+  if (ents == NULL) {
+    fail("map", NGTCP2_ERR_NOMEM);
+  }
+
+  rv = ngtcp2_map_init(&map, mem);
+  if (rv != 0) {
+    fail("map", rv);
+  }
+
+  op_start();
+  for (i = 0; i < n; ++i) {
+    ngtcp2_map_entry_init(&ents[i], keys[i]);
+    rv = ngtcp2_map_insert(&map, &ents[i]);
+    if (rv != 0) {
+      fail("map", rv);
+    }
+  }
+  op_end("map", "insert", pat, n);
+
+  op_start();
+  for (i = 0; i < n; ++i) {
+    ent = ngtcp2_map_find(&map, keys[i]);
+    s += ent->key;
+  }
+  op_end("map", "lookup", pat, n);
+
+  op_start();
+  ngtcp2_map_each(&map, map_count, &s);
+  op_end("map", "iterate", pat, n);
+
+  op_start();
+  for (i = 0; i < n; ++i) {
+    rv = ngtcp2_map_remove(&map, keys[i]);
+    if (rv != 0) {
+      fail("map", rv);
+    }
+  }
+  op_end("map", "remove", pat, n);
+
+  sink = s;
+
+  ngtcp2_map_free(&map);
+  free(ents);
+}
+
+static void bench_rob(const uint64_t *keys, size_t n, pattern pat) {
+  static const uint8_t data[SEGLEN];
+  ngtcp2_rob rob;
+  const uint8_t *p;
+  uint64_t offset = 0;
+  size_t i, len;
+  int rv;
+
+  rv = ngtcp2_rob_init(&rob, 8 * 1024, mem);
+  if (rv != 0) {
+    fail("rob", rv);
+  }
+
+  op_start();
+  for (i = 0; i < n; ++i) {
+    rv = ngtcp2_rob_push(&rob, keys[i] * SEGLEN, data, SEGLEN);
+    if (rv != 0) {
+      fail("rob", rv);
+    }
+  }
+  op_end("rob", "insert", pat, n);
+
+  op_start();
+  for (; (len = ngtcp2_rob_data_at(&rob, &p, offset)) > 0; offset += len) {
+    rv = ngtcp2_rob_pop(&rob, offset, len);
+    if (rv != 0) {
+      fail("rob", rv);
+    }
+  }
+  op_end("rob", "iterate", pat, n);
+
+  sink = offset;
+
+  ngtcp2_rob_free(&rob);
+}
+
+static void bench_gaptr(const uint64_t *keys, size_t n, pattern pat) {
+  ngtcp2_gaptr gaptr;
+  size_t i;
+  int rv;
+
+  rv = ngtcp2_gaptr_init(&gaptr, mem);
+  if (rv != 0) {
+    fail("gaptr", rv);
+  }
+
+  op_start();
+  for (i = 0; i < n; ++i) {
+    rv = ngtcp2_gaptr_push(&gaptr, keys[i] * SEGLEN, SEGLEN);
+    if (rv != 0) {
+      fail("gaptr", rv);
+    }
+  }
+  op_end("gaptr", "insert", pat, n);
+
+  sink = ngtcp2_gaptr_first_gap_offset(&gaptr);
+
+  ngtcp2_gaptr_free(&gaptr);
+}
+
+static void bench_idtr(const uint64_t *keys, size_t n, pattern pat) {
+  ngtcp2_idtr idtr;
+  uint64_t s = 0;
+  size_t i;
+  int rv;
+
+  rv = ngtcp2_idtr_init(&idtr, 0, mem);
+  if (rv != 0) {
+    fail("idtr", rv);
+  }
+
+  op_start();
+  for (i = 0; i < n; ++i) {
+    rv = ngtcp2_idtr_open(&idtr, keys[i] * 4);
+    if (rv != 0) {
+      fail("idtr", rv);
+    }
+  }
+  op_end("idtr", "insert", pat, n);
+
+  op_start();
+  for (i = 0; i < n; ++i) {
+    s += (uint64_t)ngtcp2_idtr_is_open(&idtr, keys[i] * 4);
+  }
+  op_end("idtr", "lookup", pat, n);
+
+  sink = s;
+
+  ngtcp2_idtr_free(&idtr);
+}
+
+static void bench_acktr(const uint64_t *keys, size_t n, pattern pat) {
+  ngtcp2_acktr acktr;
+  ngtcp2_acktr_entry *ent;
+  ngtcp2_frame *fr;
+  ngtcp2_ksl_it it;
+  ngtcp2_log log;
+  uint64_t s = 0;
+  size_t i;
+  int rv;
+
+  ngtcp2_log_init(&log, NULL, NULL, 0, NULL);
+
+  rv = ngtcp2_acktr_init(&acktr, 0, &log, mem);
+  if (rv != 0) {
+    fail("acktr", rv);
+  }
+
+  /* acktr keeps at most NGTCP2_ACKTR_MAX_ENT entries, so large N
+     measures the steady state where the oldest entry is evicted. */
+  op_start();
+  for (i = 0; i < n; ++i) {
+    rv = ngtcp2_acktr_entry_new(&ent, keys[i], 0, mem);
+    if (rv != 0) {
+      fail("acktr", rv);
+    }
+    rv = ngtcp2_acktr_add(&acktr, ent, 1, 0);
+    if (rv != 0) {
+      fail("acktr", rv);
+    }
+  }
+  op_end("acktr", "insert", pat, n);
+
+  /* The first call may rebuild the ACK frame if packets were added
+     out of order.  The rest of them must be cheap. */
+  op_start();
+  for (i = 0; i < n; ++i) {
+    rv = ngtcp2_acktr_create_ack_frame(&acktr, &fr, 0, 0);
+    if (rv != 0) {
+      fail("acktr", rv);
+    }
+    s += fr->ack.num_blks;
+  }
+  op_end("acktr", "ack", pat, n);
+
+  op_start();
+  for (it = ngtcp2_acktr_get(&acktr); !ngtcp2_ksl_it_end(&it);
+       ngtcp2_ksl_it_next(&it)) {
+    s += (uint64_t)ngtcp2_ksl_it_key(&it);
+  }
+  op_end("acktr", "iterate", pat, ngtcp2_ksl_len(&acktr.ents));
+
+  sink = s;
+
+  ngtcp2_acktr_free(&acktr);
+}
+
+static void bench_rtb(const uint64_t *keys, size_t n, pattern pat) {
+  ngtcp2_rtb rtb;
+  ngtcp2_rtb_entry *ent;
+  ngtcp2_cc_stat ccs;
+  ngtcp2_log log;
+  ngtcp2_pkt_hd hd;
+  ngtcp2_cid dcid;
+  ngtcp2_ack fr;
+  size_t i;
+  int rv;
+
+  memset(&ccs, 0, sizeof(ccs));
+  ngtcp2_cid_zero(&dcid);
+  ngtcp2_log_init(&log, NULL, NULL, 0, NULL);
+  ngtcp2_rtb_init(&rtb, &ccs, &log, mem);
+
+  op_start();
+  for (i = 0; i < n; ++i) {
+    ngtcp2_pkt_hd_init(&hd, NGTCP2_PKT_FLAG_NONE, NGTCP2_PKT_SHORT, &dcid,
+                       NULL, keys[i], 4, NGTCP2_PROTO_VER_MAX, 0);
+    rv = ngtcp2_rtb_entry_new(&ent, &hd, NULL, 0, NGTCP2_MAX_PKTLEN_IPV4,
+                              NGTCP2_RTB_FLAG_NONE, mem);
+    if (rv != 0) {
+      fail("rtb", rv);
+    }
+    ngtcp2_rtb_add(&rtb, ent);
+  }
+  op_end("rtb", "insert", pat, n);
+
+  /* Each ACK frame acknowledges one packet. */
+  memset(&fr, 0, sizeof(fr));
+  fr.type = NGTCP2_FRAME_ACK;
+
+  op_start();
+  for (i = 0; i < n; ++i) {
+    fr.largest_ack = keys[i];
+    rv = ngtcp2_rtb_recv_ack(&rtb, &fr, NULL, 0);
+    if (rv != 0) {
+      fail("rtb", rv);
+    }
+  }
+  op_end("rtb", "remove", pat, n);
+
+  ngtcp2_rtb_free(&rtb);
+}
+
+static const bench benches[] = {
+    {"ksl", bench_ksl, SIZE_MAX},     {"psl", bench_psl, SIZE_MAX},
+    {"map", bench_map, SIZE_MAX},     {"rob", bench_rob, 10000},
+    {"gaptr", bench_gaptr, 10000},    {"idtr", bench_idtr, 10000},
+    {"acktr", bench_acktr, SIZE_MAX}, {"rtb", bench_rtb, SIZE_MAX},
+};
+
+static const size_t sizes[] = {1000, 10000, 100000, 1000000};
+
+#define NSIZES (sizeof(sizes) / sizeof(sizes[0]))
+#define NBENCHES (sizeof(benches) / sizeof(benches[0]))
+
+static void print_usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [-a] [-n MAX_N] [STRUCTURE...]\n"
+          "STRUCTURE is one of ksl, psl, map, rob, gaptr, idtr, acktr and\n"
+          "rtb.  All structures are run if none is given.  -a allocates\n"
+          "from ngtcp2_arena.\n",
+          prog);
+}
+
+int main(int argc, char **argv) {
+  uint64_t *keys;
+  ngtcp2_arena *arena = NULL;
+  size_t max_n = SIZE_MAX;
+  int use_arena = 0;
+  size_t i, j, k;
+  int c, rv;
+  int pat;
+
+  while ((c = getopt(argc, argv, "an:h")) != -1) {
+    switch (c) {
+    case 'a':
+      use_arena = 1;
+      break;
+    case 'n':
+      max_n = (size_t)strtoul(optarg, NULL, 10);
+      break;
+    default:
+      print_usage(argv[0]);
+      return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+
+  for (c = optind; c < argc; ++c) {
+    for (i = 0; i < NBENCHES; ++i) {
+      if (strcmp(argv[c], benches[i].name) == 0) {
+        break;
+      }
+    }
+    if (i == NBENCHES) {
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  keys = malloc(sizeof(uint64_t) * sizes[NSIZES - 1]);
+  if (keys == NULL) {
+    fprintf(stderr, "malloc failed\n");
+    return EXIT_FAILURE;
+  }
+
+  ngtcp2_bench_mem_init(&bmem);
+  mem = &bmem.mem;
+
+  printf("%-6s %-8s %-11s %8s %10s %8s\n", "struct", "op", "pattern", "n",
+         "ns/op", "allocs/op");
+
+  for (i = 0; i < NBENCHES; ++i) {
+    if (optind < argc) {
+      for (c = optind; c < argc; ++c) {
+        if (strcmp(argv[c], benches[i].name) == 0) {
+          break;
+        }
+      }
+      if (c == argc) {
+        continue;
+      }
+    }
+
+    for (pat = PATTERN_SEQ; pat <= PATTERN_ADVERSARIAL; ++pat) {
+      for (j = 0; j < NSIZES; ++j) {
+        k = sizes[j];
+        if (k > max_n ||
+            (pat != PATTERN_SEQ && k > benches[i].max_unordered)) {
+          continue;
+        }
+        make_keys(keys, k, (pattern)pat);
+        if (use_arena) {
+          rv = ngtcp2_arena_new(&arena, 0, &bmem.mem);
+          if (rv != 0) {
+            fail("arena", rv);
+          }
+          mem = ngtcp2_arena_get_mem(arena);
+        }
+        benches[i].run(keys, k, (pattern)pat);
+        if (use_arena) {
+          ngtcp2_arena_del(arena);
+          mem = &bmem.mem;
+        }
+      }
+    }
+  }
+
+  free(keys);
+
+  return EXIT_SUCCESS;
+}
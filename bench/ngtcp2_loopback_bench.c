@@ -0,0 +1,518 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2018 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * loopback_bench runs a client and a server ngtcp2_conn in one
+ * process, and shuttles packets between them through memory.  Both
+ * endpoints use the null AEAD, and the handshake is scripted: they
+ * exchange transport parameters directly, and are put into the
+ * post-handshake state with null keys, just like the unit tests do.
+ * Time is virtual, so loss recovery is deterministic, and the
+ * measured time is the CPU time the two endpoints spend in the
+ * library.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ngtcp2/ngtcp2.h>
+
+#include "ngtcp2_conn.h"
+#include "ngtcp2_macro.h"
+#include "ngtcp2_bench_helper.h"
+
+/* LINK_DELAY is the one way delay of the virtual link in
+   nanoseconds. */
+#define LINK_DELAY 50000
+/* PKTQLEN is the maximum number of packets in flight in one
+   direction in a round. */
+#define PKTQLEN 4096
+
+typedef struct {
+  const char *name;
+  /* nstreams is the number of unidirectional streams client opens. */
+  size_t nstreams;
+  /* streamlen is the number of bytes client sends in each stream. */
+  size_t streamlen;
+  /* loss drops every packet for which the deterministic pseudo
+     random number modulo |loss| is 0.  0 disables packet loss. */
+  uint32_t loss;
+} scenario;
+
+typedef struct {
+  uint8_t data[NGTCP2_MAX_PKTLEN_IPV4];
+  size_t datalen;
+} packet;
+
+typedef struct {
+  packet *pkts;
+  size_t len;
+} pktq;
+
+typedef struct {
+  ngtcp2_conn *conn;
+  /* rx_bytes is the number of stream data received. */
+  uint64_t rx_bytes;
+  /* nfin is the number of streams which are fully received. */
+  size_t nfin;
+  /* npkts is the number of packets this endpoint has written. */
+  uint64_t npkts;
+  /* max_inflight is the largest number of packets this endpoint has
+     had in flight. */
+  size_t max_inflight;
+  /* inflight_mem is the number of bytes allocated for the sent
+     packet records and their frames when max_inflight was
+     observed. */
+  size_t inflight_mem;
+} endpoint;
+
+typedef struct {
+  const scenario *sc;
+  endpoint client;
+  endpoint server;
+  /* stream_id is the ID of the stream which client is sending. */
+  uint64_t stream_id;
+  /* stream_active is nonzero if |stream_id| is valid. */
+  int stream_active;
+  /* stream_offset is the number of bytes sent in |stream_id|. */
+  size_t stream_offset;
+  /* nopened is the number of streams client has opened. */
+  size_t nopened;
+  /* rnd is the state of the deterministic packet dropper. */
+  uint32_t rnd;
+  uint64_t ndropped;
+  ngtcp2_tstamp ts;
+} loopback;
+
+static uint8_t payload[16384];
+
+static int recv_stream_data(ngtcp2_conn *conn, uint64_t stream_id,
+                            uint8_t fin, uint64_t offset, const uint8_t *data,
+                            size_t datalen, void *user_data,
+                            void *stream_user_data) {
+  endpoint *ep = user_data;
+  (void)offset;
+  (void)data;
+  (void)stream_user_data;
+
+  ep->rx_bytes += datalen;
+  if (fin) {
+    ++ep->nfin;
+  }
+
+  ngtcp2_conn_extend_max_stream_offset(conn, stream_id, datalen);
+  ngtcp2_conn_extend_max_offset(conn, datalen);
+
+  return 0;
+}
+
+static void default_settings(ngtcp2_settings *settings) {
+  memset(settings, 0, sizeof(*settings));
+  settings->max_stream_data = 1024 * 1024;
+  settings->max_data = 4 * 1024 * 1024;
+  settings->max_bidi_streams = 100;
+  settings->max_uni_streams = 100;
+  settings->idle_timeout = 60;
+  settings->max_packet_size = NGTCP2_MAX_PKT_SIZE;
+  settings->ack_delay_exponent = NGTCP2_DEFAULT_ACK_DELAY_EXPONENT;
+}
+
+/*
+ * loopback_init creates client and server connections, and puts them
+ * into the post-handshake state.
+ */
+static int loopback_init(loopback *lb, const scenario *sc) {
+  ngtcp2_conn_callbacks cb;
+  ngtcp2_settings settings;
+  ngtcp2_transport_params params;
+  ngtcp2_cid client_scid, server_scid;
+  uint8_t cidbuf[NGTCP2_MAX_CIDLEN];
+  int rv;
+
+  memset(lb, 0, sizeof(*lb));
+  lb->sc = sc;
+  lb->rnd = 1;
+
+  memset(cidbuf, 0xc, sizeof(cidbuf));
+  ngtcp2_cid_init(&client_scid, cidbuf, 8);
+  memset(cidbuf, 0x5, sizeof(cidbuf));
+  ngtcp2_cid_init(&server_scid, cidbuf, 8);
+
+  memset(&cb, 0, sizeof(cb));
+  ngtcp2_bench_null_callbacks(&cb);
+  cb.recv_stream_data = recv_stream_data;
+
+  default_settings(&settings);
+
+  rv = ngtcp2_conn_client_new(&lb->client.conn, &server_scid, &client_scid,
+                              NGTCP2_PROTO_VER_MAX, &cb, &settings, NULL,
+                              &lb->client);
+  if (rv != 0) {
+    return rv;
+  }
+
+  rv = ngtcp2_conn_server_new(&lb->server.conn, &client_scid, &server_scid,
+                              NGTCP2_PROTO_VER_MAX, &cb, &settings, NULL,
+                              &lb->server);
+  if (rv != 0) {
+    return rv;
+  }
+
+  ngtcp2_conn_get_local_transport_params(
+      lb->client.conn, &params, NGTCP2_TRANSPORT_PARAMS_TYPE_CLIENT_HELLO);
+  rv = ngtcp2_conn_set_remote_transport_params(
+      lb->server.conn, NGTCP2_TRANSPORT_PARAMS_TYPE_CLIENT_HELLO, &params);
+  if (rv != 0) {
+    return rv;
+  }
+
+  ngtcp2_conn_get_local_transport_params(
+      lb->server.conn, &params,
+      NGTCP2_TRANSPORT_PARAMS_TYPE_ENCRYPTED_EXTENSIONS);
+  rv = ngtcp2_conn_set_remote_transport_params(
+      lb->client.conn, NGTCP2_TRANSPORT_PARAMS_TYPE_ENCRYPTED_EXTENSIONS,
+      &params);
+  if (rv != 0) {
+    return rv;
+  }
+
+  ngtcp2_bench_install_null_keys(lb->client.conn);
+  ngtcp2_bench_install_null_keys(lb->server.conn);
+
+  ngtcp2_conn_handshake_completed(lb->client.conn);
+  ngtcp2_conn_handshake_completed(lb->server.conn);
+
+  lb->client.conn->state = NGTCP2_CS_POST_HANDSHAKE;
+  lb->server.conn->state = NGTCP2_CS_POST_HANDSHAKE;
+
+  return 0;
+}
+
+static void loopback_free(loopback *lb) {
+  ngtcp2_conn_del(lb->client.conn);
+  ngtcp2_conn_del(lb->server.conn);
+}
+
+/*
+ * drop_pkt returns nonzero if the next packet should be dropped.
+ */
+static int drop_pkt(loopback *lb) {
+  if (lb->sc->loss == 0) {
+    return 0;
+  }
+
+  lb->rnd = lb->rnd * 1103515245u + 12345u;
+
+  return ((lb->rnd >> 16) % lb->sc->loss) == 0;
+}
+
+/*
+ * client_write_pkt writes a packet which carries stream data if
+ * client has any to send.  It returns 0 if client has nothing to
+ * send.
+ */
+static ssize_t client_write_pkt(loopback *lb, uint8_t *dest, size_t destlen) {
+  ngtcp2_conn *conn = lb->client.conn;
+  const scenario *sc = lb->sc;
+  ssize_t nwrite, ndatalen;
+  size_t datalen;
+  int rv;
+
+  if (!lb->stream_active && lb->nopened < sc->nstreams) {
+    rv = ngtcp2_conn_open_uni_stream(conn, &lb->stream_id, NULL);
+    if (rv == 0) {
+      lb->stream_active = 1;
+      lb->stream_offset = 0;
+      ++lb->nopened;
+    } else if (rv != NGTCP2_ERR_STREAM_ID_BLOCKED) {
+      return rv;
+    }
+  }
+
+  if (!lb->stream_active) {
+    return ngtcp2_conn_write_pkt(conn, dest, destlen, lb->ts);
+  }
+
+  datalen = ngtcp2_min(sc->streamlen - lb->stream_offset, sizeof(payload));
+
+  nwrite = ngtcp2_conn_write_stream(
+      conn, dest, destlen, &ndatalen, lb->stream_id,
+      lb->stream_offset + datalen == sc->streamlen, payload, datalen, lb->ts);
+  switch (nwrite) {
+  case NGTCP2_ERR_STREAM_DATA_BLOCKED:
+    return ngtcp2_conn_write_pkt(conn, dest, destlen, lb->ts);
+  case NGTCP2_ERR_CONGESTION:
+    return 0;
+  }
+
+  if (nwrite > 0 && ndatalen >= 0) {
+    lb->stream_offset += (size_t)ndatalen;
+    if (lb->stream_offset == sc->streamlen) {
+      lb->stream_active = 0;
+    }
+  }
+
+  return nwrite;
+}
+
+/*
+ * sample_inflight records the memory which |ep| spends to track its
+ * packets in flight if it has more of them than ever before.
+ */
+static void sample_inflight(endpoint *ep) {
+  size_t n = ngtcp2_ksl_len(&ep->conn->pktns.rtb.ents);
+
+  if (n <= ep->max_inflight) {
+    return;
+  }
+
+  ep->max_inflight = n;
+  ep->inflight_mem =
+      ngtcp2_conn_get_mem_usage(ep->conn, NGTCP2_MEM_SUBSYS_RTB) +
+      ngtcp2_conn_get_mem_usage(ep->conn, NGTCP2_MEM_SUBSYS_FRAME);
+}
+
+/*
+ * write_pkts lets |ep| write packets to |q| until it has nothing to
+ * send.  It returns the number of packets written, or a negative
+ * error code.
+ */
+static ssize_t write_pkts(loopback *lb, endpoint *ep, pktq *q) {
+  packet *pkt;
+  ssize_t nwrite;
+  size_t n = 0;
+
+  for (; q->len < PKTQLEN;) {
+    pkt = &q->pkts[q->len];
+
+    if (ep == &lb->client) {
+      nwrite = client_write_pkt(lb, pkt->data, sizeof(pkt->data));
+    } else {
+      nwrite = ngtcp2_conn_write_pkt(ep->conn, pkt->data, sizeof(pkt->data),
+                                     lb->ts);
+    }
+
+    if (nwrite == NGTCP2_ERR_CONGESTION) {
+      break;
+    }
+    if (nwrite < 0) {
+      return nwrite;
+    }
+    if (nwrite == 0) {
+      break;
+    }
+
+    ++ep->npkts;
+    ++n;
+
+    if (drop_pkt(lb)) {
+      ++lb->ndropped;
+      continue;
+    }
+
+    pkt->datalen = (size_t)nwrite;
+    ++q->len;
+  }
+
+  sample_inflight(ep);
+
+  return (ssize_t)n;
+}
+
+static int recv_pkts(loopback *lb, endpoint *ep, pktq *q) {
+  size_t i;
+  int rv;
+
+  for (i = 0; i < q->len; ++i) {
+    rv = ngtcp2_conn_recv(ep->conn, q->pkts[i].data, q->pkts[i].datalen,
+                          lb->ts);
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
+  q->len = 0;
+
+  return 0;
+}
+
+static ngtcp2_tstamp next_expiry(endpoint *ep) {
+  return ngtcp2_min(ngtcp2_conn_loss_detection_expiry(ep->conn),
+                    ngtcp2_conn_ack_delay_expiry(ep->conn));
+}
+
+static int handle_expiry(loopback *lb, endpoint *ep) {
+  if (ngtcp2_conn_loss_detection_expiry(ep->conn) <= lb->ts) {
+    return ngtcp2_conn_on_loss_detection_alarm(ep->conn, lb->ts);
+  }
+  return 0;
+}
+
+static int loopback_run(loopback *lb, pktq *c2s, pktq *s2c) {
+  ssize_t nclient, nserver;
+  ngtcp2_tstamp expiry;
+  int rv;
+
+  while (lb->server.nfin < lb->sc->nstreams) {
+    nclient = write_pkts(lb, &lb->client, c2s);
+    if (nclient < 0) {
+      return (int)nclient;
+    }
+
+    lb->ts += LINK_DELAY;
+
+    rv = recv_pkts(lb, &lb->server, c2s);
+    if (rv != 0) {
+      return rv;
+    }
+
+    nserver = write_pkts(lb, &lb->server, s2c);
+    if (nserver < 0) {
+      return (int)nserver;
+    }
+
+    lb->ts += LINK_DELAY;
+
+    rv = recv_pkts(lb, &lb->client, s2c);
+    if (rv != 0) {
+      return rv;
+    }
+
+    if (nclient == 0 && nserver == 0) {
+      /* Nothing is in flight on the link.  Jump to the next timer. */
+      expiry = ngtcp2_min(next_expiry(&lb->client), next_expiry(&lb->server));
+      if (expiry == UINT64_MAX) {
+        fprintf(stderr, "%s: stalled\n", lb->sc->name);
+        return NGTCP2_ERR_INTERNAL;
+      }
+      if (expiry > lb->ts) {
+        lb->ts = expiry;
+      }
+    }
+
+    rv = handle_expiry(lb, &lb->client);
+    if (rv != 0) {
+      return rv;
+    }
+
+    rv = handle_expiry(lb, &lb->server);
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
+  return 0;
+}
+
+static int run_scenario(const scenario *sc, pktq *c2s, pktq *s2c) {
+  loopback lb;
+  ngtcp2_bench_timer timer;
+  uint64_t nbytes, npkts;
+  int rv;
+
+  rv = loopback_init(&lb, sc);
+  if (rv != 0) {
+    fprintf(stderr, "%s: could not set up connections: %s\n", sc->name,
+            ngtcp2_strerror(rv));
+    loopback_free(&lb);
+    return -1;
+  }
+
+  ngtcp2_bench_timer_start(&timer);
+  rv = loopback_run(&lb, c2s, s2c);
+  ngtcp2_bench_timer_stop(&timer);
+
+  c2s->len = s2c->len = 0;
+
+  if (rv != 0) {
+    fprintf(stderr, "%s: %s\n", sc->name, ngtcp2_strerror(rv));
+    loopback_free(&lb);
+    return -1;
+  }
+
+  nbytes = lb.server.rx_bytes;
+  npkts = lb.client.npkts + lb.server.npkts;
+
+  printf("%-14s %10.3f %10.3f %12.0f %8" PRIu64 " %8zu %10.1f", sc->name,
+         timer.elapsed, (double)nbytes * 8 / timer.elapsed / 1e9,
+         (double)npkts / timer.elapsed, lb.ndropped, lb.client.max_inflight,
+         (double)lb.client.inflight_mem /
+             (double)ngtcp2_max(lb.client.max_inflight, 1));
+  if (ngtcp2_bench_have_cycles()) {
+    printf(" %12.2f", (double)timer.cycles / (double)nbytes);
+  } else {
+    printf(" %12s", "n/a");
+  }
+  if (timer.has_cache_misses) {
+    printf(" %11.2f\n", (double)timer.cache_misses / (double)npkts);
+  } else {
+    printf(" %11s\n", "n/a");
+  }
+
+  ngtcp2_bench_print_phase_hist(stdout, lb.client.conn, "client");
+  ngtcp2_bench_print_phase_hist(stdout, lb.server.conn, "server");
+
+  loopback_free(&lb);
+
+  return 0;
+}
+
+int main(void) {
+  static const scenario scenarios[] = {
+      {"bulk", 1, 1024 * 1024 * 1024, 0},
+      {"small-streams", 100000, 1024, 0},
+      {"lossy", 1, 256 * 1024 * 1024, 100},
+      {"retransmit", 1, 64 * 1024 * 1024, 10},
+  };
+  pktq c2s, s2c;
+  size_t i;
+  int rv = 0;
+
+  c2s.pkts = malloc(sizeof(packet) * PKTQLEN);
+  s2c.pkts = malloc(sizeof(packet) * PKTQLEN);
+  if (c2s.pkts == NULL || s2c.pkts == NULL) {
+    fprintf(stderr, "malloc failed\n");
+    return EXIT_FAILURE;
+  }
+  c2s.len = s2c.len = 0;
+
+  printf("%-14s %10s %10s %12s %8s %8s %10s %12s %11s\n", "scenario",
+         "seconds", "Gbit/s", "packets/s", "dropped", "inflight", "bytes/pkt",
+         "cycles/byte", "misses/pkt");
+
+  for (i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); ++i) {
+    if (run_scenario(&scenarios[i], &c2s, &s2c) != 0) {
+      rv = EXIT_FAILURE;
+    }
+  }
+
+  free(c2s.pkts);
+  free(s2c.pkts);
+
+  return rv;
+}
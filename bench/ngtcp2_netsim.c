@@ -0,0 +1,782 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2018 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * netsim runs a client and a server ngtcp2_conn in one process, and
+ * connects them through an emulated link with limited bandwidth,
+ * propagation delay, jitter, reordering, bursty loss and a drop-tail
+ * queue.  Set up of the connections is the same as loopback_bench.
+ * The simulation runs on a virtual clock which jumps from one event
+ * to the next, so a run with the same parameters and seed always
+ * produces the same result, and it finishes much faster than real
+ * time.
+ *
+ * Client sends a single unidirectional stream to server.  Once per
+ * client's smoothed RTT, netsim writes a sample of client's
+ * congestion window, bytes in flight and goodput, which is meant to
+ * be compared between runs before and after changes in loss recovery
+ * and congestion control.  With -T, client's binary event trace is
+ * written to a file, which tracedump decodes.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <ngtcp2/ngtcp2.h>
+
+#include "ngtcp2_conn.h"
+#include "ngtcp2_pq.h"
+#include "ngtcp2_macro.h"
+#include "ngtcp2_bench_helper.h"
+
+#define NSEC_PER_MSEC 1000000ULL
+#define NSEC_PER_SEC 1000000000ULL
+/* SAMPLE_MIN_INTERVAL is the minimum interval between samples. */
+#define SAMPLE_MIN_INTERVAL NSEC_PER_MSEC
+/* TRACE_NRECORDS is the number of the most recent trace records which
+   are kept with -T. */
+#define TRACE_NRECORDS (1 << 18)
+
+/*
+ * link_config is the configuration of a link.  Both directions use
+ * the same configuration.
+ */
+typedef struct {
+  /* bandwidth is the bottleneck bandwidth in bits per second. */
+  uint64_t bandwidth;
+  /* delay is the one way propagation delay. */
+  ngtcp2_tstamp delay;
+  /* jitter is the upper bound of extra delay which is added to each
+     packet uniformly at random.  Jitter alone does not reorder
+     packets. */
+  ngtcp2_tstamp jitter;
+  /* reorder is the probability that a packet is held for extra
+     |reorder_delay| so that the following packets overtake it. */
+  double reorder;
+  ngtcp2_tstamp reorder_delay;
+  /* The parameters of Gilbert-Elliott loss model.  ge_p is the
+     probability of the transition from good to bad state, and ge_r
+     is the probability of the transition from bad to good state.
+     ge_loss_good and ge_loss_bad are the loss probability in each
+     state. */
+  double ge_p;
+  double ge_r;
+  double ge_loss_good;
+  double ge_loss_bad;
+  /* qsize is the capacity of the queue in front of the bottleneck in
+     bytes. */
+  size_t qsize;
+} link_config;
+
+typedef struct {
+  ngtcp2_pq_entry pe;
+  /* arrival is the time when the packet arrives at the receiver. */
+  ngtcp2_tstamp arrival;
+  /* seq breaks the ties of arrival so that the packets which arrive
+     at the same time are delivered in the order they are sent. */
+  uint64_t seq;
+  /* to_server is nonzero if the packet is sent by client. */
+  int to_server;
+  size_t datalen;
+  uint8_t data[NGTCP2_MAX_PKTLEN_IPV4];
+} sim_pkt;
+
+typedef struct {
+  /* busy_until is the time when the bottleneck finishes sending the
+     packets in the queue. */
+  ngtcp2_tstamp busy_until;
+  /* last_arrival is the arrival time of the last packet which is not
+     reordered. */
+  ngtcp2_tstamp last_arrival;
+  /* bad is nonzero if Gilbert-Elliott model is in bad state. */
+  int bad;
+  uint64_t npkts;
+  /* nqdrops is the number of packets dropped by the full queue. */
+  uint64_t nqdrops;
+  /* nlost is the number of packets lost by loss model. */
+  uint64_t nlost;
+  uint64_t nreordered;
+} sim_link;
+
+typedef struct {
+  ngtcp2_conn *conn;
+  /* rx_bytes is the number of stream data received in order. */
+  uint64_t rx_bytes;
+  /* nfin is the number of streams which are fully received. */
+  size_t nfin;
+} sim_endpoint;
+
+typedef struct {
+  const link_config *lcfg;
+  /* total is the number of bytes client sends. */
+  uint64_t total;
+  sim_endpoint client;
+  sim_endpoint server;
+  sim_link c2s;
+  sim_link s2c;
+  /* pq contains the packets on the link ordered by arrival time. */
+  ngtcp2_pq pq;
+  uint64_t seq;
+  /* nundecryptable is the number of packets which failed to
+     decrypt. */
+  uint64_t nundecryptable;
+  uint64_t stream_id;
+  int stream_opened;
+  uint64_t stream_offset;
+  /* rnd is the state of xorshift64* generator. */
+  uint64_t rnd;
+  ngtcp2_tstamp ts;
+  /* next_sample is the time when the next sample is taken. */
+  ngtcp2_tstamp next_sample;
+  ngtcp2_tstamp last_sample;
+  uint64_t last_rx_bytes;
+  FILE *out;
+} sim;
+
+static uint8_t payload[16384];
+
+static double sim_rand(sim *s) {
+  s->rnd ^= s->rnd >> 12;
+  s->rnd ^= s->rnd << 25;
+  s->rnd ^= s->rnd >> 27;
+
+  return (double)((s->rnd * 2685821657736338717ULL) >> 11) /
+         (double)(1ULL << 53);
+}
+
+static int sim_pkt_less(const void *lhs, const void *rhs) {
+  const sim_pkt *a = ngtcp2_struct_of(lhs, sim_pkt, pe);
+  const sim_pkt *b = ngtcp2_struct_of(rhs, sim_pkt, pe);
+
+  if (a->arrival == b->arrival) {
+    return a->seq < b->seq;
+  }
+  return a->arrival < b->arrival;
+}
+
+static int recv_stream_data(ngtcp2_conn *conn, uint64_t stream_id,
+                            uint8_t fin, uint64_t offset, const uint8_t *data,
+                            size_t datalen, void *user_data,
+                            void *stream_user_data) {
+  sim_endpoint *ep = user_data;
+  (void)offset;
+  (void)data;
+  (void)stream_user_data;
+
+  ep->rx_bytes += datalen;
+  if (fin) {
+    ++ep->nfin;
+  }
+
+  ngtcp2_conn_extend_max_stream_offset(conn, stream_id, datalen);
+  ngtcp2_conn_extend_max_offset(conn, datalen);
+
+  return 0;
+}
+
+/*
+ * sim_init creates client and server connections, and puts them into
+ * the post-handshake state.
+ */
+static int sim_init(sim *s, const link_config *lcfg, uint64_t total,
+                    uint64_t seed, FILE *out, ngtcp2_trace_ring *trace) {
+  ngtcp2_conn_callbacks cb;
+  ngtcp2_settings settings;
+  ngtcp2_transport_params params;
+  ngtcp2_cid client_scid, server_scid;
+  uint8_t cidbuf[NGTCP2_MAX_CIDLEN];
+  int rv;
+
+  memset(s, 0, sizeof(*s));
+  s->lcfg = lcfg;
+  s->total = total;
+  /* xorshift64* must not be seeded with 0. */
+  s->rnd = seed ? seed : 1;
+  s->out = out;
+
+  ngtcp2_pq_init(&s->pq, sim_pkt_less, ngtcp2_mem_default());
+
+  memset(cidbuf, 0xc, sizeof(cidbuf));
+  ngtcp2_cid_init(&client_scid, cidbuf, 8);
+  memset(cidbuf, 0x5, sizeof(cidbuf));
+  ngtcp2_cid_init(&server_scid, cidbuf, 8);
+
+  memset(&cb, 0, sizeof(cb));
+  ngtcp2_bench_null_callbacks(&cb);
+  cb.recv_stream_data = recv_stream_data;
+
+  memset(&settings, 0, sizeof(settings));
+  settings.max_stream_data = 16 * 1024 * 1024;
+  settings.max_data = 16 * 1024 * 1024;
+  settings.max_bidi_streams = 1;
+  settings.max_uni_streams = 1;
+  settings.idle_timeout = 60;
+  settings.max_packet_size = NGTCP2_MAX_PKT_SIZE;
+  settings.ack_delay_exponent = NGTCP2_DEFAULT_ACK_DELAY_EXPONENT;
+
+  settings.trace = trace;
+
+  rv = ngtcp2_conn_client_new(&s->client.conn, &server_scid, &client_scid,
+                              NGTCP2_PROTO_VER_MAX, &cb, &settings, NULL,
+                              &s->client);
+  if (rv != 0) {
+    return rv;
+  }
+
+  settings.trace = NULL;
+
+  rv = ngtcp2_conn_server_new(&s->server.conn, &client_scid, &server_scid,
+                              NGTCP2_PROTO_VER_MAX, &cb, &settings, NULL,
+                              &s->server);
+  if (rv != 0) {
+    return rv;
+  }
+
+  ngtcp2_conn_get_local_transport_params(
+      s->client.conn, &params, NGTCP2_TRANSPORT_PARAMS_TYPE_CLIENT_HELLO);
+  rv = ngtcp2_conn_set_remote_transport_params(
+      s->server.conn, NGTCP2_TRANSPORT_PARAMS_TYPE_CLIENT_HELLO, &params);
+  if (rv != 0) {
+    return rv;
+  }
+
+  ngtcp2_conn_get_local_transport_params(
+      s->server.conn, &params,
+      NGTCP2_TRANSPORT_PARAMS_TYPE_ENCRYPTED_EXTENSIONS);
+  rv = ngtcp2_conn_set_remote_transport_params(
+      s->client.conn, NGTCP2_TRANSPORT_PARAMS_TYPE_ENCRYPTED_EXTENSIONS,
+      &params);
+  if (rv != 0) {
+    return rv;
+  }
+
+  ngtcp2_bench_install_null_keys(s->client.conn);
+  ngtcp2_bench_install_null_keys(s->server.conn);
+
+  ngtcp2_conn_handshake_completed(s->client.conn);
+  ngtcp2_conn_handshake_completed(s->server.conn);
+
+  s->client.conn->state = NGTCP2_CS_POST_HANDSHAKE;
+  s->server.conn->state = NGTCP2_CS_POST_HANDSHAKE;
+
+  return 0;
+}
+
+static void sim_free(sim *s) {
+  sim_pkt *pkt;
+
+  for (; !ngtcp2_pq_empty(&s->pq);) {
+    pkt = ngtcp2_struct_of(ngtcp2_pq_top(&s->pq), sim_pkt, pe);
+    ngtcp2_pq_pop(&s->pq);
+    free(pkt);
+  }
+  ngtcp2_pq_free(&s->pq);
+
+  ngtcp2_conn_del(s->client.conn);
+  ngtcp2_conn_del(s->server.conn);
+}
+
+/*
+ * sim_send puts a packet of length |datalen| pointed by |data| on the
+ * link |l|.  The packet might be dropped by the queue or the loss
+ * model.
+ */
+static int sim_send(sim *s, sim_link *l, int to_server, const uint8_t *data,
+                    size_t datalen) {
+  const link_config *lcfg = s->lcfg;
+  ngtcp2_tstamp start, arrival;
+  uint64_t queued = 0;
+  sim_pkt *pkt;
+  double loss;
+  int rv;
+
+  ++l->npkts;
+
+  if (l->busy_until > s->ts) {
+    queued = (l->busy_until - s->ts) * lcfg->bandwidth / 8 / NSEC_PER_SEC;
+  }
+  if (queued + datalen > lcfg->qsize) {
+    ++l->nqdrops;
+    return 0;
+  }
+
+  start = ngtcp2_max(s->ts, l->busy_until);
+  l->busy_until =
+      start + (uint64_t)datalen * 8 * NSEC_PER_SEC / lcfg->bandwidth;
+
+  /* The packet consumes the bandwidth even if it is lost after the
+     bottleneck. */
+  if (l->bad) {
+    if (sim_rand(s) < lcfg->ge_r) {
+      l->bad = 0;
+    }
+  } else if (sim_rand(s) < lcfg->ge_p) {
+    l->bad = 1;
+  }
+
+  loss = l->bad ? lcfg->ge_loss_bad : lcfg->ge_loss_good;
+  if (loss > 0 && sim_rand(s) < loss) {
+    ++l->nlost;
+    return 0;
+  }
+
+  arrival = l->busy_until + lcfg->delay;
+  if (lcfg->jitter) {
+    arrival += (ngtcp2_tstamp)(sim_rand(s) * (double)lcfg->jitter);
+  }
+
+  if (lcfg->reorder > 0 && sim_rand(s) < lcfg->reorder) {
+    arrival += lcfg->reorder_delay;
+    ++l->nreordered;
+  } else {
+    arrival = ngtcp2_max(arrival, l->last_arrival);
+    l->last_arrival = arrival;
+  }
+
+  pkt = malloc(sizeof(sim_pkt));
+  if (pkt == NULL) {
+    return NGTCP2_ERR_NOMEM;
+  }
+
+  pkt->arrival = arrival;
+  pkt->seq = s->seq++;
+  pkt->to_server = to_server;
+  pkt->datalen = datalen;
+  memcpy(pkt->data, data, datalen);
+
+  rv = ngtcp2_pq_push(&s->pq, &pkt->pe);
+  if (rv != 0) {
+    free(pkt);
+    return rv;
+  }
+
+  return 0;
+}
+
+/*
+ * client_write_pkt writes a packet which carries stream data if
+ * client has any to send.  It returns 0 if client has nothing to
+ * send.
+ */
+static ssize_t client_write_pkt(sim *s, uint8_t *dest, size_t destlen) {
+  ngtcp2_conn *conn = s->client.conn;
+  ssize_t nwrite, ndatalen;
+  size_t datalen;
+  int rv;
+
+  if (!s->stream_opened) {
+    rv = ngtcp2_conn_open_uni_stream(conn, &s->stream_id, NULL);
+    if (rv != 0) {
+      return rv;
+    }
+    s->stream_opened = 1;
+  }
+
+  if (s->stream_offset == s->total) {
+    return ngtcp2_conn_write_pkt(conn, dest, destlen, s->ts);
+  }
+
+  datalen = (size_t)ngtcp2_min(s->total - s->stream_offset, sizeof(payload));
+
+  nwrite = ngtcp2_conn_write_stream(
+      conn, dest, destlen, &ndatalen, s->stream_id,
+      s->stream_offset + datalen == s->total, payload, datalen, s->ts);
+  switch (nwrite) {
+  case NGTCP2_ERR_STREAM_DATA_BLOCKED:
+    return ngtcp2_conn_write_pkt(conn, dest, destlen, s->ts);
+  case NGTCP2_ERR_CONGESTION:
+    return 0;
+  }
+
+  if (nwrite > 0 && ndatalen >= 0) {
+    s->stream_offset += (size_t)ndatalen;
+  }
+
+  return nwrite;
+}
+
+/*
+ * write_pkts lets |ep| write packets to the link until it has nothing
+ * to send.
+ */
+static int write_pkts(sim *s, sim_endpoint *ep) {
+  uint8_t buf[NGTCP2_MAX_PKTLEN_IPV4];
+  ssize_t nwrite;
+  int rv;
+
+  for (;;) {
+    if (ep == &s->client) {
+      nwrite = client_write_pkt(s, buf, sizeof(buf));
+    } else {
+      nwrite = ngtcp2_conn_write_pkt(ep->conn, buf, sizeof(buf), s->ts);
+    }
+
+    if (nwrite == NGTCP2_ERR_CONGESTION || nwrite == 0) {
+      return 0;
+    }
+    if (nwrite < 0) {
+      return (int)nwrite;
+    }
+
+    if (ep == &s->client) {
+      rv = sim_send(s, &s->c2s, 1, buf, (size_t)nwrite);
+    } else {
+      rv = sim_send(s, &s->s2c, 0, buf, (size_t)nwrite);
+    }
+    if (rv != 0) {
+      return rv;
+    }
+  }
+}
+
+/*
+ * deliver_pkts passes the packets which have arrived by now to the
+ * receivers.
+ */
+static int deliver_pkts(sim *s) {
+  sim_pkt *pkt;
+  ngtcp2_conn *conn;
+  int rv;
+
+  for (; !ngtcp2_pq_empty(&s->pq);) {
+    pkt = ngtcp2_struct_of(ngtcp2_pq_top(&s->pq), sim_pkt, pe);
+    if (pkt->arrival > s->ts) {
+      return 0;
+    }
+
+    ngtcp2_pq_pop(&s->pq);
+
+    conn = pkt->to_server ? s->server.conn : s->client.conn;
+    rv = ngtcp2_conn_recv(conn, pkt->data, pkt->datalen, s->ts);
+
+    free(pkt);
+
+    if (rv != 0) {
+      if (rv != NGTCP2_ERR_TLS_DECRYPT) {
+        return rv;
+      }
+      /* The packet arrived so late that its packet number was
+         recovered incorrectly. */
+      ++s->nundecryptable;
+    }
+  }
+
+  return 0;
+}
+
+static ngtcp2_tstamp next_expiry(sim_endpoint *ep) {
+  return ngtcp2_min(ngtcp2_conn_loss_detection_expiry(ep->conn),
+                    ngtcp2_conn_ack_delay_expiry(ep->conn));
+}
+
+static int handle_expiry(sim *s, sim_endpoint *ep) {
+  if (ngtcp2_conn_loss_detection_expiry(ep->conn) <= s->ts) {
+    return ngtcp2_conn_on_loss_detection_alarm(ep->conn, s->ts);
+  }
+  return 0;
+}
+
+/*
+ * sample_interval returns client's smoothed RTT, or the round trip
+ * propagation delay if RTT has not been measured yet.  It is at least
+ * SAMPLE_MIN_INTERVAL.
+ */
+static ngtcp2_tstamp sample_interval(sim *s) {
+  double srtt = s->client.conn->rcs.smoothed_rtt;
+  ngtcp2_tstamp interval;
+
+  if (srtt < 1) {
+    interval = 2 * s->lcfg->delay;
+  } else {
+    interval = (ngtcp2_tstamp)srtt;
+  }
+
+  return ngtcp2_max(interval, SAMPLE_MIN_INTERVAL);
+}
+
+/*
+ * take_samples writes samples until |ts|.  The state of the
+ * connections does not change between events, so the current state
+ * is used for all samples taken before |ts|.
+ */
+static void take_samples(sim *s, ngtcp2_tstamp ts) {
+  ngtcp2_conn *conn = s->client.conn;
+  uint64_t ssthresh;
+  double goodput;
+
+  for (; s->next_sample <= ts;) {
+    goodput = (double)(s->server.rx_bytes - s->last_rx_bytes) * 8 /
+              ((double)(s->next_sample - s->last_sample) / NSEC_PER_SEC) /
+              1e6;
+    ssthresh = conn->ccs.ssthresh;
+
+    fprintf(s->out, "%10.4f %10" PRIu64 " %12" PRId64 " %10zu %9.3f %10.3f\n",
+            (double)s->next_sample / NSEC_PER_SEC, conn->ccs.cwnd,
+            ssthresh == UINT64_MAX ? -1 : (int64_t)ssthresh,
+            ngtcp2_conn_get_bytes_in_flight(conn),
+            conn->rcs.smoothed_rtt / NSEC_PER_MSEC, goodput);
+
+    s->last_rx_bytes = s->server.rx_bytes;
+    s->last_sample = s->next_sample;
+    s->next_sample += sample_interval(s);
+  }
+}
+
+/*
+ * sim_run runs the simulation until server receives all data or
+ * virtual time reaches |limit|.
+ */
+static int sim_run(sim *s, ngtcp2_tstamp limit) {
+  ngtcp2_tstamp next;
+  int rv;
+
+  s->next_sample = sample_interval(s);
+
+  fprintf(s->out, "%10s %10s %12s %10s %9s %10s\n", "#time(s)", "cwnd",
+          "ssthresh", "inflight", "srtt(ms)", "Mbit/s");
+
+  while (s->server.nfin == 0) {
+    rv = write_pkts(s, &s->client);
+    if (rv != 0) {
+      return rv;
+    }
+
+    rv = write_pkts(s, &s->server);
+    if (rv != 0) {
+      return rv;
+    }
+
+    next = ngtcp2_min(next_expiry(&s->client), next_expiry(&s->server));
+    if (!ngtcp2_pq_empty(&s->pq)) {
+      next = ngtcp2_min(
+          next, ngtcp2_struct_of(ngtcp2_pq_top(&s->pq), sim_pkt, pe)->arrival);
+    }
+    if (next == UINT64_MAX) {
+      fprintf(stderr, "stalled at %.4fs\n", (double)s->ts / NSEC_PER_SEC);
+      return NGTCP2_ERR_INTERNAL;
+    }
+    if (next <= s->ts) {
+      /* A timer has expired, but the endpoint had nothing to send.
+         Move the clock forward so that the loop makes progress. */
+      next = s->ts + 1000;
+    }
+    if (next > limit) {
+      fprintf(stderr, "time limit exceeded\n");
+      return NGTCP2_ERR_INTERNAL;
+    }
+
+    take_samples(s, next);
+
+    s->ts = next;
+
+    rv = deliver_pkts(s);
+    if (rv != 0) {
+      return rv;
+    }
+
+    rv = handle_expiry(s, &s->client);
+    if (rv != 0) {
+      return rv;
+    }
+
+    rv = handle_expiry(s, &s->server);
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
+  return 0;
+}
+
+static void print_usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [-b MBPS] [-d MS] [-j MS] [-r PROB[,MS]]\n"
+          "          [-g P,R[,LOSS_GOOD,LOSS_BAD]] [-q BYTES] [-n BYTES]\n"
+          "          [-s SEED] [-t SECONDS] [-o FILE] [-T FILE]\n"
+          "  -b  Bottleneck bandwidth in Mbit/s (default: 10)\n"
+          "  -d  One way propagation delay in ms (default: 20)\n"
+          "  -j  Maximum jitter in ms (default: 0)\n"
+          "  -r  Probability of reordering a packet, and the extra delay\n"
+          "      of a reordered packet in ms (default: 0,10)\n"
+          "  -g  Gilbert-Elliott loss model.  P and R are the transition\n"
+          "      probabilities from good to bad and from bad to good.\n"
+          "      LOSS_GOOD and LOSS_BAD are the loss probability in each\n"
+          "      state (default: 0,1,0,1)\n"
+          "  -q  Queue size in bytes (default: 65536)\n"
+          "  -n  Number of bytes client sends (default: 16777216)\n"
+          "  -s  Seed of the pseudo random number generator (default: 1)\n"
+          "  -t  Limit of virtual time in seconds (default: 600)\n"
+          "  -o  Write the time series to FILE instead of stdout\n"
+          "  -T  Write client's binary event trace to FILE\n"
+          "The link configuration applies to both directions.\n",
+          prog);
+}
+
+int main(int argc, char **argv) {
+  link_config lcfg;
+  sim s;
+  uint64_t total = 16 * 1024 * 1024;
+  uint64_t seed = 1;
+  double limit = 600;
+  double mbps = 10, delay = 20, jitter = 0, reorder_delay = 10;
+  const char *outfile = NULL;
+  const char *tracefile = NULL;
+  FILE *out = stdout, *tracefp;
+  ngtcp2_trace_ring trace;
+  ngtcp2_trace_record *records = NULL;
+  uint64_t nlost, nqdrops;
+  int c;
+  int rv;
+
+  memset(&lcfg, 0, sizeof(lcfg));
+  lcfg.ge_r = 1;
+  lcfg.ge_loss_bad = 1;
+  lcfg.qsize = 65536;
+
+  while ((c = getopt(argc, argv, "b:d:j:r:g:q:n:s:t:o:T:h")) != -1) {
+    switch (c) {
+    case 'b':
+      mbps = strtod(optarg, NULL);
+      break;
+    case 'd':
+      delay = strtod(optarg, NULL);
+      break;
+    case 'j':
+      jitter = strtod(optarg, NULL);
+      break;
+    case 'r':
+      sscanf(optarg, "%lf,%lf", &lcfg.reorder, &reorder_delay);
+      break;
+    case 'g':
+      sscanf(optarg, "%lf,%lf,%lf,%lf", &lcfg.ge_p, &lcfg.ge_r,
+             &lcfg.ge_loss_good, &lcfg.ge_loss_bad);
+      break;
+    case 'q':
+      lcfg.qsize = (size_t)strtoul(optarg, NULL, 10);
+      break;
+    case 'n':
+      total = strtoull(optarg, NULL, 10);
+      break;
+    case 's':
+      seed = strtoull(optarg, NULL, 10);
+      break;
+    case 't':
+      limit = strtod(optarg, NULL);
+      break;
+    case 'o':
+      outfile = optarg;
+      break;
+    case 'T':
+      tracefile = optarg;
+      break;
+    default:
+      print_usage(argv[0]);
+      return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+
+  if (mbps <= 0 || delay < 0 || jitter < 0 || reorder_delay < 0 ||
+      limit <= 0 || total == 0 || lcfg.qsize < NGTCP2_MAX_PKTLEN_IPV4) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  lcfg.bandwidth = (uint64_t)(mbps * 1e6);
+  lcfg.delay = (ngtcp2_tstamp)(delay * NSEC_PER_MSEC);
+  lcfg.jitter = (ngtcp2_tstamp)(jitter * NSEC_PER_MSEC);
+  lcfg.reorder_delay = (ngtcp2_tstamp)(reorder_delay * NSEC_PER_MSEC);
+
+  if (outfile) {
+    out = fopen(outfile, "w");
+    if (out == NULL) {
+      perror(outfile);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (tracefile) {
+    records = malloc(sizeof(ngtcp2_trace_record) * TRACE_NRECORDS);
+    if (records == NULL) {
+      fprintf(stderr, "could not allocate trace buffer\n");
+      if (outfile) {
+        fclose(out);
+      }
+      return EXIT_FAILURE;
+    }
+    ngtcp2_trace_ring_init(&trace, records, TRACE_NRECORDS);
+  }
+
+  rv = sim_init(&s, &lcfg, total, seed, out, records ? &trace : NULL);
+  if (rv != 0) {
+    fprintf(stderr, "could not set up connections: %s\n", ngtcp2_strerror(rv));
+  } else {
+    rv = sim_run(&s, (ngtcp2_tstamp)(limit * NSEC_PER_SEC));
+    if (rv != 0) {
+      fprintf(stderr, "simulation failed: %s\n", ngtcp2_strerror(rv));
+    }
+  }
+
+  nlost = s.c2s.nlost + s.s2c.nlost;
+  nqdrops = s.c2s.nqdrops + s.s2c.nqdrops;
+
+  fprintf(stderr,
+          "transferred %" PRIu64 " bytes in %.4fs (virtual), %.3f Mbit/s\n"
+          "packets: client %" PRIu64 ", server %" PRIu64 ", lost %" PRIu64
+          ", queue drops %" PRIu64 ", reordered %" PRIu64
+          ", undecryptable %" PRIu64 "\n",
+          s.server.rx_bytes, (double)s.ts / NSEC_PER_SEC,
+          s.ts ? (double)s.server.rx_bytes * 8 /
+                     ((double)s.ts / NSEC_PER_SEC) / 1e6
+               : 0.,
+          s.c2s.npkts, s.s2c.npkts, nlost, nqdrops,
+          s.c2s.nreordered + s.s2c.nreordered, s.nundecryptable);
+
+  sim_free(&s);
+
+  if (outfile) {
+    fclose(out);
+  }
+
+  if (tracefile) {
+    tracefp = fopen(tracefile, "wb");
+    if (tracefp == NULL) {
+      perror(tracefile);
+      rv = -1;
+    } else {
+      if (ngtcp2_bench_write_trace(tracefp, &trace, 0) != 0) {
+        fprintf(stderr, "could not write trace to %s\n", tracefile);
+        rv = -1;
+      }
+      fclose(tracefp);
+    }
+    free(records);
+  }
+
+  return rv == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
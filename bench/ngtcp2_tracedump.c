@@ -0,0 +1,131 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2018 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * tracedump decodes a trace file written by ngtcp2_bench_write_trace
+ * (e.g., netsim -T), and prints the records as text, one per line, or
+ * as a qlog style JSON document.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <ngtcp2/ngtcp2.h>
+
+#include "ngtcp2_bench_helper.h"
+
+static void print_usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [-q] FILE\n"
+          "  -q  Write qlog style JSON instead of text\n",
+          prog);
+}
+
+static int dump(FILE *fp, int fmt) {
+  ngtcp2_bench_trace_hd hd;
+  ngtcp2_trace_record rec;
+  char buf[1024];
+  ssize_t n;
+  int first = 1;
+
+  if (fread(&hd, sizeof(hd), 1, fp) != 1 ||
+      memcmp(hd.magic, NGTCP2_BENCH_TRACE_MAGIC, sizeof(hd.magic)) != 0) {
+    fprintf(stderr, "not a trace file\n");
+    return -1;
+  }
+
+  if (hd.reclen != sizeof(rec)) {
+    fprintf(stderr, "record length mismatch: %u != %zu\n", hd.reclen,
+            sizeof(rec));
+    return -1;
+  }
+
+  if (fmt == NGTCP2_TRACE_FORMAT_QLOG) {
+    printf("{\"qlog_version\":\"draft-00\",\"traces\":[{\"vantage_point\":{"
+           "\"type\":\"client\"},\"events\":[\n");
+  }
+
+  while (fread(&rec, sizeof(rec), 1, fp) == 1) {
+    n = ngtcp2_trace_format(buf, sizeof(buf), &rec, hd.base_ts, fmt);
+    if (n < 0) {
+      fprintf(stderr, "could not format record: %s\n", ngtcp2_strerror((int)n));
+      return -1;
+    }
+
+    if (fmt == NGTCP2_TRACE_FORMAT_QLOG && !first) {
+      printf(",\n");
+    }
+    fwrite(buf, 1, (size_t)n, stdout);
+    if (fmt == NGTCP2_TRACE_FORMAT_TEXT) {
+      printf("\n");
+    }
+    first = 0;
+  }
+
+  if (fmt == NGTCP2_TRACE_FORMAT_QLOG) {
+    printf("\n]}]}\n");
+  }
+
+  return ferror(fp) ? -1 : 0;
+}
+
+int main(int argc, char **argv) {
+  int fmt = NGTCP2_TRACE_FORMAT_TEXT;
+  FILE *fp;
+  int c;
+  int rv;
+
+  while ((c = getopt(argc, argv, "qh")) != -1) {
+    switch (c) {
+    case 'q':
+      fmt = NGTCP2_TRACE_FORMAT_QLOG;
+      break;
+    default:
+      print_usage(argv[0]);
+      return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+
+  if (optind + 1 != argc) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  fp = fopen(argv[optind], "rb");
+  if (fp == NULL) {
+    perror(argv[optind]);
+    return EXIT_FAILURE;
+  }
+
+  rv = dump(fp, fmt);
+
+  fclose(fp);
+
+  return rv == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,46 @@
+# - Try to find liburing
+# Once done this will define
+#  LIBURING_FOUND        - System has liburing
+#  LIBURING_INCLUDE_DIRS - The liburing include directories
+#  LIBURING_LIBRARIES    - The libraries needed to use liburing
+
+find_package(PkgConfig QUIET)
+pkg_check_modules(PC_LIBURING QUIET liburing)
+
+find_path(LIBURING_INCLUDE_DIR
+  NAMES liburing.h
+  HINTS ${PC_LIBURING_INCLUDE_DIRS}
+)
+find_library(LIBURING_LIBRARY
+  NAMES uring
+  HINTS ${PC_LIBURING_LIBRARY_DIRS}
+)
+
+if(PC_LIBURING_FOUND)
+  set(LIBURING_VERSION ${PC_LIBURING_VERSION})
+elseif(LIBURING_INCLUDE_DIR AND
+    EXISTS "${LIBURING_INCLUDE_DIR}/liburing/io_uring_version.h")
+  file(STRINGS "${LIBURING_INCLUDE_DIR}/liburing/io_uring_version.h"
+    LIBURING_VERSION_MAJOR REGEX "^#define[ \t]+IO_URING_VERSION_MAJOR[ \t]+[0-9]+")
+  file(STRINGS "${LIBURING_INCLUDE_DIR}/liburing/io_uring_version.h"
+    LIBURING_VERSION_MINOR REGEX "^#define[ \t]+IO_URING_VERSION_MINOR[ \t]+[0-9]+")
+  string(REGEX REPLACE "[^0-9]+" "" LIBURING_VERSION_MAJOR "${LIBURING_VERSION_MAJOR}")
+  string(REGEX REPLACE "[^0-9]+" "" LIBURING_VERSION_MINOR "${LIBURING_VERSION_MINOR}")
+  set(LIBURING_VERSION "${LIBURING_VERSION_MAJOR}.${LIBURING_VERSION_MINOR}")
+  unset(LIBURING_VERSION_MINOR)
+  unset(LIBURING_VERSION_MAJOR)
+endif()
+
+include(FindPackageHandleStandardArgs)
+# handle the QUIETLY and REQUIRED arguments and set LIBURING_FOUND to TRUE
+# if all listed variables are TRUE and the requested version matches.
+find_package_handle_standard_args(Liburing REQUIRED_VARS
+                                  LIBURING_LIBRARY LIBURING_INCLUDE_DIR
+                                  VERSION_VAR LIBURING_VERSION)
+
+if(LIBURING_FOUND)
+  set(LIBURING_LIBRARIES     ${LIBURING_LIBRARY})
+  set(LIBURING_INCLUDE_DIRS  ${LIBURING_INCLUDE_DIR})
+endif()
+
+mark_as_advanced(LIBURING_INCLUDE_DIR LIBURING_LIBRARY)
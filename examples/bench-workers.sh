@@ -0,0 +1,109 @@
+#!/bin/sh
+#
+# bench-workers.sh compares the throughput of the example server
+# running with 1, 2, 4 and 8 workers on loopback.  For each I/O backend
+# and worker count, it starts the server, runs NCLIENTS concurrent
+# clients each of which requests a FILESIZE bytes document NSTREAMS
+# times, and reports the number of connections and bytes served per
+# second.  Clients use the same I/O backend as the server.
+#
+# Usage: bench-workers.sh <PRIVATE_KEY_FILE> <CERTIFICATE_FILE>
+#
+# The following environment variables change the workload:
+#
+#   BUILDDIR   Directory which contains server and client (default: .)
+#   PORT       Port the server listens on (default: 4433)
+#   NCLIENTS   The number of concurrent clients (default: 64)
+#   NSTREAMS   The number of requests per client (default: 10)
+#   FILESIZE   The size of the requested document (default: 1048576)
+#   WORKERS    Worker counts to compare (default: "1 2 4 8")
+#   BACKENDS   I/O backends to compare.  "io_uring" requires the
+#              examples to be built with liburing (default: "libev")
+
+set -e
+
+if [ $# -lt 2 ]; then
+    echo "Usage: $0 <PRIVATE_KEY_FILE> <CERTIFICATE_FILE>" >&2
+    exit 1
+fi
+
+KEY=$1
+CERT=$2
+BUILDDIR=${BUILDDIR:-.}
+PORT=${PORT:-4433}
+NCLIENTS=${NCLIENTS:-64}
+NSTREAMS=${NSTREAMS:-10}
+FILESIZE=${FILESIZE:-1048576}
+WORKERS=${WORKERS:-"1 2 4 8"}
+BACKENDS=${BACKENDS:-libev}
+# Clients exit after this many seconds of inactivity.  It is
+# subtracted from the measured time.
+CLIENT_TIMEOUT=1
+
+WORKDIR=$(mktemp -d)
+trap 'rm -rf "$WORKDIR"' EXIT
+
+head -c "$FILESIZE" /dev/zero > "$WORKDIR/doc"
+printf 'GET /doc HTTP/1.1\r\nHost: localhost\r\n\r\n' > "$WORKDIR/req"
+
+# run_bench runs the workload against the server with backend $1 and
+# $2 workers.
+run_bench() {
+    backend=$1
+    n=$2
+
+    case $backend in
+        libev) io_opts= ;;
+        io_uring) io_opts=--io-uring ;;
+        *)
+            echo "Unknown backend: $backend" >&2
+            exit 1
+            ;;
+    esac
+
+    "$BUILDDIR/server" -q -w "$n" -d "$WORKDIR" $io_opts 127.0.0.1 "$PORT" \
+                       "$KEY" "$CERT" 2>/dev/null &
+    server_pid=$!
+    sleep 1
+
+    start=$(date +%s.%N)
+
+    i=0
+    while [ $i -lt "$NCLIENTS" ]; do
+        "$BUILDDIR/client" -q -d "$WORKDIR/req" -n "$NSTREAMS" $io_opts \
+                           --timeout="$CLIENT_TIMEOUT" 127.0.0.1 "$PORT" \
+                           > /dev/null 2>&1 &
+        i=$((i + 1))
+    done
+
+    # Wait for clients only.
+    for pid in $(jobs -p); do
+        if [ "$pid" != "$server_pid" ]; then
+            wait "$pid" || true
+        fi
+    done
+
+    end=$(date +%s.%N)
+
+    kill -INT "$server_pid"
+    wait "$server_pid" || true
+
+    awk -v start="$start" -v end="$end" -v timeout="$CLIENT_TIMEOUT" \
+        -v backend="$backend" -v n="$n" -v nclients="$NCLIENTS" \
+        -v nstreams="$NSTREAMS" -v filesize="$FILESIZE" 'BEGIN {
+        t = end - start - timeout
+        if (t <= 0) {
+            t = 0.001
+        }
+        printf "%-8s %8d %10.3f %12.1f %12.1f\n", backend, n, t,
+               nclients / t, nclients * nstreams * filesize / t / 1048576
+    }'
+}
+
+printf '%-8s %8s %10s %12s %12s\n' backend workers seconds conns/s MiB/s
+
+for backend in $BACKENDS; do
+    for n in $WORKERS; do
+        run_bench "$backend" "$n"
+    done
+done
@@ -293,6 +293,42 @@ void readcb(struct ev_loop *loop, ev_io *w, int revents) {
 }
 } // namespace
 
+#ifdef HAVE_LIBURING
+namespace {
+void uring_recvcb(uint8_t *data, size_t datalen, const sockaddr *sa,
+                  socklen_t salen, void *user_data) {
+  auto c = static_cast<Client *>(user_data);
+
+  if (debug::packet_lost(config.rx_loss_prob)) {
+    if (!config.quiet) {
+      std::cerr << "** Simulated incoming packet loss **" << std::endl;
+    }
+    return;
+  }
+
+  c->feed_data(data, datalen);
+}
+} // namespace
+
+namespace {
+void uring_recv_donecb(void *user_data) {
+  auto c = static_cast<Client *>(user_data);
+
+  if (c->on_read_done() != 0) {
+    return;
+  }
+  auto rv = c->on_write();
+  switch (rv) {
+  case 0:
+    return;
+  case NETWORK_ERR_SEND_NON_FATAL:
+    c->start_wev();
+    return;
+  }
+}
+} // namespace
+#endif // HAVE_LIBURING
+
 namespace {
 void stdin_readcb(struct ev_loop *loop, ev_io *w, int revents) {
   auto c = static_cast<Client *>(w->data);
@@ -401,6 +437,11 @@ void Client::disconnect(int liberr) {
 
   ev_io_stop(loop_, &stdinrev_);
   ev_io_stop(loop_, &rev_);
+#ifdef HAVE_LIBURING
+  if (uring_) {
+    uring_->stop_recv();
+  }
+#endif // HAVE_LIBURING
 
   ev_signal_stop(loop_, &sigintev_);
 
@@ -420,6 +461,10 @@ void Client::close() {
     ssl_ = nullptr;
   }
 
+#ifdef HAVE_LIBURING
+  uring_.reset();
+#endif // HAVE_LIBURING
+
   if (fd_ != -1) {
     ::close(fd_);
     fd_ = -1;
@@ -771,7 +816,7 @@ int Client::init(int fd, const Address &remote_addr, const char *addr,
   settings.ack_delay_exponent = NGTCP2_DEFAULT_ACK_DELAY_EXPONENT;
 
   rv = ngtcp2_conn_client_new(&conn_, &dcid, &scid, version, &callbacks,
-                              &settings, this);
+                              &settings, NULL, this);
   if (rv != 0) {
     std::cerr << "ngtcp2_conn_client_new: " << ngtcp2_strerror(rv) << std::endl;
     return -1;
@@ -785,7 +830,20 @@ int Client::init(int fd, const Address &remote_addr, const char *addr,
   ev_io_set(&wev_, fd_, EV_WRITE);
   ev_io_set(&rev_, fd_, EV_READ);
 
+#ifdef HAVE_LIBURING
+  if (config.io_uring) {
+    uring_ = std::make_unique<Uring>(loop_, uring_recvcb, uring_recv_donecb,
+                                     this);
+    if (uring_->init(fd_) != 0) {
+      uring_.reset();
+      return -1;
+    }
+  } else {
+    ev_io_start(loop_, &rev_);
+  }
+#else  // !HAVE_LIBURING
   ev_io_start(loop_, &rev_);
+#endif // !HAVE_LIBURING
   ev_timer_again(loop_, &timer_);
 
   ev_signal_start(loop_, &sigintev_);
@@ -1109,6 +1167,10 @@ int Client::on_read() {
     }
   }
 
+  return on_read_done();
+}
+
+int Client::on_read_done() {
   ev_timer_again(loop_, &timer_);
 
   return 0;
@@ -1444,6 +1506,17 @@ int Client::send_packet() {
     return NETWORK_ERR_OK;
   }
 
+#ifdef HAVE_LIBURING
+  if (uring_) {
+    auto rv = uring_->send(nullptr, 0, sendbuf_.rpos(), sendbuf_.size());
+    if (rv != NETWORK_ERR_OK) {
+      return rv;
+    }
+    sendbuf_.reset();
+    return NETWORK_ERR_OK;
+  }
+#endif // HAVE_LIBURING
+
   int eintr_retries = 5;
   ssize_t nwrite = 0;
 
@@ -2068,6 +2141,11 @@ Options:
               Read/write QUIC transport parameters from/to <PATH>.  To
               send 0-RTT data, the  transport parameters received from
               the previous session must be supplied with this option.
+  --io-uring  Use io_uring for  socket I/O instead of libev readiness
+              notification.  Datagrams  are received by multishot
+              recvmsg  with provided  buffers, and  sent in  batches.
+              This option  is available  only if  client is  built with
+              liburing.
   -h, --help  Display this help and exit.
 )";
 }
@@ -2094,6 +2172,7 @@ int main(int argc, char **argv) {
         {"timeout", required_argument, &flag, 3},
         {"session-file", required_argument, &flag, 4},
         {"tp-file", required_argument, &flag, 5},
+        {"io-uring", no_argument, &flag, 6},
         {nullptr, 0, nullptr, 0},
     };
 
@@ -2165,6 +2244,16 @@ int main(int argc, char **argv) {
         // --tp-file
         config.tp_file = optarg;
         break;
+      case 6:
+        // --io-uring
+#ifdef HAVE_LIBURING
+        config.io_uring = true;
+#else  // !HAVE_LIBURING
+        std::cerr << "io-uring: client is built without liburing"
+                  << std::endl;
+        exit(EXIT_FAILURE);
+#endif // !HAVE_LIBURING
+        break;
       }
       break;
     default:
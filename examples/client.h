@@ -42,6 +42,7 @@
 #include "network.h"
 #include "crypto.h"
 #include "template.h"
+#include "uring.h"
 
 using namespace ngtcp2;
 
@@ -79,6 +80,9 @@ struct Config {
   const char *tp_file;
   // show_secret is true if transport secrets should be printed out.
   bool show_secret;
+  // io_uring is true if io_uring is used for socket I/O instead of
+  // libev readiness notification.
+  bool io_uring;
 };
 
 struct Buffer {
@@ -145,6 +149,8 @@ public:
   int tls_handshake(bool initial = false);
   int read_tls();
   int on_read();
+  // on_read_done is called after all available datagrams are read.
+  int on_read_done();
   int on_write(bool retransmit = false);
   int write_streams();
   int on_write_stream(uint64_t stream_id, uint8_t fin, Buffer &data);
@@ -220,6 +226,9 @@ private:
   SSL *ssl_;
   int fd_;
   int datafd_;
+#ifdef HAVE_LIBURING
+  std::unique_ptr<Uring> uring_;
+#endif // HAVE_LIBURING
   std::map<uint32_t, std::unique_ptr<Stream>> streams_;
   std::deque<Buffer> chandshake_;
   // *chandshake_idx_ is the index in *chandshake_, which points to
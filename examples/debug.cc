@@ -33,7 +33,7 @@ namespace ngtcp2 {
 namespace debug {
 
 namespace {
-auto randgen = util::make_mt19937();
+thread_local auto randgen = util::make_mt19937();
 } // namespace
 
 namespace {
@@ -0,0 +1,1328 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2018 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+// hsbench runs full QUIC handshakes between a client and a server
+// ngtcp2_conn in a single process.  Packets are passed in memory, and
+// TLS is driven by OpenSSL exactly like client and server do.  It
+// reports the number of handshakes per second, and how the time is
+// split between TLS, key derivation, transport parameters, and
+// ngtcp2_conn setup.
+#include <cstdlib>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include <getopt.h>
+
+#include <ngtcp2/ngtcp2.h>
+
+#include <openssl/ssl.h>
+#include <openssl/bio.h>
+#include <openssl/err.h>
+
+#include "network.h"
+#include "util.h"
+#include "crypto.h"
+#include "template.h"
+
+using namespace ngtcp2;
+
+namespace {
+auto randgen = util::make_mt19937();
+} // namespace
+
+namespace {
+struct Config {
+  // handshakes is the number of handshakes to run.
+  size_t handshakes;
+  // ciphers is the list of TLS cipher suites.
+  const char *ciphers;
+  // groups is the list of supported groups.
+  const char *groups;
+};
+} // namespace
+
+namespace {
+Config config{};
+} // namespace
+
+namespace {
+// MAX_FLIGHTS is the maximum number of flights which a handshake may
+// take before it is regarded as stuck.
+constexpr size_t MAX_FLIGHTS = 16;
+// FLIGHT_DELAY is the amount of time which the virtual clock advances
+// per flight.
+constexpr ngtcp2_tstamp FLIGHT_DELAY = 1000000;
+// CLIENT_SCIDLEN and SERVER_SCIDLEN are the lengths of Source
+// Connection ID which client and server choose respectively.
+constexpr size_t CLIENT_SCIDLEN = 17;
+constexpr size_t SERVER_SCIDLEN = 18;
+// CLIENT_DCIDLEN is the length of Destination Connection ID which
+// client chooses for its first Initial packet.
+constexpr size_t CLIENT_DCIDLEN = 18;
+} // namespace
+
+namespace {
+// Phase is the category which the elapsed time is charged to.
+enum Phase {
+  // PHASE_HARNESS is the time spent in this program outside of the
+  // other phases, e.g., moving packets between endpoints.
+  PHASE_HARNESS,
+  // PHASE_TLS is the time spent in OpenSSL to process the handshake
+  // messages.  It includes the key schedule inside TLS stack.
+  PHASE_TLS,
+  // PHASE_KEY_DERIVATION is the time spent in deriving Initial
+  // secrets, packet protection keys, IVs and packet number
+  // protection keys with HKDF.
+  PHASE_KEY_DERIVATION,
+  // PHASE_TRANSPORT_PARAMS is the time spent in encoding, decoding
+  // and applying transport parameters.
+  PHASE_TRANSPORT_PARAMS,
+  // PHASE_CONN_SETUP is the time spent in creating and deleting
+  // ngtcp2_conn.
+  PHASE_CONN_SETUP,
+  // PHASE_PACKET_PROTECTION is the time spent in AEAD and packet
+  // number encryption.
+  PHASE_PACKET_PROTECTION,
+  // PHASE_PACKET is the time spent in ngtcp2 to build and parse
+  // packets.
+  PHASE_PACKET,
+  PHASE_MAX,
+};
+} // namespace
+
+namespace {
+constexpr const char *phase_names[] = {
+    "harness",    "tls",
+    "key derivation", "transport params",
+    "conn setup", "packet protection",
+    "packet processing",
+};
+} // namespace
+
+namespace {
+// Profiler charges the elapsed time to the current phase.  Phases
+// nest: entering a phase stops the clock of the enclosing one, so
+// that each phase only counts its own time.
+class Profiler {
+public:
+  Profiler() : cur_(PHASE_HARNESS), last_(clock::now()), elapsed_{} {}
+
+  // reset clears the accumulated time.
+  void reset() {
+    cur_ = PHASE_HARNESS;
+    last_ = clock::now();
+    elapsed_.fill(clock::duration::zero());
+  }
+
+  // enter charges the time since the last switch to the current
+  // phase, and makes |phase| current.  It returns the previous phase.
+  Phase enter(Phase phase) {
+    auto now = clock::now();
+    elapsed_[cur_] += now - last_;
+    last_ = now;
+    auto prev = cur_;
+    cur_ = phase;
+    return prev;
+  }
+
+  // elapsed returns the time charged to |phase| in seconds.
+  double elapsed(Phase phase) const {
+    return std::chrono::duration<double>(elapsed_[phase]).count();
+  }
+
+private:
+  using clock = std::chrono::steady_clock;
+
+  Phase cur_;
+  clock::time_point last_;
+  std::array<clock::duration, PHASE_MAX> elapsed_;
+};
+} // namespace
+
+namespace {
+Profiler profiler;
+} // namespace
+
+namespace {
+// PhaseScope charges the time while it is alive to a phase.
+class PhaseScope {
+public:
+  PhaseScope(Phase phase) : prev_(profiler.enter(phase)) {}
+  ~PhaseScope() { profiler.enter(prev_); }
+
+private:
+  Phase prev_;
+};
+} // namespace
+
+namespace {
+using Packet = std::vector<uint8_t>;
+} // namespace
+
+namespace {
+// Endpoint is one side of the handshake.  It owns SSL object and
+// ngtcp2_conn.
+class Endpoint {
+public:
+  Endpoint(SSL_CTX *ssl_ctx, bool server);
+  ~Endpoint();
+
+  // init creates ngtcp2_conn.  |dcid| is the Destination Connection
+  // ID, and |version| is the QUIC version.
+  int init(const ngtcp2_cid *dcid, uint32_t version, ngtcp2_tstamp ts);
+  // setup_initial_crypto_context derives the Initial keys from
+  // |dcid| which is the Destination Connection ID that client chose.
+  int setup_initial_crypto_context(const ngtcp2_cid *dcid);
+  int on_key(int name, const uint8_t *secret, size_t secretlen,
+             const uint8_t *key, size_t keylen, const uint8_t *iv,
+             size_t ivlen);
+  int tls_handshake();
+  int read_tls();
+  // feed passes |pkt| of length |pktlen| to ngtcp2_conn, and appends
+  // the packets it produces to |out|.  |pkt| may be nullptr to just
+  // write packets.
+  int feed(const uint8_t *pkt, size_t pktlen, ngtcp2_tstamp ts,
+           std::deque<Packet> &out);
+
+  // write_tx_handshake stores the handshake message generated by TLS
+  // stack, and submits it to ngtcp2_conn.
+  void write_tx_handshake(const uint8_t *data, size_t datalen);
+  // write_rx_handshake stores the handshake data received from the
+  // peer.
+  void write_rx_handshake(const uint8_t *data, size_t datalen);
+  // read_rx_handshake passes the stored handshake data to TLS stack.
+  size_t read_rx_handshake(uint8_t *buf, size_t buflen);
+
+  ssize_t hs_encrypt_data(uint8_t *dest, size_t destlen,
+                          const uint8_t *plaintext, size_t plaintextlen,
+                          const uint8_t *key, size_t keylen,
+                          const uint8_t *nonce, size_t noncelen,
+                          const uint8_t *ad, size_t adlen);
+  ssize_t hs_decrypt_data(uint8_t *dest, size_t destlen,
+                          const uint8_t *ciphertext, size_t ciphertextlen,
+                          const uint8_t *key, size_t keylen,
+                          const uint8_t *nonce, size_t noncelen,
+                          const uint8_t *ad, size_t adlen);
+  ssize_t encrypt_data(uint8_t *dest, size_t destlen, const uint8_t *plaintext,
+                       size_t plaintextlen, const uint8_t *key, size_t keylen,
+                       const uint8_t *nonce, size_t noncelen,
+                       const uint8_t *ad, size_t adlen);
+  ssize_t decrypt_data(uint8_t *dest, size_t destlen,
+                       const uint8_t *ciphertext, size_t ciphertextlen,
+                       const uint8_t *key, size_t keylen, const uint8_t *nonce,
+                       size_t noncelen, const uint8_t *ad, size_t adlen);
+  ssize_t hs_encrypt_pn(uint8_t *dest, size_t destlen,
+                        const uint8_t *plaintext, size_t plaintextlen,
+                        const uint8_t *key, size_t keylen,
+                        const uint8_t *nonce, size_t noncelen);
+  ssize_t encrypt_pn(uint8_t *dest, size_t destlen, const uint8_t *plaintext,
+                     size_t plaintextlen, const uint8_t *key, size_t keylen,
+                     const uint8_t *nonce, size_t noncelen);
+
+  ngtcp2_conn *conn() const;
+  bool server() const;
+
+private:
+  SSL_CTX *ssl_ctx_;
+  SSL *ssl_;
+  ngtcp2_conn *conn_;
+  crypto::Context hs_crypto_ctx_;
+  crypto::Context crypto_ctx_;
+  // txhs_ stores the handshake messages generated by TLS stack.
+  // ngtcp2_conn refers to them until the endpoint is destroyed.
+  std::deque<std::vector<uint8_t>> txhs_;
+  // rxhs_ is the handshake data received from the peer, and nrxhs_
+  // is the number of bytes in it which TLS stack has read.
+  std::vector<uint8_t> rxhs_;
+  size_t nrxhs_;
+  bool server_;
+};
+} // namespace
+
+namespace {
+int key_cb(SSL *ssl, int name, const unsigned char *secret, size_t secretlen,
+           const unsigned char *key, size_t keylen, const unsigned char *iv,
+           size_t ivlen, void *arg) {
+  auto ep = static_cast<Endpoint *>(arg);
+
+  if (ep->on_key(name, secret, secretlen, key, keylen, iv, ivlen) != 0) {
+    return 0;
+  }
+
+  return 1;
+}
+} // namespace
+
+namespace {
+void msg_cb(int write_p, int version, int content_type, const void *buf,
+            size_t len, SSL *ssl, void *arg) {
+  if (!write_p || content_type != SSL3_RT_HANDSHAKE) {
+    return;
+  }
+
+  auto ep = static_cast<Endpoint *>(arg);
+
+  ep->write_tx_handshake(reinterpret_cast<const uint8_t *>(buf), len);
+}
+} // namespace
+
+namespace {
+int bio_write(BIO *b, const char *buf, int len) {
+  assert(0);
+  return -1;
+}
+} // namespace
+
+namespace {
+int bio_read(BIO *b, char *buf, int len) {
+  BIO_clear_retry_flags(b);
+
+  auto ep = static_cast<Endpoint *>(BIO_get_data(b));
+
+  len = ep->read_rx_handshake(reinterpret_cast<uint8_t *>(buf), len);
+  if (len == 0) {
+    BIO_set_retry_read(b);
+    return -1;
+  }
+
+  return len;
+}
+} // namespace
+
+namespace {
+int bio_puts(BIO *b, const char *str) { return bio_write(b, str, strlen(str)); }
+} // namespace
+
+namespace {
+int bio_gets(BIO *b, char *buf, int len) { return -1; }
+} // namespace
+
+namespace {
+long bio_ctrl(BIO *b, int cmd, long num, void *ptr) {
+  switch (cmd) {
+  case BIO_CTRL_FLUSH:
+    return 1;
+  }
+
+  return 0;
+}
+} // namespace
+
+namespace {
+int bio_create(BIO *b) {
+  BIO_set_init(b, 1);
+  return 1;
+}
+} // namespace
+
+namespace {
+int bio_destroy(BIO *b) {
+  if (b == nullptr) {
+    return 0;
+  }
+
+  return 1;
+}
+} // namespace
+
+namespace {
+BIO_METHOD *create_bio_method() {
+  static auto meth = BIO_meth_new(BIO_TYPE_FD, "bio");
+  BIO_meth_set_write(meth, bio_write);
+  BIO_meth_set_read(meth, bio_read);
+  BIO_meth_set_puts(meth, bio_puts);
+  BIO_meth_set_gets(meth, bio_gets);
+  BIO_meth_set_ctrl(meth, bio_ctrl);
+  BIO_meth_set_create(meth, bio_create);
+  BIO_meth_set_destroy(meth, bio_destroy);
+  return meth;
+}
+} // namespace
+
+Endpoint::Endpoint(SSL_CTX *ssl_ctx, bool server)
+    : ssl_ctx_(ssl_ctx),
+      ssl_(nullptr),
+      conn_(nullptr),
+      hs_crypto_ctx_{},
+      crypto_ctx_{},
+      nrxhs_(0),
+      server_(server) {}
+
+Endpoint::~Endpoint() {
+  if (conn_) {
+    PhaseScope ps(PHASE_CONN_SETUP);
+    ngtcp2_conn_del(conn_);
+  }
+
+  if (ssl_) {
+    PhaseScope ps(PHASE_TLS);
+    SSL_free(ssl_);
+  }
+}
+
+namespace {
+int client_initial(ngtcp2_conn *conn, void *user_data) {
+  auto ep = static_cast<Endpoint *>(user_data);
+
+  if (ep->tls_handshake() != 0) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+} // namespace
+
+namespace {
+int recv_client_initial(ngtcp2_conn *conn, const ngtcp2_cid *dcid,
+                        void *user_data) {
+  auto ep = static_cast<Endpoint *>(user_data);
+
+  if (ep->setup_initial_crypto_context(dcid) != 0) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+} // namespace
+
+namespace {
+int recv_crypto_data(ngtcp2_conn *conn, uint64_t offset, const uint8_t *data,
+                     size_t datalen, void *user_data) {
+  int rv;
+  auto ep = static_cast<Endpoint *>(user_data);
+
+  ep->write_rx_handshake(data, datalen);
+
+  if (!ngtcp2_conn_get_handshake_completed(conn)) {
+    rv = ep->tls_handshake();
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
+  return ep->read_tls();
+}
+} // namespace
+
+namespace {
+ssize_t do_hs_encrypt(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
+                      const uint8_t *plaintext, size_t plaintextlen,
+                      const uint8_t *key, size_t keylen, const uint8_t *nonce,
+                      size_t noncelen, const uint8_t *ad, size_t adlen,
+                      void *user_data) {
+  auto ep = static_cast<Endpoint *>(user_data);
+
+  auto nwrite = ep->hs_encrypt_data(dest, destlen, plaintext, plaintextlen,
+                                    key, keylen, nonce, noncelen, ad, adlen);
+  if (nwrite < 0) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return nwrite;
+}
+} // namespace
+
+namespace {
+ssize_t do_hs_decrypt(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
+                      const uint8_t *ciphertext, size_t ciphertextlen,
+                      const uint8_t *key, size_t keylen, const uint8_t *nonce,
+                      size_t noncelen, const uint8_t *ad, size_t adlen,
+                      void *user_data) {
+  auto ep = static_cast<Endpoint *>(user_data);
+
+  auto nwrite = ep->hs_decrypt_data(dest, destlen, ciphertext, ciphertextlen,
+                                    key, keylen, nonce, noncelen, ad, adlen);
+  if (nwrite < 0) {
+    return NGTCP2_ERR_TLS_DECRYPT;
+  }
+
+  return nwrite;
+}
+} // namespace
+
+namespace {
+ssize_t do_encrypt(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
+                   const uint8_t *plaintext, size_t plaintextlen,
+                   const uint8_t *key, size_t keylen, const uint8_t *nonce,
+                   size_t noncelen, const uint8_t *ad, size_t adlen,
+                   void *user_data) {
+  auto ep = static_cast<Endpoint *>(user_data);
+
+  auto nwrite = ep->encrypt_data(dest, destlen, plaintext, plaintextlen, key,
+                                 keylen, nonce, noncelen, ad, adlen);
+  if (nwrite < 0) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return nwrite;
+}
+} // namespace
+
+namespace {
+ssize_t do_decrypt(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
+                   const uint8_t *ciphertext, size_t ciphertextlen,
+                   const uint8_t *key, size_t keylen, const uint8_t *nonce,
+                   size_t noncelen, const uint8_t *ad, size_t adlen,
+                   void *user_data) {
+  auto ep = static_cast<Endpoint *>(user_data);
+
+  auto nwrite = ep->decrypt_data(dest, destlen, ciphertext, ciphertextlen, key,
+                                 keylen, nonce, noncelen, ad, adlen);
+  if (nwrite < 0) {
+    return NGTCP2_ERR_TLS_DECRYPT;
+  }
+
+  return nwrite;
+}
+} // namespace
+
+namespace {
+ssize_t do_hs_encrypt_pn(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
+                         const uint8_t *plaintext, size_t plaintextlen,
+                         const uint8_t *key, size_t keylen,
+                         const uint8_t *nonce, size_t noncelen,
+                         void *user_data) {
+  auto ep = static_cast<Endpoint *>(user_data);
+
+  auto nwrite = ep->hs_encrypt_pn(dest, destlen, plaintext, plaintextlen, key,
+                                  keylen, nonce, noncelen);
+  if (nwrite < 0) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return nwrite;
+}
+} // namespace
+
+namespace {
+ssize_t do_encrypt_pn(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
+                      const uint8_t *plaintext, size_t plaintextlen,
+                      const uint8_t *key, size_t keylen, const uint8_t *nonce,
+                      size_t noncelen, void *user_data) {
+  auto ep = static_cast<Endpoint *>(user_data);
+
+  auto nwrite = ep->encrypt_pn(dest, destlen, plaintext, plaintextlen, key,
+                               keylen, nonce, noncelen);
+  if (nwrite < 0) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return nwrite;
+}
+} // namespace
+
+namespace {
+void generate_cid(ngtcp2_cid *cid, size_t cidlen) {
+  auto dis = std::uniform_int_distribution<uint8_t>(
+      0, std::numeric_limits<uint8_t>::max());
+
+  cid->datalen = cidlen;
+  std::generate(std::begin(cid->data), std::begin(cid->data) + cidlen,
+                [&dis]() { return dis(randgen); });
+}
+} // namespace
+
+int Endpoint::init(const ngtcp2_cid *dcid, uint32_t version,
+                   ngtcp2_tstamp ts) {
+  int rv;
+
+  {
+    PhaseScope ps(PHASE_TLS);
+
+    ssl_ = SSL_new(ssl_ctx_);
+    auto bio = BIO_new(create_bio_method());
+    BIO_set_data(bio, this);
+    SSL_set_bio(ssl_, bio, bio);
+    SSL_set_app_data(ssl_, this);
+    if (server_) {
+      SSL_set_accept_state(ssl_);
+    } else {
+      SSL_set_connect_state(ssl_);
+      SSL_set_tlsext_host_name(ssl_, "localhost");
+    }
+    SSL_set_msg_callback(ssl_, msg_cb);
+    SSL_set_msg_callback_arg(ssl_, this);
+    SSL_set_key_callback(ssl_, key_cb, this);
+  }
+
+  auto callbacks = ngtcp2_conn_callbacks{
+      server_ ? nullptr : client_initial,
+      server_ ? recv_client_initial : nullptr,
+      recv_crypto_data,
+      nullptr, // handshake_completed
+      nullptr, // recv_version_negotiation
+      do_hs_encrypt,
+      do_hs_decrypt,
+      do_encrypt,
+      do_decrypt,
+      do_hs_encrypt_pn,
+      do_encrypt_pn,
+  };
+
+  ngtcp2_settings settings{};
+  settings.initial_ts = ts;
+  settings.max_stream_data = 256_k;
+  settings.max_data = 1_m;
+  settings.max_bidi_streams = 100;
+  settings.max_uni_streams = 100;
+  settings.idle_timeout = 30;
+  settings.max_packet_size = NGTCP2_MAX_PKT_SIZE;
+  settings.ack_delay_exponent = NGTCP2_DEFAULT_ACK_DELAY_EXPONENT;
+
+  ngtcp2_cid scid;
+  generate_cid(&scid, server_ ? SERVER_SCIDLEN : CLIENT_SCIDLEN);
+
+  {
+    PhaseScope ps(PHASE_CONN_SETUP);
+
+    if (server_) {
+      rv = ngtcp2_conn_server_new(&conn_, dcid, &scid, version, &callbacks,
+                                  &settings, NULL, this);
+    } else {
+      rv = ngtcp2_conn_client_new(&conn_, dcid, &scid, version, &callbacks,
+                                  &settings, NULL, this);
+    }
+  }
+  if (rv != 0) {
+    std::cerr << (server_ ? "ngtcp2_conn_server_new: "
+                          : "ngtcp2_conn_client_new: ")
+              << ngtcp2_strerror(rv) << std::endl;
+    return -1;
+  }
+
+  if (!server_) {
+    return setup_initial_crypto_context(dcid);
+  }
+
+  return 0;
+}
+
+int Endpoint::setup_initial_crypto_context(const ngtcp2_cid *dcid) {
+  PhaseScope ps(PHASE_KEY_DERIVATION);
+
+  int rv;
+
+  std::array<uint8_t, 32> initial_secret, secret;
+  rv = crypto::derive_initial_secret(
+      initial_secret.data(), initial_secret.size(), dcid,
+      reinterpret_cast<const uint8_t *>(NGTCP2_INITIAL_SALT),
+      str_size(NGTCP2_INITIAL_SALT));
+  if (rv != 0) {
+    std::cerr << "crypto::derive_initial_secret() failed" << std::endl;
+    return -1;
+  }
+
+  crypto::prf_sha256(hs_crypto_ctx_);
+  crypto::aead_aes_128_gcm(hs_crypto_ctx_);
+
+  // The first iteration derives the keys for outgoing packets, and
+  // the second one derives them for incoming packets.
+  for (auto tx : {true, false}) {
+    if (tx == server_) {
+      rv = crypto::derive_server_initial_secret(secret.data(), secret.size(),
+                                                initial_secret.data(),
+                                                initial_secret.size());
+    } else {
+      rv = crypto::derive_client_initial_secret(secret.data(), secret.size(),
+                                                initial_secret.data(),
+                                                initial_secret.size());
+    }
+    if (rv != 0) {
+      std::cerr << "crypto::derive_initial_secret() failed" << std::endl;
+      return -1;
+    }
+
+    std::array<uint8_t, 16> key, iv, pn;
+
+    auto keylen = crypto::derive_packet_protection_key(
+        key.data(), key.size(), secret.data(), secret.size(), hs_crypto_ctx_);
+    if (keylen < 0) {
+      return -1;
+    }
+
+    auto ivlen = crypto::derive_packet_protection_iv(
+        iv.data(), iv.size(), secret.data(), secret.size(), hs_crypto_ctx_);
+    if (ivlen < 0) {
+      return -1;
+    }
+
+    auto pnlen = crypto::derive_pkt_num_protection_key(
+        pn.data(), pn.size(), secret.data(), secret.size(), hs_crypto_ctx_);
+    if (pnlen < 0) {
+      return -1;
+    }
+
+    if (tx) {
+      ngtcp2_conn_set_initial_tx_keys(conn_, key.data(), keylen, iv.data(),
+                                      ivlen, pn.data(), pnlen);
+    } else {
+      ngtcp2_conn_set_initial_rx_keys(conn_, key.data(), keylen, iv.data(),
+                                      ivlen, pn.data(), pnlen);
+    }
+  }
+
+  return 0;
+}
+
+int Endpoint::on_key(int name, const uint8_t *secret, size_t secretlen,
+                     const uint8_t *key, size_t keylen, const uint8_t *iv,
+                     size_t ivlen) {
+  int rv;
+
+  switch (name) {
+  case SSL_KEY_CLIENT_HANDSHAKE_TRAFFIC:
+  case SSL_KEY_CLIENT_APPLICATION_TRAFFIC:
+  case SSL_KEY_SERVER_HANDSHAKE_TRAFFIC:
+  case SSL_KEY_SERVER_APPLICATION_TRAFFIC:
+    break;
+  default:
+    return 0;
+  }
+
+  PhaseScope ps(PHASE_KEY_DERIVATION);
+
+  rv = crypto::negotiated_prf(crypto_ctx_, ssl_);
+  if (rv != 0) {
+    return -1;
+  }
+  rv = crypto::negotiated_aead(crypto_ctx_, ssl_);
+  if (rv != 0) {
+    return -1;
+  }
+
+  std::array<uint8_t, 64> pn;
+  auto pnlen = crypto::derive_pkt_num_protection_key(
+      pn.data(), pn.size(), secret, secretlen, crypto_ctx_);
+  if (pnlen < 0) {
+    return -1;
+  }
+
+  ngtcp2_conn_set_aead_overhead(conn_, crypto::aead_max_overhead(crypto_ctx_));
+
+  // tx is true if the key protects the packets this endpoint sends.
+  auto tx = server_ == (name == SSL_KEY_SERVER_HANDSHAKE_TRAFFIC ||
+                        name == SSL_KEY_SERVER_APPLICATION_TRAFFIC);
+
+  switch (name) {
+  case SSL_KEY_CLIENT_HANDSHAKE_TRAFFIC:
+  case SSL_KEY_SERVER_HANDSHAKE_TRAFFIC:
+    if (tx) {
+      ngtcp2_conn_set_handshake_tx_keys(conn_, key, keylen, iv, ivlen,
+                                        pn.data(), pnlen);
+    } else {
+      ngtcp2_conn_set_handshake_rx_keys(conn_, key, keylen, iv, ivlen,
+                                        pn.data(), pnlen);
+    }
+    break;
+  default:
+    if (tx) {
+      ngtcp2_conn_update_tx_keys(conn_, key, keylen, iv, ivlen, pn.data(),
+                                 pnlen);
+    } else {
+      ngtcp2_conn_update_rx_keys(conn_, key, keylen, iv, ivlen, pn.data(),
+                                 pnlen);
+    }
+    break;
+  }
+
+  return 0;
+}
+
+int Endpoint::tls_handshake() {
+  PhaseScope ps(PHASE_TLS);
+
+  ERR_clear_error();
+
+  auto rv = SSL_do_handshake(ssl_);
+  if (rv <= 0) {
+    auto err = SSL_get_error(ssl_, rv);
+    switch (err) {
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+      return 0;
+    case SSL_ERROR_SSL:
+      std::cerr << "TLS handshake error: "
+                << ERR_error_string(ERR_get_error(), nullptr) << std::endl;
+      return NGTCP2_ERR_CRYPTO;
+    default:
+      std::cerr << "TLS handshake error: " << err << std::endl;
+      return NGTCP2_ERR_CRYPTO;
+    }
+  }
+
+  ngtcp2_conn_handshake_completed(conn_);
+
+  return 0;
+}
+
+int Endpoint::read_tls() {
+  PhaseScope ps(PHASE_TLS);
+
+  ERR_clear_error();
+
+  std::array<uint8_t, 4096> buf;
+  size_t nread;
+
+  for (;;) {
+    // Client might receive NewSessionTicket here.  It is just
+    // discarded.
+    auto rv = SSL_read_ex(ssl_, buf.data(), buf.size(), &nread);
+    if (rv == 1) {
+      continue;
+    }
+    auto err = SSL_get_error(ssl_, 0);
+    switch (err) {
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+      return 0;
+    case SSL_ERROR_SSL:
+    case SSL_ERROR_ZERO_RETURN:
+      std::cerr << "TLS read error: "
+                << ERR_error_string(ERR_get_error(), nullptr) << std::endl;
+      return NGTCP2_ERR_CRYPTO;
+    default:
+      std::cerr << "TLS read error: " << err << std::endl;
+      return NGTCP2_ERR_CRYPTO;
+    }
+  }
+}
+
+int Endpoint::feed(const uint8_t *pkt, size_t pktlen, ngtcp2_tstamp ts,
+                   std::deque<Packet> &out) {
+  PhaseScope ps(PHASE_PACKET);
+
+  std::array<uint8_t, NGTCP2_MAX_PKTLEN_IPV4> buf;
+
+  for (;;) {
+    auto nwrite =
+        ngtcp2_conn_handshake(conn_, buf.data(), buf.size(), pkt, pktlen, ts);
+    if (nwrite < 0) {
+      switch (nwrite) {
+      case NGTCP2_ERR_NOBUF:
+      case NGTCP2_ERR_CONGESTION:
+        return 0;
+      }
+      std::cerr << "ngtcp2_conn_handshake: "
+                << ngtcp2_strerror(static_cast<int>(nwrite)) << std::endl;
+      return -1;
+    }
+
+    if (nwrite == 0) {
+      return 0;
+    }
+
+    out.emplace_back(buf.data(), buf.data() + nwrite);
+
+    pkt = nullptr;
+    pktlen = 0;
+  }
+}
+
+void Endpoint::write_tx_handshake(const uint8_t *data, size_t datalen) {
+  txhs_.emplace_back(data, data + datalen);
+
+  auto &v = txhs_.back();
+
+  ngtcp2_conn_submit_crypto_data(conn_, v.data(), v.size());
+}
+
+void Endpoint::write_rx_handshake(const uint8_t *data, size_t datalen) {
+  std::copy_n(data, datalen, std::back_inserter(rxhs_));
+}
+
+size_t Endpoint::read_rx_handshake(uint8_t *buf, size_t buflen) {
+  auto n = std::min(buflen, rxhs_.size() - nrxhs_);
+  std::copy_n(std::begin(rxhs_) + nrxhs_, n, buf);
+  nrxhs_ += n;
+  return n;
+}
+
+ssize_t Endpoint::hs_encrypt_data(uint8_t *dest, size_t destlen,
+                                  const uint8_t *plaintext,
+                                  size_t plaintextlen, const uint8_t *key,
+                                  size_t keylen, const uint8_t *nonce,
+                                  size_t noncelen, const uint8_t *ad,
+                                  size_t adlen) {
+  PhaseScope ps(PHASE_PACKET_PROTECTION);
+  return crypto::encrypt(dest, destlen, plaintext, plaintextlen, hs_crypto_ctx_,
+                         key, keylen, nonce, noncelen, ad, adlen);
+}
+
+ssize_t Endpoint::hs_decrypt_data(uint8_t *dest, size_t destlen,
+                                  const uint8_t *ciphertext,
+                                  size_t ciphertextlen, const uint8_t *key,
+                                  size_t keylen, const uint8_t *nonce,
+                                  size_t noncelen, const uint8_t *ad,
+                                  size_t adlen) {
+  PhaseScope ps(PHASE_PACKET_PROTECTION);
+  return crypto::decrypt(dest, destlen, ciphertext, ciphertextlen,
+                         hs_crypto_ctx_, key, keylen, nonce, noncelen, ad,
+                         adlen);
+}
+
+ssize_t Endpoint::encrypt_data(uint8_t *dest, size_t destlen,
+                               const uint8_t *plaintext, size_t plaintextlen,
+                               const uint8_t *key, size_t keylen,
+                               const uint8_t *nonce, size_t noncelen,
+                               const uint8_t *ad, size_t adlen) {
+  PhaseScope ps(PHASE_PACKET_PROTECTION);
+  return crypto::encrypt(dest, destlen, plaintext, plaintextlen, crypto_ctx_,
+                         key, keylen, nonce, noncelen, ad, adlen);
+}
+
+ssize_t Endpoint::decrypt_data(uint8_t *dest, size_t destlen,
+                               const uint8_t *ciphertext, size_t ciphertextlen,
+                               const uint8_t *key, size_t keylen,
+                               const uint8_t *nonce, size_t noncelen,
+                               const uint8_t *ad, size_t adlen) {
+  PhaseScope ps(PHASE_PACKET_PROTECTION);
+  return crypto::decrypt(dest, destlen, ciphertext, ciphertextlen, crypto_ctx_,
+                         key, keylen, nonce, noncelen, ad, adlen);
+}
+
+ssize_t Endpoint::hs_encrypt_pn(uint8_t *dest, size_t destlen,
+                                const uint8_t *plaintext, size_t plaintextlen,
+                                const uint8_t *key, size_t keylen,
+                                const uint8_t *nonce, size_t noncelen) {
+  PhaseScope ps(PHASE_PACKET_PROTECTION);
+  return crypto::encrypt_pn(dest, destlen, plaintext, plaintextlen,
+                            hs_crypto_ctx_, key, keylen, nonce, noncelen);
+}
+
+ssize_t Endpoint::encrypt_pn(uint8_t *dest, size_t destlen,
+                             const uint8_t *plaintext, size_t plaintextlen,
+                             const uint8_t *key, size_t keylen,
+                             const uint8_t *nonce, size_t noncelen) {
+  PhaseScope ps(PHASE_PACKET_PROTECTION);
+  return crypto::encrypt_pn(dest, destlen, plaintext, plaintextlen,
+                            crypto_ctx_, key, keylen, nonce, noncelen);
+}
+
+ngtcp2_conn *Endpoint::conn() const { return conn_; }
+
+bool Endpoint::server() const { return server_; }
+
+namespace {
+int transport_params_add_cb(SSL *ssl, unsigned int ext_type,
+                            unsigned int context, const unsigned char **out,
+                            size_t *outlen, X509 *x, size_t chainidx, int *al,
+                            void *add_arg) {
+  PhaseScope ps(PHASE_TRANSPORT_PARAMS);
+
+  int rv;
+  auto ep = static_cast<Endpoint *>(SSL_get_app_data(ssl));
+  auto conn = ep->conn();
+  auto exttype = ep->server()
+                     ? NGTCP2_TRANSPORT_PARAMS_TYPE_ENCRYPTED_EXTENSIONS
+                     : NGTCP2_TRANSPORT_PARAMS_TYPE_CLIENT_HELLO;
+
+  ngtcp2_transport_params params;
+
+  rv = ngtcp2_conn_get_local_transport_params(conn, &params, exttype);
+  if (rv != 0) {
+    *al = SSL_AD_INTERNAL_ERROR;
+    return -1;
+  }
+
+  if (ep->server()) {
+    params.v.ee.len = 1;
+    params.v.ee.supported_versions[0] = NGTCP2_PROTO_VER_D13;
+  }
+
+  constexpr size_t bufsize = 512;
+  auto buf = std::make_unique<uint8_t[]>(bufsize);
+
+  auto nwrite =
+      ngtcp2_encode_transport_params(buf.get(), bufsize, exttype, &params);
+  if (nwrite < 0) {
+    std::cerr << "ngtcp2_encode_transport_params: "
+              << ngtcp2_strerror(static_cast<int>(nwrite)) << std::endl;
+    *al = SSL_AD_INTERNAL_ERROR;
+    return -1;
+  }
+
+  *out = buf.release();
+  *outlen = static_cast<size_t>(nwrite);
+
+  return 1;
+}
+} // namespace
+
+namespace {
+void transport_params_free_cb(SSL *ssl, unsigned int ext_type,
+                              unsigned int context, const unsigned char *out,
+                              void *add_arg) {
+  delete[] const_cast<unsigned char *>(out);
+}
+} // namespace
+
+namespace {
+int transport_params_parse_cb(SSL *ssl, unsigned int ext_type,
+                              unsigned int context, const unsigned char *in,
+                              size_t inlen, X509 *x, size_t chainidx, int *al,
+                              void *parse_arg) {
+  PhaseScope ps(PHASE_TRANSPORT_PARAMS);
+
+  int rv;
+  auto ep = static_cast<Endpoint *>(SSL_get_app_data(ssl));
+  auto conn = ep->conn();
+  auto exttype = ep->server()
+                     ? NGTCP2_TRANSPORT_PARAMS_TYPE_CLIENT_HELLO
+                     : NGTCP2_TRANSPORT_PARAMS_TYPE_ENCRYPTED_EXTENSIONS;
+
+  ngtcp2_transport_params params;
+
+  rv = ngtcp2_decode_transport_params(&params, exttype, in, inlen);
+  if (rv != 0) {
+    std::cerr << "ngtcp2_decode_transport_params: " << ngtcp2_strerror(rv)
+              << std::endl;
+    *al = SSL_AD_ILLEGAL_PARAMETER;
+    return -1;
+  }
+
+  rv = ngtcp2_conn_set_remote_transport_params(conn, exttype, &params);
+  if (rv != 0) {
+    *al = SSL_AD_ILLEGAL_PARAMETER;
+    return -1;
+  }
+
+  return 1;
+}
+} // namespace
+
+namespace {
+SSL_CTX *create_ssl_ctx(const char *private_key_file, const char *cert_file) {
+  auto ssl_ctx = SSL_CTX_new(TLS_method());
+
+  SSL_CTX_set_min_proto_version(ssl_ctx, TLS1_3_VERSION);
+  SSL_CTX_set_max_proto_version(ssl_ctx, TLS1_3_VERSION);
+
+  SSL_CTX_clear_options(ssl_ctx, SSL_OP_ENABLE_MIDDLEBOX_COMPAT);
+
+  if (SSL_CTX_set_cipher_list(ssl_ctx, config.ciphers) != 1) {
+    std::cerr << "SSL_CTX_set_cipher_list: "
+              << ERR_error_string(ERR_get_error(), nullptr) << std::endl;
+    goto fail;
+  }
+
+  if (SSL_CTX_set1_groups_list(ssl_ctx, config.groups) != 1) {
+    std::cerr << "SSL_CTX_set1_groups_list failed" << std::endl;
+    goto fail;
+  }
+
+  SSL_CTX_set_mode(ssl_ctx, SSL_MODE_QUIC_HACK);
+
+  if (private_key_file) {
+    if (SSL_CTX_use_PrivateKey_file(ssl_ctx, private_key_file,
+                                    SSL_FILETYPE_PEM) != 1) {
+      std::cerr << "SSL_CTX_use_PrivateKey_file: "
+                << ERR_error_string(ERR_get_error(), nullptr) << std::endl;
+      goto fail;
+    }
+
+    if (SSL_CTX_use_certificate_chain_file(ssl_ctx, cert_file) != 1) {
+      std::cerr << "SSL_CTX_use_certificate_file: "
+                << ERR_error_string(ERR_get_error(), nullptr) << std::endl;
+      goto fail;
+    }
+
+    if (SSL_CTX_check_private_key(ssl_ctx) != 1) {
+      std::cerr << "SSL_CTX_check_private_key: "
+                << ERR_error_string(ERR_get_error(), nullptr) << std::endl;
+      goto fail;
+    }
+  }
+
+  if (SSL_CTX_add_custom_ext(
+          ssl_ctx, NGTCP2_TLSEXT_QUIC_TRANSPORT_PARAMETERS,
+          SSL_EXT_CLIENT_HELLO | SSL_EXT_TLS1_3_ENCRYPTED_EXTENSIONS,
+          transport_params_add_cb, transport_params_free_cb, nullptr,
+          transport_params_parse_cb, nullptr) != 1) {
+    std::cerr << "SSL_CTX_add_custom_ext(NGTCP2_TLSEXT_QUIC_TRANSPORT_"
+                 "PARAMETERS) failed: "
+              << ERR_error_string(ERR_get_error(), nullptr) << std::endl;
+    goto fail;
+  }
+
+  return ssl_ctx;
+
+fail:
+  SSL_CTX_free(ssl_ctx);
+  return nullptr;
+}
+} // namespace
+
+namespace {
+// run_handshake runs a handshake between a new client and server.
+// |ts| is the virtual clock, and it is advanced by each flight.  It
+// returns 0 if the handshake completes, or -1.
+int run_handshake(SSL_CTX *client_ssl_ctx, SSL_CTX *server_ssl_ctx,
+                  ngtcp2_tstamp &ts) {
+  Endpoint client(client_ssl_ctx, false);
+  std::unique_ptr<Endpoint> server;
+  std::deque<Packet> to_server, to_client;
+
+  ngtcp2_cid dcid;
+  generate_cid(&dcid, CLIENT_DCIDLEN);
+
+  if (client.init(&dcid, NGTCP2_PROTO_VER_D13, ts) != 0) {
+    return -1;
+  }
+
+  if (client.feed(nullptr, 0, ts, to_server) != 0) {
+    return -1;
+  }
+
+  for (size_t i = 0; i < MAX_FLIGHTS; ++i) {
+    ts += FLIGHT_DELAY;
+
+    for (; !to_server.empty(); to_server.pop_front()) {
+      auto &pkt = to_server.front();
+
+      if (!server) {
+        ngtcp2_pkt_hd hd;
+        if (ngtcp2_accept(&hd, pkt.data(), pkt.size()) != 0) {
+          std::cerr << "ngtcp2_accept failed" << std::endl;
+          return -1;
+        }
+
+        server = std::make_unique<Endpoint>(server_ssl_ctx, true);
+        if (server->init(&hd.scid, hd.version, ts) != 0) {
+          return -1;
+        }
+      }
+
+      if (server->feed(pkt.data(), pkt.size(), ts, to_client) != 0) {
+        return -1;
+      }
+    }
+
+    if (ngtcp2_conn_get_handshake_completed(client.conn()) &&
+        ngtcp2_conn_get_handshake_completed(server->conn())) {
+      return 0;
+    }
+
+    ts += FLIGHT_DELAY;
+
+    for (; !to_client.empty(); to_client.pop_front()) {
+      auto &pkt = to_client.front();
+
+      if (client.feed(pkt.data(), pkt.size(), ts, to_server) != 0) {
+        return -1;
+      }
+    }
+  }
+
+  std::cerr << "Handshake did not complete in " << MAX_FLIGHTS << " flights"
+            << std::endl;
+
+  return -1;
+}
+} // namespace
+
+namespace {
+void print_usage() {
+  std::cerr << "Usage: hsbench [OPTIONS] <PRIVATE_KEY_FILE> <CERTIFICATE_FILE>"
+            << std::endl;
+}
+} // namespace
+
+namespace {
+void config_set_default(Config &config) {
+  config = Config{};
+  config.handshakes = 1000;
+  config.ciphers = "TLS13-AES-128-GCM-SHA256:TLS13-AES-256-GCM-SHA384:TLS13-"
+                   "CHACHA20-POLY1305-SHA256";
+  config.groups = "P-256:X25519:P-384:P-521";
+}
+} // namespace
+
+namespace {
+void print_help() {
+  print_usage();
+
+  config_set_default(config);
+
+  std::cout << R"(
+  <PRIVATE_KEY_FILE>
+              Path to private key file of server
+  <CERTIFICATE_FILE>
+              Path to certificate file of server
+Options:
+  -n, --handshakes=<N>
+              The number of handshakes to run.
+              Default: )"
+            << config.handshakes << R"(
+  --ciphers=<CIPHERS>
+              Specify the cipher suite list to enable.
+              Default: )"
+            << config.ciphers << R"(
+  --groups=<GROUPS>
+              Specify the supported groups.
+              Default: )"
+            << config.groups << R"(
+  -h, --help  Display this help and exit.
+
+The time  is split into the  following phases.  A phase  does not
+include the time spent in the phases it calls into.
+
+  tls         OpenSSL handshake processing including its key schedule
+  key derivation
+              Initial  secrets,  packet  protection keys,  IVs  and
+              packet number protection keys derived with HKDF
+  transport params
+              Encoding, decoding and applying transport parameters
+  conn setup  ngtcp2_conn_client_new,  ngtcp2_conn_server_new  and
+              ngtcp2_conn_del
+  packet protection
+              AEAD and packet number encryption
+  packet processing
+              ngtcp2_conn_handshake excluding the above
+  harness     Everything else in this program
+)";
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  config_set_default(config);
+
+  for (;;) {
+    static int flag = 0;
+    constexpr static option long_opts[] = {
+        {"help", no_argument, nullptr, 'h'},
+        {"handshakes", required_argument, nullptr, 'n'},
+        {"ciphers", required_argument, &flag, 1},
+        {"groups", required_argument, &flag, 2},
+        {nullptr, 0, nullptr, 0}};
+
+    auto optidx = 0;
+    auto c = getopt_long(argc, argv, "hn:", long_opts, &optidx);
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+    case 'h':
+      // --help
+      print_help();
+      exit(EXIT_SUCCESS);
+    case 'n': {
+      // --handshakes
+      auto n = strtoul(optarg, nullptr, 10);
+      if (n == 0) {
+        std::cerr << "handshakes: must be greater than 0" << std::endl;
+        exit(EXIT_FAILURE);
+      }
+      config.handshakes = n;
+      break;
+    }
+    case '?':
+      print_usage();
+      exit(EXIT_FAILURE);
+    case 0:
+      switch (flag) {
+      case 1:
+        // --ciphers
+        config.ciphers = optarg;
+        break;
+      case 2:
+        // --groups
+        config.groups = optarg;
+        break;
+      }
+      break;
+    default:
+      break;
+    };
+  }
+
+  if (argc - optind < 2) {
+    std::cerr << "Too few arguments" << std::endl;
+    print_usage();
+    exit(EXIT_FAILURE);
+  }
+
+  auto private_key_file = argv[optind++];
+  auto cert_file = argv[optind++];
+
+  auto client_ssl_ctx = create_ssl_ctx(nullptr, nullptr);
+  if (client_ssl_ctx == nullptr) {
+    exit(EXIT_FAILURE);
+  }
+
+  auto client_ssl_ctx_d = defer(SSL_CTX_free, client_ssl_ctx);
+
+  auto server_ssl_ctx = create_ssl_ctx(private_key_file, cert_file);
+  if (server_ssl_ctx == nullptr) {
+    exit(EXIT_FAILURE);
+  }
+
+  auto server_ssl_ctx_d = defer(SSL_CTX_free, server_ssl_ctx);
+
+  ngtcp2_tstamp ts = 0;
+
+  profiler.reset();
+  auto start = std::chrono::steady_clock::now();
+
+  for (size_t i = 0; i < config.handshakes; ++i) {
+    if (run_handshake(client_ssl_ctx, server_ssl_ctx, ts) != 0) {
+      std::cerr << "Handshake #" << i << " failed" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  profiler.enter(PHASE_HARNESS);
+
+  auto elapsed = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+
+  std::cout << std::fixed << std::setprecision(3) << "handshakes: "
+            << config.handshakes << "\n"
+            << "seconds:    " << elapsed << "\n"
+            << "handshakes/s: " << std::setprecision(1)
+            << config.handshakes / elapsed << "\n\n"
+            << std::left << std::setw(20) << "phase" << std::right
+            << std::setw(10) << "seconds" << std::setw(14) << "us/handshake"
+            << std::setw(8) << "share" << "\n";
+
+  for (size_t i = 0; i < PHASE_MAX; ++i) {
+    auto t = profiler.elapsed(static_cast<Phase>(i));
+    std::cout << std::left << std::setw(20) << phase_names[i] << std::right
+              << std::setprecision(3) << std::setw(10) << t
+              << std::setprecision(1) << std::setw(14)
+              << t * 1000000 / config.handshakes << std::setw(7)
+              << t * 100 / elapsed << "%\n";
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,2099 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2018 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+// qload is a load generator for the example server.  It runs many
+// connections concurrently across threads.  Each connection issues
+// HTTP/1.1 GET requests over bidirectional streams, keeping a number
+// of them in flight, until it completes its share of the requests.
+// The connection handling follows Client in client.cc.
+#include <cstdlib>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <deque>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+
+#include <ngtcp2/ngtcp2.h>
+
+#include <openssl/ssl.h>
+#include <openssl/bio.h>
+#include <openssl/err.h>
+
+#include <ev.h>
+
+#include "network.h"
+#include "util.h"
+#include "crypto.h"
+#include "template.h"
+
+using namespace ngtcp2;
+
+namespace {
+struct Config {
+  // ciphers is the list of enabled ciphers.
+  const char *ciphers;
+  // groups is the list of supported groups.
+  const char *groups;
+  // nreqs is the total number of requests.
+  size_t nreqs;
+  // nclients is the total number of connections.
+  size_t nclients;
+  // nthreads is the number of worker threads.
+  size_t nthreads;
+  // max_concurrent_streams is the maximum number of requests in
+  // flight per connection.
+  size_t max_concurrent_streams;
+  // rate is the number of requests started per second across all
+  // connections.  0 means no limit.
+  double rate;
+  // path is the path to request.
+  const char *path;
+  // version is a QUIC version to use.
+  uint32_t version;
+  // timeout is an idle timeout for QUIC connection.
+  uint32_t timeout;
+  // request is the request sent on each stream.  It is built from
+  // path and the remote host.
+  std::string request;
+};
+} // namespace
+
+namespace {
+Config config{};
+} // namespace
+
+namespace {
+// RATE_TICK is the interval in seconds at which the request rate
+// limiter adds tokens.
+constexpr double RATE_TICK = 0.01;
+} // namespace
+
+namespace {
+using clock_type = std::chrono::steady_clock;
+} // namespace
+
+namespace {
+double seconds_since(const clock_type::time_point &t) {
+  return std::chrono::duration<double>(clock_type::now() - t).count();
+}
+} // namespace
+
+namespace {
+// Stats holds the measurements of a worker.  Latencies are in
+// seconds.
+struct Stats {
+  std::vector<double> handshake;
+  std::vector<double> ttfb;
+  std::vector<double> request;
+  // nreqs_done is the number of requests which received complete
+  // response.
+  size_t nreqs_done;
+  // nreqs_failed is the number of requests which did not complete.
+  size_t nreqs_failed;
+  // nclients_failed is the number of connections which failed.
+  size_t nclients_failed;
+  // bytes_recv is the number of response bytes received.
+  uint64_t bytes_recv;
+};
+} // namespace
+
+namespace {
+// Request is a request in flight.
+struct Request {
+  uint64_t stream_id;
+  // offset is the number of bytes of config.request passed to
+  // ngtcp2_conn.
+  size_t offset;
+  clock_type::time_point start;
+  // first_byte is true if the first byte of response has been
+  // received.
+  bool first_byte;
+  // done is true if the complete response has been received.
+  bool done;
+};
+} // namespace
+
+namespace {
+class Worker;
+} // namespace
+
+namespace {
+// LoadClient is a connection which issues requests.
+class LoadClient {
+public:
+  LoadClient(Worker *worker, SSL_CTX *ssl_ctx, size_t nreqs);
+  ~LoadClient();
+
+  int init(const Address &remote_addr, const char *host);
+  // finish closes the connection.  If |failed| is true, the requests
+  // which have not completed are counted as failures.
+  void finish(bool failed);
+  bool finished() const;
+
+  int on_read();
+  int on_write(bool retransmit = false);
+  int feed_data(uint8_t *data, size_t datalen);
+  int do_handshake(const uint8_t *data, size_t datalen);
+  ssize_t do_handshake_once(const uint8_t *data, size_t datalen);
+  int write_streams();
+  int on_write_stream(Request &req);
+  int send_packet();
+  void schedule_retransmit();
+  void start_wev();
+
+  // submit_requests opens streams for new requests while the
+  // concurrency limit, the rate limit and the peer's stream limit
+  // allow.
+  int submit_requests();
+  void on_handshake_completed();
+  void on_recv_stream_data(uint64_t stream_id, uint8_t fin, size_t datalen);
+  void on_stream_close(uint64_t stream_id);
+  // rate_blocked returns true if a request is waiting for the rate
+  // limiter.
+  bool rate_blocked() const;
+
+  int on_key(int name, const uint8_t *secret, size_t secretlen,
+             const uint8_t *key, size_t keylen, const uint8_t *iv,
+             size_t ivlen);
+  int tls_handshake();
+  int read_tls();
+  int setup_initial_crypto_context();
+
+  int write_client_handshake(const uint8_t *data, size_t datalen);
+  size_t read_server_handshake(uint8_t *buf, size_t buflen);
+  void write_server_handshake(const uint8_t *data, size_t datalen);
+  void remove_tx_crypto_data(uint64_t offset, size_t datalen);
+
+  ssize_t hs_encrypt_data(uint8_t *dest, size_t destlen,
+                          const uint8_t *plaintext, size_t plaintextlen,
+                          const uint8_t *key, size_t keylen,
+                          const uint8_t *nonce, size_t noncelen,
+                          const uint8_t *ad, size_t adlen);
+  ssize_t hs_decrypt_data(uint8_t *dest, size_t destlen,
+                          const uint8_t *ciphertext, size_t ciphertextlen,
+                          const uint8_t *key, size_t keylen,
+                          const uint8_t *nonce, size_t noncelen,
+                          const uint8_t *ad, size_t adlen);
+  ssize_t encrypt_data(uint8_t *dest, size_t destlen, const uint8_t *plaintext,
+                       size_t plaintextlen, const uint8_t *key, size_t keylen,
+                       const uint8_t *nonce, size_t noncelen,
+                       const uint8_t *ad, size_t adlen);
+  ssize_t decrypt_data(uint8_t *dest, size_t destlen,
+                       const uint8_t *ciphertext, size_t ciphertextlen,
+                       const uint8_t *key, size_t keylen, const uint8_t *nonce,
+                       size_t noncelen, const uint8_t *ad, size_t adlen);
+  ssize_t hs_encrypt_pn(uint8_t *dest, size_t destlen,
+                        const uint8_t *plaintext, size_t plaintextlen,
+                        const uint8_t *key, size_t keylen,
+                        const uint8_t *nonce, size_t noncelen);
+  ssize_t encrypt_pn(uint8_t *dest, size_t destlen, const uint8_t *plaintext,
+                     size_t plaintextlen, const uint8_t *key, size_t keylen,
+                     const uint8_t *nonce, size_t noncelen);
+
+  ngtcp2_conn *conn() const;
+
+private:
+  Worker *worker_;
+  struct ev_loop *loop_;
+  ev_io wev_;
+  ev_io rev_;
+  ev_timer timer_;
+  ev_timer rttimer_;
+  SSL_CTX *ssl_ctx_;
+  SSL *ssl_;
+  int fd_;
+  size_t max_pktlen_;
+  ngtcp2_conn *conn_;
+  crypto::Context hs_crypto_ctx_;
+  crypto::Context crypto_ctx_;
+  // chandshake_ is the handshake data generated by TLS stack.  It is
+  // kept until it is acknowledged, and tx_crypto_offset_ is the
+  // offset of its first element.
+  std::deque<std::vector<uint8_t>> chandshake_;
+  uint64_t tx_crypto_offset_;
+  std::vector<uint8_t> shandshake_;
+  size_t nsread_;
+  std::array<uint8_t, NGTCP2_MAX_PKTLEN_IPV6> sendbuf_;
+  size_t sendbuflen_;
+  std::map<uint64_t, Request> reqs_;
+  clock_type::time_point start_;
+  // nreqs_ is the number of requests this connection issues.
+  size_t nreqs_;
+  // nreqs_started_ is the number of requests started.
+  size_t nreqs_started_;
+  // nreqs_active_ is the number of requests waiting for response.
+  size_t nreqs_active_;
+  // nreqs_done_ is the number of requests which completed.
+  size_t nreqs_done_;
+  bool handshake_completed_;
+  bool rate_blocked_;
+  bool finished_;
+};
+} // namespace
+
+namespace {
+// Worker runs connections in its own thread and event loop.
+class Worker {
+public:
+  Worker(SSL_CTX *ssl_ctx, const Address &remote_addr, const char *host,
+         size_t nclients, size_t nreqs, double rate);
+  ~Worker();
+
+  void run();
+  // take_token returns true if a request may start now.
+  bool take_token();
+  void on_rate_tick();
+  void on_client_finished();
+
+  struct ev_loop *loop() const;
+  Stats &stats();
+
+private:
+  struct ev_loop *loop_;
+  ev_timer ratetimer_;
+  SSL_CTX *ssl_ctx_;
+  Address remote_addr_;
+  const char *host_;
+  size_t nclients_;
+  size_t nreqs_;
+  // rate is the number of requests per second this worker starts.
+  double rate_;
+  double tokens_;
+  std::vector<std::unique_ptr<LoadClient>> clients_;
+  size_t nclients_finished_;
+  Stats stats_;
+};
+} // namespace
+
+namespace {
+int key_cb(SSL *ssl, int name, const unsigned char *secret, size_t secretlen,
+           const unsigned char *key, size_t keylen, const unsigned char *iv,
+           size_t ivlen, void *arg) {
+  auto c = static_cast<LoadClient *>(arg);
+
+  if (c->on_key(name, secret, secretlen, key, keylen, iv, ivlen) != 0) {
+    return 0;
+  }
+
+  return 1;
+}
+} // namespace
+
+int LoadClient::on_key(int name, const uint8_t *secret, size_t secretlen,
+                       const uint8_t *key, size_t keylen, const uint8_t *iv,
+                       size_t ivlen) {
+  int rv;
+
+  switch (name) {
+  case SSL_KEY_CLIENT_HANDSHAKE_TRAFFIC:
+  case SSL_KEY_CLIENT_APPLICATION_TRAFFIC:
+  case SSL_KEY_SERVER_HANDSHAKE_TRAFFIC:
+  case SSL_KEY_SERVER_APPLICATION_TRAFFIC:
+    break;
+  default:
+    return 0;
+  }
+
+  rv = crypto::negotiated_prf(crypto_ctx_, ssl_);
+  if (rv != 0) {
+    return -1;
+  }
+  rv = crypto::negotiated_aead(crypto_ctx_, ssl_);
+  if (rv != 0) {
+    return -1;
+  }
+
+  std::array<uint8_t, 64> pn;
+  auto pnlen = crypto::derive_pkt_num_protection_key(
+      pn.data(), pn.size(), secret, secretlen, crypto_ctx_);
+  if (pnlen < 0) {
+    return -1;
+  }
+
+  ngtcp2_conn_set_aead_overhead(conn_, crypto::aead_max_overhead(crypto_ctx_));
+
+  switch (name) {
+  case SSL_KEY_CLIENT_HANDSHAKE_TRAFFIC:
+    ngtcp2_conn_set_handshake_tx_keys(conn_, key, keylen, iv, ivlen, pn.data(),
+                                      pnlen);
+    break;
+  case SSL_KEY_CLIENT_APPLICATION_TRAFFIC:
+    ngtcp2_conn_update_tx_keys(conn_, key, keylen, iv, ivlen, pn.data(), pnlen);
+    break;
+  case SSL_KEY_SERVER_HANDSHAKE_TRAFFIC:
+    ngtcp2_conn_set_handshake_rx_keys(conn_, key, keylen, iv, ivlen, pn.data(),
+                                      pnlen);
+    break;
+  case SSL_KEY_SERVER_APPLICATION_TRAFFIC:
+    ngtcp2_conn_update_rx_keys(conn_, key, keylen, iv, ivlen, pn.data(), pnlen);
+    break;
+  }
+
+  return 0;
+}
+
+namespace {
+void msg_cb(int write_p, int version, int content_type, const void *buf,
+            size_t len, SSL *ssl, void *arg) {
+  if (!write_p || content_type != SSL3_RT_HANDSHAKE) {
+    return;
+  }
+
+  auto c = static_cast<LoadClient *>(arg);
+
+  auto rv =
+      c->write_client_handshake(reinterpret_cast<const uint8_t *>(buf), len);
+
+  assert(0 == rv);
+}
+} // namespace
+
+namespace {
+int bio_write(BIO *b, const char *buf, int len) {
+  assert(0);
+  return -1;
+}
+} // namespace
+
+namespace {
+int bio_read(BIO *b, char *buf, int len) {
+  BIO_clear_retry_flags(b);
+
+  auto c = static_cast<LoadClient *>(BIO_get_data(b));
+
+  len = c->read_server_handshake(reinterpret_cast<uint8_t *>(buf), len);
+  if (len == 0) {
+    BIO_set_retry_read(b);
+    return -1;
+  }
+
+  return len;
+}
+} // namespace
+
+namespace {
+int bio_puts(BIO *b, const char *str) { return bio_write(b, str, strlen(str)); }
+} // namespace
+
+namespace {
+int bio_gets(BIO *b, char *buf, int len) { return -1; }
+} // namespace
+
+namespace {
+long bio_ctrl(BIO *b, int cmd, long num, void *ptr) {
+  switch (cmd) {
+  case BIO_CTRL_FLUSH:
+    return 1;
+  }
+
+  return 0;
+}
+} // namespace
+
+namespace {
+int bio_create(BIO *b) {
+  BIO_set_init(b, 1);
+  return 1;
+}
+} // namespace
+
+namespace {
+int bio_destroy(BIO *b) {
+  if (b == nullptr) {
+    return 0;
+  }
+
+  return 1;
+}
+} // namespace
+
+namespace {
+BIO_METHOD *create_bio_method() {
+  static auto meth = []() {
+    auto meth = BIO_meth_new(BIO_TYPE_FD, "bio");
+    BIO_meth_set_write(meth, bio_write);
+    BIO_meth_set_read(meth, bio_read);
+    BIO_meth_set_puts(meth, bio_puts);
+    BIO_meth_set_gets(meth, bio_gets);
+    BIO_meth_set_ctrl(meth, bio_ctrl);
+    BIO_meth_set_create(meth, bio_create);
+    BIO_meth_set_destroy(meth, bio_destroy);
+    return meth;
+  }();
+  return meth;
+}
+} // namespace
+
+namespace {
+void writecb(struct ev_loop *loop, ev_io *w, int revents) {
+  ev_io_stop(loop, w);
+
+  auto c = static_cast<LoadClient *>(w->data);
+
+  auto rv = c->on_write();
+  switch (rv) {
+  case 0:
+    return;
+  case NETWORK_ERR_SEND_NON_FATAL:
+    c->start_wev();
+    return;
+  }
+}
+} // namespace
+
+namespace {
+void readcb(struct ev_loop *loop, ev_io *w, int revents) {
+  auto c = static_cast<LoadClient *>(w->data);
+
+  if (c->on_read() != 0) {
+    return;
+  }
+  auto rv = c->on_write();
+  switch (rv) {
+  case 0:
+    return;
+  case NETWORK_ERR_SEND_NON_FATAL:
+    c->start_wev();
+    return;
+  }
+}
+} // namespace
+
+namespace {
+void timeoutcb(struct ev_loop *loop, ev_timer *w, int revents) {
+  auto c = static_cast<LoadClient *>(w->data);
+
+  std::cerr << "Timeout" << std::endl;
+
+  c->finish(true);
+}
+} // namespace
+
+namespace {
+void retransmitcb(struct ev_loop *loop, ev_timer *w, int revents) {
+  int rv;
+  auto c = static_cast<LoadClient *>(w->data);
+  auto conn = c->conn();
+  auto now = util::timestamp(loop);
+
+  if (ngtcp2_conn_loss_detection_expiry(conn) <= now) {
+    rv = c->on_write(true);
+    if (rv != 0) {
+      goto fail;
+    }
+  }
+
+  if (ngtcp2_conn_ack_delay_expiry(conn) <= now) {
+    rv = c->on_write();
+    if (rv != 0) {
+      goto fail;
+    }
+  }
+
+  return;
+
+fail:
+  switch (rv) {
+  case NETWORK_ERR_SEND_NON_FATAL:
+    c->start_wev();
+    return;
+  default:
+    c->finish(true);
+    return;
+  }
+}
+} // namespace
+
+LoadClient::LoadClient(Worker *worker, SSL_CTX *ssl_ctx, size_t nreqs)
+    : worker_(worker),
+      loop_(worker->loop()),
+      ssl_ctx_(ssl_ctx),
+      ssl_(nullptr),
+      fd_(-1),
+      max_pktlen_(0),
+      conn_(nullptr),
+      hs_crypto_ctx_{},
+      crypto_ctx_{},
+      tx_crypto_offset_(0),
+      nsread_(0),
+      sendbuflen_(0),
+      nreqs_(nreqs),
+      nreqs_started_(0),
+      nreqs_active_(0),
+      nreqs_done_(0),
+      handshake_completed_(false),
+      rate_blocked_(false),
+      finished_(false) {
+  ev_io_init(&wev_, writecb, 0, EV_WRITE);
+  ev_io_init(&rev_, readcb, 0, EV_READ);
+  wev_.data = this;
+  rev_.data = this;
+  ev_timer_init(&timer_, timeoutcb, 0., config.timeout);
+  timer_.data = this;
+  ev_timer_init(&rttimer_, retransmitcb, 0., 0.);
+  rttimer_.data = this;
+}
+
+LoadClient::~LoadClient() {
+  if (conn_) {
+    ngtcp2_conn_del(conn_);
+  }
+
+  if (ssl_) {
+    SSL_free(ssl_);
+  }
+
+  if (fd_ != -1) {
+    close(fd_);
+  }
+}
+
+namespace {
+int client_initial(ngtcp2_conn *conn, void *user_data) {
+  auto c = static_cast<LoadClient *>(user_data);
+
+  if (c->tls_handshake() != 0) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+} // namespace
+
+namespace {
+int recv_crypto_data(ngtcp2_conn *conn, uint64_t offset, const uint8_t *data,
+                     size_t datalen, void *user_data) {
+  auto c = static_cast<LoadClient *>(user_data);
+
+  c->write_server_handshake(data, datalen);
+
+  if (!ngtcp2_conn_get_handshake_completed(conn) && c->tls_handshake() != 0) {
+    return NGTCP2_ERR_CRYPTO;
+  }
+
+  return c->read_tls();
+}
+} // namespace
+
+namespace {
+int handshake_completed(ngtcp2_conn *conn, void *user_data) {
+  auto c = static_cast<LoadClient *>(user_data);
+
+  c->on_handshake_completed();
+
+  return 0;
+}
+} // namespace
+
+namespace {
+int recv_stream_data(ngtcp2_conn *conn, uint64_t stream_id, uint8_t fin,
+                     uint64_t offset, const uint8_t *data, size_t datalen,
+                     void *user_data, void *stream_user_data) {
+  auto c = static_cast<LoadClient *>(user_data);
+
+  ngtcp2_conn_extend_max_stream_offset(conn, stream_id, datalen);
+  ngtcp2_conn_extend_max_offset(conn, datalen);
+
+  c->on_recv_stream_data(stream_id, fin, datalen);
+
+  return 0;
+}
+} // namespace
+
+namespace {
+int acked_crypto_offset(ngtcp2_conn *conn, uint64_t offset, size_t datalen,
+                        void *user_data) {
+  auto c = static_cast<LoadClient *>(user_data);
+
+  c->remove_tx_crypto_data(offset, datalen);
+
+  return 0;
+}
+} // namespace
+
+namespace {
+int stream_close(ngtcp2_conn *conn, uint64_t stream_id, uint16_t app_error_code,
+                 void *user_data, void *stream_user_data) {
+  auto c = static_cast<LoadClient *>(user_data);
+
+  c->on_stream_close(stream_id);
+
+  return 0;
+}
+} // namespace
+
+namespace {
+int extend_max_stream_id(ngtcp2_conn *conn, uint64_t max_stream_id,
+                         void *user_data) {
+  auto c = static_cast<LoadClient *>(user_data);
+
+  if (c->submit_requests() != 0) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+} // namespace
+
+namespace {
+ssize_t do_hs_encrypt(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
+                      const uint8_t *plaintext, size_t plaintextlen,
+                      const uint8_t *key, size_t keylen, const uint8_t *nonce,
+                      size_t noncelen, const uint8_t *ad, size_t adlen,
+                      void *user_data) {
+  auto c = static_cast<LoadClient *>(user_data);
+
+  auto nwrite = c->hs_encrypt_data(dest, destlen, plaintext, plaintextlen, key,
+                                   keylen, nonce, noncelen, ad, adlen);
+  if (nwrite < 0) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return nwrite;
+}
+} // namespace
+
+namespace {
+ssize_t do_hs_decrypt(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
+                      const uint8_t *ciphertext, size_t ciphertextlen,
+                      const uint8_t *key, size_t keylen, const uint8_t *nonce,
+                      size_t noncelen, const uint8_t *ad, size_t adlen,
+                      void *user_data) {
+  auto c = static_cast<LoadClient *>(user_data);
+
+  auto nwrite = c->hs_decrypt_data(dest, destlen, ciphertext, ciphertextlen,
+                                   key, keylen, nonce, noncelen, ad, adlen);
+  if (nwrite < 0) {
+    return NGTCP2_ERR_TLS_DECRYPT;
+  }
+
+  return nwrite;
+}
+} // namespace
+
+namespace {
+ssize_t do_encrypt(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
+                   const uint8_t *plaintext, size_t plaintextlen,
+                   const uint8_t *key, size_t keylen, const uint8_t *nonce,
+                   size_t noncelen, const uint8_t *ad, size_t adlen,
+                   void *user_data) {
+  auto c = static_cast<LoadClient *>(user_data);
+
+  auto nwrite = c->encrypt_data(dest, destlen, plaintext, plaintextlen, key,
+                                keylen, nonce, noncelen, ad, adlen);
+  if (nwrite < 0) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return nwrite;
+}
+} // namespace
+
+namespace {
+ssize_t do_decrypt(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
+                   const uint8_t *ciphertext, size_t ciphertextlen,
+                   const uint8_t *key, size_t keylen, const uint8_t *nonce,
+                   size_t noncelen, const uint8_t *ad, size_t adlen,
+                   void *user_data) {
+  auto c = static_cast<LoadClient *>(user_data);
+
+  auto nwrite = c->decrypt_data(dest, destlen, ciphertext, ciphertextlen, key,
+                                keylen, nonce, noncelen, ad, adlen);
+  if (nwrite < 0) {
+    return NGTCP2_ERR_TLS_DECRYPT;
+  }
+
+  return nwrite;
+}
+} // namespace
+
+namespace {
+ssize_t do_hs_encrypt_pn(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
+                         const uint8_t *plaintext, size_t plaintextlen,
+                         const uint8_t *key, size_t keylen,
+                         const uint8_t *nonce, size_t noncelen,
+                         void *user_data) {
+  auto c = static_cast<LoadClient *>(user_data);
+
+  auto nwrite = c->hs_encrypt_pn(dest, destlen, plaintext, plaintextlen, key,
+                                 keylen, nonce, noncelen);
+  if (nwrite < 0) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return nwrite;
+}
+} // namespace
+
+namespace {
+ssize_t do_encrypt_pn(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
+                      const uint8_t *plaintext, size_t plaintextlen,
+                      const uint8_t *key, size_t keylen, const uint8_t *nonce,
+                      size_t noncelen, void *user_data) {
+  auto c = static_cast<LoadClient *>(user_data);
+
+  auto nwrite = c->encrypt_pn(dest, destlen, plaintext, plaintextlen, key,
+                              keylen, nonce, noncelen);
+  if (nwrite < 0) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return nwrite;
+}
+} // namespace
+
+namespace {
+int create_sock(const Address &remote_addr) {
+  auto fd = socket(remote_addr.su.storage.ss_family,
+                   SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    std::cerr << "socket: " << strerror(errno) << std::endl;
+    return -1;
+  }
+
+  if (connect(fd, &remote_addr.su.sa, remote_addr.len) == -1) {
+    std::cerr << "connect: " << strerror(errno) << std::endl;
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+} // namespace
+
+int LoadClient::init(const Address &remote_addr, const char *host) {
+  int rv;
+
+  start_ = clock_type::now();
+
+  switch (remote_addr.su.storage.ss_family) {
+  case AF_INET:
+    max_pktlen_ = NGTCP2_MAX_PKTLEN_IPV4;
+    break;
+  case AF_INET6:
+    max_pktlen_ = NGTCP2_MAX_PKTLEN_IPV6;
+    break;
+  default:
+    return -1;
+  }
+
+  fd_ = create_sock(remote_addr);
+  if (fd_ == -1) {
+    return -1;
+  }
+
+  ssl_ = SSL_new(ssl_ctx_);
+  auto bio = BIO_new(create_bio_method());
+  BIO_set_data(bio, this);
+  SSL_set_bio(ssl_, bio, bio);
+  SSL_set_app_data(ssl_, this);
+  SSL_set_connect_state(ssl_);
+  SSL_set_msg_callback(ssl_, msg_cb);
+  SSL_set_msg_callback_arg(ssl_, this);
+  SSL_set_key_callback(ssl_, key_cb, this);
+
+  switch (config.version) {
+  case NGTCP2_PROTO_VER_D13:
+    SSL_set_alpn_protos(ssl_,
+                        reinterpret_cast<const uint8_t *>(NGTCP2_ALPN_D13),
+                        str_size(NGTCP2_ALPN_D13));
+    break;
+  }
+
+  if (util::numeric_host(host)) {
+    SSL_set_tlsext_host_name(ssl_, "localhost");
+  } else {
+    SSL_set_tlsext_host_name(ssl_, host);
+  }
+
+  auto callbacks = ngtcp2_conn_callbacks{
+      client_initial,
+      nullptr, // recv_client_initial
+      recv_crypto_data,
+      handshake_completed,
+      nullptr, // recv_version_negotiation
+      do_hs_encrypt,
+      do_hs_decrypt,
+      do_encrypt,
+      do_decrypt,
+      do_hs_encrypt_pn,
+      do_encrypt_pn,
+      recv_stream_data,
+      acked_crypto_offset,
+      nullptr, // acked_stream_data_offset
+      stream_close,
+      nullptr, // recv_stateless_reset
+      nullptr, // recv_server_stateless_retry
+      extend_max_stream_id,
+  };
+
+  auto gen = util::make_mt19937();
+  auto dis = std::uniform_int_distribution<uint8_t>(
+      0, std::numeric_limits<uint8_t>::max());
+
+  ngtcp2_cid scid, dcid;
+  scid.datalen = 17;
+  std::generate(std::begin(scid.data), std::begin(scid.data) + scid.datalen,
+                [&dis, &gen]() { return dis(gen); });
+  dcid.datalen = 18;
+  std::generate(std::begin(dcid.data), std::begin(dcid.data) + dcid.datalen,
+                [&dis, &gen]() { return dis(gen); });
+
+  ngtcp2_settings settings{};
+  settings.initial_ts = util::timestamp(loop_);
+  settings.max_stream_data = 256_k;
+  settings.max_data = 1_m;
+  settings.max_bidi_streams = 0;
+  settings.max_uni_streams = 0;
+  settings.idle_timeout = config.timeout;
+  settings.max_packet_size = NGTCP2_MAX_PKT_SIZE;
+  settings.ack_delay_exponent = NGTCP2_DEFAULT_ACK_DELAY_EXPONENT;
+
+  rv = ngtcp2_conn_client_new(&conn_, &dcid, &scid, config.version, &callbacks,
+                              &settings, NULL, this);
+  if (rv != 0) {
+    std::cerr << "ngtcp2_conn_client_new: " << ngtcp2_strerror(rv) << std::endl;
+    return -1;
+  }
+
+  rv = setup_initial_crypto_context();
+  if (rv != 0) {
+    return -1;
+  }
+
+  ev_io_set(&wev_, fd_, EV_WRITE);
+  ev_io_set(&rev_, fd_, EV_READ);
+  ev_io_start(loop_, &rev_);
+  ev_timer_again(loop_, &timer_);
+
+  auto nwrite = do_handshake_once(nullptr, 0);
+  if (nwrite < 0) {
+    return -1;
+  }
+
+  schedule_retransmit();
+
+  return 0;
+}
+
+int LoadClient::setup_initial_crypto_context() {
+  int rv;
+
+  std::array<uint8_t, 32> initial_secret, secret;
+  auto dcid = ngtcp2_conn_get_dcid(conn_);
+  rv = crypto::derive_initial_secret(
+      initial_secret.data(), initial_secret.size(), dcid,
+      reinterpret_cast<const uint8_t *>(NGTCP2_INITIAL_SALT),
+      str_size(NGTCP2_INITIAL_SALT));
+  if (rv != 0) {
+    std::cerr << "crypto::derive_initial_secret() failed" << std::endl;
+    return -1;
+  }
+
+  crypto::prf_sha256(hs_crypto_ctx_);
+  crypto::aead_aes_128_gcm(hs_crypto_ctx_);
+
+  rv = crypto::derive_client_initial_secret(secret.data(), secret.size(),
+                                            initial_secret.data(),
+                                            initial_secret.size());
+  if (rv != 0) {
+    std::cerr << "crypto::derive_client_initial_secret() failed" << std::endl;
+    return -1;
+  }
+
+  std::array<uint8_t, 16> key, iv, pn;
+
+  auto keylen = crypto::derive_packet_protection_key(
+      key.data(), key.size(), secret.data(), secret.size(), hs_crypto_ctx_);
+  if (keylen < 0) {
+    return -1;
+  }
+
+  auto ivlen = crypto::derive_packet_protection_iv(
+      iv.data(), iv.size(), secret.data(), secret.size(), hs_crypto_ctx_);
+  if (ivlen < 0) {
+    return -1;
+  }
+
+  auto pnlen = crypto::derive_pkt_num_protection_key(
+      pn.data(), pn.size(), secret.data(), secret.size(), hs_crypto_ctx_);
+  if (pnlen < 0) {
+    return -1;
+  }
+
+  ngtcp2_conn_set_initial_tx_keys(conn_, key.data(), keylen, iv.data(), ivlen,
+                                  pn.data(), pnlen);
+
+  rv = crypto::derive_server_initial_secret(secret.data(), secret.size(),
+                                            initial_secret.data(),
+                                            initial_secret.size());
+  if (rv != 0) {
+    std::cerr << "crypto::derive_server_initial_secret() failed" << std::endl;
+    return -1;
+  }
+
+  keylen = crypto::derive_packet_protection_key(
+      key.data(), key.size(), secret.data(), secret.size(), hs_crypto_ctx_);
+  if (keylen < 0) {
+    return -1;
+  }
+
+  ivlen = crypto::derive_packet_protection_iv(
+      iv.data(), iv.size(), secret.data(), secret.size(), hs_crypto_ctx_);
+  if (ivlen < 0) {
+    return -1;
+  }
+
+  pnlen = crypto::derive_pkt_num_protection_key(
+      pn.data(), pn.size(), secret.data(), secret.size(), hs_crypto_ctx_);
+  if (pnlen < 0) {
+    return -1;
+  }
+
+  ngtcp2_conn_set_initial_rx_keys(conn_, key.data(), keylen, iv.data(), ivlen,
+                                  pn.data(), pnlen);
+
+  return 0;
+}
+
+int LoadClient::tls_handshake() {
+  ERR_clear_error();
+
+  auto rv = SSL_do_handshake(ssl_);
+  if (rv <= 0) {
+    auto err = SSL_get_error(ssl_, rv);
+    switch (err) {
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+      return 0;
+    case SSL_ERROR_SSL:
+      std::cerr << "TLS handshake error: "
+                << ERR_error_string(ERR_get_error(), nullptr) << std::endl;
+      return -1;
+    default:
+      std::cerr << "TLS handshake error: " << err << std::endl;
+      return -1;
+    }
+  }
+
+  ngtcp2_conn_handshake_completed(conn_);
+
+  return 0;
+}
+
+int LoadClient::read_tls() {
+  ERR_clear_error();
+
+  std::array<uint8_t, 4096> buf;
+  size_t nread;
+
+  for (;;) {
+    auto rv = SSL_read_ex(ssl_, buf.data(), buf.size(), &nread);
+    if (rv == 1) {
+      continue;
+    }
+    auto err = SSL_get_error(ssl_, 0);
+    switch (err) {
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+      return 0;
+    case SSL_ERROR_SSL:
+    case SSL_ERROR_ZERO_RETURN:
+      std::cerr << "TLS read error: "
+                << ERR_error_string(ERR_get_error(), nullptr) << std::endl;
+      return NGTCP2_ERR_CRYPTO;
+    default:
+      std::cerr << "TLS read error: " << err << std::endl;
+      return NGTCP2_ERR_CRYPTO;
+    }
+  }
+}
+
+int LoadClient::feed_data(uint8_t *data, size_t datalen) {
+  if (!ngtcp2_conn_get_handshake_completed(conn_)) {
+    return do_handshake(data, datalen);
+  }
+
+  auto rv = ngtcp2_conn_recv(conn_, data, datalen, util::timestamp(loop_));
+  if (rv != 0) {
+    std::cerr << "ngtcp2_conn_recv: " << ngtcp2_strerror(rv) << std::endl;
+    if (rv != NGTCP2_ERR_TLS_DECRYPT) {
+      finish(true);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+ssize_t LoadClient::do_handshake_once(const uint8_t *data, size_t datalen) {
+  auto nwrite = ngtcp2_conn_handshake(conn_, sendbuf_.data(), max_pktlen_,
+                                      data, datalen, util::timestamp(loop_));
+  if (nwrite < 0) {
+    switch (nwrite) {
+    case NGTCP2_ERR_TLS_DECRYPT:
+    case NGTCP2_ERR_NOBUF:
+    case NGTCP2_ERR_CONGESTION:
+      return 0;
+    }
+
+    std::cerr << "ngtcp2_conn_handshake: " << ngtcp2_strerror(nwrite)
+              << std::endl;
+    finish(true);
+    return -1;
+  }
+
+  if (nwrite == 0) {
+    return 0;
+  }
+
+  sendbuflen_ = nwrite;
+
+  auto rv = send_packet();
+  if (rv == NETWORK_ERR_SEND_NON_FATAL) {
+    schedule_retransmit();
+    return rv;
+  }
+  if (rv != NETWORK_ERR_OK) {
+    return rv;
+  }
+
+  return nwrite;
+}
+
+int LoadClient::do_handshake(const uint8_t *data, size_t datalen) {
+  ssize_t nwrite;
+
+  if (sendbuflen_ > 0) {
+    auto rv = send_packet();
+    if (rv != NETWORK_ERR_OK) {
+      return rv;
+    }
+  }
+
+  nwrite = do_handshake_once(data, datalen);
+  if (nwrite <= 0) {
+    return nwrite;
+  }
+
+  for (;;) {
+    nwrite = do_handshake_once(nullptr, 0);
+    if (nwrite <= 0) {
+      return nwrite;
+    }
+  }
+}
+
+int LoadClient::on_read() {
+  std::array<uint8_t, 65536> buf;
+
+  for (;;) {
+    auto nread =
+        recvfrom(fd_, buf.data(), buf.size(), MSG_DONTWAIT, nullptr, nullptr);
+
+    if (nread == -1) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        std::cerr << "recvfrom: " << strerror(errno) << std::endl;
+      }
+      break;
+    }
+
+    if (feed_data(buf.data(), nread) != 0) {
+      return -1;
+    }
+  }
+
+  ev_timer_again(loop_, &timer_);
+
+  return 0;
+}
+
+int LoadClient::on_write(bool retransmit) {
+  if (finished_) {
+    return 0;
+  }
+
+  if (sendbuflen_ > 0) {
+    auto rv = send_packet();
+    if (rv != NETWORK_ERR_OK) {
+      if (rv != NETWORK_ERR_SEND_NON_FATAL) {
+        finish(true);
+      }
+      return rv;
+    }
+  }
+
+  if (retransmit) {
+    auto rv =
+        ngtcp2_conn_on_loss_detection_alarm(conn_, util::timestamp(loop_));
+    if (rv != 0) {
+      std::cerr << "ngtcp2_conn_on_loss_detection_alarm: "
+                << ngtcp2_strerror(rv) << std::endl;
+      finish(true);
+      return -1;
+    }
+  }
+
+  if (!ngtcp2_conn_get_handshake_completed(conn_)) {
+    auto rv = do_handshake(nullptr, 0);
+    schedule_retransmit();
+    return rv;
+  }
+
+  if (nreqs_done_ == nreqs_) {
+    finish(false);
+    return 0;
+  }
+
+  if (submit_requests() != 0) {
+    finish(true);
+    return -1;
+  }
+
+  for (;;) {
+    auto n = ngtcp2_conn_write_pkt(conn_, sendbuf_.data(), max_pktlen_,
+                                   util::timestamp(loop_));
+    if (n < 0) {
+      if (n == NGTCP2_ERR_NOBUF || n == NGTCP2_ERR_CONGESTION) {
+        break;
+      }
+      std::cerr << "ngtcp2_conn_write_pkt: " << ngtcp2_strerror(n) << std::endl;
+      finish(true);
+      return -1;
+    }
+    if (n == 0) {
+      break;
+    }
+
+    sendbuflen_ = n;
+
+    auto rv = send_packet();
+    if (rv == NETWORK_ERR_SEND_NON_FATAL) {
+      schedule_retransmit();
+      return rv;
+    }
+    if (rv != NETWORK_ERR_OK) {
+      return rv;
+    }
+  }
+
+  if (!retransmit) {
+    auto rv = write_streams();
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
+  schedule_retransmit();
+  return 0;
+}
+
+int LoadClient::write_streams() {
+  for (auto &p : reqs_) {
+    auto &req = p.second;
+    if (req.offset == config.request.size()) {
+      continue;
+    }
+
+    auto rv = on_write_stream(req);
+    if (rv != 0) {
+      if (rv == NETWORK_ERR_SEND_NON_FATAL) {
+        schedule_retransmit();
+        return 0;
+      }
+      return rv;
+    }
+  }
+
+  return 0;
+}
+
+int LoadClient::on_write_stream(Request &req) {
+  ssize_t ndatalen;
+
+  for (;;) {
+    auto data = reinterpret_cast<const uint8_t *>(config.request.data());
+    auto n = ngtcp2_conn_write_stream(
+        conn_, sendbuf_.data(), max_pktlen_, &ndatalen, req.stream_id, 1,
+        data + req.offset, config.request.size() - req.offset,
+        util::timestamp(loop_));
+    if (n < 0) {
+      switch (n) {
+      case NGTCP2_ERR_STREAM_DATA_BLOCKED:
+      case NGTCP2_ERR_STREAM_SHUT_WR:
+      case NGTCP2_ERR_STREAM_NOT_FOUND:
+      case NGTCP2_ERR_NOBUF:
+      case NGTCP2_ERR_CONGESTION:
+        return 0;
+      }
+      std::cerr << "ngtcp2_conn_write_stream: " << ngtcp2_strerror(n)
+                << std::endl;
+      finish(true);
+      return -1;
+    }
+
+    if (n == 0) {
+      return 0;
+    }
+
+    if (ndatalen > 0) {
+      req.offset += ndatalen;
+    }
+
+    sendbuflen_ = n;
+
+    auto rv = send_packet();
+    if (rv != NETWORK_ERR_OK) {
+      return rv;
+    }
+
+    if (req.offset == config.request.size()) {
+      break;
+    }
+  }
+
+  return 0;
+}
+
+int LoadClient::send_packet() {
+  int eintr_retries = 5;
+  ssize_t nwrite = 0;
+
+  do {
+    nwrite = send(fd_, sendbuf_.data(), sendbuflen_, 0);
+  } while ((nwrite == -1) && (errno == EINTR) && (eintr_retries-- > 0));
+
+  if (nwrite == -1) {
+    switch (errno) {
+    case EAGAIN:
+    case EINTR:
+    case 0:
+      return NETWORK_ERR_SEND_NON_FATAL;
+    default:
+      std::cerr << "send: " << strerror(errno) << std::endl;
+      return NETWORK_ERR_SEND_FATAL;
+    }
+  }
+
+  assert(static_cast<size_t>(nwrite) == sendbuflen_);
+  sendbuflen_ = 0;
+
+  return NETWORK_ERR_OK;
+}
+
+void LoadClient::schedule_retransmit() {
+  if (finished_) {
+    return;
+  }
+
+  auto expiry = std::min(ngtcp2_conn_loss_detection_expiry(conn_),
+                         ngtcp2_conn_ack_delay_expiry(conn_));
+
+  auto now = util::timestamp(loop_);
+  auto t =
+      expiry < now ? 1e-9 : static_cast<ev_tstamp>(expiry - now) / 1000000000;
+  rttimer_.repeat = t;
+  ev_timer_again(loop_, &rttimer_);
+}
+
+void LoadClient::start_wev() { ev_io_start(loop_, &wev_); }
+
+int LoadClient::submit_requests() {
+  rate_blocked_ = false;
+
+  if (!handshake_completed_) {
+    return 0;
+  }
+
+  for (; nreqs_started_ < nreqs_ &&
+         nreqs_active_ < config.max_concurrent_streams;) {
+    if (!worker_->take_token()) {
+      rate_blocked_ = true;
+      return 0;
+    }
+
+    uint64_t stream_id;
+
+    auto rv = ngtcp2_conn_open_bidi_stream(conn_, &stream_id, nullptr);
+    if (rv != 0) {
+      if (rv == NGTCP2_ERR_STREAM_ID_BLOCKED) {
+        // The token is wasted, but the server extends the limit as
+        // soon as streams are closed.
+        return 0;
+      }
+      std::cerr << "ngtcp2_conn_open_bidi_stream: " << ngtcp2_strerror(rv)
+                << std::endl;
+      return -1;
+    }
+
+    reqs_.emplace(stream_id, Request{stream_id, 0, clock_type::now(), false,
+                                     false});
+
+    ++nreqs_started_;
+    ++nreqs_active_;
+  }
+
+  return 0;
+}
+
+void LoadClient::on_handshake_completed() {
+  handshake_completed_ = true;
+
+  worker_->stats().handshake.push_back(seconds_since(start_));
+}
+
+void LoadClient::on_recv_stream_data(uint64_t stream_id, uint8_t fin,
+                                     size_t datalen) {
+  auto it = reqs_.find(stream_id);
+  if (it == std::end(reqs_)) {
+    return;
+  }
+
+  auto &req = (*it).second;
+  auto &stats = worker_->stats();
+
+  stats.bytes_recv += datalen;
+
+  if (!req.first_byte && (datalen || fin)) {
+    req.first_byte = true;
+    stats.ttfb.push_back(seconds_since(req.start));
+  }
+
+  if (fin && !req.done) {
+    req.done = true;
+    stats.request.push_back(seconds_since(req.start));
+    ++stats.nreqs_done;
+    ++nreqs_done_;
+    --nreqs_active_;
+  }
+}
+
+void LoadClient::on_stream_close(uint64_t stream_id) {
+  auto it = reqs_.find(stream_id);
+  if (it == std::end(reqs_)) {
+    return;
+  }
+
+  if (!(*it).second.done) {
+    // The stream was reset before the response completed.
+    ++worker_->stats().nreqs_failed;
+    ++nreqs_done_;
+    --nreqs_active_;
+  }
+
+  reqs_.erase(it);
+}
+
+bool LoadClient::rate_blocked() const { return rate_blocked_ && !finished_; }
+
+void LoadClient::finish(bool failed) {
+  if (finished_) {
+    return;
+  }
+
+  finished_ = true;
+
+  ev_timer_stop(loop_, &rttimer_);
+  ev_timer_stop(loop_, &timer_);
+  ev_io_stop(loop_, &rev_);
+  ev_io_stop(loop_, &wev_);
+
+  auto &stats = worker_->stats();
+
+  if (failed) {
+    ++stats.nclients_failed;
+    stats.nreqs_failed += nreqs_ - nreqs_done_;
+  }
+
+  if (conn_ && !ngtcp2_conn_is_in_closing_period(conn_)) {
+    auto n = ngtcp2_conn_write_connection_close(
+        conn_, sendbuf_.data(), max_pktlen_, NGTCP2_NO_ERROR,
+        util::timestamp(loop_));
+    if (n > 0) {
+      sendbuflen_ = n;
+      send_packet();
+    }
+  }
+
+  worker_->on_client_finished();
+}
+
+bool LoadClient::finished() const { return finished_; }
+
+int LoadClient::write_client_handshake(const uint8_t *data, size_t datalen) {
+  chandshake_.emplace_back(data, data + datalen);
+
+  auto &v = chandshake_.back();
+
+  ngtcp2_conn_submit_crypto_data(conn_, v.data(), v.size());
+
+  return 0;
+}
+
+size_t LoadClient::read_server_handshake(uint8_t *buf, size_t buflen) {
+  auto n = std::min(buflen, shandshake_.size() - nsread_);
+  std::copy_n(std::begin(shandshake_) + nsread_, n, buf);
+  nsread_ += n;
+  return n;
+}
+
+void LoadClient::write_server_handshake(const uint8_t *data, size_t datalen) {
+  std::copy_n(data, datalen, std::back_inserter(shandshake_));
+}
+
+void LoadClient::remove_tx_crypto_data(uint64_t offset, size_t datalen) {
+  for (; !chandshake_.empty() &&
+         tx_crypto_offset_ + chandshake_.front().size() <= offset + datalen;) {
+    tx_crypto_offset_ += chandshake_.front().size();
+    chandshake_.pop_front();
+  }
+}
+
+ssize_t LoadClient::hs_encrypt_data(uint8_t *dest, size_t destlen,
+                                    const uint8_t *plaintext,
+                                    size_t plaintextlen, const uint8_t *key,
+                                    size_t keylen, const uint8_t *nonce,
+                                    size_t noncelen, const uint8_t *ad,
+                                    size_t adlen) {
+  return crypto::encrypt(dest, destlen, plaintext, plaintextlen, hs_crypto_ctx_,
+                         key, keylen, nonce, noncelen, ad, adlen);
+}
+
+ssize_t LoadClient::hs_decrypt_data(uint8_t *dest, size_t destlen,
+                                    const uint8_t *ciphertext,
+                                    size_t ciphertextlen, const uint8_t *key,
+                                    size_t keylen, const uint8_t *nonce,
+                                    size_t noncelen, const uint8_t *ad,
+                                    size_t adlen) {
+  return crypto::decrypt(dest, destlen, ciphertext, ciphertextlen,
+                         hs_crypto_ctx_, key, keylen, nonce, noncelen, ad,
+                         adlen);
+}
+
+ssize_t LoadClient::encrypt_data(uint8_t *dest, size_t destlen,
+                                 const uint8_t *plaintext, size_t plaintextlen,
+                                 const uint8_t *key, size_t keylen,
+                                 const uint8_t *nonce, size_t noncelen,
+                                 const uint8_t *ad, size_t adlen) {
+  return crypto::encrypt(dest, destlen, plaintext, plaintextlen, crypto_ctx_,
+                         key, keylen, nonce, noncelen, ad, adlen);
+}
+
+ssize_t LoadClient::decrypt_data(uint8_t *dest, size_t destlen,
+                                 const uint8_t *ciphertext,
+                                 size_t ciphertextlen, const uint8_t *key,
+                                 size_t keylen, const uint8_t *nonce,
+                                 size_t noncelen, const uint8_t *ad,
+                                 size_t adlen) {
+  return crypto::decrypt(dest, destlen, ciphertext, ciphertextlen, crypto_ctx_,
+                         key, keylen, nonce, noncelen, ad, adlen);
+}
+
+ssize_t LoadClient::hs_encrypt_pn(uint8_t *dest, size_t destlen,
+                                  const uint8_t *plaintext,
+                                  size_t plaintextlen, const uint8_t *key,
+                                  size_t keylen, const uint8_t *nonce,
+                                  size_t noncelen) {
+  return crypto::encrypt_pn(dest, destlen, plaintext, plaintextlen,
+                            hs_crypto_ctx_, key, keylen, nonce, noncelen);
+}
+
+ssize_t LoadClient::encrypt_pn(uint8_t *dest, size_t destlen,
+                               const uint8_t *plaintext, size_t plaintextlen,
+                               const uint8_t *key, size_t keylen,
+                               const uint8_t *nonce, size_t noncelen) {
+  return crypto::encrypt_pn(dest, destlen, plaintext, plaintextlen,
+                            crypto_ctx_, key, keylen, nonce, noncelen);
+}
+
+ngtcp2_conn *LoadClient::conn() const { return conn_; }
+
+namespace {
+void ratecb(struct ev_loop *loop, ev_timer *w, int revents) {
+  auto worker = static_cast<Worker *>(w->data);
+
+  worker->on_rate_tick();
+}
+} // namespace
+
+Worker::Worker(SSL_CTX *ssl_ctx, const Address &remote_addr, const char *host,
+               size_t nclients, size_t nreqs, double rate)
+    : loop_(ev_loop_new(0)),
+      ssl_ctx_(ssl_ctx),
+      remote_addr_(remote_addr),
+      host_(host),
+      nclients_(nclients),
+      nreqs_(nreqs),
+      rate_(rate),
+      tokens_(0.),
+      nclients_finished_(0),
+      stats_{} {
+  ev_timer_init(&ratetimer_, ratecb, 0., RATE_TICK);
+  ratetimer_.data = this;
+}
+
+Worker::~Worker() {
+  clients_.clear();
+  ev_loop_destroy(loop_);
+}
+
+void Worker::run() {
+  if (nclients_ == 0) {
+    return;
+  }
+
+  if (rate_ > 0.) {
+    ev_timer_again(loop_, &ratetimer_);
+  }
+
+  for (size_t i = 0; i < nclients_; ++i) {
+    // Spread the requests over connections as evenly as possible.
+    auto nreqs = nreqs_ / nclients_ + (i < nreqs_ % nclients_);
+    auto c = std::make_unique<LoadClient>(this, ssl_ctx_, nreqs);
+    clients_.push_back(std::move(c));
+    if (nreqs == 0) {
+      ++nclients_finished_;
+      continue;
+    }
+    if (clients_.back()->init(remote_addr_, host_) != 0) {
+      clients_.back()->finish(true);
+    }
+  }
+
+  if (nclients_finished_ < nclients_) {
+    ev_run(loop_, 0);
+  }
+
+  ev_timer_stop(loop_, &ratetimer_);
+}
+
+bool Worker::take_token() {
+  if (rate_ <= 0.) {
+    return true;
+  }
+
+  if (tokens_ < 1.) {
+    return false;
+  }
+
+  tokens_ -= 1.;
+
+  return true;
+}
+
+void Worker::on_rate_tick() {
+  // Do not accumulate more than 1 tick worth of tokens so that idle
+  // periods do not turn into a burst.
+  tokens_ = std::min(tokens_ + rate_ * RATE_TICK,
+                     std::max(1., rate_ * RATE_TICK));
+
+  for (auto &c : clients_) {
+    if (!c->rate_blocked()) {
+      continue;
+    }
+    auto rv = c->on_write();
+    if (rv == NETWORK_ERR_SEND_NON_FATAL) {
+      c->start_wev();
+    }
+    if (tokens_ < 1.) {
+      break;
+    }
+  }
+}
+
+void Worker::on_client_finished() {
+  if (++nclients_finished_ == nclients_) {
+    ev_break(loop_, EVBREAK_ALL);
+  }
+}
+
+struct ev_loop *Worker::loop() const {
+  return loop_;
+}
+
+Stats &Worker::stats() { return stats_; }
+
+namespace {
+int transport_params_add_cb(SSL *ssl, unsigned int ext_type,
+                            unsigned int content, const unsigned char **out,
+                            size_t *outlen, X509 *x, size_t chainidx, int *al,
+                            void *add_arg) {
+  int rv;
+  auto c = static_cast<LoadClient *>(SSL_get_app_data(ssl));
+  auto conn = c->conn();
+
+  ngtcp2_transport_params params;
+
+  rv = ngtcp2_conn_get_local_transport_params(
+      conn, &params, NGTCP2_TRANSPORT_PARAMS_TYPE_CLIENT_HELLO);
+  if (rv != 0) {
+    *al = SSL_AD_INTERNAL_ERROR;
+    return -1;
+  }
+
+  constexpr size_t bufsize = 64;
+  auto buf = std::make_unique<uint8_t[]>(bufsize);
+
+  auto nwrite = ngtcp2_encode_transport_params(
+      buf.get(), bufsize, NGTCP2_TRANSPORT_PARAMS_TYPE_CLIENT_HELLO, &params);
+  if (nwrite < 0) {
+    std::cerr << "ngtcp2_encode_transport_params: "
+              << ngtcp2_strerror(static_cast<int>(nwrite)) << std::endl;
+    *al = SSL_AD_INTERNAL_ERROR;
+    return -1;
+  }
+
+  *out = buf.release();
+  *outlen = static_cast<size_t>(nwrite);
+
+  return 1;
+}
+} // namespace
+
+namespace {
+void transport_params_free_cb(SSL *ssl, unsigned int ext_type,
+                              unsigned int context, const unsigned char *out,
+                              void *add_arg) {
+  delete[] const_cast<unsigned char *>(out);
+}
+} // namespace
+
+namespace {
+int transport_params_parse_cb(SSL *ssl, unsigned int ext_type,
+                              unsigned int context, const unsigned char *in,
+                              size_t inlen, X509 *x, size_t chainidx, int *al,
+                              void *parse_arg) {
+  auto c = static_cast<LoadClient *>(SSL_get_app_data(ssl));
+  auto conn = c->conn();
+
+  int rv;
+
+  ngtcp2_transport_params params;
+
+  rv = ngtcp2_decode_transport_params(
+      &params, NGTCP2_TRANSPORT_PARAMS_TYPE_ENCRYPTED_EXTENSIONS, in, inlen);
+  if (rv != 0) {
+    std::cerr << "ngtcp2_decode_transport_params: " << ngtcp2_strerror(rv)
+              << std::endl;
+    *al = SSL_AD_ILLEGAL_PARAMETER;
+    return -1;
+  }
+
+  rv = ngtcp2_conn_set_remote_transport_params(
+      conn, NGTCP2_TRANSPORT_PARAMS_TYPE_ENCRYPTED_EXTENSIONS, &params);
+  if (rv != 0) {
+    *al = SSL_AD_ILLEGAL_PARAMETER;
+    return -1;
+  }
+
+  return 1;
+}
+} // namespace
+
+namespace {
+SSL_CTX *create_ssl_ctx() {
+  auto ssl_ctx = SSL_CTX_new(TLS_method());
+
+  SSL_CTX_set_min_proto_version(ssl_ctx, TLS1_3_VERSION);
+  SSL_CTX_set_max_proto_version(ssl_ctx, TLS1_3_VERSION);
+
+  // This makes OpenSSL client not send CCS after an initial
+  // ClientHello.
+  SSL_CTX_clear_options(ssl_ctx, SSL_OP_ENABLE_MIDDLEBOX_COMPAT);
+
+  SSL_CTX_set_default_verify_paths(ssl_ctx);
+
+  if (SSL_CTX_set_cipher_list(ssl_ctx, config.ciphers) != 1) {
+    std::cerr << "SSL_CTX_set_cipher_list: "
+              << ERR_error_string(ERR_get_error(), nullptr) << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (SSL_CTX_set1_groups_list(ssl_ctx, config.groups) != 1) {
+    std::cerr << "SSL_CTX_set1_groups_list failed" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  SSL_CTX_set_mode(ssl_ctx, SSL_MODE_QUIC_HACK);
+
+  if (SSL_CTX_add_custom_ext(
+          ssl_ctx, NGTCP2_TLSEXT_QUIC_TRANSPORT_PARAMETERS,
+          SSL_EXT_CLIENT_HELLO | SSL_EXT_TLS1_3_ENCRYPTED_EXTENSIONS,
+          transport_params_add_cb, transport_params_free_cb, nullptr,
+          transport_params_parse_cb, nullptr) != 1) {
+    std::cerr << "SSL_CTX_add_custom_ext(NGTCP2_TLSEXT_QUIC_TRANSPORT_"
+                 "PARAMETERS) failed: "
+              << ERR_error_string(ERR_get_error(), nullptr) << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  return ssl_ctx;
+}
+} // namespace
+
+namespace {
+int resolve_addr(Address &remote_addr, const char *addr, const char *port) {
+  addrinfo hints{};
+  addrinfo *res;
+
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+
+  auto rv = getaddrinfo(addr, port, &hints, &res);
+  if (rv != 0) {
+    std::cerr << "getaddrinfo: " << gai_strerror(rv) << std::endl;
+    return -1;
+  }
+
+  remote_addr.len = res->ai_addrlen;
+  memcpy(&remote_addr.su, res->ai_addr, res->ai_addrlen);
+
+  freeaddrinfo(res);
+
+  return 0;
+}
+} // namespace
+
+namespace {
+void print_latency(const char *name, std::vector<double> &v) {
+  std::cout << std::left << std::setw(12) << name << std::right;
+
+  if (v.empty()) {
+    std::cout << std::setw(10) << "-" << "\n";
+    return;
+  }
+
+  std::sort(std::begin(v), std::end(v));
+
+  auto percentile = [&v](double p) {
+    auto idx = static_cast<size_t>(p * (v.size() - 1) + 0.5);
+    return v[idx] * 1000;
+  };
+
+  double sum = 0;
+  for (auto t : v) {
+    sum += t;
+  }
+
+  std::cout << std::fixed << std::setprecision(3) << std::setw(10)
+            << v.front() * 1000 << std::setw(10) << sum * 1000 / v.size()
+            << std::setw(10) << percentile(0.5) << std::setw(10)
+            << percentile(0.9) << std::setw(10) << percentile(0.99)
+            << std::setw(10) << v.back() * 1000 << "\n";
+}
+} // namespace
+
+namespace {
+void print_usage() {
+  std::cerr << "Usage: qload [OPTIONS] <ADDR> <PORT>" << std::endl;
+}
+} // namespace
+
+namespace {
+void config_set_default(Config &config) {
+  config = Config{};
+  config.ciphers = "TLS13-AES-128-GCM-SHA256:TLS13-AES-256-GCM-SHA384:TLS13-"
+                   "CHACHA20-POLY1305-SHA256";
+  config.groups = "P-256:X25519:P-384:P-521";
+  config.nreqs = 1;
+  config.nclients = 1;
+  config.nthreads = 1;
+  config.max_concurrent_streams = 1;
+  config.rate = 0.;
+  config.path = "/";
+  config.version = NGTCP2_PROTO_VER_D13;
+  config.timeout = 30;
+}
+} // namespace
+
+namespace {
+void print_help() {
+  print_usage();
+
+  config_set_default(config);
+
+  std::cout << R"(
+  <ADDR>      Remote server address
+  <PORT>      Remote server port
+Options:
+  -n, --requests=<N>
+              The total number of requests.
+              Default: )"
+            << config.nreqs << R"(
+  -c, --clients=<N>
+              The total number of concurrent connections.  The requests
+              are distributed among them evenly.
+              Default: )"
+            << config.nclients << R"(
+  -t, --threads=<N>
+              The number of worker threads.  The connections are
+              distributed among them evenly.
+              Default: )"
+            << config.nthreads << R"(
+  -m, --max-concurrent-streams=<N>
+              The maximum number of requests in flight per connection.
+              Default: )"
+            << config.max_concurrent_streams << R"(
+  -r, --rate=<R>
+              The number of requests started per second across all
+              connections.  0 means no limit.
+              Default: )"
+            << config.rate << R"(
+  -p, --path=<PATH>
+              The path to request.
+              Default: )"
+            << config.path << R"(
+  -v, --version=<HEX>
+              Specify QUIC version to use in hex string.
+              Default: )"
+            << std::hex << "0x" << config.version << std::dec << R"(
+  --timeout=<T>
+              Specify idle timeout in seconds.
+              Default: )"
+            << config.timeout << R"(
+  --ciphers=<CIPHERS>
+              Specify the cipher suite list to enable.
+              Default: )"
+            << config.ciphers << R"(
+  --groups=<GROUPS>
+              Specify the supported groups.
+              Default: )"
+            << config.groups << R"(
+  -h, --help  Display this help and exit.
+
+Latencies are reported in milliseconds.  "handshake" is the time from
+the start of the connection until the handshake completes.  "ttfb" and
+"request" are the time from opening a stream until the first byte and
+the end of the response are received, respectively.
+)";
+}
+} // namespace
+
+namespace {
+size_t parse_count(const char *name, const char *s) {
+  auto n = strtoul(s, nullptr, 10);
+  if (n == 0) {
+    std::cerr << name << ": must be greater than 0" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  return n;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  config_set_default(config);
+
+  for (;;) {
+    static int flag = 0;
+    constexpr static option long_opts[] = {
+        {"help", no_argument, nullptr, 'h'},
+        {"requests", required_argument, nullptr, 'n'},
+        {"clients", required_argument, nullptr, 'c'},
+        {"threads", required_argument, nullptr, 't'},
+        {"max-concurrent-streams", required_argument, nullptr, 'm'},
+        {"rate", required_argument, nullptr, 'r'},
+        {"path", required_argument, nullptr, 'p'},
+        {"version", required_argument, nullptr, 'v'},
+        {"ciphers", required_argument, &flag, 1},
+        {"groups", required_argument, &flag, 2},
+        {"timeout", required_argument, &flag, 3},
+        {nullptr, 0, nullptr, 0},
+    };
+
+    auto optidx = 0;
+    auto c = getopt_long(argc, argv, "c:hm:n:p:r:t:v:", long_opts, &optidx);
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+    case 'c':
+      // --clients
+      config.nclients = parse_count("clients", optarg);
+      break;
+    case 'h':
+      // --help
+      print_help();
+      exit(EXIT_SUCCESS);
+    case 'm':
+      // --max-concurrent-streams
+      config.max_concurrent_streams =
+          parse_count("max-concurrent-streams", optarg);
+      break;
+    case 'n':
+      // --requests
+      config.nreqs = parse_count("requests", optarg);
+      break;
+    case 'p':
+      // --path
+      config.path = optarg;
+      break;
+    case 'r':
+      // --rate
+      config.rate = strtod(optarg, nullptr);
+      if (config.rate < 0.) {
+        std::cerr << "rate: must not be negative" << std::endl;
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 't':
+      // --threads
+      config.nthreads = parse_count("threads", optarg);
+      break;
+    case 'v':
+      // --version
+      config.version = strtol(optarg, nullptr, 16);
+      break;
+    case '?':
+      print_usage();
+      exit(EXIT_FAILURE);
+    case 0:
+      switch (flag) {
+      case 1:
+        // --ciphers
+        config.ciphers = optarg;
+        break;
+      case 2:
+        // --groups
+        config.groups = optarg;
+        break;
+      case 3:
+        // --timeout
+        config.timeout = strtol(optarg, nullptr, 10);
+        break;
+      }
+      break;
+    default:
+      break;
+    };
+  }
+
+  if (argc - optind < 2) {
+    std::cerr << "Too few arguments" << std::endl;
+    print_usage();
+    exit(EXIT_FAILURE);
+  }
+
+  auto addr = argv[optind++];
+  auto port = argv[optind++];
+
+  if (config.nthreads > config.nclients) {
+    config.nthreads = config.nclients;
+  }
+
+  config.request = "GET ";
+  config.request += config.path;
+  config.request += " HTTP/1.1\r\nHost: ";
+  config.request += addr;
+  config.request += "\r\n\r\n";
+
+  Address remote_addr;
+  if (resolve_addr(remote_addr, addr, port) != 0) {
+    exit(EXIT_FAILURE);
+  }
+
+  auto ssl_ctx = create_ssl_ctx();
+  auto ssl_ctx_d = defer(SSL_CTX_free, ssl_ctx);
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  size_t nclients_assigned = 0;
+  size_t nreqs_assigned = 0;
+
+  for (size_t i = 0; i < config.nthreads; ++i) {
+    auto nclients = config.nclients / config.nthreads +
+                    (i < config.nclients % config.nthreads);
+    nclients_assigned += nclients;
+    // Each worker gets the requests in proportion to its connections.
+    auto nreqs =
+        config.nreqs * nclients_assigned / config.nclients - nreqs_assigned;
+    nreqs_assigned += nreqs;
+
+    workers.push_back(std::make_unique<Worker>(
+        ssl_ctx, remote_addr, addr, nclients, nreqs,
+        config.rate / config.nthreads));
+  }
+
+  auto start = clock_type::now();
+
+  std::vector<std::thread> threads;
+  for (auto &w : workers) {
+    threads.emplace_back([&w]() { w->run(); });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+
+  auto elapsed = seconds_since(start);
+
+  Stats stats{};
+  for (auto &w : workers) {
+    auto &s = w->stats();
+    std::copy(std::begin(s.handshake), std::end(s.handshake),
+              std::back_inserter(stats.handshake));
+    std::copy(std::begin(s.ttfb), std::end(s.ttfb),
+              std::back_inserter(stats.ttfb));
+    std::copy(std::begin(s.request), std::end(s.request),
+              std::back_inserter(stats.request));
+    stats.nreqs_done += s.nreqs_done;
+    stats.nreqs_failed += s.nreqs_failed;
+    stats.nclients_failed += s.nclients_failed;
+    stats.bytes_recv += s.bytes_recv;
+  }
+
+  std::cout << std::fixed << std::setprecision(3) << "finished in " << elapsed
+            << "s, " << std::setprecision(1) << stats.nreqs_done / elapsed
+            << " req/s, " << std::setprecision(2)
+            << stats.bytes_recv / elapsed / 1048576 << " MiB/s\n"
+            << "requests: " << config.nreqs << " total, " << stats.nreqs_done
+            << " succeeded, " << stats.nreqs_failed << " failed\n"
+            << "clients: " << config.nclients << " total, "
+            << stats.nclients_failed << " failed\n"
+            << "response bytes: " << stats.bytes_recv << "\n\n"
+            << std::left << std::setw(12) << "latency(ms)" << std::right
+            << std::setw(10) << "min" << std::setw(10) << "mean"
+            << std::setw(10) << "p50" << std::setw(10) << "p90"
+            << std::setw(10) << "p99" << std::setw(10) << "max" << "\n";
+
+  print_latency("handshake", stats.handshake);
+  print_latency("ttfb", stats.ttfb);
+  print_latency("request", stats.request);
+
+  return stats.nreqs_failed || stats.nclients_failed ? EXIT_FAILURE
+                                                     : EXIT_SUCCESS;
+}
@@ -28,6 +28,7 @@
 #include <algorithm>
 #include <memory>
 #include <fstream>
+#include <thread>
 
 #include <unistd.h>
 #include <getopt.h>
@@ -53,16 +54,85 @@ using namespace ngtcp2;
 
 namespace {
 constexpr size_t NGTCP2_SV_SCIDLEN = 18;
+// NGTCP2_SV_SERVER_IDLEN is the length of server ID embedded in
+// connection ID.  The upper 2 bytes are config.server_id, and the
+// last byte is the worker ID.
+constexpr size_t NGTCP2_SV_SERVER_IDLEN = 3;
+// NGTCP2_SV_MAX_WORKERS is the maximum number of workers.
+constexpr size_t NGTCP2_SV_MAX_WORKERS = 256;
+// NGTCP2_SV_SENDQLEN is the maximum number of packets queued for
+// sending.
+constexpr size_t NGTCP2_SV_SENDQLEN = 1024;
+// NGTCP2_SV_MAX_SENDMMSG is the maximum number of packets written by
+// one sendmmsg call.
+constexpr size_t NGTCP2_SV_MAX_SENDMMSG = 64;
+// NGTCP2_SV_MAX_HANDLER_POOL is the maximum number of Handlers kept
+// for reuse per worker.
+constexpr size_t NGTCP2_SV_MAX_HANDLER_POOL = 64;
 } // namespace
 
 namespace {
-auto randgen = util::make_mt19937();
+thread_local auto randgen = util::make_mt19937();
 } // namespace
 
 namespace {
 Config config{};
 } // namespace
 
+namespace {
+// workers contains all workers.  It is populated before any worker
+// thread starts, and never modified until all of them finish.
+std::vector<std::unique_ptr<Worker>> workers;
+} // namespace
+
+namespace {
+ngtcp2_cid_routing make_cid_routing(size_t cidlen) {
+  auto rt = ngtcp2_cid_routing{};
+  rt.server_idlen = NGTCP2_SV_SERVER_IDLEN;
+  rt.cidlen = cidlen;
+  return rt;
+}
+} // namespace
+
+namespace {
+// generate_server_cid generates connection ID of length |cidlen|
+// which encodes config.server_id and |worker_id|.
+int generate_server_cid(ngtcp2_cid *cid, size_t cidlen, size_t worker_id) {
+  auto rt = make_cid_routing(cidlen);
+
+  std::array<uint8_t, NGTCP2_MAX_CIDLEN> rand;
+  auto dis = std::uniform_int_distribution<uint8_t>(0, 255);
+  std::generate(std::begin(rand), std::end(rand),
+                [&dis]() { return dis(randgen); });
+
+  return ngtcp2_cid_encode_routable(cid, &rt,
+                                    (config.server_id << 8) | worker_id,
+                                    rand.data());
+}
+} // namespace
+
+namespace {
+// find_worker returns the worker which issued |dcid|.  It returns
+// nullptr if |dcid| is not issued by this server.
+Worker *find_worker(const ngtcp2_cid *dcid) {
+  auto rt = make_cid_routing(NGTCP2_SV_SCIDLEN);
+  uint32_t server_id;
+
+  if (ngtcp2_cid_decode_routable(&server_id, &rt, dcid->data, dcid->datalen) !=
+          0 ||
+      (server_id >> 8) != config.server_id) {
+    return nullptr;
+  }
+
+  auto worker_id = server_id & 0xff;
+  if (worker_id >= workers.size()) {
+    return nullptr;
+  }
+
+  return workers[worker_id].get();
+}
+} // namespace
+
 Buffer::Buffer(const uint8_t *data, size_t datalen)
     : buf{data, data + datalen},
       begin(buf.data()),
@@ -314,7 +384,6 @@ auto htp_settings = http_parser_settings{
 
 Stream::Stream(uint64_t stream_id)
     : stream_id(stream_id),
-      streambuf_idx(0),
       tx_stream_offset(0),
       should_send_fin(false),
       resp_state(RESP_IDLE),
@@ -445,6 +514,29 @@ void Stream::buffer_file() {
   should_send_fin = true;
 }
 
+void Stream::read_data(uint64_t offset, size_t maxlen, const uint8_t **pdata,
+                       size_t *pdatalen, uint8_t *pfin) const {
+  auto base = tx_stream_offset;
+
+  for (auto it = std::begin(streambuf); it != std::end(streambuf); ++it) {
+    auto &v = *it;
+    auto end = base + v.bufsize();
+    if (offset < end) {
+      auto n = std::min(static_cast<uint64_t>(maxlen), end - offset);
+      *pdata = v.begin + (offset - base);
+      *pdatalen = n;
+      *pfin = should_send_fin && it + 1 == std::end(streambuf) &&
+              offset + n == end;
+      return;
+    }
+    base = end;
+  }
+
+  *pdata = nullptr;
+  *pdatalen = 0;
+  *pfin = should_send_fin && offset == base;
+}
+
 void Stream::send_status_response(unsigned int status_code,
                                   const std::string &extra_headers) {
   auto body = make_status_body(status_code);
@@ -606,7 +698,7 @@ void retransmitcb(struct ev_loop *loop, ev_timer *w, int revents) {
     case NETWORK_ERR_CLOSE_WAIT:
       return;
     case NETWORK_ERR_SEND_NON_FATAL:
-      s->start_wev();
+      s->add_blocked(h);
       return;
     default:
       s->remove(h);
@@ -621,7 +713,7 @@ void retransmitcb(struct ev_loop *loop, ev_timer *w, int revents) {
     case NETWORK_ERR_CLOSE_WAIT:
       return;
     case NETWORK_ERR_SEND_NON_FATAL:
-      s->start_wev();
+      s->add_blocked(h);
       return;
     default:
       s->remove(h);
@@ -631,6 +723,14 @@ void retransmitcb(struct ev_loop *loop, ev_timer *w, int revents) {
 }
 } // namespace
 
+namespace {
+void hibernatecb(struct ev_loop *loop, ev_timer *w, int revents) {
+  auto h = static_cast<Handler *>(w->data);
+
+  h->hibernate();
+}
+} // namespace
+
 Handler::Handler(struct ev_loop *loop, SSL_CTX *ssl_ctx, Server *server,
                  const ngtcp2_cid *rcid)
     : remote_addr_{},
@@ -642,24 +742,26 @@ Handler::Handler(struct ev_loop *loop, SSL_CTX *ssl_ctx, Server *server,
       fd_(-1),
       ncread_(0),
       shandshake_idx_(0),
+      arena_(nullptr),
       conn_(nullptr),
       rcid_(*rcid),
       crypto_ctx_{},
       sendbuf_{NGTCP2_MAX_PKTLEN_IPV4},
       tx_crypto_offset_(0),
       initial_(true),
-      draining_(false) {
+      draining_(false),
+      write_blocked_(false),
+      hibernated_(false) {
   ev_timer_init(&timer_, timeoutcb, 0., config.timeout);
   timer_.data = this;
   ev_timer_init(&rttimer_, retransmitcb, 0., 0.);
   rttimer_.data = this;
+  ev_timer_init(&hibernatetimer_, hibernatecb, 0., config.hibernate);
+  hibernatetimer_.data = this;
 }
 
 Handler::~Handler() {
-  if (!config.quiet) {
-    std::cerr << "Closing QUIC connection" << std::endl;
-  }
-
+  ev_timer_stop(loop_, &hibernatetimer_);
   ev_timer_stop(loop_, &rttimer_);
   ev_timer_stop(loop_, &timer_);
 
@@ -667,6 +769,8 @@ Handler::~Handler() {
     ngtcp2_conn_del(conn_);
   }
 
+  ngtcp2_arena_del(arena_);
+
   if (ssl_) {
     SSL_free(ssl_);
   }
@@ -867,6 +971,16 @@ int acked_stream_data_offset(ngtcp2_conn *conn, uint64_t stream_id,
 }
 } // namespace
 
+namespace {
+int read_stream_data(ngtcp2_conn *conn, uint64_t stream_id, uint64_t offset,
+                     size_t maxlen, const uint8_t **pdata, size_t *pdatalen,
+                     uint8_t *pfin, void *user_data, void *stream_user_data) {
+  auto h = static_cast<Handler *>(user_data);
+  h->read_stream_data(stream_id, offset, maxlen, pdata, pdatalen, pfin);
+  return 0;
+}
+} // namespace
+
 namespace {
 int stream_close(ngtcp2_conn *conn, uint64_t stream_id, uint16_t app_error_code,
                  void *user_data, void *stream_user_data) {
@@ -885,6 +999,33 @@ int rand(ngtcp2_conn *conn, uint8_t *dest, size_t destlen, ngtcp2_rand_ctx ctx,
 }
 } // namespace
 
+namespace {
+int get_new_connection_id(ngtcp2_conn *conn, ngtcp2_cid *cid, uint8_t *token,
+                          size_t cidlen, void *user_data) {
+  auto h = static_cast<Handler *>(user_data);
+  if (h->get_new_connection_id(cid, token, cidlen) != 0) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+  return 0;
+}
+} // namespace
+
+int Handler::get_new_connection_id(ngtcp2_cid *cid, uint8_t *token,
+                                   size_t cidlen) {
+  if (generate_server_cid(cid, cidlen, server_->worker()->id()) != 0) {
+    return -1;
+  }
+
+  auto dis = std::uniform_int_distribution<uint8_t>(0, 255);
+  std::generate(token, token + NGTCP2_STATELESS_RESET_TOKENLEN,
+                [&dis]() { return dis(randgen); });
+
+  scid_pool_.push_back(*cid);
+  server_->associate_cid(cid, this);
+
+  return 0;
+}
+
 int Handler::init(int fd, const sockaddr *sa, socklen_t salen,
                   const ngtcp2_cid *dcid, uint32_t version) {
   int rv;
@@ -904,15 +1045,20 @@ int Handler::init(int fd, const sockaddr *sa, socklen_t salen,
   }
 
   fd_ = fd;
-  ssl_ = SSL_new(ssl_ctx_);
-  auto bio = BIO_new(create_bio_method());
-  BIO_set_data(bio, this);
-  SSL_set_bio(ssl_, bio, bio);
-  SSL_set_app_data(ssl_, this);
+  if (ssl_) {
+    // Reuse the SSL object of the previous connection.
+    SSL_clear(ssl_);
+  } else {
+    ssl_ = SSL_new(ssl_ctx_);
+    auto bio = BIO_new(create_bio_method());
+    BIO_set_data(bio, this);
+    SSL_set_bio(ssl_, bio, bio);
+    SSL_set_app_data(ssl_, this);
+    SSL_set_msg_callback(ssl_, msg_cb);
+    SSL_set_msg_callback_arg(ssl_, this);
+    SSL_set_key_callback(ssl_, key_cb, this);
+  }
   SSL_set_accept_state(ssl_);
-  SSL_set_msg_callback(ssl_, msg_cb);
-  SSL_set_msg_callback_arg(ssl_, this);
-  SSL_set_key_callback(ssl_, key_cb, this);
 
   auto callbacks = ngtcp2_conn_callbacks{
       nullptr,
@@ -934,6 +1080,8 @@ int Handler::init(int fd, const sockaddr *sa, socklen_t salen,
       nullptr, // recv_server_stateless_retry
       nullptr, // extend_max_stream_id
       rand,
+      ::get_new_connection_id,
+      ::read_stream_data,
   };
 
   ngtcp2_settings settings{};
@@ -945,6 +1093,8 @@ int Handler::init(int fd, const sockaddr *sa, socklen_t salen,
   settings.max_bidi_streams = 100;
   settings.max_uni_streams = 0;
   settings.idle_timeout = config.timeout;
+  settings.flight_recorder_len = config.flight_recorder;
+  settings.max_mem = config.max_mem;
   settings.max_packet_size = NGTCP2_MAX_PKT_SIZE;
   settings.ack_delay_exponent = NGTCP2_DEFAULT_ACK_DELAY_EXPONENT;
   settings.stateless_reset_token_present = 1;
@@ -955,17 +1105,42 @@ int Handler::init(int fd, const sockaddr *sa, socklen_t salen,
                 [&dis]() { return dis(randgen); });
 
   ngtcp2_cid scid;
-  scid.datalen = NGTCP2_SV_SCIDLEN;
-  std::generate(scid.data, scid.data + scid.datalen,
-                [&dis]() { return dis(randgen); });
-
-  rv = ngtcp2_conn_server_new(&conn_, dcid, &scid, version, &callbacks,
-                              &settings, this);
-  if (rv != 0) {
-    std::cerr << "ngtcp2_conn_server_new: " << ngtcp2_strerror(rv) << std::endl;
+  if (generate_server_cid(&scid, NGTCP2_SV_SCIDLEN,
+                          server_->worker()->id()) != 0) {
+    std::cerr << "Could not generate connection ID" << std::endl;
     return -1;
   }
 
+  if (conn_) {
+    rv = ngtcp2_conn_reset(conn_, dcid, &scid, version, &callbacks, &settings,
+                           this);
+    if (rv != 0) {
+      std::cerr << "ngtcp2_conn_reset: " << ngtcp2_strerror(rv) << std::endl;
+      if (rv == NGTCP2_ERR_NOMEM) {
+        // conn_ has been freed.
+        conn_ = nullptr;
+      }
+      return -1;
+    }
+  } else {
+    if (config.arena && !arena_) {
+      rv = ngtcp2_arena_new(&arena_, 0, nullptr);
+      if (rv != 0) {
+        std::cerr << "ngtcp2_arena_new: " << ngtcp2_strerror(rv) << std::endl;
+        return -1;
+      }
+    }
+
+    rv = ngtcp2_conn_server_new(
+        &conn_, dcid, &scid, version, &callbacks, &settings,
+        arena_ ? ngtcp2_arena_get_mem(arena_) : nullptr, this);
+    if (rv != 0) {
+      std::cerr << "ngtcp2_conn_server_new: " << ngtcp2_strerror(rv)
+                << std::endl;
+      return -1;
+    }
+  }
+
   ev_timer_again(loop_, &timer_);
 
   return 0;
@@ -1362,12 +1537,15 @@ int Handler::feed_data(uint8_t *data, size_t datalen) {
 int Handler::on_read(uint8_t *data, size_t datalen) {
   int rv;
 
+  resume();
+
   rv = feed_data(data, datalen);
   if (rv != 0) {
     return rv;
   }
 
   ev_timer_again(loop_, &timer_);
+  ev_timer_again(loop_, &hibernatetimer_);
 
   return 0;
 }
@@ -1379,6 +1557,8 @@ int Handler::on_write(bool retransmit) {
     return 0;
   }
 
+  resume();
+
   if (sendbuf_.size() > 0) {
     auto rv = server_->send_packet(remote_addr_, sendbuf_);
     if (rv != NETWORK_ERR_OK) {
@@ -1455,41 +1635,15 @@ int Handler::on_write(bool retransmit) {
 }
 
 int Handler::on_write_stream(Stream &stream) {
-  if (stream.streambuf_idx == stream.streambuf.size()) {
-    if (stream.should_send_fin) {
-      auto v = Buffer{};
-      if (write_stream_data(stream, 1, v) != 0) {
-        return -1;
-      }
-    }
-    return 0;
-  }
-
-  for (auto it = std::begin(stream.streambuf) + stream.streambuf_idx;
-       it != std::end(stream.streambuf); ++it) {
-    auto &v = *it;
-    auto fin = stream.should_send_fin &&
-               stream.streambuf_idx == stream.streambuf.size() - 1;
-    auto rv = write_stream_data(stream, fin, v);
-    if (rv != 0) {
-      return rv;
-    }
-    if (v.size() > 0) {
-      break;
-    }
-    ++stream.streambuf_idx;
-  }
-
-  return 0;
-}
-
-int Handler::write_stream_data(Stream &stream, int fin, Buffer &data) {
   ssize_t ndatalen;
 
   for (;;) {
-    auto n = ngtcp2_conn_write_stream(
-        conn_, sendbuf_.wpos(), max_pktlen_, &ndatalen, stream.stream_id, fin,
-        data.rpos(), data.size(), util::timestamp(loop_));
+    // The stream data is pulled by read_stream_data while the packet
+    // is built.
+    auto n = ngtcp2_conn_write_stream_source(conn_, sendbuf_.wpos(),
+                                             max_pktlen_, &ndatalen,
+                                             stream.stream_id,
+                                             util::timestamp(loop_));
     if (n < 0) {
       switch (n) {
       case NGTCP2_ERR_STREAM_DATA_BLOCKED:
@@ -1498,7 +1652,7 @@ int Handler::write_stream_data(Stream &stream, int fin, Buffer &data) {
       case NGTCP2_ERR_CONGESTION:
         return 0;
       }
-      std::cerr << "ngtcp2_conn_write_stream: " << ngtcp2_strerror(n)
+      std::cerr << "ngtcp2_conn_write_stream_source: " << ngtcp2_strerror(n)
                 << std::endl;
       return handle_error(n);
     }
@@ -1507,31 +1661,29 @@ int Handler::write_stream_data(Stream &stream, int fin, Buffer &data) {
       return 0;
     }
 
-    if (ndatalen >= 0) {
-      if (fin && static_cast<size_t>(ndatalen) == data.size()) {
-        stream.should_send_fin = false;
-      }
-
-      data.seek(ndatalen);
-    }
-
     sendbuf_.push(n);
 
     auto rv = server_->send_packet(remote_addr_, sendbuf_);
     if (rv != NETWORK_ERR_OK) {
       return rv;
     }
-
-    if (data.size() == 0) {
-      break;
-    }
   }
+}
 
-  return 0;
+void Handler::read_stream_data(uint64_t stream_id, uint64_t offset,
+                               size_t maxlen, const uint8_t **pdata,
+                               size_t *pdatalen, uint8_t *pfin) {
+  auto it = streams_.find(stream_id);
+  assert(it != std::end(streams_));
+  (*it).second->read_data(offset, maxlen, pdata, pdatalen, pfin);
 }
 
 bool Handler::draining() const { return draining_; }
 
+bool Handler::write_blocked() const { return write_blocked_; }
+
+void Handler::set_write_blocked(bool f) { write_blocked_ = f; }
+
 void Handler::start_draining_period() {
   draining_ = true;
 
@@ -1555,6 +1707,12 @@ int Handler::start_closing_period(int liberr) {
 
   std::cerr << "Closing period has started" << std::endl;
 
+  if (config.flight_recorder) {
+    std::cerr << "Flight recorder:" << std::endl;
+    ngtcp2_conn_dump_trace(conn_, NGTCP2_TRACE_FORMAT_TEXT, debug::log_printf,
+                           nullptr);
+  }
+
   sendbuf_.reset();
   assert(sendbuf_.left() >= max_pktlen_);
 
@@ -1607,6 +1765,74 @@ int Handler::send_conn_close() {
   return server_->send_packet(remote_addr_, sendbuf_);
 }
 
+void Handler::release() {
+  if (!config.quiet) {
+    std::cerr << "Closing QUIC connection" << std::endl;
+  }
+
+  ev_timer_stop(loop_, &hibernatetimer_);
+  ev_timer_stop(loop_, &rttimer_);
+  ev_timer_stop(loop_, &timer_);
+
+  // Closing streams unmaps and closes the files they serve.  The
+  // containers keep their capacity for the next connection.
+  streams_.clear();
+  chandshake_.clear();
+  shandshake_.clear();
+  scid_pool_.clear();
+  conn_closebuf_.reset();
+}
+
+void Handler::reset(const ngtcp2_cid *rcid) {
+  resume();
+  sendbuf_.reset();
+
+  timer_.repeat = config.timeout;
+
+  ncread_ = 0;
+  shandshake_idx_ = 0;
+  rcid_ = *rcid;
+  hs_crypto_ctx_ = crypto::Context{};
+  crypto_ctx_ = crypto::Context{};
+  tx_crypto_offset_ = 0;
+  initial_ = true;
+  draining_ = false;
+  write_blocked_ = false;
+}
+
+void Handler::hibernate() {
+  if (hibernated_ || sendbuf_.size() || !shandshake_.empty() ||
+      ngtcp2_conn_hibernate(conn_) != 0) {
+    return;
+  }
+
+  ev_timer_stop(loop_, &hibernatetimer_);
+
+  // The handshake data has been consumed, and all crypto data we sent
+  // has been acknowledged, so these buffers are not used until the
+  // next packet arrives.
+  std::vector<uint8_t>().swap(chandshake_);
+  ncread_ = 0;
+  std::deque<Buffer>().swap(shandshake_);
+  sendbuf_ = Buffer{};
+
+  hibernated_ = true;
+
+  if (!config.quiet) {
+    std::cerr << "Hibernated idle connection" << std::endl;
+  }
+}
+
+void Handler::resume() {
+  if (!hibernated_) {
+    return;
+  }
+
+  sendbuf_ = Buffer{NGTCP2_MAX_PKTLEN_IPV4};
+
+  hibernated_ = false;
+}
+
 void Handler::schedule_retransmit() {
   auto expiry = std::min(ngtcp2_conn_loss_detection_expiry(conn_),
                          ngtcp2_conn_ack_delay_expiry(conn_));
@@ -1655,6 +1881,10 @@ const ngtcp2_cid *Handler::scid() const { return ngtcp2_conn_get_scid(conn_); }
 
 const ngtcp2_cid *Handler::rcid() const { return &rcid_; }
 
+const std::vector<ngtcp2_cid> &Handler::scid_pool() const {
+  return scid_pool_;
+}
+
 Server *Handler::server() const { return server_; }
 
 const Address &Handler::remote_addr() const { return remote_addr_; }
@@ -1688,8 +1918,12 @@ int Handler::remove_tx_stream_data(uint64_t stream_id, uint64_t offset,
   auto it = streams_.find(stream_id);
   assert(it != std::end(streams_));
   auto &stream = (*it).second;
-  ::remove_tx_stream_data(stream->streambuf, stream->streambuf_idx,
-                          stream->tx_stream_offset, offset + datalen);
+  auto &d = stream->streambuf;
+  for (; !d.empty() &&
+         stream->tx_stream_offset + d.front().bufsize() <= offset + datalen;) {
+    stream->tx_stream_offset += d.front().bufsize();
+    d.pop_front();
+  }
 
   if (stream->streambuf.empty() && stream->resp_state == RESP_COMPLETED) {
     rv = ngtcp2_conn_shutdown_stream_read(conn_, stream_id, NGTCP2_APP_NOERROR);
@@ -1753,18 +1987,55 @@ void sreadcb(struct ev_loop *loop, ev_io *w, int revents) {
 }
 } // namespace
 
+namespace {
+void sprepcb(struct ev_loop *loop, ev_prepare *w, int revents) {
+  auto s = static_cast<Server *>(w->data);
+
+  s->on_prepare();
+}
+} // namespace
+
+#ifdef HAVE_LIBURING
+namespace {
+void uring_recvcb(uint8_t *data, size_t datalen, const sockaddr *sa,
+                  socklen_t salen, void *user_data) {
+  auto s = static_cast<Server *>(user_data);
+
+  if (debug::packet_lost(config.rx_loss_prob)) {
+    if (!config.quiet) {
+      std::cerr << "** Simulated incoming packet loss **" << std::endl;
+    }
+    return;
+  }
+
+  if (sa == nullptr || datalen == 0) {
+    return;
+  }
+
+  s->handle_packet(data, datalen, sa, salen);
+}
+} // namespace
+#endif // HAVE_LIBURING
+
 namespace {
 void siginthandler(struct ev_loop *loop, ev_signal *watcher, int revents) {
   ev_break(loop, EVBREAK_ALL);
 }
 } // namespace
 
-Server::Server(struct ev_loop *loop, SSL_CTX *ssl_ctx)
-    : loop_(loop), ssl_ctx_(ssl_ctx), fd_(-1) {
+Server::Server(struct ev_loop *loop, SSL_CTX *ssl_ctx, Worker *worker)
+    : loop_(loop),
+      ssl_ctx_(ssl_ctx),
+      worker_(worker),
+      fd_(-1),
+      sendq_head_(0),
+      sendq_len_(0) {
   ev_io_init(&wev_, swritecb, 0, EV_WRITE);
   ev_io_init(&rev_, sreadcb, 0, EV_READ);
+  ev_prepare_init(&prepev_, sprepcb);
   wev_.data = this;
   rev_.data = this;
+  prepev_.data = this;
   ev_signal_init(&sigintev_, siginthandler, SIGINT);
 }
 
@@ -1779,6 +2050,11 @@ void Server::disconnect(int liberr) {
   config.tx_loss_prob = 0;
 
   ev_io_stop(loop_, &rev_);
+#ifdef HAVE_LIBURING
+  if (uring_) {
+    uring_->stop_recv();
+  }
+#endif // HAVE_LIBURING
 
   ev_signal_stop(loop_, &sigintev_);
 
@@ -1794,6 +2070,14 @@ void Server::disconnect(int liberr) {
 
 void Server::close() {
   ev_io_stop(loop_, &wev_);
+  ev_prepare_stop(loop_, &prepev_);
+
+  // Write CONNECTION_CLOSE queued by disconnect() if possible.
+  flush_sendq();
+
+#ifdef HAVE_LIBURING
+  uring_.reset();
+#endif // HAVE_LIBURING
 
   if (fd_ != -1) {
     ::close(fd_);
@@ -1807,39 +2091,82 @@ int Server::init(int fd) {
   ev_io_set(&wev_, fd_, EV_WRITE);
   ev_io_set(&rev_, fd_, EV_READ);
 
+#ifdef HAVE_LIBURING
+  if (config.io_uring) {
+    uring_ = std::make_unique<Uring>(loop_, uring_recvcb, nullptr, this);
+    if (uring_->init(fd_) != 0) {
+      uring_.reset();
+      return -1;
+    }
+  } else {
+    ev_io_start(loop_, &rev_);
+  }
+#else  // !HAVE_LIBURING
   ev_io_start(loop_, &rev_);
+#endif // !HAVE_LIBURING
+
+  sendq_.resize(NGTCP2_SV_SENDQLEN);
+  ev_prepare_start(loop_, &prepev_);
 
-  ev_signal_start(loop_, &sigintev_);
+  // A signal can be attached to one event loop only.  The other
+  // workers are stopped by the main thread.
+  if (ev_is_default_loop(loop_)) {
+    ev_signal_start(loop_, &sigintev_);
+  }
 
   return 0;
 }
 
 int Server::on_write() {
-  for (auto it = std::cbegin(handlers_); it != std::cend(handlers_);) {
-    auto h = it->second.get();
-    auto rv = h->on_write();
+  auto rv = flush_sendq();
+  if (rv != NETWORK_ERR_OK) {
+    return rv;
+  }
+
+  // Resume the blocked connections in round-robin order.  A
+  // connection which gets blocked again goes to the back of the
+  // queue.
+  for (auto n = blocked_.size(); n > 0 && !blocked_.empty(); --n) {
+    auto key = std::move(blocked_.front());
+    blocked_.pop_front();
+
+    auto it = handlers_.find(key);
+    if (it == std::end(handlers_)) {
+      continue;
+    }
+
+    auto h = (*it).second.get();
+    h->set_write_blocked(false);
+
+    rv = h->on_write();
     switch (rv) {
     case 0:
     case NETWORK_ERR_CLOSE_WAIT:
-      ++it;
       continue;
     case NETWORK_ERR_SEND_NON_FATAL:
+      h->set_write_blocked(true);
+      blocked_.push_back(std::move(key));
       return NETWORK_ERR_SEND_NON_FATAL;
     }
-    it = remove(it);
+    remove(it);
   }
 
   return NETWORK_ERR_OK;
 }
 
+void Server::on_prepare() {
+  if (flush_sendq() == NETWORK_ERR_SEND_NON_FATAL) {
+    start_wev();
+  }
+}
+
 int Server::on_read() {
   sockaddr_union su;
-  socklen_t addrlen = sizeof(su);
+  socklen_t addrlen;
   std::array<uint8_t, 64_k> buf;
-  int rv;
-  ngtcp2_pkt_hd hd;
 
   while (true) {
+    addrlen = sizeof(su);
     auto nread =
         recvfrom(fd_, buf.data(), buf.size(), MSG_DONTWAIT, &su.sa, &addrlen);
     if (nread == -1) {
@@ -1860,119 +2187,149 @@ int Server::on_read() {
       continue;
     }
 
-    if (buf[0] & 0x80) {
-      rv = ngtcp2_pkt_decode_hd_long(&hd, buf.data(), nread);
-    } else {
-      // TODO For Short packet, we just need DCID.
-      rv =
-          ngtcp2_pkt_decode_hd_short(&hd, buf.data(), nread, NGTCP2_SV_SCIDLEN);
-    }
-    if (rv < 0) {
-      std::cerr << "Could not decode QUIC packet header: "
-                << ngtcp2_strerror(rv) << std::endl;
-      return 0;
-    }
+    handle_packet(buf.data(), nread, &su.sa, addrlen);
+  }
+  return 0;
+}
 
-    auto dcid_key = util::make_cid_key(&hd.dcid);
+int Server::handle_packet(uint8_t *data, size_t datalen, const sockaddr *sa,
+                          socklen_t salen) {
+  int rv;
+  ngtcp2_pkt_hd hd;
 
-    auto handler_it = handlers_.find(dcid_key);
-    if (handler_it == std::end(handlers_)) {
-      auto ctos_it = ctos_.find(dcid_key);
-      if (ctos_it == std::end(ctos_)) {
-        constexpr size_t MIN_PKT_SIZE = 1200;
-        if (static_cast<size_t>(nread) < MIN_PKT_SIZE) {
-          if (!config.quiet) {
-            std::cerr << "Initial packet is too short: " << nread << " < "
-                      << MIN_PKT_SIZE << std::endl;
-          }
-          return 0;
-        }
+  if (data[0] & 0x80) {
+    rv = ngtcp2_pkt_decode_hd_long(&hd, data, datalen);
+  } else {
+    // TODO For Short packet, we just need DCID.
+    rv = ngtcp2_pkt_decode_hd_short(&hd, data, datalen, NGTCP2_SV_SCIDLEN);
+  }
+  if (rv < 0) {
+    std::cerr << "Could not decode QUIC packet header: " << ngtcp2_strerror(rv)
+              << std::endl;
+    return 0;
+  }
 
-        rv = ngtcp2_accept(&hd, buf.data(), nread);
-        if (rv == -1) {
-          if (!config.quiet) {
-            std::cerr << "Unexpected packet received" << std::endl;
-          }
-          return 0;
-        }
-        if (rv == 1) {
+  auto dcid_key = util::make_cid_key(&hd.dcid);
+
+  auto handler_it = handlers_.find(dcid_key);
+  if (handler_it == std::end(handlers_)) {
+    auto ctos_it = ctos_.find(dcid_key);
+    if (ctos_it == std::end(ctos_)) {
+      // Initial and 0-RTT Protected packets carry the connection ID
+      // chosen by client.  Other packets carry the connection ID
+      // issued by one of the workers.
+      if (!(data[0] & 0x80) || hd.type == NGTCP2_PKT_HANDSHAKE) {
+        auto w = find_worker(&hd.dcid);
+        if (w && w != worker_) {
           if (!config.quiet) {
-            std::cerr << "Unsupported version: Send Version Negotiation"
-                      << std::endl;
+            std::cerr << "Hand off packet to worker " << w->id() << std::endl;
           }
-          send_version_negotiation(&hd, &su.sa, addrlen);
+          w->handoff(sa, salen, data, datalen);
           return 0;
         }
+      }
 
-        auto h = std::make_unique<Handler>(loop_, ssl_ctx_, this, &hd.dcid);
-        h->init(fd_, &su.sa, addrlen, &hd.scid, hd.version);
+      constexpr size_t MIN_PKT_SIZE = 1200;
+      if (datalen < MIN_PKT_SIZE) {
+        if (!config.quiet) {
+          std::cerr << "Initial packet is too short: " << datalen << " < "
+                    << MIN_PKT_SIZE << std::endl;
+        }
+        return 0;
+      }
 
-        if (h->on_read(buf.data(), nread) != 0) {
-          return 0;
+      rv = ngtcp2_accept(&hd, data, datalen);
+      if (rv == -1) {
+        if (!config.quiet) {
+          std::cerr << "Unexpected packet received" << std::endl;
         }
-        rv = h->on_write();
-        switch (rv) {
-        case 0:
-          break;
-        case NETWORK_ERR_SEND_NON_FATAL:
-          start_wev();
-          break;
-        default:
-          return 0;
+        return 0;
+      }
+      if (rv == 1) {
+        if (!config.quiet) {
+          std::cerr << "Unsupported version: Send Version Negotiation"
+                    << std::endl;
         }
-
-        auto scid = h->scid();
-        auto scid_key = util::make_cid_key(scid);
-        handlers_.emplace(scid_key, std::move(h));
-        ctos_.emplace(dcid_key, scid_key);
+        send_version_negotiation(&hd, sa, salen);
         return 0;
       }
-      if (!config.quiet) {
-        std::cerr << "Forward CID=" << util::format_hex((*ctos_it).first)
-                  << " to CID=" << util::format_hex((*ctos_it).second)
-                  << std::endl;
+
+      auto h = get_handler(&hd.dcid);
+      if (h->init(fd_, sa, salen, &hd.scid, hd.version) != 0) {
+        return 0;
       }
-      handler_it = handlers_.find((*ctos_it).second);
-      assert(handler_it != std::end(handlers_));
-    }
 
-    auto h = (*handler_it).second.get();
-    if (ngtcp2_conn_is_in_closing_period(h->conn())) {
-      // TODO do exponential backoff.
-      rv = h->send_conn_close();
+      if (h->on_read(data, datalen) != 0) {
+        release_handler(std::move(h));
+        return 0;
+      }
+      rv = h->on_write();
       switch (rv) {
       case 0:
       case NETWORK_ERR_SEND_NON_FATAL:
         break;
       default:
-        remove(handler_it);
+        release_handler(std::move(h));
+        return 0;
       }
-      return 0;
-    }
-    if (h->draining()) {
-      return 0;
-    }
 
-    rv = h->on_read(buf.data(), nread);
-    if (rv != 0) {
-      if (rv != NETWORK_ERR_CLOSE_WAIT) {
-        remove(handler_it);
+      auto hp = h.get();
+      auto scid = h->scid();
+      auto scid_key = util::make_cid_key(scid);
+      handlers_.emplace(scid_key, std::move(h));
+      ctos_.emplace(dcid_key, scid_key);
+
+      if (rv == NETWORK_ERR_SEND_NON_FATAL) {
+        add_blocked(hp);
       }
       return 0;
     }
+    if (!config.quiet) {
+      std::cerr << "Forward CID=" << util::format_hex((*ctos_it).first)
+                << " to CID=" << util::format_hex((*ctos_it).second)
+                << std::endl;
+    }
+    handler_it = handlers_.find((*ctos_it).second);
+    assert(handler_it != std::end(handlers_));
+  }
 
-    rv = h->on_write();
+  auto h = (*handler_it).second.get();
+  if (ngtcp2_conn_is_in_closing_period(h->conn())) {
+    // TODO do exponential backoff.
+    rv = h->send_conn_close();
     switch (rv) {
     case 0:
-    case NETWORK_ERR_CLOSE_WAIT:
-      break;
     case NETWORK_ERR_SEND_NON_FATAL:
-      start_wev();
       break;
     default:
       remove(handler_it);
     }
+    return 0;
+  }
+  if (h->draining()) {
+    return 0;
+  }
+
+  rv = h->on_read(data, datalen);
+  if (rv != 0) {
+    if (rv != NETWORK_ERR_CLOSE_WAIT) {
+      remove(handler_it);
+    }
+    return 0;
+  }
+
+  rv = h->on_write();
+  switch (rv) {
+  case 0:
+  case NETWORK_ERR_CLOSE_WAIT:
+    break;
+  case NETWORK_ERR_SEND_NON_FATAL:
+    add_blocked(h);
+    break;
+  default:
+    remove(handler_it);
   }
+
   return 0;
 }
 
@@ -2040,45 +2397,181 @@ int Server::send_packet(Address &remote_addr, Buffer &buf) {
     return NETWORK_ERR_OK;
   }
 
-  int eintr_retries = 5;
-  ssize_t nwrite = 0;
+#ifdef HAVE_LIBURING
+  if (uring_) {
+    auto rv = uring_->send(&remote_addr.su.sa, remote_addr.len, buf.rpos(),
+                           buf.size());
+    if (rv != NETWORK_ERR_OK) {
+      return rv;
+    }
+    buf.reset();
+    return NETWORK_ERR_OK;
+  }
+#endif // HAVE_LIBURING
 
-  do {
-    nwrite = sendto(fd_, buf.rpos(), buf.size(), 0, &remote_addr.su.sa,
-                    remote_addr.len);
-  } while ((nwrite == -1) && (errno == EINTR) && (eintr_retries-- > 0));
+  assert(buf.size() <= std::tuple_size<decltype(TxPacket::data)>::value);
 
-  if (nwrite == -1) {
-    switch (errno) {
-    case EAGAIN:
-    case EINTR:
-    case 0:
-      return NETWORK_ERR_SEND_NON_FATAL;
-    default:
-      std::cerr << "sendto: " << strerror(errno) << std::endl;
-      return NETWORK_ERR_SEND_FATAL;
-    }
+  if (sendq_len_ == sendq_.size() &&
+      flush_sendq() == NETWORK_ERR_SEND_NON_FATAL) {
+    return NETWORK_ERR_SEND_NON_FATAL;
   }
 
-  assert(static_cast<size_t>(nwrite) == buf.size());
+  auto &pkt = sendq_[(sendq_head_ + sendq_len_) % sendq_.size()];
+  pkt.remote_addr = remote_addr;
+  pkt.datalen = buf.size();
+  std::copy_n(buf.rpos(), buf.size(), std::begin(pkt.data));
+  ++sendq_len_;
+
   buf.reset();
 
   return NETWORK_ERR_OK;
 }
 
+#ifdef HAVE_SENDMMSG
+int Server::flush_sendq() {
+  std::array<mmsghdr, NGTCP2_SV_MAX_SENDMMSG> msgs;
+  std::array<iovec, NGTCP2_SV_MAX_SENDMMSG> iovs;
+
+  while (sendq_len_) {
+    auto n = std::min(sendq_len_, msgs.size());
+
+    for (size_t i = 0; i < n; ++i) {
+      auto &pkt = sendq_[(sendq_head_ + i) % sendq_.size()];
+      auto &iov = iovs[i];
+      auto &msg = msgs[i].msg_hdr;
+
+      iov.iov_base = pkt.data.data();
+      iov.iov_len = pkt.datalen;
+
+      msg = msghdr{};
+      msg.msg_name = &pkt.remote_addr.su;
+      msg.msg_namelen = pkt.remote_addr.len;
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+    }
+
+    int nsent;
+
+    do {
+      nsent = sendmmsg(fd_, msgs.data(), n, 0);
+    } while (nsent == -1 && errno == EINTR);
+
+    if (nsent == -1) {
+      switch (errno) {
+      case EAGAIN:
+#  if EAGAIN != EWOULDBLOCK
+      case EWOULDBLOCK:
+#  endif // EAGAIN != EWOULDBLOCK
+        return NETWORK_ERR_SEND_NON_FATAL;
+      default:
+        // The first packet cannot be sent.  Drop it, and let QUIC
+        // recover it.
+        std::cerr << "sendmmsg: " << strerror(errno) << std::endl;
+        nsent = 1;
+      }
+    }
+
+    sendq_head_ = (sendq_head_ + nsent) % sendq_.size();
+    sendq_len_ -= nsent;
+  }
+
+  return NETWORK_ERR_OK;
+}
+#else  // !HAVE_SENDMMSG
+int Server::flush_sendq() {
+  while (sendq_len_) {
+    auto &pkt = sendq_[sendq_head_];
+
+    ssize_t nwrite;
+
+    do {
+      nwrite = sendto(fd_, pkt.data.data(), pkt.datalen, 0,
+                      &pkt.remote_addr.su.sa, pkt.remote_addr.len);
+    } while (nwrite == -1 && errno == EINTR);
+
+    if (nwrite == -1) {
+      switch (errno) {
+      case EAGAIN:
+#  if EAGAIN != EWOULDBLOCK
+      case EWOULDBLOCK:
+#  endif // EAGAIN != EWOULDBLOCK
+        return NETWORK_ERR_SEND_NON_FATAL;
+      default:
+        std::cerr << "sendto: " << strerror(errno) << std::endl;
+      }
+    }
+
+    sendq_head_ = (sendq_head_ + 1) % sendq_.size();
+    --sendq_len_;
+  }
+
+  return NETWORK_ERR_OK;
+}
+#endif // !HAVE_SENDMMSG
+
+void Server::add_blocked(Handler *h) {
+  if (!h->write_blocked()) {
+    h->set_write_blocked(true);
+    blocked_.push_back(util::make_cid_key(h->scid()));
+  }
+
+  start_wev();
+}
+
+void Server::associate_cid(const ngtcp2_cid *cid, const Handler *h) {
+  ctos_.emplace(util::make_cid_key(cid), util::make_cid_key(h->scid()));
+}
+
 void Server::remove(const Handler *h) {
   ctos_.erase(util::make_cid_key(h->rcid()));
-  handlers_.erase(util::make_cid_key(h->scid()));
+  for (auto &cid : h->scid_pool()) {
+    ctos_.erase(util::make_cid_key(&cid));
+  }
+
+  auto it = handlers_.find(util::make_cid_key(h->scid()));
+  if (it == std::end(handlers_)) {
+    return;
+  }
+
+  release_handler(std::move((*it).second));
+  handlers_.erase(it);
 }
 
-std::map<std::string, std::unique_ptr<Handler>>::const_iterator Server::remove(
-    std::map<std::string, std::unique_ptr<Handler>>::const_iterator it) {
+std::map<std::string, std::unique_ptr<Handler>>::iterator
+Server::remove(std::map<std::string, std::unique_ptr<Handler>>::iterator it) {
   ctos_.erase(util::make_cid_key((*it).second->rcid()));
+  for (auto &cid : (*it).second->scid_pool()) {
+    ctos_.erase(util::make_cid_key(&cid));
+  }
+  release_handler(std::move((*it).second));
   return handlers_.erase(it);
 }
 
+std::unique_ptr<Handler> Server::get_handler(const ngtcp2_cid *rcid) {
+  if (handler_pool_.empty()) {
+    return std::make_unique<Handler>(loop_, ssl_ctx_, this, rcid);
+  }
+
+  auto h = std::move(handler_pool_.back());
+  handler_pool_.pop_back();
+
+  h->reset(rcid);
+
+  return h;
+}
+
+void Server::release_handler(std::unique_ptr<Handler> h) {
+  h->release();
+
+  if (handler_pool_.size() < NGTCP2_SV_MAX_HANDLER_POOL) {
+    handler_pool_.push_back(std::move(h));
+  }
+}
+
 void Server::start_wev() { ev_io_start(loop_, &wev_); }
 
+Worker *Server::worker() const { return worker_; }
+
 namespace {
 int alpn_select_proto_cb(SSL *ssl, const unsigned char **out,
                          unsigned char *outlen, const unsigned char *in,
@@ -2317,6 +2810,14 @@ int create_sock(const char *addr, const char *port, int family) {
       }
     }
 
+    // Let the kernel distribute incoming packets among workers.
+    if (config.workers > 1 &&
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &val,
+                   static_cast<socklen_t>(sizeof(val))) == -1) {
+      close(fd);
+      continue;
+    }
+
     if (bind(fd, rp->ai_addr, rp->ai_addrlen) != -1) {
       break;
     }
@@ -2363,8 +2864,109 @@ void close(Server &s) {
 } // namespace
 
 namespace {
+void handoffcb(struct ev_loop *loop, ev_async *w, int revents) {
+  auto worker = static_cast<Worker *>(w->data);
+
+  worker->on_handoff();
+}
+} // namespace
+
+namespace {
+void stopcb(struct ev_loop *loop, ev_async *w, int revents) {
+  ev_break(loop, EVBREAK_ALL);
+}
+} // namespace
+
+Worker::Worker(size_t id, struct ev_loop *loop, SSL_CTX *ssl_ctx)
+    : id_(id),
+      loop_(loop),
+      s4_(std::make_unique<Server>(loop, ssl_ctx, this)),
+      s6_(std::make_unique<Server>(loop, ssl_ctx, this)) {
+  ev_async_init(&handoffev_, handoffcb);
+  handoffev_.data = this;
+  ev_async_init(&stopev_, stopcb);
+  stopev_.data = this;
+
+  ev_async_start(loop_, &handoffev_);
+  ev_async_start(loop_, &stopev_);
+}
+
+Worker::~Worker() {
+  ev_async_stop(loop_, &handoffev_);
+  ev_async_stop(loop_, &stopev_);
+
+  close(*s6_);
+  close(*s4_);
+
+  // Servers must be destroyed before the loop which they use.
+  s6_.reset();
+  s4_.reset();
+
+  if (!ev_is_default_loop(loop_)) {
+    ev_loop_destroy(loop_);
+  }
+}
+
+int Worker::serve(const char *addr, const char *port) {
+  auto ready = false;
+
+  if (!util::numeric_host(addr, AF_INET6)) {
+    if (::serve(*s4_, addr, port, AF_INET) == 0) {
+      ready = true;
+    }
+  }
+
+  if (!util::numeric_host(addr, AF_INET)) {
+    if (::serve(*s6_, addr, port, AF_INET6) == 0) {
+      ready = true;
+    }
+  }
+
+  return ready ? 0 : -1;
+}
+
+void Worker::run() { ev_run(loop_, 0); }
+
+void Worker::stop() { ev_async_send(loop_, &stopev_); }
+
+void Worker::handoff(const sockaddr *sa, socklen_t salen, const uint8_t *data,
+                     size_t datalen) {
+  HandoffPacket pkt;
+  pkt.remote_addr.len = salen;
+  memcpy(&pkt.remote_addr.su.sa, sa, salen);
+  pkt.data.assign(data, data + datalen);
+
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    handoffq_.push_back(std::move(pkt));
+  }
+
+  ev_async_send(loop_, &handoffev_);
+}
+
+void Worker::on_handoff() {
+  std::deque<HandoffPacket> q;
+
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    q.swap(handoffq_);
+  }
+
+  for (auto &pkt : q) {
+    auto &s =
+        pkt.remote_addr.su.storage.ss_family == AF_INET6 ? *s6_ : *s4_;
+    s.handle_packet(pkt.data.data(), pkt.data.size(), &pkt.remote_addr.su.sa,
+                    pkt.remote_addr.len);
+  }
+}
+
+size_t Worker::id() const { return id_; }
+
+namespace {
+std::mutex keylog_mu;
 std::ofstream keylog_file;
 void keylog_callback(const SSL *ssl, const char *line) {
+  std::lock_guard<std::mutex> lock(keylog_mu);
   keylog_file.write(line, strlen(line));
   keylog_file.put('\n');
   keylog_file.flush();
@@ -2388,6 +2990,8 @@ void config_set_default(Config &config) {
                    "CHACHA20-POLY1305-SHA256";
   config.groups = "P-256:X25519:P-384:P-521";
   config.timeout = 30;
+  config.workers = 1;
+  config.hibernate = 5.;
   {
     auto path = realpath(".", nullptr);
     config.htdocs = path;
@@ -2436,6 +3040,49 @@ Options:
               Specify idle timeout in seconds.
               Default: )"
             << config.timeout << R"(
+  -w, --workers=<N>
+              Specify the number  of worker threads.  Each worker has
+              its own event loop and  UDP socket which shares the port
+              with the  other workers using SO_REUSEPORT.   <N> must
+              be in range [1, )"
+            << NGTCP2_SV_MAX_WORKERS << R"(], inclusive.
+              Default: )"
+            << config.workers << R"(
+  --server-id=<ID>
+              Specify server ID which is  embedded in connection IDs so
+              that a load balancer can route packets to this server.
+              <ID> must be in range [0, 65535], inclusive.
+              Default: )"
+            << config.server_id << R"(
+  --io-uring  Use io_uring for  socket I/O instead of libev readiness
+              notification.  Datagrams  are received by multishot
+              recvmsg  with provided  buffers, and  sent in  batches.
+              This option  is available  only if  server is  built with
+              liburing.
+  --flight-recorder=<N>
+              Keep the last <N>  transport events of each connection in
+              memory,  and  print them  out  when the  connection starts
+              closing period.  <N> must be 0 or a power of 2.  0 disables
+              the recorder.
+              Default: )"
+            << config.flight_recorder << R"(
+  --hibernate=<T>
+              Free  the buffers  of a  connection  which has  been idle
+              for <T> seconds  until the next packet  arrives.  0 disables
+              hibernation.
+              Default: )"
+            << config.hibernate << R"(
+  --arena     Allocate the objects of each connection from its own
+              arena, and free them at once when the connection is
+              deleted.  The memory freed by a connection, including
+              the buffers freed  by hibernation, is only reused by the
+              same connection.
+  --max-mem=<SIZE>
+              Stop buffering out  of order data and extending flow
+              control windows of a connection  once it has allocated
+              <SIZE> bytes.  0 means no limit.
+              Default: )"
+            << config.max_mem << R"(
   -h, --help  Display this help and exit.
 )";
 }
@@ -2453,13 +3100,20 @@ int main(int argc, char **argv) {
         {"htdocs", required_argument, nullptr, 'd'},
         {"quiet", no_argument, nullptr, 'q'},
         {"show-secret", no_argument, nullptr, 's'},
+        {"workers", required_argument, nullptr, 'w'},
         {"ciphers", required_argument, &flag, 1},
         {"groups", required_argument, &flag, 2},
         {"timeout", required_argument, &flag, 3},
+        {"server-id", required_argument, &flag, 4},
+        {"io-uring", no_argument, &flag, 5},
+        {"flight-recorder", required_argument, &flag, 6},
+        {"hibernate", required_argument, &flag, 7},
+        {"arena", no_argument, &flag, 8},
+        {"max-mem", required_argument, &flag, 9},
         {nullptr, 0, nullptr, 0}};
 
     auto optidx = 0;
-    auto c = getopt_long(argc, argv, "d:hqr:st:", long_opts, &optidx);
+    auto c = getopt_long(argc, argv, "d:hqr:st:w:", long_opts, &optidx);
     if (c == -1) {
       break;
     }
@@ -2495,6 +3149,17 @@ int main(int argc, char **argv) {
       // --tx-loss
       config.tx_loss_prob = strtod(optarg, nullptr);
       break;
+    case 'w': {
+      // --workers
+      auto n = strtoul(optarg, nullptr, 10);
+      if (n == 0 || n > NGTCP2_SV_MAX_WORKERS) {
+        std::cerr << "workers: must be in range [1, " << NGTCP2_SV_MAX_WORKERS
+                  << "], inclusive" << std::endl;
+        exit(EXIT_FAILURE);
+      }
+      config.workers = n;
+      break;
+    }
     case '?':
       print_usage();
       exit(EXIT_FAILURE);
@@ -2512,6 +3177,50 @@ int main(int argc, char **argv) {
         // --timeout
         config.timeout = strtol(optarg, nullptr, 10);
         break;
+      case 4: {
+        // --server-id
+        auto server_id = strtoul(optarg, nullptr, 10);
+        if (server_id > std::numeric_limits<uint16_t>::max()) {
+          std::cerr << "server-id: must be in range [0, 65535], inclusive"
+                    << std::endl;
+          exit(EXIT_FAILURE);
+        }
+        config.server_id = server_id;
+        break;
+      }
+      case 5:
+        // --io-uring
+#ifdef HAVE_LIBURING
+        config.io_uring = true;
+#else  // !HAVE_LIBURING
+        std::cerr << "io-uring: server is built without liburing"
+                  << std::endl;
+        exit(EXIT_FAILURE);
+#endif // !HAVE_LIBURING
+        break;
+      case 6: {
+        // --flight-recorder
+        auto n = strtoul(optarg, nullptr, 10);
+        if (n & (n - 1)) {
+          std::cerr << "flight-recorder: must be 0 or a power of 2"
+                    << std::endl;
+          exit(EXIT_FAILURE);
+        }
+        config.flight_recorder = n;
+        break;
+      }
+      case 7:
+        // --hibernate
+        config.hibernate = strtod(optarg, nullptr);
+        break;
+      case 8:
+        // --arena
+        config.arena = true;
+        break;
+      case 9:
+        // --max-mem
+        config.max_mem = strtoul(optarg, nullptr, 10);
+        break;
       }
       break;
     default:
@@ -2564,30 +3273,37 @@ int main(int argc, char **argv) {
     }
   }
 
-  auto ready = false;
-
-  Server s4(EV_DEFAULT, ssl_ctx);
-  if (!util::numeric_host(addr, AF_INET6)) {
-    if (serve(s4, addr, port, AF_INET) == 0) {
-      ready = true;
+  // The first worker runs on the default loop in the main thread, and
+  // handles SIGINT.
+  for (size_t i = 0; i < config.workers; ++i) {
+    auto loop = i == 0 ? EV_DEFAULT : ev_loop_new(EVFLAG_AUTO);
+    if (loop == nullptr) {
+      std::cerr << "ev_loop_new: could not create event loop" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    workers.push_back(std::make_unique<Worker>(i, loop, ssl_ctx));
+    if (workers.back()->serve(addr, port) != 0) {
+      exit(EXIT_FAILURE);
     }
   }
 
-  Server s6(EV_DEFAULT, ssl_ctx);
-  if (!util::numeric_host(addr, AF_INET)) {
-    if (serve(s6, addr, port, AF_INET6) == 0) {
-      ready = true;
-    }
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < workers.size(); ++i) {
+    auto w = workers[i].get();
+    threads.emplace_back([w]() { w->run(); });
   }
 
-  if (!ready) {
-    exit(EXIT_FAILURE);
+  workers[0]->run();
+
+  for (size_t i = 1; i < workers.size(); ++i) {
+    workers[i]->stop();
   }
 
-  ev_run(EV_DEFAULT, 0);
+  for (auto &t : threads) {
+    t.join();
+  }
 
-  close(s6);
-  close(s4);
+  workers.clear();
 
   return EXIT_SUCCESS;
 }
@@ -30,9 +30,12 @@
 #endif // HAVE_CONFIG_H
 
 #include <vector>
+#include <array>
 #include <deque>
 #include <map>
 #include <string>
+#include <memory>
+#include <mutex>
 
 #include <ngtcp2/ngtcp2.h>
 
@@ -43,6 +46,7 @@
 #include "network.h"
 #include "crypto.h"
 #include "template.h"
+#include "uring.h"
 
 using namespace ngtcp2;
 
@@ -67,6 +71,31 @@ struct Config {
   uint32_t timeout;
   // show_secret is true if transport secrets should be printed out.
   bool show_secret;
+  // server_id is embedded in every connection ID this server issues
+  // so that a load balancer can route packets to this server.
+  uint32_t server_id;
+  // workers is the number of worker threads.  Each worker has its own
+  // event loop and UDP socket bound to the same port with
+  // SO_REUSEPORT.
+  size_t workers;
+  // io_uring is true if io_uring is used for socket I/O instead of
+  // libev readiness notification.
+  bool io_uring;
+  // flight_recorder is the number of recent transport events each
+  // connection keeps.  They are printed out when a connection starts
+  // closing period.  0 disables the recorder.
+  size_t flight_recorder;
+  // hibernate is the idle time in seconds after which a connection
+  // frees its buffers until the next packet arrives.  0 disables
+  // hibernation.
+  double hibernate;
+  // arena is true if each connection allocates its objects from its
+  // own ngtcp2_arena.
+  bool arena;
+  // max_mem is the maximum number of bytes each connection may
+  // allocate before it stops buffering out of order data and
+  // extending flow control windows.  0 means no limit.
+  size_t max_mem;
 };
 
 struct Buffer {
@@ -116,17 +145,21 @@ struct Stream {
                             const std::string &extra_headers = "");
   void send_redirect_response(unsigned int status_code,
                               const std::string &path);
+  // read_data returns the data at stream |offset| up to |maxlen|
+  // bytes without copying it.
+  void read_data(uint64_t offset, size_t maxlen, const uint8_t **pdata,
+                 size_t *pdatalen, uint8_t *pfin) const;
 
   uint64_t stream_id;
+  // streambuf contains the data to send.  A file is not copied, and
+  // its buffer points to the mapped memory.  The buffers are removed
+  // when they are acknowledged.
   std::deque<Buffer> streambuf;
-  // streambuf_idx is the index in streambuf, which points to the
-  // buffer to send next.
-  size_t streambuf_idx;
   // tx_stream_offset is the offset where all data before offset is
   // acked by the remote endpoint.
   uint64_t tx_stream_offset;
   // should_send_fin tells that fin should be sent after currently
-  // buffered data is sent.  After sending fin, it is set to false.
+  // buffered data is sent.
   bool should_send_fin;
   // resp_state is the state of response.
   int resp_state;
@@ -150,6 +183,7 @@ struct Stream {
 };
 
 class Server;
+class Worker;
 
 class Handler {
 public:
@@ -165,7 +199,9 @@ public:
   int on_read(uint8_t *data, size_t datalen);
   int on_write(bool retransmit = false);
   int on_write_stream(Stream &stream);
-  int write_stream_data(Stream &stream, int fin, Buffer &data);
+  void read_stream_data(uint64_t stream_id, uint64_t offset, size_t maxlen,
+                        const uint8_t **pdata, size_t *pdatalen,
+                        uint8_t *pfin);
   int feed_data(uint8_t *data, size_t datalen);
   ssize_t do_handshake_once(const uint8_t *data, size_t datalen);
   int do_handshake(const uint8_t *data, size_t datalen);
@@ -213,6 +249,10 @@ public:
                        size_t datalen);
   const ngtcp2_cid *scid() const;
   const ngtcp2_cid *rcid() const;
+  // scid_pool returns additional connection IDs issued by this
+  // connection.
+  const std::vector<ngtcp2_cid> &scid_pool() const;
+  int get_new_connection_id(ngtcp2_cid *cid, uint8_t *token, size_t cidlen);
   uint32_t version() const;
   void remove_tx_crypto_data(uint64_t offset, size_t datalen);
   int remove_tx_stream_data(uint64_t stream_id, uint64_t offset,
@@ -221,6 +261,10 @@ public:
   void start_draining_period();
   int start_closing_period(int liberror);
   bool draining() const;
+  // write_blocked returns true if this connection waits for the
+  // socket to become writable.
+  bool write_blocked() const;
+  void set_write_blocked(bool f);
   int handle_error(int liberror);
   int send_conn_close();
 
@@ -230,6 +274,19 @@ public:
              const uint8_t *key, size_t keylen, const uint8_t *iv,
              size_t ivlen);
 
+  // release frees the per-connection resources of this object when
+  // its connection is closed, so that it can be reused by reset.
+  void release();
+  // reset prepares this object, which has been released, for a new
+  // connection.  |rcid| is the destination connection ID which
+  // client chose.
+  void reset(const ngtcp2_cid *rcid);
+
+  // hibernate frees the buffers of this connection if it is idle.
+  void hibernate();
+  // resume allocates the buffers freed by hibernate again.
+  void resume();
+
 private:
   Address remote_addr_;
   size_t max_pktlen_;
@@ -240,14 +297,18 @@ private:
   int fd_;
   ev_timer timer_;
   ev_timer rttimer_;
+  ev_timer hibernatetimer_;
   std::vector<uint8_t> chandshake_;
   size_t ncread_;
   std::deque<Buffer> shandshake_;
   // shandshake_idx_ is the index in shandshake_, which points to the
   // buffer to read next.
   size_t shandshake_idx_;
+  // arena_ is the allocator of conn_ if config.arena is true.
+  ngtcp2_arena *arena_;
   ngtcp2_conn *conn_;
   ngtcp2_cid rcid_;
+  std::vector<ngtcp2_cid> scid_pool_;
   crypto::Context hs_crypto_ctx_;
   crypto::Context crypto_ctx_;
   std::map<uint32_t, std::unique_ptr<Stream>> streams_;
@@ -267,11 +328,22 @@ private:
   bool initial_;
   // draining_ becomes true when draining period starts.
   bool draining_;
+  bool write_blocked_;
+  // hibernated_ is true if the buffers of this connection are freed
+  // by hibernate.
+  bool hibernated_;
+};
+
+// TxPacket is a packet queued for sending.
+struct TxPacket {
+  Address remote_addr;
+  size_t datalen;
+  std::array<uint8_t, NGTCP2_MAX_PKTLEN_IPV4> data;
 };
 
 class Server {
 public:
-  Server(struct ev_loop *loop, SSL_CTX *ssl_ctx);
+  Server(struct ev_loop *loop, SSL_CTX *ssl_ctx, Worker *worker);
   ~Server();
 
   int init(int fd);
@@ -281,25 +353,101 @@ public:
 
   int on_write();
   int on_read();
+  void on_prepare();
+  int handle_packet(uint8_t *data, size_t datalen, const sockaddr *sa,
+                    socklen_t salen);
   int send_version_negotiation(const ngtcp2_pkt_hd *hd, const sockaddr *sa,
                                socklen_t salen);
+  // send_packet queues a packet in |buf|.  The queued packets are
+  // written to the socket together before the event loop blocks.
   int send_packet(Address &remote_addr, Buffer &buf);
+  // flush_sendq writes the queued packets to the socket.  The packets
+  // which cannot be written because the socket is not writable stay
+  // in the queue.
+  int flush_sendq();
+  // add_blocked makes |h| resume writing when the socket becomes
+  // writable.
+  void add_blocked(Handler *h);
+  void associate_cid(const ngtcp2_cid *cid, const Handler *h);
   void remove(const Handler *h);
-  std::map<std::string, std::unique_ptr<Handler>>::const_iterator
-  remove(std::map<std::string, std::unique_ptr<Handler>>::const_iterator it);
+  std::map<std::string, std::unique_ptr<Handler>>::iterator
+  remove(std::map<std::string, std::unique_ptr<Handler>>::iterator it);
+  // get_handler returns a Handler for a new connection whose client
+  // chose |rcid| as destination connection ID.  A Handler released
+  // by a closed connection is reused if available.
+  std::unique_ptr<Handler> get_handler(const ngtcp2_cid *rcid);
+  // release_handler releases |h| whose connection is closed, and
+  // keeps it for reuse.
+  void release_handler(std::unique_ptr<Handler> h);
   void start_wev();
+  Worker *worker() const;
 
 private:
   std::map<std::string, std::unique_ptr<Handler>> handlers_;
+  // handler_pool_ contains the Handlers released by closed
+  // connections, which are reused for new connections.
+  std::vector<std::unique_ptr<Handler>> handler_pool_;
   // ctos_ is a mapping between client's initial destination
-  // connection ID, and server source connection ID.
+  // connection ID, or additional connection ID issued by server, and
+  // server source connection ID.
   std::map<std::string, std::string> ctos_;
   struct ev_loop *loop_;
   SSL_CTX *ssl_ctx_;
+  Worker *worker_;
   int fd_;
   ev_io wev_;
   ev_io rev_;
+  ev_prepare prepev_;
   ev_signal sigintev_;
+  // sendq_ is a ring buffer of packets to send.  sendq_head_ is the
+  // index of the oldest packet, and sendq_len_ is the number of
+  // packets queued.
+  std::vector<TxPacket> sendq_;
+  size_t sendq_head_;
+  size_t sendq_len_;
+  // blocked_ contains the source connection IDs of Handlers which
+  // wait for the socket to become writable, in the order they are
+  // resumed.
+  std::deque<std::string> blocked_;
+#ifdef HAVE_LIBURING
+  std::unique_ptr<Uring> uring_;
+#endif // HAVE_LIBURING
+};
+
+// HandoffPacket is a packet which is received by a worker, but
+// belongs to a connection owned by another worker.
+struct HandoffPacket {
+  Address remote_addr;
+  std::vector<uint8_t> data;
+};
+
+class Worker {
+public:
+  Worker(size_t id, struct ev_loop *loop, SSL_CTX *ssl_ctx);
+  ~Worker();
+
+  int serve(const char *addr, const char *port);
+  void run();
+  // stop makes the event loop return.  This function can be called
+  // from any thread.
+  void stop();
+  // handoff queues a packet to this worker.  This function can be
+  // called from any thread.
+  void handoff(const sockaddr *sa, socklen_t salen, const uint8_t *data,
+               size_t datalen);
+  void on_handoff();
+  size_t id() const;
+
+private:
+  size_t id_;
+  struct ev_loop *loop_;
+  std::unique_ptr<Server> s4_;
+  std::unique_ptr<Server> s6_;
+  ev_async handoffev_;
+  ev_async stopev_;
+  // mu_ protects handoffq_.
+  std::mutex mu_;
+  std::deque<HandoffPacket> handoffq_;
 };
 
 #endif // SERVER_H
@@ -0,0 +1,348 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2018 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "uring.h"
+
+#ifdef HAVE_LIBURING
+
+#  include <cstring>
+#  include <array>
+#  include <iostream>
+#  include <limits>
+
+#  include "template.h"
+
+namespace ngtcp2 {
+
+namespace {
+// URING_ENTRIES is the number of submission queue entries.
+constexpr unsigned int URING_ENTRIES = 512;
+// URING_NRECVBUF is the number of provided receive buffers.  It must
+// be a power of 2.
+constexpr unsigned int URING_NRECVBUF = 256;
+// URING_RECVBUFLEN is the length of a receive buffer.  It must be
+// large enough to hold io_uring_recvmsg_out, the source address, and
+// a QUIC packet.
+constexpr size_t URING_RECVBUFLEN = 4_k;
+// URING_BGID is the buffer group ID of the receive buffers.
+constexpr uint16_t URING_BGID = 0;
+// URING_NSENDSLOT is the maximum number of sendmsg in flight.
+constexpr size_t URING_NSENDSLOT = 256;
+// URING_RECV_DATA is user_data of multishot recvmsg.  sendmsg uses
+// the index to send_slots_ as user_data.
+constexpr uint64_t URING_RECV_DATA = std::numeric_limits<uint64_t>::max();
+} // namespace
+
+namespace {
+void uring_readcb(struct ev_loop *loop, ev_io *w, int revents) {
+  auto u = static_cast<Uring *>(w->data);
+
+  u->on_event();
+}
+} // namespace
+
+namespace {
+void uring_preparecb(struct ev_loop *loop, ev_prepare *w, int revents) {
+  auto u = static_cast<Uring *>(w->data);
+
+  u->submit();
+}
+} // namespace
+
+Uring::Uring(struct ev_loop *loop, UringRecvCallback recv_cb,
+             UringRecvDoneCallback recv_done_cb, void *user_data)
+    : loop_(loop),
+      recv_cb_(recv_cb),
+      recv_done_cb_(recv_done_cb),
+      user_data_(user_data),
+      ring_inited_(false),
+      fd_(-1),
+      buf_ring_(nullptr),
+      recvmsg_{},
+      recv_posted_(false),
+      recv_stopped_(false) {
+  ev_io_init(&rev_, uring_readcb, 0, EV_READ);
+  ev_prepare_init(&prepev_, uring_preparecb);
+  rev_.data = this;
+  prepev_.data = this;
+}
+
+Uring::~Uring() { close(); }
+
+int Uring::init(int fd) {
+  int rv;
+
+  fd_ = fd;
+
+  rv = io_uring_queue_init(URING_ENTRIES, &ring_, 0);
+  if (rv != 0) {
+    std::cerr << "io_uring_queue_init: " << strerror(-rv) << std::endl;
+    return -1;
+  }
+
+  ring_inited_ = true;
+
+  buf_ring_ =
+      io_uring_setup_buf_ring(&ring_, URING_NRECVBUF, URING_BGID, 0, &rv);
+  if (buf_ring_ == nullptr) {
+    std::cerr << "io_uring_setup_buf_ring: " << strerror(-rv) << std::endl;
+    close();
+    return -1;
+  }
+
+  recvbuf_.resize(URING_NRECVBUF * URING_RECVBUFLEN);
+
+  auto mask = io_uring_buf_ring_mask(URING_NRECVBUF);
+  for (unsigned int i = 0; i < URING_NRECVBUF; ++i) {
+    io_uring_buf_ring_add(buf_ring_, recvbuf_.data() + i * URING_RECVBUFLEN,
+                          URING_RECVBUFLEN, i, mask, i);
+  }
+  io_uring_buf_ring_advance(buf_ring_, URING_NRECVBUF);
+
+  // Multishot recvmsg only looks at msg_namelen and msg_controllen.
+  recvmsg_.msg_namelen = sizeof(sockaddr_storage);
+
+  send_slots_.resize(URING_NSENDSLOT);
+  free_slots_.reserve(URING_NSENDSLOT);
+  for (size_t i = URING_NSENDSLOT; i > 0; --i) {
+    free_slots_.push_back(i - 1);
+  }
+
+  if (post_recv() != 0) {
+    close();
+    return -1;
+  }
+
+  submit();
+
+  ev_io_set(&rev_, ring_.ring_fd, EV_READ);
+  ev_io_start(loop_, &rev_);
+  ev_prepare_start(loop_, &prepev_);
+
+  return 0;
+}
+
+void Uring::stop_recv() { recv_stopped_ = true; }
+
+void Uring::close() {
+  ev_prepare_stop(loop_, &prepev_);
+  ev_io_stop(loop_, &rev_);
+
+  if (!ring_inited_) {
+    return;
+  }
+
+  // Flush the queued datagrams, which might include
+  // CONNECTION_CLOSE.  sendmsg on a non-blocking UDP socket completes
+  // inline, so it is done before io_uring is torn down.
+  submit();
+
+  if (buf_ring_) {
+    io_uring_free_buf_ring(&ring_, buf_ring_, URING_NRECVBUF, URING_BGID);
+    buf_ring_ = nullptr;
+  }
+
+  io_uring_queue_exit(&ring_);
+  ring_inited_ = false;
+}
+
+io_uring_sqe *Uring::get_sqe() {
+  auto sqe = io_uring_get_sqe(&ring_);
+  if (sqe) {
+    return sqe;
+  }
+
+  // Submission queue is full.  Hand the queued requests to the kernel
+  // to make room.
+  submit();
+
+  return io_uring_get_sqe(&ring_);
+}
+
+int Uring::post_recv() {
+  auto sqe = get_sqe();
+  if (sqe == nullptr) {
+    return -1;
+  }
+
+  io_uring_prep_recvmsg_multishot(sqe, fd_, &recvmsg_, 0);
+  sqe->flags |= IOSQE_BUFFER_SELECT;
+  sqe->buf_group = URING_BGID;
+  io_uring_sqe_set_data64(sqe, URING_RECV_DATA);
+
+  recv_posted_ = true;
+
+  return 0;
+}
+
+int Uring::send(const sockaddr *sa, socklen_t salen, const uint8_t *data,
+                size_t datalen) {
+  if (free_slots_.empty()) {
+    // All slots are in flight.  They are released when the ring
+    // becomes readable.
+    submit();
+    return NETWORK_ERR_SEND_NON_FATAL;
+  }
+
+  auto sqe = get_sqe();
+  if (sqe == nullptr) {
+    return NETWORK_ERR_SEND_NON_FATAL;
+  }
+
+  auto idx = free_slots_.back();
+  free_slots_.pop_back();
+
+  auto &slot = send_slots_[idx];
+
+  slot.buf.assign(data, data + datalen);
+  slot.iov.iov_base = slot.buf.data();
+  slot.iov.iov_len = slot.buf.size();
+  slot.msg = msghdr{};
+  if (sa) {
+    memcpy(&slot.su, sa, salen);
+    slot.msg.msg_name = &slot.su;
+    slot.msg.msg_namelen = salen;
+  }
+  slot.msg.msg_iov = &slot.iov;
+  slot.msg.msg_iovlen = 1;
+
+  io_uring_prep_sendmsg(sqe, fd_, &slot.msg, 0);
+  io_uring_sqe_set_data64(sqe, idx);
+
+  return NETWORK_ERR_OK;
+}
+
+void Uring::submit() {
+  if (!ring_inited_ || io_uring_sq_ready(&ring_) == 0) {
+    return;
+  }
+
+  auto rv = io_uring_submit(&ring_);
+  if (rv < 0) {
+    std::cerr << "io_uring_submit: " << strerror(-rv) << std::endl;
+  }
+}
+
+void Uring::on_event() {
+  std::array<Completion, 64> cqes;
+  auto recvd = false;
+
+  for (;;) {
+    io_uring_cqe *cqe;
+    unsigned int head;
+    size_t n = 0;
+
+    // Copy completions out of the ring first because the callbacks
+    // might close this object.
+    io_uring_for_each_cqe(&ring_, head, cqe) {
+      if (n == cqes.size()) {
+        break;
+      }
+      cqes[n++] = {io_uring_cqe_get_data64(cqe), cqe->res, cqe->flags};
+    }
+
+    if (n == 0) {
+      break;
+    }
+
+    io_uring_cq_advance(&ring_, n);
+
+    for (size_t i = 0; i < n; ++i) {
+      auto &c = cqes[i];
+      if (c.user_data == URING_RECV_DATA) {
+        handle_recv(c);
+        recvd = true;
+      } else {
+        handle_send(c);
+      }
+      if (!ring_inited_) {
+        return;
+      }
+    }
+  }
+
+  if (!recv_posted_) {
+    // Multishot recvmsg terminates if it runs out of buffers.
+    post_recv();
+  }
+
+  if (recvd && !recv_stopped_ && recv_done_cb_) {
+    recv_done_cb_(user_data_);
+  }
+}
+
+void Uring::handle_recv(const Completion &c) {
+  if (!(c.flags & IORING_CQE_F_MORE)) {
+    recv_posted_ = false;
+  }
+
+  if (c.res < 0) {
+    if (c.res != -ENOBUFS) {
+      std::cerr << "recvmsg: " << strerror(-c.res) << std::endl;
+    }
+    return;
+  }
+
+  if (!(c.flags & IORING_CQE_F_BUFFER)) {
+    return;
+  }
+
+  auto bid = c.flags >> IORING_CQE_BUFFER_SHIFT;
+  auto buf = recvbuf_.data() + bid * URING_RECVBUFLEN;
+
+  auto o = io_uring_recvmsg_validate(buf, c.res, &recvmsg_);
+  if (o && !recv_stopped_ && !(o->flags & MSG_TRUNC)) {
+    auto data = static_cast<uint8_t *>(io_uring_recvmsg_payload(o, &recvmsg_));
+    auto datalen = io_uring_recvmsg_payload_length(o, c.res, &recvmsg_);
+    const sockaddr *sa = nullptr;
+    socklen_t salen = 0;
+    if (o->namelen > 0 && o->namelen <= recvmsg_.msg_namelen) {
+      sa = static_cast<const sockaddr *>(io_uring_recvmsg_name(o));
+      salen = o->namelen;
+    }
+
+    recv_cb_(data, datalen, sa, salen, user_data_);
+
+    if (!ring_inited_) {
+      return;
+    }
+  }
+
+  io_uring_buf_ring_add(buf_ring_, buf, URING_RECVBUFLEN, bid,
+                        io_uring_buf_ring_mask(URING_NRECVBUF), 0);
+  io_uring_buf_ring_advance(buf_ring_, 1);
+}
+
+void Uring::handle_send(const Completion &c) {
+  free_slots_.push_back(c.user_data);
+
+  // A datagram which is not sent is treated as lost.
+  if (c.res < 0 && c.res != -EAGAIN) {
+    std::cerr << "sendmsg: " << strerror(-c.res) << std::endl;
+  }
+}
+
+} // namespace ngtcp2
+
+#endif // HAVE_LIBURING
@@ -0,0 +1,128 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2018 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef URING_H
+#define URING_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif // HAVE_CONFIG_H
+
+#ifdef HAVE_LIBURING
+
+#  include <vector>
+
+#  include <liburing.h>
+#  include <ev.h>
+
+#  include "network.h"
+
+namespace ngtcp2 {
+
+// UringRecvCallback is called for each received datagram.  |sa| is
+// nullptr if the kernel did not report the source address.
+using UringRecvCallback = void (*)(uint8_t *data, size_t datalen,
+                                   const sockaddr *sa, socklen_t salen,
+                                   void *user_data);
+// UringRecvDoneCallback is called after all received datagrams that
+// are available at the moment are passed to UringRecvCallback.
+using UringRecvDoneCallback = void (*)(void *user_data);
+
+// Uring is an alternative to the ev_io based I/O on a UDP socket.  It
+// keeps a multishot recvmsg posted with a ring of provided buffers so
+// that the kernel delivers datagrams without a syscall per packet,
+// and queues outgoing datagrams as sendmsg requests which are
+// submitted together right before the event loop blocks.  The ring
+// file descriptor is watched by the event loop, so timers and other
+// watchers keep working unchanged.
+class Uring {
+public:
+  Uring(struct ev_loop *loop, UringRecvCallback recv_cb,
+        UringRecvDoneCallback recv_done_cb, void *user_data);
+  ~Uring();
+
+  // init sets up io_uring for |fd| and starts receiving.  It returns
+  // 0 if it succeeds, or -1.
+  int init(int fd);
+  // stop_recv stops passing received datagrams to the callbacks.
+  // Sending still works.
+  void stop_recv();
+  // close submits the queued requests, and tears down io_uring.
+  void close();
+
+  // send queues a datagram to |sa|.  |sa| may be nullptr if the
+  // socket is connected.  |data| is copied, and caller may reuse it
+  // immediately.  It returns one of NETWORK_ERR_*.
+  int send(const sockaddr *sa, socklen_t salen, const uint8_t *data,
+           size_t datalen);
+  // submit hands queued requests to the kernel.
+  void submit();
+  // on_event processes completed requests.
+  void on_event();
+
+private:
+  struct SendSlot {
+    msghdr msg;
+    iovec iov;
+    sockaddr_union su;
+    std::vector<uint8_t> buf;
+  };
+
+  struct Completion {
+    uint64_t user_data;
+    int32_t res;
+    uint32_t flags;
+  };
+
+  int post_recv();
+  void handle_recv(const Completion &c);
+  void handle_send(const Completion &c);
+  io_uring_sqe *get_sqe();
+
+  struct ev_loop *loop_;
+  UringRecvCallback recv_cb_;
+  UringRecvDoneCallback recv_done_cb_;
+  void *user_data_;
+  io_uring ring_;
+  bool ring_inited_;
+  int fd_;
+  io_uring_buf_ring *buf_ring_;
+  std::vector<uint8_t> recvbuf_;
+  msghdr recvmsg_;
+  // recv_posted_ is true if multishot recvmsg is in flight.
+  bool recv_posted_;
+  bool recv_stopped_;
+  std::vector<SendSlot> send_slots_;
+  // free_slots_ is a list of indices to send_slots_ which are not
+  // used by sendmsg in flight.
+  std::vector<size_t> free_slots_;
+  ev_io rev_;
+  ev_prepare prepev_;
+};
+
+} // namespace ngtcp2
+
+#endif // HAVE_LIBURING
+
+#endif // URING_H
@@ -155,6 +155,112 @@ typedef struct {
   ngtcp2_realloc realloc;
 } ngtcp2_mem;
 
+/**
+ * @enum
+ *
+ * ngtcp2_mem_subsys is the part of a connection which memory is
+ * allocated for.  See `ngtcp2_conn_get_mem_usage`.
+ */
+typedef enum {
+  /**
+   * NGTCP2_MEM_SUBSYS_CONN is the connection object itself, and the
+   * other per-connection state, such as packet decryption buffer and
+   * keys.
+   */
+  NGTCP2_MEM_SUBSYS_CONN,
+  /**
+   * NGTCP2_MEM_SUBSYS_STRM is the stream objects.
+   */
+  NGTCP2_MEM_SUBSYS_STRM,
+  /**
+   * NGTCP2_MEM_SUBSYS_ROB is the reorder buffers of the streams,
+   * including crypto stream, and the trackers of acknowledged stream
+   * data.
+   */
+  NGTCP2_MEM_SUBSYS_ROB,
+  /**
+   * NGTCP2_MEM_SUBSYS_FRAME is the frames which are queued for
+   * transmission or retransmission.
+   */
+  NGTCP2_MEM_SUBSYS_FRAME,
+  /**
+   * NGTCP2_MEM_SUBSYS_RTB is the sent packets which are waiting for
+   * acknowledgement.
+   */
+  NGTCP2_MEM_SUBSYS_RTB,
+  /**
+   * NGTCP2_MEM_SUBSYS_ACKTR is the received packets which are
+   * tracked in order to send acknowledgement.
+   */
+  NGTCP2_MEM_SUBSYS_ACKTR,
+  /**
+   * NGTCP2_MEM_SUBSYS_PKT is the received packets which are buffered
+   * until keys to decrypt them are available.
+   */
+  NGTCP2_MEM_SUBSYS_PKT,
+  /**
+   * NGTCP2_MEM_SUBSYS_MAX is the number of subsystems.
+   */
+  NGTCP2_MEM_SUBSYS_MAX
+} ngtcp2_mem_subsys;
+
+struct ngtcp2_arena;
+
+/**
+ * @struct
+ *
+ * :type:`ngtcp2_arena` is a region allocator which carves objects
+ * from slabs with size class free lists.  Giving one arena to each
+ * connection keeps the objects of the connection close together, and
+ * lets an application release all of them at once.
+ */
+typedef struct ngtcp2_arena ngtcp2_arena;
+
+/**
+ * @function
+ *
+ * `ngtcp2_arena_new` creates new :type:`ngtcp2_arena`, and assigns
+ * its pointer to |*parena|.  Slabs of |slablen| bytes are allocated
+ * from |mem| on demand.  If |slablen| is 0, the default 4096 is used.
+ * Objects larger than 1024 bytes are allocated from |mem|
+ * individually.  If |mem| is NULL, malloc, free, calloc and realloc
+ * of the C standard library are used.  |mem| must outlive the arena.
+ *
+ * The memory freed to the arena is only reused by the arena.  It is
+ * returned to |mem| when `ngtcp2_arena_del` is called.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :enum:`NGTCP2_ERR_NOMEM`
+ *     Out of memory.
+ * :enum:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     |slablen| is too small to hold the largest size class.
+ */
+NGTCP2_EXTERN int ngtcp2_arena_new(ngtcp2_arena **parena, size_t slablen,
+                                   ngtcp2_mem *mem);
+
+/**
+ * @function
+ *
+ * `ngtcp2_arena_del` frees all memory allocated from |arena| at once,
+ * including the objects which have not been freed yet, and then
+ * frees |arena| itself.  If |arena| is NULL, this function does
+ * nothing.
+ */
+NGTCP2_EXTERN void ngtcp2_arena_del(ngtcp2_arena *arena);
+
+/**
+ * @function
+ *
+ * `ngtcp2_arena_get_mem` returns the memory allocator which allocates
+ * from |arena|.  Pass it to `ngtcp2_conn_client_new` or
+ * `ngtcp2_conn_server_new` to allocate the connection from |arena|.
+ * The arena must outlive the connection, and it must not be shared by
+ * connections which are used by different threads.
+ */
+NGTCP2_EXTERN ngtcp2_mem *ngtcp2_arena_get_mem(ngtcp2_arena *arena);
+
 /* NGTCP2_PROTO_VER_D13 is the supported QUIC protocol version
    draft-13. */
 #define NGTCP2_PROTO_VER_D13 0xff00000du
@@ -216,6 +322,7 @@ typedef enum {
   NGTCP2_ERR_DRAINING = -231,
   NGTCP2_ERR_PKT_ENCODING = -232,
   NGTCP2_ERR_CONGESTION = -233,
+  NGTCP2_ERR_DISCARD_PKT = -234,
   NGTCP2_ERR_FATAL = -500,
   NGTCP2_ERR_NOMEM = -501,
   NGTCP2_ERR_CALLBACK_FAILURE = -502,
@@ -323,6 +430,112 @@ typedef struct {
  */
 void ngtcp2_cid_init(ngtcp2_cid *cid, const uint8_t *data, size_t datalen);
 
+/* NGTCP2_CID_BLOCKLEN is the block length of a cipher which is used
+   to obfuscate routable Connection ID. */
+#define NGTCP2_CID_BLOCKLEN 16
+
+/* NGTCP2_CID_MAX_SERVER_IDLEN is the maximum length of server ID
+   embedded in routable Connection ID. */
+#define NGTCP2_CID_MAX_SERVER_IDLEN 4
+
+/* NGTCP2_CID_MAX_CONFIG_ID is the maximum value of config_id in
+   :type:`ngtcp2_cid_routing`. */
+#define NGTCP2_CID_MAX_CONFIG_ID 3
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_cid_block_cipher` is a callback function which
+ * encrypts or decrypts a single block of length
+ * :macro:`NGTCP2_CID_BLOCKLEN` pointed by |src| and writes the result
+ * into the buffer pointed by |dest|.  |src| and |dest| never overlap.
+ * For example, AES-128-ECB with a secret key shared by all servers
+ * behind the same load balancer is a good choice.
+ *
+ * The callback function must return 0 if it succeeds, or nonzero.
+ */
+typedef int (*ngtcp2_cid_block_cipher)(uint8_t *dest, const uint8_t *src,
+                                       void *user_data);
+
+/**
+ * @struct
+ *
+ * ngtcp2_cid_routing describes the layout of routable Connection ID.
+ * The first byte of routable Connection ID contains |config_id| in
+ * its upper 2 bits, and the remaining 6 bits are random.  It is
+ * followed by server ID of length |server_idlen| in network byte
+ * order, and the random nonce fills the rest of Connection ID.  If
+ * |encrypt| is not ``NULL``, server ID and nonce are encrypted as a
+ * single block, and |cidlen| must be 1 + :macro:`NGTCP2_CID_BLOCKLEN`.
+ */
+typedef struct {
+  /* config_id identifies the configuration which produces Connection
+     ID.  It allows a receiver to change the configuration, e.g., a
+     key, without breaking routing of existing connections.  It must
+     not be greater than NGTCP2_CID_MAX_CONFIG_ID. */
+  uint8_t config_id;
+  /* server_idlen is the length of server ID in bytes.  It must be in
+     range [1, NGTCP2_CID_MAX_SERVER_IDLEN], inclusive. */
+  size_t server_idlen;
+  /* cidlen is the length of Connection ID.  It must be in range
+     [NGTCP2_MIN_CIDLEN, NGTCP2_MAX_CIDLEN], inclusive, and must leave
+     at least 1 byte for nonce. */
+  size_t cidlen;
+  /* encrypt, if not NULL, obfuscates server ID and nonce. */
+  ngtcp2_cid_block_cipher encrypt;
+  /* decrypt is the inverse of encrypt.  It must be set if encrypt is
+     not NULL. */
+  ngtcp2_cid_block_cipher decrypt;
+  /* user_data is passed to encrypt and decrypt. */
+  void *user_data;
+} ngtcp2_cid_routing;
+
+/**
+ * @function
+ *
+ * `ngtcp2_cid_encode_routable` writes routable Connection ID which
+ * encodes |server_id| to |cid| according to the layout described by
+ * |rt|.  |rand| must point to the buffer which contains |rt->cidlen|
+ * bytes of random data.  As long as |rand| differs, the function
+ * produces the distinct Connection ID for the same |server_id|.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :enum:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     |rt| is malformed, or |server_id| does not fit in
+ *     |rt->server_idlen| bytes.
+ * :enum:`NGTCP2_ERR_CALLBACK_FAILURE`
+ *     |rt->encrypt| failed.
+ */
+NGTCP2_EXTERN int ngtcp2_cid_encode_routable(ngtcp2_cid *cid,
+                                             const ngtcp2_cid_routing *rt,
+                                             uint32_t server_id,
+                                             const uint8_t *rand);
+
+/**
+ * @function
+ *
+ * `ngtcp2_cid_decode_routable` decodes server ID from Connection ID
+ * |cid| of length |cidlen| which is produced by
+ * `ngtcp2_cid_encode_routable` with the same |rt|, and stores it in
+ * |*pserver_id|.  |cid| can point directly to Destination Connection
+ * ID field of a received packet.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :enum:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     |rt| is malformed, |cidlen| does not match |rt->cidlen|, or
+ *     config_id in |cid| does not match |rt->config_id|.
+ * :enum:`NGTCP2_ERR_CALLBACK_FAILURE`
+ *     |rt->decrypt| failed.
+ */
+NGTCP2_EXTERN int ngtcp2_cid_decode_routable(uint32_t *pserver_id,
+                                             const ngtcp2_cid_routing *rt,
+                                             const uint8_t *cid,
+                                             size_t cidlen);
+
 typedef struct {
   ngtcp2_cid dcid;
   ngtcp2_cid scid;
@@ -612,12 +825,195 @@ typedef struct {
    ngtcp2_conn_server_new. */
 typedef void (*ngtcp2_printf)(void *user_data, const char *format, ...);
 
+/**
+ * @enum
+ *
+ * ngtcp2_trace_event is the type of :type:`ngtcp2_trace_record`.
+ */
+typedef enum {
+  /* NGTCP2_TRACE_EVENT_PKT_SENT is recorded when a packet is written.
+     a is the length of the packet. */
+  NGTCP2_TRACE_EVENT_PKT_SENT,
+  /* NGTCP2_TRACE_EVENT_PKT_RECV is recorded when a packet is
+     decrypted.  a is the length of the packet. */
+  NGTCP2_TRACE_EVENT_PKT_RECV,
+  /* NGTCP2_TRACE_EVENT_PKT_LOST is recorded when a packet is declared
+     lost.  a is the timestamp when the packet was sent. */
+  NGTCP2_TRACE_EVENT_PKT_LOST,
+  /* NGTCP2_TRACE_EVENT_FRM_SENT is recorded when a frame is written.
+     See `ngtcp2_trace_record` for a, b, and c. */
+  NGTCP2_TRACE_EVENT_FRM_SENT,
+  /* NGTCP2_TRACE_EVENT_FRM_RECV is recorded when a frame is
+     received. */
+  NGTCP2_TRACE_EVENT_FRM_RECV,
+  /* NGTCP2_TRACE_EVENT_CC is recorded when congestion window
+     changes.  a is cwnd, b is ssthresh, and c is bytes in flight of
+     the packet number space. */
+  NGTCP2_TRACE_EVENT_CC,
+  /* NGTCP2_TRACE_EVENT_LOSS_TIMER is recorded when loss detection
+     alarm fires.  a is handshake_count, b is tlp_count, and c is
+     rto_count after the alarm is handled. */
+  NGTCP2_TRACE_EVENT_LOSS_TIMER
+} ngtcp2_trace_event;
+
+/**
+ * @enum
+ *
+ * ngtcp2_trace_flag is the flags of :type:`ngtcp2_trace_record`.
+ */
+typedef enum {
+  NGTCP2_TRACE_FLAG_NONE = 0x00,
+  /* NGTCP2_TRACE_FLAG_LONG_FORM indicates that the packet has long
+     header. */
+  NGTCP2_TRACE_FLAG_LONG_FORM = 0x01,
+  /* NGTCP2_TRACE_FLAG_FIN indicates that STREAM frame has fin bit
+     set. */
+  NGTCP2_TRACE_FLAG_FIN = 0x02
+} ngtcp2_trace_flag;
+
+/**
+ * @struct
+ *
+ * ngtcp2_trace_record is a fixed size binary event record.  Nothing
+ * is formatted when it is recorded.  pkt_num, pkt_type, and flags
+ * describe the packet which the event belongs to.  The meaning of a,
+ * b, and c depends on event.  For frame events, they are:
+ *
+ * - STREAM: a=stream_id, b=offset, c=datalen
+ * - ACK: a=largest_ack, b=ack_delay_unscaled, c=num_blks
+ * - CRYPTO: b=offset, c=datalen
+ * - PADDING: c=len
+ * - RST_STREAM: a=stream_id, b=final_offset, c=app_error_code
+ * - STOP_SENDING: a=stream_id, c=app_error_code
+ * - CONNECTION_CLOSE, APPLICATION_CLOSE: c=error code
+ * - MAX_DATA, MAX_STREAM_ID, BLOCKED: a=value
+ * - MAX_STREAM_DATA, STREAM_BLOCKED: a=stream_id, b=value
+ * - STREAM_ID_BLOCKED: a=stream_id
+ * - NEW_CONNECTION_ID: a=seq
+ *
+ * Unused fields are 0.
+ */
+typedef struct {
+  /* ts is the timestamp of the event. */
+  ngtcp2_tstamp ts;
+  uint64_t pkt_num;
+  uint64_t a;
+  uint64_t b;
+  uint32_t c;
+  /* event is one of ngtcp2_trace_event. */
+  uint8_t event;
+  uint8_t pkt_type;
+  /* flags is bitwise OR of zero or more of ngtcp2_trace_flag. */
+  uint8_t flags;
+  /* frame_type is the type of frame for frame events. */
+  uint8_t frame_type;
+} ngtcp2_trace_record;
+
+/**
+ * @struct
+ *
+ * ngtcp2_trace_ring is a ring buffer of :type:`ngtcp2_trace_record`
+ * which application supplies.  When it is full, the oldest record is
+ * overwritten.  Initialize it with `ngtcp2_trace_ring_init`.
+ */
+typedef struct {
+  ngtcp2_trace_record *records;
+  /* mask is the number of records minus 1. */
+  size_t mask;
+  /* next is the number of records written so far. */
+  uint64_t next;
+} ngtcp2_trace_ring;
+
+/**
+ * @function
+ *
+ * `ngtcp2_trace_ring_init` initializes |ring| to use |records| of
+ * length |nrecords| as a storage.  |nrecords| must be a power of 2.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :enum:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     |nrecords| is not a power of 2.
+ */
+NGTCP2_EXTERN int ngtcp2_trace_ring_init(ngtcp2_trace_ring *ring,
+                                         ngtcp2_trace_record *records,
+                                         size_t nrecords);
+
+/**
+ * @function
+ *
+ * `ngtcp2_trace_ring_len` returns the number of records stored in
+ * |ring|.
+ */
+NGTCP2_EXTERN size_t ngtcp2_trace_ring_len(const ngtcp2_trace_ring *ring);
+
+/**
+ * @function
+ *
+ * `ngtcp2_trace_ring_get` returns |idx|-th oldest record in |ring|.
+ * |idx| must be less than `ngtcp2_trace_ring_len(ring)
+ * <ngtcp2_trace_ring_len>`.
+ */
+NGTCP2_EXTERN const ngtcp2_trace_record *
+ngtcp2_trace_ring_get(const ngtcp2_trace_ring *ring, size_t idx);
+
+/**
+ * @enum
+ *
+ * ngtcp2_trace_format is the output format of `ngtcp2_trace_format`.
+ */
+typedef enum {
+  /* NGTCP2_TRACE_FORMAT_TEXT is a line of text which resembles the
+     log written to :member:`ngtcp2_settings.log_printf`. */
+  NGTCP2_TRACE_FORMAT_TEXT,
+  /* NGTCP2_TRACE_FORMAT_QLOG is a qlog style JSON event object. */
+  NGTCP2_TRACE_FORMAT_QLOG
+} ngtcp2_trace_format_type;
+
+/**
+ * @function
+ *
+ * `ngtcp2_trace_format` writes |rec| in |dest| of length |destlen|
+ * in the format |fmt|, which is one of
+ * :type:`ngtcp2_trace_format_type`.  Timestamp is written relative to
+ * |base_ts|.  The output is NULL-terminated, and has no trailing
+ * newline.
+ *
+ * This function returns the number of bytes written, excluding the
+ * terminating NULL, or one of the following negative error codes:
+ *
+ * :enum:`NGTCP2_ERR_NOBUF`
+ *     Buffer is too small.
+ * :enum:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     |fmt| is unknown.
+ */
+NGTCP2_EXTERN ssize_t ngtcp2_trace_format(char *dest, size_t destlen,
+                                          const ngtcp2_trace_record *rec,
+                                          ngtcp2_tstamp base_ts, int fmt);
+
 typedef struct {
   ngtcp2_preferred_addr preferred_address;
   ngtcp2_tstamp initial_ts;
   /* log_printf is a function that the library uses to write logs.
      NULL means no logging output. */
   ngtcp2_printf log_printf;
+  /* trace is a ring buffer that the library writes binary event
+     records to.  NULL means no tracing.  It must outlive the
+     connection. */
+  ngtcp2_trace_ring *trace;
+  /* flight_recorder_len, if nonzero, is the number of records in the
+     flight recorder which the connection allocates for itself.  The
+     connection records its recent events there in the same way as
+     trace.  It must be 0 or a power of 2.  It is ignored if trace is
+     not NULL. */
+  size_t flight_recorder_len;
+  /* max_mem, if nonzero, is the number of bytes of memory which the
+     connection may hold.  The connection does not fail when the
+     limit is reached.  Instead, it stops extending flow control
+     windows, and drops the packets which it would otherwise buffer
+     until the usage falls below the limit. */
+  size_t max_mem;
   uint32_t max_stream_data;
   uint32_t max_data;
   uint16_t max_bidi_streams;
@@ -660,6 +1056,153 @@ typedef struct {
   ngtcp2_tstamp last_hs_tx_pkt_ts;
 } ngtcp2_rcvry_stat;
 
+/**
+ * @macro
+ *
+ * NGTCP2_CONN_STATS_VERSION is the version of
+ * :type:`ngtcp2_conn_stats` that this library defines.  New fields
+ * are only appended to the end of the struct, and the version is
+ * incremented when it happens.
+ */
+#define NGTCP2_CONN_STATS_VERSION 1
+
+/**
+ * @enum
+ *
+ * ngtcp2_stats_pkt_type is an index to the per packet type counters
+ * in :type:`ngtcp2_conn_stats`.
+ */
+typedef enum {
+  NGTCP2_STATS_PKT_INITIAL,
+  NGTCP2_STATS_PKT_HANDSHAKE,
+  NGTCP2_STATS_PKT_0RTT_PROTECTED,
+  NGTCP2_STATS_PKT_SHORT,
+  NGTCP2_STATS_PKT_MAX
+} ngtcp2_stats_pkt_type;
+
+/**
+ * @struct
+ *
+ * ngtcp2_conn_stats holds the counters of a connection.  Packet
+ * counters only include the packets protected by this library, that
+ * is Version Negotiation, Retry and Stateless Reset are not counted.
+ * Received packets are counted after they are successfully
+ * decrypted.
+ *
+ * Everything is nanoseconds resolution.
+ */
+typedef struct {
+  /* Fields in version 1 */
+  uint64_t pkts_sent[NGTCP2_STATS_PKT_MAX];
+  uint64_t bytes_sent[NGTCP2_STATS_PKT_MAX];
+  uint64_t pkts_recv[NGTCP2_STATS_PKT_MAX];
+  uint64_t bytes_recv[NGTCP2_STATS_PKT_MAX];
+  /* pkts_retransmitted and bytes_retransmitted count the packets
+     which are written to retransmit the frames in lost packets.
+     TLP and RTO probes are not included. */
+  uint64_t pkts_retransmitted;
+  uint64_t bytes_retransmitted;
+  /* pkts_lost is the number of packets declared lost. */
+  uint64_t pkts_lost;
+  /* pkts_spurious_lost is the number of packets which were declared
+     lost, and then acknowledged.  Only the recently lost packets are
+     tracked, so this is a lower bound. */
+  uint64_t pkts_spurious_lost;
+  uint64_t tlp_count;
+  uint64_t rto_count;
+  /* handshake_timeout_count is the number of the retransmissions of
+     handshake packets caused by timeout. */
+  uint64_t handshake_timeout_count;
+  /* acks_sent and acks_recv are the number of ACK frames. */
+  uint64_t acks_sent;
+  uint64_t acks_recv;
+  uint64_t cwnd;
+  uint64_t ssthresh;
+  /* fc_blocked_duration is the total time during which stream data
+     could not be sent because of flow control.  A blocked period
+     starts when the application tries to send stream data but none
+     is allowed, and ends when stream data is sent next time.  The
+     ongoing period is not included. */
+  uint64_t fc_blocked_duration;
+  /* handshake_duration is the time from
+     :member:`ngtcp2_settings.initial_ts` to the completion of the
+     handshake.  It is 0 if handshake has not completed yet. */
+  uint64_t handshake_duration;
+} ngtcp2_conn_stats;
+
+/**
+ * @enum
+ *
+ * ngtcp2_phase is a part of packet processing which is timed when
+ * the library is built with phase timing (``ENABLE_PHASE_TIMING`` in
+ * cmake, or ``--enable-phase-timing`` in configure).
+ */
+typedef enum {
+  /* NGTCP2_PHASE_RECV is the whole `ngtcp2_conn_recv` call. */
+  NGTCP2_PHASE_RECV,
+  /* NGTCP2_PHASE_RECV_DECRYPT_PN is the removal of packet number
+     protection of a packet. */
+  NGTCP2_PHASE_RECV_DECRYPT_PN,
+  /* NGTCP2_PHASE_RECV_DECRYPT is the decryption of a packet
+     payload. */
+  NGTCP2_PHASE_RECV_DECRYPT,
+  /* NGTCP2_PHASE_RECV_DECODE_FRAME is the decoding of a frame. */
+  NGTCP2_PHASE_RECV_DECODE_FRAME,
+  /* NGTCP2_PHASE_RECV_ACK is the processing of an ACK frame,
+     including loss detection. */
+  NGTCP2_PHASE_RECV_ACK,
+  /* NGTCP2_PHASE_RECV_STREAM is the processing of a STREAM frame,
+     including the callbacks to deliver data. */
+  NGTCP2_PHASE_RECV_STREAM,
+  /* NGTCP2_PHASE_WRITE_PKT is the writing of a packet in
+     1RTT protected packet, or 0RTT protected packet. */
+  NGTCP2_PHASE_WRITE_PKT,
+  /* NGTCP2_PHASE_WRITE_ACK is the creation of an ACK frame to
+     write. */
+  NGTCP2_PHASE_WRITE_ACK,
+  /* NGTCP2_PHASE_WRITE_ENCRYPT is the encryption and packet number
+     protection of a packet to write. */
+  NGTCP2_PHASE_WRITE_ENCRYPT,
+  /* NGTCP2_PHASE_RTB_RECV_ACK is the removal of acknowledged packets
+     from the retransmission buffer. */
+  NGTCP2_PHASE_RTB_RECV_ACK,
+  /* NGTCP2_PHASE_RTB_ACKED_STREAM_DATA is the
+     :member:`ngtcp2_conn_callbacks.acked_stream_data_offset`
+     callbacks made for acknowledged packets. */
+  NGTCP2_PHASE_RTB_ACKED_STREAM_DATA,
+  /* NGTCP2_PHASE_RTB_DETECT_LOST is the loss detection in the
+     retransmission buffer. */
+  NGTCP2_PHASE_RTB_DETECT_LOST,
+  NGTCP2_PHASE_MAX
+} ngtcp2_phase;
+
+/**
+ * @macro
+ *
+ * NGTCP2_PHASE_HIST_NBUCKETS is the number of buckets in
+ * :type:`ngtcp2_phase_hist`.
+ */
+#define NGTCP2_PHASE_HIST_NBUCKETS 32
+
+/**
+ * @struct
+ *
+ * ngtcp2_phase_hist is a histogram of the time spent in a phase.  The
+ * unit is a CPU cycle on x86 and aarch64, and nanosecond otherwise.
+ */
+typedef struct {
+  /* count is the number of samples. */
+  uint64_t count;
+  /* sum is the sum of all samples. */
+  uint64_t sum;
+  uint64_t min;
+  uint64_t max;
+  /* buckets[0] counts the samples less than 2, and buckets[i]
+     counts the samples in [2^i, 2^(i+1)).  The last bucket also
+     counts all larger samples. */
+  uint64_t buckets[NGTCP2_PHASE_HIST_NBUCKETS];
+} ngtcp2_phase_hist;
+
 /**
  * @function
  *
@@ -1007,6 +1550,61 @@ typedef int (*ngtcp2_extend_max_stream_id)(ngtcp2_conn *conn,
 typedef int (*ngtcp2_rand)(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
                            ngtcp2_rand_ctx ctx, void *user_data);
 
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_get_new_connection_id` is a callback function to ask
+ * an application for new connection ID.  Application must generate
+ * new unused connection ID with the exact |cidlen| bytes and store it
+ * in |cid|.  It also has to generate stateless reset token into
+ * |token|.  The length of stateless reset token is
+ * :macro:`NGTCP2_STATELESS_RESET_TOKENLEN` and it is guaranteed that
+ * the buffer pointed by |token| has the sufficient space to store the
+ * token.  The library sends new connection ID to the remote endpoint
+ * in NEW_CONNECTION_ID frame after handshake completes, and accepts
+ * Short packet which carries it.  Application which distributes
+ * packets among several processes or threads can use
+ * `ngtcp2_cid_encode_routable` to embed routing information.
+ *
+ * The callback function must return 0 if it succeeds.  Returning
+ * :enum:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
+ * immediately.
+ */
+typedef int (*ngtcp2_get_new_connection_id)(ngtcp2_conn *conn, ngtcp2_cid *cid,
+                                            uint8_t *token, size_t cidlen,
+                                            void *user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_read_stream_data` is invoked by
+ * `ngtcp2_conn_write_stream_source` to ask an application for the
+ * data of stream denoted by |stream_id| while the library builds a
+ * packet.  |offset| is the stream offset of the first byte to send,
+ * and |maxlen| is the maximum number of bytes which the packet can
+ * carry.
+ *
+ * Application must set |*pdata| to the pointer to the data at
+ * |offset|, and |*pdatalen| to its length which must not exceed
+ * |maxlen|.  If the data is the end of the stream, application must
+ * set |*pfin| to nonzero.  The library only references the data, and
+ * it must be kept alive and unchanged until it is acknowledged by
+ * :type:`ngtcp2_acked_stream_data_offset`.  Application typically
+ * returns the pointer to the memory mapped file here, and the data is
+ * copied only once into the packet buffer.  Setting |*pdatalen| to 0
+ * and |*pfin| to 0 tells the library that there is no data to send at
+ * the moment.
+ *
+ * The callback function must return 0 if it succeeds.  Returning
+ * :enum:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
+ * immediately.
+ */
+typedef int (*ngtcp2_read_stream_data)(ngtcp2_conn *conn, uint64_t stream_id,
+                                       uint64_t offset, size_t maxlen,
+                                       const uint8_t **pdata, size_t *pdatalen,
+                                       uint8_t *pfin, void *user_data,
+                                       void *stream_user_data);
+
 typedef struct {
   ngtcp2_client_initial client_initial;
   ngtcp2_recv_client_initial recv_client_initial;
@@ -1031,6 +1629,8 @@ typedef struct {
   ngtcp2_recv_server_stateless_retry recv_server_stateless_retry;
   ngtcp2_extend_max_stream_id extend_max_stream_id;
   ngtcp2_rand rand;
+  ngtcp2_get_new_connection_id get_new_connection_id;
+  ngtcp2_read_stream_data read_stream_data;
 } ngtcp2_conn_callbacks;
 
 /*
@@ -1055,21 +1655,29 @@ NGTCP2_EXTERN int ngtcp2_accept(ngtcp2_pkt_hd *dest, const uint8_t *pkt,
  * initializes it as client.  |dcid| is randomized destination
  * connection ID.  |scid| is source connection ID.  |version| is a
  * QUIC version to use.  |callbacks|, and |settings| must not be NULL,
- * and the function make a copy of each of them.  |user_data| is the
- * arbitrary pointer which is passed to the user-defined callback
- * functions.
+ * and the function make a copy of each of them.  |mem| is a memory
+ * allocator which is used for all allocations made for the
+ * connection.  If |mem| is NULL, malloc, free, calloc and realloc
+ * of the C standard library are used.  |mem| must outlive the
+ * connection.
+ * |user_data| is the arbitrary pointer which is passed to the
+ * user-defined callback functions.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
  *
  * :enum:`NGTCP2_ERR_NOMEM`
  *     Out of memory.
+ * :enum:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     :member:`ngtcp2_settings.flight_recorder_len` is not a power of
+ *     2.
  */
 NGTCP2_EXTERN int
 ngtcp2_conn_client_new(ngtcp2_conn **pconn, const ngtcp2_cid *dcid,
                        const ngtcp2_cid *scid, uint32_t version,
                        const ngtcp2_conn_callbacks *callbacks,
-                       const ngtcp2_settings *settings, void *user_data);
+                       const ngtcp2_settings *settings, ngtcp2_mem *mem,
+                       void *user_data);
 
 /**
  * @function
@@ -1078,20 +1686,28 @@ ngtcp2_conn_client_new(ngtcp2_conn **pconn, const ngtcp2_cid *dcid,
  * initializes it as server.  |dcid| is a destination connection ID.
  * |scid| is a source connection ID.  |version| is a QUIC version to
  * use.  |callbacks|, and |settings| must not be NULL, and the
- * function make a copy of each of them.  |user_data| is the arbitrary
- * pointer which is passed to the user-defined callback functions.
+ * function make a copy of each of them.  |mem| is a memory allocator
+ * which is used for all allocations made for the connection.  If
+ * |mem| is NULL, malloc, free, calloc and realloc of the C standard
+ * library are used.  |mem| must outlive the connection.
+ * |user_data| is the arbitrary pointer which is passed to the
+ * user-defined callback functions.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
  *
  * :enum:`NGTCP2_ERR_NOMEM`
  *     Out of memory.
+ * :enum:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     :member:`ngtcp2_settings.flight_recorder_len` is not a power of
+ *     2.
  */
 NGTCP2_EXTERN int
 ngtcp2_conn_server_new(ngtcp2_conn **pconn, const ngtcp2_cid *dcid,
                        const ngtcp2_cid *scid, uint32_t version,
                        const ngtcp2_conn_callbacks *callbacks,
-                       const ngtcp2_settings *settings, void *user_data);
+                       const ngtcp2_settings *settings, ngtcp2_mem *mem,
+                       void *user_data);
 
 /**
  * @function
@@ -1101,6 +1717,40 @@ ngtcp2_conn_server_new(ngtcp2_conn **pconn, const ngtcp2_cid *dcid,
  */
 NGTCP2_EXTERN void ngtcp2_conn_del(ngtcp2_conn *conn);
 
+/**
+ * @function
+ *
+ * `ngtcp2_conn_reset` reinitializes |conn| for a new connection as if
+ * it were created by `ngtcp2_conn_client_new` or
+ * `ngtcp2_conn_server_new` with the given parameters.  |conn| keeps
+ * its role, that is, client or server, and the memory allocator.  The
+ * state of the previous connection is discarded without invoking any
+ * callback.
+ *
+ * The object pointed by |conn|, and the buffers which do not depend
+ * on the connection state, such as the buffer to decrypt packets, the
+ * freed stream objects, and the flight recorder of the same length,
+ * are reused, so that a server which accepts a connection after
+ * another one is closed does not free and allocate them again.
+ *
+ * |callbacks| and |settings| must not point to the memory inside
+ * |conn|.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :enum:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     settings->flight_recorder_len is not 0 nor a power of 2.  |conn|
+ *     is left unchanged.
+ * :enum:`NGTCP2_ERR_NOMEM`
+ *     Out of memory.  |conn| is freed, and must not be used.
+ */
+NGTCP2_EXTERN int ngtcp2_conn_reset(ngtcp2_conn *conn, const ngtcp2_cid *dcid,
+                                    const ngtcp2_cid *scid, uint32_t version,
+                                    const ngtcp2_conn_callbacks *callbacks,
+                                    const ngtcp2_settings *settings,
+                                    void *user_data);
+
 /**
  * @function
  *
@@ -1234,6 +1884,9 @@ NGTCP2_EXTERN int ngtcp2_conn_get_handshake_completed(ngtcp2_conn *conn);
  *
  * :enum:`NGTCP2_ERR_NOMEM`
  *     Out of memory.
+ * :enum:`NGTCP2_ERR_INVALID_STATE`
+ *     Initial and Handshake state has been discarded because the
+ *     handshake has been confirmed.
  */
 NGTCP2_EXTERN int
 ngtcp2_conn_set_initial_tx_keys(ngtcp2_conn *conn, const uint8_t *key,
@@ -1252,6 +1905,9 @@ ngtcp2_conn_set_initial_tx_keys(ngtcp2_conn *conn, const uint8_t *key,
  *
  * :enum:`NGTCP2_ERR_NOMEM`
  *     Out of memory.
+ * :enum:`NGTCP2_ERR_INVALID_STATE`
+ *     Initial and Handshake state has been discarded because the
+ *     handshake has been confirmed.
  */
 NGTCP2_EXTERN int
 ngtcp2_conn_set_initial_rx_keys(ngtcp2_conn *conn, const uint8_t *key,
@@ -1270,6 +1926,9 @@ ngtcp2_conn_set_initial_rx_keys(ngtcp2_conn *conn, const uint8_t *key,
  *
  * :enum:`NGTCP2_ERR_NOMEM`
  *     Out of memory.
+ * :enum:`NGTCP2_ERR_INVALID_STATE`
+ *     Initial and Handshake state has been discarded because the
+ *     handshake has been confirmed.
  */
 NGTCP2_EXTERN int ngtcp2_conn_set_handshake_tx_keys(
     ngtcp2_conn *conn, const uint8_t *key, size_t keylen, const uint8_t *iv,
@@ -1287,6 +1946,9 @@ NGTCP2_EXTERN int ngtcp2_conn_set_handshake_tx_keys(
  *
  * :enum:`NGTCP2_ERR_NOMEM`
  *     Out of memory.
+ * :enum:`NGTCP2_ERR_INVALID_STATE`
+ *     Initial and Handshake state has been discarded because the
+ *     handshake has been confirmed.
  */
 NGTCP2_EXTERN int ngtcp2_conn_set_handshake_rx_keys(
     ngtcp2_conn *conn, const uint8_t *key, size_t keylen, const uint8_t *iv,
@@ -1573,6 +2235,30 @@ ngtcp2_conn_write_stream(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
                          ssize_t *pdatalen, uint64_t stream_id, uint8_t fin,
                          const uint8_t *data, size_t datalen, ngtcp2_tstamp ts);
 
+/**
+ * @function
+ *
+ * `ngtcp2_conn_write_stream_source` is like
+ * `ngtcp2_conn_write_stream`, but the stream data is obtained by
+ * :type:`ngtcp2_read_stream_data` callback when the packet is built.
+ * The callback is asked for the data at the current stream offset,
+ * and the amount is capped by |destlen| and flow control.  The
+ * callback must be set in :type:`ngtcp2_conn_callbacks`.
+ *
+ * If the callback tells that there is no data to send, this function
+ * returns 0, and |*pdatalen| would be -1 if |pdatalen| is not NULL.
+ *
+ * This function must not be called from inside the callback
+ * functions.
+ *
+ * This function returns the number of bytes written in |dest| if it
+ * succeeds, or one of the negative error codes that
+ * `ngtcp2_conn_write_stream` returns.
+ */
+NGTCP2_EXTERN ssize_t ngtcp2_conn_write_stream_source(
+    ngtcp2_conn *conn, uint8_t *dest, size_t destlen, ssize_t *pdatalen,
+    uint64_t stream_id, ngtcp2_tstamp ts);
+
 /**
  * @function
  *
@@ -1726,6 +2412,120 @@ NGTCP2_EXTERN void ngtcp2_conn_early_data_rejected(ngtcp2_conn *conn);
 NGTCP2_EXTERN void ngtcp2_conn_get_rcvry_stat(ngtcp2_conn *conn,
                                               ngtcp2_rcvry_stat *rcs);
 
+/**
+ * @function
+ *
+ * `ngtcp2_conn_get_trace` returns the ring buffer which |conn| writes
+ * its event records to.  It is either
+ * :member:`ngtcp2_settings.trace` or the flight recorder of |conn|.
+ * It returns NULL if neither is enabled.
+ */
+NGTCP2_EXTERN const ngtcp2_trace_ring *
+ngtcp2_conn_get_trace(ngtcp2_conn *conn);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_dump_trace` formats the event records of |conn|,
+ * oldest first, in the format |fmt| (see `ngtcp2_trace_format`), and
+ * passes each line to |print| with |user_data|.  Timestamp is
+ * relative to :member:`ngtcp2_settings.initial_ts`.  Records are only
+ * formatted in this function, so it is intended to be called when a
+ * connection fails, or on demand.  It does nothing if tracing is not
+ * enabled.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :enum:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     |fmt| is unknown.
+ */
+NGTCP2_EXTERN int ngtcp2_conn_dump_trace(ngtcp2_conn *conn, int fmt,
+                                         ngtcp2_printf print,
+                                         void *user_data);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_get_stats` stores the counters of |conn| in the object
+ * pointed by |stats|.  |version| must be the version of
+ * :type:`ngtcp2_conn_stats` which the application is compiled with,
+ * that is :macro:`NGTCP2_CONN_STATS_VERSION`.  Only the fields of
+ * |version| are written, so an application built against an older
+ * header keeps working with a newer library.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :enum:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     |version| is not supported.
+ */
+NGTCP2_EXTERN int ngtcp2_conn_get_stats(ngtcp2_conn *conn, int version,
+                                        ngtcp2_conn_stats *stats);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_get_mem_usage` returns the number of bytes of memory
+ * which |conn| currently holds for |subsys|.  The count includes the
+ * bookkeeping overhead of each allocation, but not the overhead of
+ * the memory allocator.  It returns 0 if |subsys| is not one of
+ * :type:`ngtcp2_mem_subsys`.
+ */
+NGTCP2_EXTERN size_t ngtcp2_conn_get_mem_usage(ngtcp2_conn *conn,
+                                               ngtcp2_mem_subsys subsys);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_get_total_mem_usage` returns the number of bytes of
+ * memory which |conn| currently holds for all subsystems.  This is
+ * the value compared against :member:`ngtcp2_settings.max_mem`.
+ */
+NGTCP2_EXTERN size_t ngtcp2_conn_get_total_mem_usage(ngtcp2_conn *conn);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_get_phase_hist` stores the histogram of |phase| of
+ * |conn| in the object pointed by |hist|.  |phase| is one of
+ * :type:`ngtcp2_phase`.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :enum:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     |phase| is not supported.
+ * :enum:`NGTCP2_ERR_INVALID_STATE`
+ *     The library is built without phase timing.
+ */
+NGTCP2_EXTERN int ngtcp2_conn_get_phase_hist(ngtcp2_conn *conn, int phase,
+                                             ngtcp2_phase_hist *hist);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_hibernate` frees the buffers of |conn| which are only
+ * needed while packets are exchanged, so that an idle connection
+ * occupies little more than the :type:`ngtcp2_conn` object itself.
+ * The buffers are allocated again when they are next needed, so the
+ * application uses |conn| as usual after this call, and the next
+ * incoming packet restores it transparently.
+ *
+ * |conn| must be idle: the handshake must be confirmed, and there
+ * must be no packet in flight, no pending frame, and no pending
+ * acknowledgement.  The application should call this function after
+ * |conn| has been idle for a while, rather than after every write,
+ * because the buffers are allocated again on the next packet.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :enum:`NGTCP2_ERR_INVALID_STATE`
+ *     |conn| is not idle.
+ */
+NGTCP2_EXTERN int ngtcp2_conn_hibernate(ngtcp2_conn *conn);
+
 /**
  * @struct
  *
@@ -1772,6 +2572,12 @@ NGTCP2_EXTERN int ngtcp2_conn_on_loss_detection_alarm(ngtcp2_conn *conn,
  * Application should keep the buffer pointed by |data| alive until
  * the data is acknowledged.  The acknowledgement is notified by
  * :type:`ngtcp2_acked_crypto_offset` callback.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :enum:`NGTCP2_ERR_NOMEM`
+ *     Out of memory
  */
 NGTCP2_EXTERN int ngtcp2_conn_submit_crypto_data(ngtcp2_conn *conn,
                                                  const uint8_t *data,
@@ -25,6 +25,7 @@
 #include "ngtcp2_acktr.h"
 
 #include <assert.h>
+#include <string.h>
 
 #include "ngtcp2_conn.h"
 #include "ngtcp2_macro.h"
@@ -52,8 +53,10 @@ int ngtcp2_acktr_init(ngtcp2_acktr *acktr, int delayed_ack, ngtcp2_log *log,
                       ngtcp2_mem *mem) {
   int rv;
 
-  rv = ngtcp2_ringbuf_init(&acktr->acks, 128, sizeof(ngtcp2_acktr_ack_entry),
-                           mem);
+  ngtcp2_ringbuf_init_growable(&acktr->acks, 128,
+                               sizeof(ngtcp2_acktr_ack_entry), mem);
+
+  rv = ngtcp2_ringbuf_reserve(&acktr->acks);
   if (rv != 0) {
     return rv;
   }
@@ -69,13 +72,14 @@ int ngtcp2_acktr_init(ngtcp2_acktr *acktr, int delayed_ack, ngtcp2_log *log,
   acktr->flags =
       delayed_ack ? NGTCP2_ACKTR_FLAG_DELAYED_ACK : NGTCP2_ACKTR_FLAG_NONE;
   acktr->first_unacked_ts = UINT64_MAX;
+  acktr->max_pkt_num = 0;
+  acktr->nlate = 0;
+  acktr->ack.ackfr.ack.type = NGTCP2_FRAME_ACK;
 
   return 0;
 }
 
 void ngtcp2_acktr_free(ngtcp2_acktr *acktr) {
-  ngtcp2_acktr_ack_entry *ack_ent;
-  size_t i;
   ngtcp2_ksl_it it;
 
   if (acktr == NULL) {
@@ -88,17 +92,191 @@ void ngtcp2_acktr_free(ngtcp2_acktr *acktr) {
   }
   ngtcp2_ksl_free(&acktr->ents);
 
-  for (i = 0; i < acktr->acks.len; ++i) {
-    ack_ent = ngtcp2_ringbuf_get(&acktr->acks, i);
-    ngtcp2_mem_free(acktr->mem, ack_ent->ack);
-  }
   ngtcp2_ringbuf_free(&acktr->acks);
 }
 
+/*
+ * acktr_remove_below removes all entries which have the packet number
+ * that is equal to or less than |pkt_num|.  This function does not
+ * update acktr->ack.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory.
+ */
+static int acktr_remove_below(ngtcp2_acktr *acktr, uint64_t pkt_num) {
+  ngtcp2_ksl_it it;
+  ngtcp2_acktr_entry *ent;
+  int rv;
+
+  it = ngtcp2_ksl_lower_bound(&acktr->ents, (int64_t)pkt_num);
+
+  for (; !ngtcp2_ksl_it_end(&it);) {
+    ent = ngtcp2_ksl_it_get(&it);
+    rv = ngtcp2_ksl_remove(&acktr->ents, &it, (int64_t)ent->pkt_num);
+    if (rv != 0) {
+      return rv;
+    }
+    ngtcp2_acktr_entry_del(ent, acktr->mem);
+  }
+
+  return 0;
+}
+
+/*
+ * acktr_ack_truncate removes the packet numbers which are equal to or
+ * less than |pkt_num| from acktr->ack.
+ */
+static void acktr_ack_truncate(ngtcp2_acktr *acktr, uint64_t pkt_num) {
+  ngtcp2_ack *ack = &acktr->ack.ackfr.ack;
+  uint64_t largest_ack = ack->largest_ack;
+  uint64_t min_ack = largest_ack - ack->first_ack_blklen;
+  size_t i;
+
+  if (acktr->flags & NGTCP2_ACKTR_FLAG_ACK_DIRTY) {
+    return;
+  }
+
+  if (min_ack <= pkt_num) {
+    if (largest_ack > pkt_num) {
+      ack->first_ack_blklen = largest_ack - pkt_num - 1;
+    }
+    ack->num_blks = 0;
+    return;
+  }
+
+  for (i = 0; i < ack->num_blks; ++i) {
+    largest_ack = min_ack - ack->blks[i].gap - 2;
+    if (largest_ack <= pkt_num) {
+      ack->num_blks = i;
+      return;
+    }
+    min_ack = largest_ack - ack->blks[i].blklen;
+    if (min_ack <= pkt_num) {
+      ack->blks[i].blklen = largest_ack - pkt_num - 1;
+      ack->num_blks = i + 1;
+      return;
+    }
+  }
+}
+
+/*
+ * acktr_ack_min returns the smallest packet number which acktr->ack
+ * acknowledges.
+ */
+static uint64_t acktr_ack_min(ngtcp2_acktr *acktr) {
+  ngtcp2_ack *ack = &acktr->ack.ackfr.ack;
+  uint64_t min_ack = ack->largest_ack - ack->first_ack_blklen;
+  size_t i;
+
+  for (i = 0; i < ack->num_blks; ++i) {
+    min_ack -= ack->blks[i].gap + 2 + ack->blks[i].blklen;
+  }
+
+  return min_ack;
+}
+
+/*
+ * acktr_ack_push adds |pkt_num| which is larger than
+ * acktr->ack.ackfr.ack.largest_ack + 1 to acktr->ack.  If acktr->ack
+ * has NGTCP2_ACKTR_MAX_ACK_BLKS ranges, the last range is removed
+ * along with the entries which it acknowledges.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory.
+ */
+static int acktr_ack_push(ngtcp2_acktr *acktr, uint64_t pkt_num) {
+  ngtcp2_ack *ack = &acktr->ack.ackfr.ack;
+  int rv;
+
+  if (ack->num_blks == NGTCP2_ACKTR_MAX_ACK_BLKS - 1) {
+    --ack->num_blks;
+    rv = acktr_remove_below(acktr, acktr_ack_min(acktr) - 1);
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
+  memmove(&ack->blks[1], &ack->blks[0],
+          sizeof(ngtcp2_ack_blk) * ack->num_blks);
+
+  ack->blks[0].gap = pkt_num - ack->largest_ack - 2;
+  ack->blks[0].blklen = ack->first_ack_blklen;
+  ++ack->num_blks;
+
+  ack->largest_ack = pkt_num;
+  ack->first_ack_blklen = 0;
+
+  return 0;
+}
+
+/*
+ * acktr_ack_rebuild builds acktr->ack from acktr->ents.  The entries
+ * which do not fit into NGTCP2_ACKTR_MAX_ACK_BLKS ranges are removed.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory.
+ */
+static int acktr_ack_rebuild(ngtcp2_acktr *acktr) {
+  ngtcp2_ack *ack = &acktr->ack.ackfr.ack;
+  ngtcp2_ksl_it it;
+  ngtcp2_acktr_entry *ent;
+  uint64_t min_ack;
+  ngtcp2_ack_blk *blk = NULL;
+  int rv;
+
+  it = ngtcp2_ksl_begin(&acktr->ents);
+  ent = ngtcp2_ksl_it_get(&it);
+
+  ack->largest_ack = min_ack = ent->pkt_num;
+  ack->first_ack_blklen = 0;
+  ack->num_blks = 0;
+
+  for (ngtcp2_ksl_it_next(&it); !ngtcp2_ksl_it_end(&it);
+       ngtcp2_ksl_it_next(&it)) {
+    ent = ngtcp2_ksl_it_get(&it);
+    if (ent->pkt_num + 1 == min_ack) {
+      min_ack = ent->pkt_num;
+      if (blk) {
+        ++blk->blklen;
+      } else {
+        ++ack->first_ack_blklen;
+      }
+      continue;
+    }
+
+    if (ack->num_blks == NGTCP2_ACKTR_MAX_ACK_BLKS - 1) {
+      rv = acktr_remove_below(acktr, ent->pkt_num);
+      if (rv != 0) {
+        return rv;
+      }
+      break;
+    }
+
+    blk = &ack->blks[ack->num_blks++];
+    blk->gap = min_ack - ent->pkt_num - 2;
+    blk->blklen = 0;
+    min_ack = ent->pkt_num;
+  }
+
+  acktr->flags &= (uint16_t)~NGTCP2_ACKTR_FLAG_ACK_DIRTY;
+
+  return 0;
+}
+
 int ngtcp2_acktr_add(ngtcp2_acktr *acktr, ngtcp2_acktr_entry *ent,
                      int active_ack, ngtcp2_tstamp ts) {
   ngtcp2_ksl_it it;
   ngtcp2_acktr_entry *delent;
+  ngtcp2_ack *ack = &acktr->ack.ackfr.ack;
   int rv;
 
   it = ngtcp2_ksl_lower_bound(&acktr->ents, (int64_t)ent->pkt_num);
@@ -113,6 +291,33 @@ int ngtcp2_acktr_add(ngtcp2_acktr *acktr, ngtcp2_acktr_entry *ent,
     return rv;
   }
 
+  if (ent->pkt_num < acktr->max_pkt_num) {
+    ++acktr->nlate;
+  } else {
+    acktr->max_pkt_num = ent->pkt_num;
+  }
+
+  if (ngtcp2_ksl_len(&acktr->ents) == 1) {
+    ack->largest_ack = ent->pkt_num;
+    ack->first_ack_blklen = 0;
+    ack->num_blks = 0;
+    acktr->flags &= (uint16_t)~NGTCP2_ACKTR_FLAG_ACK_DIRTY;
+  } else if (!(acktr->flags & NGTCP2_ACKTR_FLAG_ACK_DIRTY)) {
+    if (ent->pkt_num == ack->largest_ack + 1) {
+      ack->largest_ack = ent->pkt_num;
+      ++ack->first_ack_blklen;
+    } else if (ent->pkt_num > ack->largest_ack) {
+      rv = acktr_ack_push(acktr, ent->pkt_num);
+      if (rv != 0) {
+        return rv;
+      }
+    } else {
+      /* A packet which fills a gap is rare.  Rebuild acktr->ack
+         lazily. */
+      acktr->flags |= NGTCP2_ACKTR_FLAG_ACK_DIRTY;
+    }
+  }
+
   if (active_ack) {
     acktr->flags |= NGTCP2_ACKTR_FLAG_ACTIVE_ACK;
     if (acktr->first_unacked_ts == UINT64_MAX) {
@@ -124,6 +329,7 @@ int ngtcp2_acktr_add(ngtcp2_acktr *acktr, ngtcp2_acktr_entry *ent,
     it = ngtcp2_ksl_end(&acktr->ents);
     ngtcp2_ksl_it_prev(&it);
     delent = ngtcp2_ksl_it_get(&it);
+    acktr_ack_truncate(acktr, delent->pkt_num);
     ngtcp2_ksl_remove(&acktr->ents, NULL, (int64_t)delent->pkt_num);
     ngtcp2_acktr_entry_del(delent, acktr->mem);
   }
@@ -132,51 +338,82 @@ int ngtcp2_acktr_add(ngtcp2_acktr *acktr, ngtcp2_acktr_entry *ent,
 }
 
 int ngtcp2_acktr_forget(ngtcp2_acktr *acktr, ngtcp2_acktr_entry *ent) {
+  uint64_t pkt_num = ent->pkt_num;
+
+  acktr_ack_truncate(acktr, pkt_num);
+
+  return acktr_remove_below(acktr, pkt_num);
+}
+
+ngtcp2_ksl_it ngtcp2_acktr_get(ngtcp2_acktr *acktr) {
+  return ngtcp2_ksl_begin(&acktr->ents);
+}
+
+int ngtcp2_acktr_create_ack_frame(ngtcp2_acktr *acktr, ngtcp2_frame **pfr,
+                                  ngtcp2_tstamp ts,
+                                  uint8_t ack_delay_exponent) {
+  ngtcp2_ack *ack = &acktr->ack.ackfr.ack;
   ngtcp2_ksl_it it;
+  ngtcp2_acktr_entry *ent;
   int rv;
 
-  it = ngtcp2_ksl_lower_bound(&acktr->ents, (int64_t)ent->pkt_num);
-  assert(ngtcp2_ksl_it_key(&it) == (int64_t)ent->pkt_num);
+  it = ngtcp2_ksl_begin(&acktr->ents);
+  if (ngtcp2_ksl_it_end(&it)) {
+    *pfr = NULL;
+    return 0;
+  }
 
-  for (; !ngtcp2_ksl_it_end(&it);) {
-    ent = ngtcp2_ksl_it_get(&it);
-    rv = ngtcp2_ksl_remove(&acktr->ents, &it, (int64_t)ent->pkt_num);
+  if (acktr->flags & NGTCP2_ACKTR_FLAG_ACK_DIRTY) {
+    rv = acktr_ack_rebuild(acktr);
     if (rv != 0) {
       return rv;
     }
-    ngtcp2_acktr_entry_del(ent, acktr->mem);
   }
 
-  return 0;
-}
+  ent = ngtcp2_ksl_it_get(&it);
 
-ngtcp2_ksl_it ngtcp2_acktr_get(ngtcp2_acktr *acktr) {
-  return ngtcp2_ksl_begin(&acktr->ents);
+  assert(ack->largest_ack == ent->pkt_num);
+
+  ack->ack_delay_unscaled = ts - ent->tstamp;
+  ack->ack_delay = (ack->ack_delay_unscaled / 1000) >> ack_delay_exponent;
+
+  *pfr = &acktr->ack.fr;
+
+  return 0;
 }
 
 ngtcp2_acktr_ack_entry *ngtcp2_acktr_add_ack(ngtcp2_acktr *acktr,
-                                             uint64_t pkt_num, ngtcp2_ack *fr,
+                                             uint64_t pkt_num,
+                                             const ngtcp2_ack *fr,
                                              ngtcp2_tstamp ts, int ack_only) {
   ngtcp2_acktr_ack_entry *ent;
 
-  if (ngtcp2_ringbuf_full(&acktr->acks)) {
-    ent =
-        ngtcp2_ringbuf_get(&acktr->acks, ngtcp2_ringbuf_len(&acktr->acks) - 1);
-    ngtcp2_mem_free(acktr->mem, ent->ack);
-  }
+  /* If the buffer cannot grow, the oldest entry is overwritten as if
+     the buffer had reached its maximum capacity. */
+  ngtcp2_ringbuf_reserve(&acktr->acks);
+
   ent = ngtcp2_ringbuf_push_front(&acktr->acks);
 
-  ent->ack = fr;
+  ent->largest_ack = fr->largest_ack;
+  ent->first_ack_blklen = fr->first_ack_blklen;
   ent->pkt_num = pkt_num;
   ent->ts = ts;
+  ent->nlate = acktr->nlate;
   ent->ack_only = (uint8_t)ack_only;
 
   return ent;
 }
 
+void ngtcp2_acktr_compact(ngtcp2_acktr *acktr) {
+  if (acktr->acks.len > 1) {
+    ngtcp2_ringbuf_resize(&acktr->acks, 1);
+  }
+}
+
 /*
- * acktr_remove removes |ent| from |acktr|.  The iterator which points
- * to the entry next to |ent| is assigned to |it|.
+ * acktr_on_ack removes the entries which the outgoing ACK frame at
+ * |ack_ent_offset| in |rb| acknowledges, and discards it and the
+ * older ACK frames.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
@@ -184,78 +421,48 @@ ngtcp2_acktr_ack_entry *ngtcp2_acktr_add_ack(ngtcp2_acktr *acktr,
  * NGTCP2_ERR_NOMEM
  *     Out of memory.
  */
-static int acktr_remove(ngtcp2_acktr *acktr, ngtcp2_ksl_it *it,
-                        ngtcp2_acktr_entry *ent) {
-  int rv;
-
-  rv = ngtcp2_ksl_remove(&acktr->ents, it, (int64_t)ent->pkt_num);
-  if (rv != 0) {
-    return rv;
-  }
-
-  ngtcp2_acktr_entry_del(ent, acktr->mem);
-
-  return 0;
-}
-
 static int acktr_on_ack(ngtcp2_acktr *acktr, ngtcp2_ringbuf *rb,
                         size_t ack_ent_offset) {
   ngtcp2_acktr_ack_entry *ack_ent;
   ngtcp2_acktr_entry *ent;
-  ngtcp2_ack *fr;
   uint64_t largest_ack, min_ack;
-  size_t i;
   ngtcp2_ksl_it it;
   int rv;
 
   ack_ent = ngtcp2_ringbuf_get(rb, ack_ent_offset);
-  fr = ack_ent->ack;
-  largest_ack = fr->largest_ack;
-  min_ack = largest_ack - fr->first_ack_blklen;
-
-  /* Assume that ngtcp2_pkt_validate_ack(fr) returns 0 */
-  it = ngtcp2_ksl_lower_bound(&acktr->ents, (int64_t)largest_ack);
-  if (ngtcp2_ksl_it_end(&it)) {
+  largest_ack = ack_ent->largest_ack;
+
+  if (ack_ent->nlate == acktr->nlate) {
+    /* No packet has arrived out of order since the ACK frame was
+       sent.  It acknowledged all entries which have the packet number
+       that is equal to or less than largest_ack. */
+    acktr_ack_truncate(acktr, largest_ack);
+    rv = acktr_remove_below(acktr, largest_ack);
+    if (rv != 0) {
+      return rv;
+    }
     goto fin;
   }
 
+  /* The packets received out of order might fall in the gaps of the
+     ACK frame.  Only the first range is known to be acknowledged. */
+  min_ack = largest_ack - ack_ent->first_ack_blklen;
+
+  it = ngtcp2_ksl_lower_bound(&acktr->ents, (int64_t)largest_ack);
   for (; !ngtcp2_ksl_it_end(&it);) {
     ent = ngtcp2_ksl_it_get(&it);
     if (ent->pkt_num < min_ack) {
       break;
     }
-    rv = acktr_remove(acktr, &it, ent);
+    rv = ngtcp2_ksl_remove(&acktr->ents, &it, (int64_t)ent->pkt_num);
     if (rv != 0) {
       return rv;
     }
-  }
-
-  for (i = 0; i < fr->num_blks && !ngtcp2_ksl_it_end(&it); ++i) {
-    largest_ack = min_ack - fr->blks[i].gap - 2;
-    min_ack = largest_ack - fr->blks[i].blklen;
-
-    it = ngtcp2_ksl_lower_bound(&acktr->ents, (int64_t)largest_ack);
-    if (ngtcp2_ksl_it_end(&it)) {
-      break;
-    }
-
-    for (; !ngtcp2_ksl_it_end(&it);) {
-      ent = ngtcp2_ksl_it_get(&it);
-      if (ent->pkt_num < min_ack) {
-        break;
-      }
-      rv = acktr_remove(acktr, &it, ent);
-      if (rv != 0) {
-        return rv;
-      }
-    }
+    ngtcp2_acktr_entry_del(ent, acktr->mem);
+    acktr->flags |= NGTCP2_ACKTR_FLAG_ACK_DIRTY;
   }
 
 fin:
-  for (i = ack_ent_offset; i < rb->len; ++i) {
-    ack_ent = ngtcp2_ringbuf_get(rb, i);
-    ngtcp2_mem_free(acktr->mem, ack_ent->ack);
-  }
   ngtcp2_ringbuf_resize(rb, ack_ent_offset);
 
   return 0;
@@ -39,6 +39,12 @@
    which ngtcp2_acktr stores. */
 #define NGTCP2_ACKTR_MAX_ENT 1024
 
+/* NGTCP2_ACKTR_MAX_ACK_BLKS is the maximum number of ACK ranges,
+   including the first one, which ngtcp2_acktr puts into an outgoing
+   ACK frame.  The ranges which acknowledge the largest packet numbers
+   are kept, and the older ones are forgotten. */
+#define NGTCP2_ACKTR_MAX_ACK_BLKS 32
+
 /* ns */
 #define NGTCP2_DEFAULT_ACK_DELAY 25000000
 
@@ -72,10 +78,21 @@ int ngtcp2_acktr_entry_new(ngtcp2_acktr_entry **ent, uint64_t pkt_num,
  */
 void ngtcp2_acktr_entry_del(ngtcp2_acktr_entry *ent, ngtcp2_mem *mem);
 
+/*
+ * ngtcp2_acktr_ack_entry is an outgoing ACK frame which has not been
+ * acknowledged yet.
+ */
 typedef struct {
-  ngtcp2_ack *ack;
+  /* largest_ack and first_ack_blklen are copied from the ACK
+     frame. */
+  uint64_t largest_ack;
+  uint64_t first_ack_blklen;
+  /* pkt_num is the packet number which the ACK frame belongs to. */
   uint64_t pkt_num;
   ngtcp2_tstamp ts;
+  /* nlate is the value of ngtcp2_acktr.nlate when the ACK frame was
+     sent. */
+  uint64_t nlate;
   uint8_t ack_only;
 } ngtcp2_acktr_ack_entry;
 
@@ -87,6 +104,10 @@ typedef enum {
   /* NGTCP2_ACKTR_FLAG_ACTIVE_ACK indicates that there are
      pending protected packet to be acknowledged. */
   NGTCP2_ACKTR_FLAG_ACTIVE_ACK = 0x02,
+  /* NGTCP2_ACKTR_FLAG_ACK_DIRTY indicates that ngtcp2_acktr.ack does
+     not reflect ngtcp2_acktr.ents, and must be rebuilt before it is
+     sent. */
+  NGTCP2_ACKTR_FLAG_ACK_DIRTY = 0x04,
   /* NGTCP2_ACKTR_FLAG_PENDING_ACK_FINISHED is set when server
      received TLSv1.3 Finished message, and its acknowledgement is
      pending. */
@@ -100,10 +121,28 @@ typedef enum {
   NGTCP2_ACKTR_FLAG_DELAYED_ACK_EXPIRED = 0x0100,
 } ngtcp2_acktr_flag;
 
+/*
+ * ngtcp2_acktr_ack is a buffer which is large enough to hold ACK
+ * frame which has NGTCP2_ACKTR_MAX_ACK_BLKS ranges.
+ */
+typedef union {
+  ngtcp2_frame fr;
+  struct {
+    ngtcp2_ack ack;
+    /* ack includes 1 ngtcp2_ack_blk. */
+    ngtcp2_ack_blk blks[NGTCP2_ACKTR_MAX_ACK_BLKS - 2];
+  } ackfr;
+} ngtcp2_acktr_ack;
+
 /*
  * ngtcp2_acktr tracks received packets which we have to send ack.
  */
 typedef struct {
+  /* ack is the ACK frame which acknowledges the packets in ents.  It
+     is updated as packets are added and removed, so that an outgoing
+     ACK frame does not have to be built from ents every time.  It is
+     only valid if ents is not empty. */
+  ngtcp2_acktr_ack ack;
   ngtcp2_ringbuf acks;
   /* ents includes ngtcp2_acktr_entry sorted by decreasing order of
      packet number. */
@@ -115,6 +154,11 @@ typedef struct {
   /* first_unacked_ts is timestamp when ngtcp2_acktr_entry is added
      first time after the last outgoing protected ACK frame. */
   ngtcp2_tstamp first_unacked_ts;
+  /* max_pkt_num is the largest packet number ever added. */
+  uint64_t max_pkt_num;
+  /* nlate is the number of packets added whose packet number is
+     smaller than max_pkt_num. */
+  uint64_t nlate;
 } ngtcp2_acktr;
 
 /*
@@ -137,13 +181,17 @@ int ngtcp2_acktr_init(ngtcp2_acktr *acktr, int delayed_ack, ngtcp2_log *log,
 void ngtcp2_acktr_free(ngtcp2_acktr *acktr);
 
 /*
- * ngtcp2_acktr_add adds |ent|.
+ * ngtcp2_acktr_add adds |ent|.  If the outgoing ACK frame has
+ * already NGTCP2_ACKTR_MAX_ACK_BLKS ranges, the range which has the
+ * smallest packet numbers is forgotten.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
  *
  * NGTCP2_ERR_INVALID_ARGUMENT
  *     Same packet number has already been included in |acktr|.
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory.
  */
 int ngtcp2_acktr_add(ngtcp2_acktr *acktr, ngtcp2_acktr_entry *ent,
                      int active_ack, ngtcp2_tstamp ts);
@@ -169,16 +217,44 @@ int ngtcp2_acktr_forget(ngtcp2_acktr *acktr, ngtcp2_acktr_entry *ent);
 ngtcp2_ksl_it ngtcp2_acktr_get(ngtcp2_acktr *acktr);
 
 /*
- * ngtcp2_acktr_add_ack adds the outgoing ACK frame |fr| to |acktr|.
- * |pkt_num| is the packet number which |fr| belongs.  This function
- * transfers the ownership of |fr| to |acktr|.  |ack_only| is nonzero
- * if the packet contains an ACK frame only.  This function returns a
- * pointer to the object it adds.
+ * ngtcp2_acktr_create_ack_frame assigns the pointer to the ACK frame
+ * which acknowledges the packets in |acktr| to |*pfr|.  The frame is
+ * owned by |acktr|, and it is valid until |acktr| is modified.  This
+ * function does not allocate memory for the frame.  |ts| is the
+ * current timestamp, and it is used to compute ACK Delay encoded with
+ * |ack_delay_exponent|.  If there is no packet to acknowledge, |*pfr|
+ * is set to NULL.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory.
+ */
+int ngtcp2_acktr_create_ack_frame(ngtcp2_acktr *acktr, ngtcp2_frame **pfr,
+                                  ngtcp2_tstamp ts, uint8_t ack_delay_exponent);
+
+/*
+ * ngtcp2_acktr_add_ack records the outgoing ACK frame |fr| to
+ * |acktr|.  |pkt_num| is the packet number which |fr| belongs.
+ * |ack_only| is nonzero if the packet contains an ACK frame only.
+ * This function returns a pointer to the object it adds.
  */
 ngtcp2_acktr_ack_entry *ngtcp2_acktr_add_ack(ngtcp2_acktr *acktr,
-                                             uint64_t pkt_num, ngtcp2_ack *fr,
+                                             uint64_t pkt_num,
+                                             const ngtcp2_ack *fr,
                                              ngtcp2_tstamp ts, int ack_only);
 
+/*
+ * ngtcp2_acktr_compact discards the outgoing ACK frames added by
+ * ngtcp2_acktr_add_ack except for the most recent one.  The most
+ * recent ACK frame acknowledges the largest packet numbers, and
+ * ngtcp2_acktr_recv_ack removes all entries which it acknowledges
+ * when it is acknowledged, so only the entries which were
+ * acknowledged by the older ACK frames alone stay longer.
+ */
+void ngtcp2_acktr_compact(ngtcp2_acktr *acktr);
+
 /*
  * ngtcp2_acktr_recv_ack processes the incoming ACK frame |fr|.
  * |pkt_num| is a packet number which includes |fr|.  If we receive
@@ -190,6 +266,8 @@ ngtcp2_acktr_ack_entry *ngtcp2_acktr_add_ack(ngtcp2_acktr *acktr,
  *
  * NGTCP2_ERR_CALLBACK_FAILURE
  *     User-defined callback function failed.
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory.
  */
 int ngtcp2_acktr_recv_ack(ngtcp2_acktr *acktr, const ngtcp2_ack *fr,
                           ngtcp2_conn *conn, ngtcp2_tstamp ts);
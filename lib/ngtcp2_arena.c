@@ -0,0 +1,325 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2018 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "ngtcp2_arena.h"
+
+#include <string.h>
+#include <stddef.h>
+#include <assert.h>
+
+#include "ngtcp2_macro.h"
+
+/* arena_class_sizes is the usable size of a block in each size
+   class. */
+static const size_t arena_class_sizes[NGTCP2_ARENA_NCLASS] = {
+    16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024};
+
+/*
+ * arena_class returns the smallest size class which can hold |size|
+ * bytes.  |size| must not exceed NGTCP2_ARENA_MAX_CLASS.
+ */
+static size_t arena_class(size_t size) {
+  size_t i;
+
+  for (i = 0; i < NGTCP2_ARENA_NCLASS; ++i) {
+    if (size <= arena_class_sizes[i]) {
+      return i;
+    }
+  }
+
+  assert(0);
+  return NGTCP2_ARENA_NCLASS - 1;
+}
+
+/*
+ * arena_carve makes a block of size class |c| at arena->pos, and
+ * returns the pointer to its usable area.  The current slab must have
+ * enough room for it.
+ */
+static void *arena_carve(ngtcp2_arena *arena, size_t c) {
+  ngtcp2_arena_hd *hd = (ngtcp2_arena_hd *)(void *)arena->pos;
+
+  hd->size = arena_class_sizes[c];
+  arena->pos += sizeof(ngtcp2_arena_hd) + arena_class_sizes[c];
+
+  return hd + 1;
+}
+
+/*
+ * arena_push_free pushes the block pointed by |ptr| of size class |c|
+ * to the free list.
+ */
+static void arena_push_free(ngtcp2_arena *arena, void *ptr, size_t c) {
+  ngtcp2_arena_free_blk *blk = ptr;
+
+  blk->next = arena->free_blks[c];
+  arena->free_blks[c] = blk;
+}
+
+/*
+ * arena_add_slab allocates new slab and makes it current.  The unused
+ * region of the previous slab is split into the free blocks so that
+ * it is not wasted.
+ *
+ * This function returns 0 if it succeeds, or -1 if it fails to
+ * allocate memory.
+ */
+static int arena_add_slab(ngtcp2_arena *arena) {
+  ngtcp2_arena_slab *slab;
+  size_t left, c;
+
+  for (;;) {
+    left = (size_t)(arena->end - arena->pos);
+    if (left < sizeof(ngtcp2_arena_hd) + arena_class_sizes[0]) {
+      break;
+    }
+    for (c = NGTCP2_ARENA_NCLASS - 1;
+         sizeof(ngtcp2_arena_hd) + arena_class_sizes[c] > left; --c)
+      ;
+    arena_push_free(arena, arena_carve(arena, c), c);
+  }
+
+  slab = ngtcp2_mem_malloc(arena->parent, arena->slablen);
+  if (slab == NULL) {
+    return -1;
+  }
+
+  slab->next = arena->slab;
+  arena->slab = slab;
+  arena->pos = (uint8_t *)(slab + 1);
+  arena->end = (uint8_t *)slab + arena->slablen;
+  ++arena->nslab;
+
+  return 0;
+}
+
+static void *arena_large_malloc(ngtcp2_arena *arena, size_t size) {
+  ngtcp2_arena_large *lg;
+
+  if (size > SIZE_MAX - sizeof(ngtcp2_arena_large)) {
+    return NULL;
+  }
+
+  lg = ngtcp2_mem_malloc(arena->parent, sizeof(ngtcp2_arena_large) + size);
+  if (lg == NULL) {
+    return NULL;
+  }
+
+  lg->hd.size = size;
+  lg->prev = NULL;
+  lg->next = arena->large;
+  if (lg->next) {
+    lg->next->prev = lg;
+  }
+  arena->large = lg;
+
+  return lg + 1;
+}
+
+static ngtcp2_arena_large *arena_large_of(ngtcp2_arena_hd *hd) {
+  return (ngtcp2_arena_large *)(void *)((uint8_t *)hd -
+                                        offsetof(ngtcp2_arena_large, hd));
+}
+
+static void arena_large_unlink(ngtcp2_arena *arena, ngtcp2_arena_large *lg) {
+  if (lg->prev) {
+    lg->prev->next = lg->next;
+  } else {
+    arena->large = lg->next;
+  }
+  if (lg->next) {
+    lg->next->prev = lg->prev;
+  }
+}
+
+static void *arena_malloc(size_t size, void *mem_user_data) {
+  ngtcp2_arena *arena = mem_user_data;
+  ngtcp2_arena_free_blk *blk;
+  size_t c;
+
+  if (size > NGTCP2_ARENA_MAX_CLASS) {
+    return arena_large_malloc(arena, size);
+  }
+
+  c = arena_class(size);
+
+  blk = arena->free_blks[c];
+  if (blk) {
+    arena->free_blks[c] = blk->next;
+    return blk;
+  }
+
+  if ((size_t)(arena->end - arena->pos) <
+          sizeof(ngtcp2_arena_hd) + arena_class_sizes[c] &&
+      arena_add_slab(arena) != 0) {
+    return NULL;
+  }
+
+  return arena_carve(arena, c);
+}
+
+static void arena_free(void *ptr, void *mem_user_data) {
+  ngtcp2_arena *arena = mem_user_data;
+  ngtcp2_arena_hd *hd;
+  ngtcp2_arena_large *lg;
+
+  if (ptr == NULL) {
+    return;
+  }
+
+  hd = (ngtcp2_arena_hd *)ptr - 1;
+
+  if (hd->size > NGTCP2_ARENA_MAX_CLASS) {
+    lg = arena_large_of(hd);
+    arena_large_unlink(arena, lg);
+    ngtcp2_mem_free(arena->parent, lg);
+    return;
+  }
+
+  arena_push_free(arena, ptr, arena_class(hd->size));
+}
+
+static void *arena_calloc(size_t nmemb, size_t size, void *mem_user_data) {
+  void *p;
+
+  if (size && nmemb > SIZE_MAX / size) {
+    return NULL;
+  }
+
+  p = arena_malloc(nmemb * size, mem_user_data);
+  if (p == NULL) {
+    return NULL;
+  }
+
+  memset(p, 0, nmemb * size);
+
+  return p;
+}
+
+static void *arena_realloc(void *ptr, size_t size, void *mem_user_data) {
+  ngtcp2_arena *arena = mem_user_data;
+  ngtcp2_arena_hd *hd;
+  ngtcp2_arena_large *lg, *nlg;
+  void *p;
+
+  if (ptr == NULL) {
+    return arena_malloc(size, mem_user_data);
+  }
+
+  hd = (ngtcp2_arena_hd *)ptr - 1;
+
+  if (hd->size <= NGTCP2_ARENA_MAX_CLASS) {
+    if (size <= hd->size) {
+      return ptr;
+    }
+  } else if (size > NGTCP2_ARENA_MAX_CLASS) {
+    if (size > SIZE_MAX - sizeof(ngtcp2_arena_large)) {
+      return NULL;
+    }
+
+    lg = arena_large_of(hd);
+    nlg = ngtcp2_mem_realloc(arena->parent, lg,
+                             sizeof(ngtcp2_arena_large) + size);
+    if (nlg == NULL) {
+      return NULL;
+    }
+
+    nlg->hd.size = size;
+    if (nlg->prev) {
+      nlg->prev->next = nlg;
+    } else {
+      arena->large = nlg;
+    }
+    if (nlg->next) {
+      nlg->next->prev = nlg;
+    }
+
+    return nlg + 1;
+  }
+
+  p = arena_malloc(size, mem_user_data);
+  if (p == NULL) {
+    return NULL;
+  }
+
+  memcpy(p, ptr, ngtcp2_min(hd->size, size));
+  arena_free(ptr, mem_user_data);
+
+  return p;
+}
+
+int ngtcp2_arena_new(ngtcp2_arena **parena, size_t slablen, ngtcp2_mem *mem) {
+  ngtcp2_arena *arena;
+
+  if (mem == NULL) {
+    mem = ngtcp2_mem_default();
+  }
+
+  if (slablen == 0) {
+    slablen = NGTCP2_ARENA_DEFAULT_SLABLEN;
+  } else if (slablen < sizeof(ngtcp2_arena_slab) + sizeof(ngtcp2_arena_hd) +
+                           NGTCP2_ARENA_MAX_CLASS) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  arena = ngtcp2_mem_calloc(mem, 1, sizeof(ngtcp2_arena));
+  if (arena == NULL) {
+    return NGTCP2_ERR_NOMEM;
+  }
+
+  arena->mem.mem_user_data = arena;
+  arena->mem.malloc = arena_malloc;
+  arena->mem.free = arena_free;
+  arena->mem.calloc = arena_calloc;
+  arena->mem.realloc = arena_realloc;
+  arena->parent = mem;
+  arena->slablen = slablen;
+
+  *parena = arena;
+
+  return 0;
+}
+
+void ngtcp2_arena_del(ngtcp2_arena *arena) {
+  ngtcp2_arena_slab *slab, *next;
+  ngtcp2_arena_large *lg, *nlg;
+
+  if (arena == NULL) {
+    return;
+  }
+
+  for (lg = arena->large; lg; lg = nlg) {
+    nlg = lg->next;
+    ngtcp2_mem_free(arena->parent, lg);
+  }
+
+  for (slab = arena->slab; slab; slab = next) {
+    next = slab->next;
+    ngtcp2_mem_free(arena->parent, slab);
+  }
+
+  ngtcp2_mem_free(arena->parent, arena);
+}
+
+ngtcp2_mem *ngtcp2_arena_get_mem(ngtcp2_arena *arena) { return &arena->mem; }
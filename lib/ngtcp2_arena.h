@@ -0,0 +1,110 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2018 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NGTCP2_ARENA_H
+#define NGTCP2_ARENA_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <ngtcp2/ngtcp2.h>
+
+#include "ngtcp2_mem.h"
+
+/* NGTCP2_ARENA_DEFAULT_SLABLEN is the default size of a slab. */
+#define NGTCP2_ARENA_DEFAULT_SLABLEN 4096
+/* NGTCP2_ARENA_NCLASS is the number of size classes. */
+#define NGTCP2_ARENA_NCLASS 12
+/* NGTCP2_ARENA_MAX_CLASS is the largest size class.  Larger requests
+   are forwarded to the backing allocator. */
+#define NGTCP2_ARENA_MAX_CLASS 1024
+
+/*
+ * ngtcp2_arena_hd precedes every block handed out by ngtcp2_arena.
+ * It is 16 bytes long so that the block following it is suitably
+ * aligned for any type.
+ */
+typedef union {
+  /* size is the usable size of the block. */
+  size_t size;
+  uint64_t align[2];
+} ngtcp2_arena_hd;
+
+struct ngtcp2_arena_slab;
+typedef struct ngtcp2_arena_slab ngtcp2_arena_slab;
+
+/*
+ * ngtcp2_arena_slab is a chunk of memory which small blocks are
+ * carved from.  The blocks follow this header.
+ */
+struct ngtcp2_arena_slab {
+  ngtcp2_arena_slab *next;
+  uint64_t pad;
+};
+
+struct ngtcp2_arena_large;
+typedef struct ngtcp2_arena_large ngtcp2_arena_large;
+
+/*
+ * ngtcp2_arena_large is a block which is larger than
+ * NGTCP2_ARENA_MAX_CLASS.  It is allocated by the backing allocator
+ * individually, and linked to the arena so that ngtcp2_arena_del can
+ * free it.
+ */
+struct ngtcp2_arena_large {
+  ngtcp2_arena_large *prev, *next;
+  ngtcp2_arena_hd hd;
+};
+
+/*
+ * ngtcp2_arena_free_blk is a free small block.  It is stored in the
+ * usable area of the block.
+ */
+typedef struct ngtcp2_arena_free_blk {
+  struct ngtcp2_arena_free_blk *next;
+} ngtcp2_arena_free_blk;
+
+struct ngtcp2_arena {
+  /* mem is the allocator which allocates memory from this arena.
+     Its mem_user_data points to this object. */
+  ngtcp2_mem mem;
+  /* parent is the backing allocator. */
+  ngtcp2_mem *parent;
+  /* slab is the list of slabs.  The first one is the slab which
+     blocks are currently carved from. */
+  ngtcp2_arena_slab *slab;
+  /* pos and end delimit the unused region of the current slab. */
+  uint8_t *pos, *end;
+  /* large is the list of outstanding large blocks. */
+  ngtcp2_arena_large *large;
+  /* free_blks is the free list per size class. */
+  ngtcp2_arena_free_blk *free_blks[NGTCP2_ARENA_NCLASS];
+  /* slablen is the size of a slab including its header. */
+  size_t slablen;
+  /* nslab is the number of slabs allocated. */
+  size_t nslab;
+};
+
+#endif /* NGTCP2_ARENA_H */
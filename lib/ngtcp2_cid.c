@@ -46,3 +46,81 @@ int ngtcp2_cid_eq(const ngtcp2_cid *cid, const ngtcp2_cid *other) {
 }
 
 int ngtcp2_cid_empty(const ngtcp2_cid *cid) { return cid->datalen == 0; }
+
+/*
+ * cid_routing_valid returns nonzero if |rt| describes the valid
+ * routable Connection ID layout.
+ */
+static int cid_routing_valid(const ngtcp2_cid_routing *rt) {
+  if (rt->config_id > NGTCP2_CID_MAX_CONFIG_ID || rt->server_idlen == 0 ||
+      rt->server_idlen > NGTCP2_CID_MAX_SERVER_IDLEN) {
+    return 0;
+  }
+
+  if (rt->encrypt) {
+    return rt->decrypt && rt->cidlen == 1 + NGTCP2_CID_BLOCKLEN;
+  }
+
+  return rt->cidlen >= NGTCP2_MIN_CIDLEN && rt->cidlen <= NGTCP2_MAX_CIDLEN &&
+         rt->cidlen > 1 + rt->server_idlen;
+}
+
+int ngtcp2_cid_encode_routable(ngtcp2_cid *cid, const ngtcp2_cid_routing *rt,
+                               uint32_t server_id, const uint8_t *rand) {
+  uint8_t block[NGTCP2_CID_BLOCKLEN];
+  uint8_t *p;
+  size_t i;
+
+  if (!cid_routing_valid(rt) ||
+      (rt->server_idlen < 4 && (server_id >> (rt->server_idlen * 8)))) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  cid->datalen = rt->cidlen;
+  cid->data[0] = (uint8_t)((rt->config_id << 6) | (rand[0] & 0x3f));
+
+  p = rt->encrypt ? block : cid->data + 1;
+
+  for (i = rt->server_idlen; i > 0; --i) {
+    *p++ = (uint8_t)(server_id >> ((i - 1) * 8));
+  }
+  ngtcp2_cpymem(p, rand + 1 + rt->server_idlen,
+                rt->cidlen - 1 - rt->server_idlen);
+
+  if (rt->encrypt && rt->encrypt(cid->data + 1, block, rt->user_data) != 0) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+
+int ngtcp2_cid_decode_routable(uint32_t *pserver_id,
+                               const ngtcp2_cid_routing *rt, const uint8_t *cid,
+                               size_t cidlen) {
+  uint8_t block[NGTCP2_CID_BLOCKLEN];
+  const uint8_t *p;
+  uint32_t server_id = 0;
+  size_t i;
+
+  if (!cid_routing_valid(rt) || cidlen != rt->cidlen ||
+      (cid[0] >> 6) != rt->config_id) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  if (rt->encrypt) {
+    if (rt->decrypt(block, cid + 1, rt->user_data) != 0) {
+      return NGTCP2_ERR_CALLBACK_FAILURE;
+    }
+    p = block;
+  } else {
+    p = cid + 1;
+  }
+
+  for (i = 0; i < rt->server_idlen; ++i) {
+    server_id = (server_id << 8) | p[i];
+  }
+
+  *pserver_id = server_id;
+
+  return 0;
+}
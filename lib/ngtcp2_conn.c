@@ -33,6 +33,7 @@
 #include "ngtcp2_log.h"
 #include "ngtcp2_cid.h"
 #include "ngtcp2_conv.h"
+#include "ngtcp2_trace.h"
 
 /*
  * conn_local_stream returns nonzero if |stream_id| indicates that it
@@ -147,18 +148,71 @@ static int conn_call_extend_max_stream_id(ngtcp2_conn *conn,
   return 0;
 }
 
+static int conn_call_get_new_connection_id(ngtcp2_conn *conn, ngtcp2_cid *cid,
+                                           uint8_t *token, size_t cidlen) {
+  int rv;
+
+  assert(conn->callbacks.get_new_connection_id);
+
+  rv = conn->callbacks.get_new_connection_id(conn, cid, token, cidlen,
+                                             conn->user_data);
+  if (rv != 0) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+
+static int conn_call_read_stream_data(ngtcp2_conn *conn, ngtcp2_strm *strm,
+                                      size_t maxlen, const uint8_t **pdata,
+                                      size_t *pdatalen, uint8_t *pfin) {
+  int rv;
+
+  assert(conn->callbacks.read_stream_data);
+
+  rv = conn->callbacks.read_stream_data(conn, strm->stream_id, strm->tx_offset,
+                                        maxlen, pdata, pdatalen, pfin,
+                                        conn->user_data,
+                                        strm->stream_user_data);
+  if (rv != 0) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  assert(*pdatalen <= maxlen);
+
+  return 0;
+}
+
+/*
+ * conn_mem returns the allocator which |conn| uses for |subsys|.
+ */
+static ngtcp2_mem *conn_mem(ngtcp2_conn *conn, ngtcp2_mem_subsys subsys) {
+  return ngtcp2_mem_acct_get(&conn->macct, subsys);
+}
+
+/*
+ * conn_mem_exhausted returns nonzero if |conn| holds
+ * ngtcp2_settings.max_mem bytes of memory or more.
+ */
+static int conn_mem_exhausted(ngtcp2_conn *conn) {
+  return conn->local_settings.max_mem &&
+         conn->macct.total >= conn->local_settings.max_mem;
+}
+
 static int pktns_init(ngtcp2_pktns *pktns, int delayed_ack, ngtcp2_cc_stat *ccs,
-                      ngtcp2_log *log, ngtcp2_mem *mem) {
+                      ngtcp2_log *log, ngtcp2_mem_acct *macct) {
   int rv;
 
   pktns->last_tx_pkt_num = (uint64_t)-1;
 
-  rv = ngtcp2_acktr_init(&pktns->acktr, delayed_ack, log, mem);
+  rv = ngtcp2_acktr_init(&pktns->acktr, delayed_ack, log,
+                         ngtcp2_mem_acct_get(macct, NGTCP2_MEM_SUBSYS_ACKTR));
   if (rv != 0) {
     return rv;
   }
 
-  ngtcp2_rtb_init(&pktns->rtb, ccs, log, mem);
+  ngtcp2_rtb_init(&pktns->rtb, ccs, log,
+                  ngtcp2_mem_acct_get(macct, NGTCP2_MEM_SUBSYS_RTB));
 
   return 0;
 }
@@ -171,169 +225,250 @@ static void pktns_free(ngtcp2_pktns *pktns, ngtcp2_mem *mem) {
   ngtcp2_acktr_free(&pktns->acktr);
 }
 
-static int conn_new(ngtcp2_conn **pconn, const ngtcp2_cid *dcid,
-                    const ngtcp2_cid *scid, uint32_t version,
-                    const ngtcp2_conn_callbacks *callbacks,
-                    const ngtcp2_settings *settings, void *user_data,
-                    int server) {
+static int pktns_new(ngtcp2_pktns **ppktns, int delayed_ack,
+                     ngtcp2_cc_stat *ccs, ngtcp2_log *log,
+                     ngtcp2_mem_acct *macct) {
+  ngtcp2_mem *mem = ngtcp2_mem_acct_get(macct, NGTCP2_MEM_SUBSYS_CONN);
   int rv;
-  ngtcp2_mem *mem = ngtcp2_mem_default();
 
-  *pconn = ngtcp2_mem_calloc(mem, 1, sizeof(ngtcp2_conn));
-  if (*pconn == NULL) {
-    rv = NGTCP2_ERR_NOMEM;
-    goto fail_conn;
+  *ppktns = ngtcp2_mem_calloc(mem, 1, sizeof(ngtcp2_pktns));
+  if (*ppktns == NULL) {
+    return NGTCP2_ERR_NOMEM;
   }
 
-  rv = ngtcp2_strm_init(&(*pconn)->crypto, 0, NGTCP2_STRM_FLAG_NONE, 0, 0, NULL,
-                        mem);
+  rv = pktns_init(*ppktns, delayed_ack, ccs, log, macct);
   if (rv != 0) {
-    goto fail_crypto_init;
+    ngtcp2_mem_free(mem, *ppktns);
   }
 
-  rv = ngtcp2_map_init(&(*pconn)->strms, mem);
-  if (rv != 0) {
-    goto fail_strms_init;
+  return rv;
+}
+
+static void pktns_del(ngtcp2_pktns *pktns, ngtcp2_mem *mem) {
+  if (pktns == NULL) {
+    return;
   }
 
-  rv = ngtcp2_idtr_init(&(*pconn)->remote_bidi_idtr, !server, mem);
-  if (rv != 0) {
-    goto fail_remote_bidi_idtr_init;
+  pktns_free(pktns, mem);
+
+  ngtcp2_mem_free(mem, pktns);
+}
+
+/*
+ * conn_init initializes |conn|.  |conn| must be zero-filled except
+ * for macct, which must be initialized, and the buffers which
+ * ngtcp2_conn_reset carries over from the previous connection:
+ * decrypt_buf, strm_pool, nstrm_pool, and recorder.  If
+ * recorder.records is not NULL, it is used as the flight recorder
+ * instead of allocating new one.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_INVALID_ARGUMENT
+ *     settings->flight_recorder_len is not 0 nor a power of 2.
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory
+ */
+static int conn_init(ngtcp2_conn *conn, const ngtcp2_cid *dcid,
+                     const ngtcp2_cid *scid, uint32_t version,
+                     const ngtcp2_conn_callbacks *callbacks,
+                     const ngtcp2_settings *settings, ngtcp2_mem *mem,
+                     void *user_data, int server) {
+  int rv;
+  ngtcp2_trace_record *records;
+
+  if (settings->flight_recorder_len &
+      (settings->flight_recorder_len - 1)) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
   }
 
-  rv = ngtcp2_idtr_init(&(*pconn)->remote_uni_idtr, !server, mem);
+  conn->mem = mem;
+
+  rv = ngtcp2_strm_init(&conn->crypto, 0, NGTCP2_STRM_FLAG_NONE, 0, 0, NULL,
+                        conn_mem(conn, NGTCP2_MEM_SUBSYS_ROB));
   if (rv != 0) {
-    goto fail_remote_uni_idtr_init;
+    goto fail_crypto_init;
   }
 
-  rv = ngtcp2_ringbuf_init(&(*pconn)->tx_path_challenge, 4,
-                           sizeof(ngtcp2_path_challenge_entry), mem);
+  rv = ngtcp2_map_init(&conn->strms, mem);
   if (rv != 0) {
-    goto fail_tx_path_challenge_init;
+    goto fail_strms_init;
   }
 
-  rv = ngtcp2_ringbuf_init(&(*pconn)->rx_path_challenge, 4,
-                           sizeof(ngtcp2_path_challenge_entry), mem);
+  rv = ngtcp2_idtr_init(&conn->remote_bidi_idtr, !server, mem);
   if (rv != 0) {
-    goto fail_rx_path_challenge_init;
+    goto fail_remote_bidi_idtr_init;
   }
 
-  // TODO Setting upper bound 64 is not ideal.
-  rv = ngtcp2_ringbuf_init(&(*pconn)->tx_crypto_data, 64,
-                           sizeof(ngtcp2_crypto_data), mem);
+  rv = ngtcp2_idtr_init(&conn->remote_uni_idtr, !server, mem);
   if (rv != 0) {
-    goto fail_tx_crypto_data_init;
+    goto fail_remote_uni_idtr_init;
   }
 
-  (*pconn)->scid = *scid;
-  (*pconn)->dcid = *dcid;
+  ngtcp2_ringbuf_init_growable(&conn->tx_path_challenge, 4,
+                               sizeof(ngtcp2_path_challenge_entry), mem);
+  ngtcp2_ringbuf_init_growable(&conn->rx_path_challenge, 4,
+                               sizeof(ngtcp2_path_challenge_entry), mem);
+  // TODO Setting upper bound 64 is not ideal.
+  ngtcp2_ringbuf_init_growable(&conn->tx_crypto_data, 64,
+                               sizeof(ngtcp2_crypto_data), mem);
+
+  conn->scid = *scid;
+  conn->dcid = *dcid;
 
-  ngtcp2_log_init(&(*pconn)->log, &(*pconn)->scid, settings->log_printf,
+  ngtcp2_log_init(&conn->log, &conn->scid, settings->log_printf,
                   settings->initial_ts, user_data);
+  conn->log.trace = settings->trace;
 
-  rv = pktns_init(&(*pconn)->in_pktns, 0 /* delayed_ack */, &(*pconn)->ccs,
-                  &(*pconn)->log, mem);
+  rv = pktns_new(&conn->in_pktns, 0 /* delayed_ack */, &conn->ccs, &conn->log,
+                 &conn->macct);
   if (rv != 0) {
     goto fail_in_pktns_init;
   }
 
-  rv = pktns_init(&(*pconn)->hs_pktns, 0 /* delayed_ack */, &(*pconn)->ccs,
-                  &(*pconn)->log, mem);
+  rv = pktns_new(&conn->hs_pktns, 0 /* delayed_ack */, &conn->ccs, &conn->log,
+                 &conn->macct);
   if (rv != 0) {
     goto fail_hs_pktns_init;
   }
 
-  rv = pktns_init(&(*pconn)->pktns, 1 /* delayed_ack */, &(*pconn)->ccs,
-                  &(*pconn)->log, mem);
+  rv = pktns_init(&conn->pktns, 1 /* delayed_ack */, &conn->ccs, &conn->log,
+                  &conn->macct);
   if (rv != 0) {
     goto fail_pktns_init;
   }
 
-  (*pconn)->callbacks = *callbacks;
-  (*pconn)->version = version;
-  (*pconn)->mem = mem;
-  (*pconn)->user_data = user_data;
-  (*pconn)->largest_ack = -1;
-  (*pconn)->local_settings = *settings;
-  (*pconn)->unsent_max_rx_offset = (*pconn)->max_rx_offset = settings->max_data;
-  (*pconn)->rcs.min_rtt = UINT64_MAX;
-  (*pconn)->rcs.reordering_threshold = NGTCP2_REORDERING_THRESHOLD;
-  (*pconn)->ccs.cwnd = NGTCP2_INITIAL_CWND;
-  (*pconn)->ccs.eor_pkt_num = 0;
-  (*pconn)->ccs.ssthresh = UINT64_MAX;
+#ifdef PHASE_TIMING
+  ngtcp2_phase_timer_init(&conn->phase);
+  conn->in_pktns->rtb.phase = &conn->phase;
+  conn->hs_pktns->rtb.phase = &conn->phase;
+  conn->pktns.rtb.phase = &conn->phase;
+#endif /* PHASE_TIMING */
+
+  conn->callbacks = *callbacks;
+  conn->version = version;
+  conn->user_data = user_data;
+  conn->largest_ack = -1;
+  conn->local_settings = *settings;
+  conn->unsent_max_rx_offset = conn->max_rx_offset = settings->max_data;
+  conn->rcs.min_rtt = UINT64_MAX;
+  conn->rcs.reordering_threshold = NGTCP2_REORDERING_THRESHOLD;
+  conn->ccs.cwnd = NGTCP2_INITIAL_CWND;
+  conn->ccs.eor_pkt_num = 0;
+  conn->ccs.ssthresh = UINT64_MAX;
+  conn->fc_blocked_ts = UINT64_MAX;
+
+  if (!settings->trace && settings->flight_recorder_len) {
+    if (conn->recorder.records == NULL) {
+      records = ngtcp2_mem_malloc(mem, sizeof(ngtcp2_trace_record) *
+                                           settings->flight_recorder_len);
+      if (records == NULL) {
+        rv = NGTCP2_ERR_NOMEM;
+        goto fail_recorder;
+      }
+
+      ngtcp2_trace_ring_init(&conn->recorder, records,
+                             settings->flight_recorder_len);
+    }
+    conn->log.trace = &conn->recorder;
+  }
+
+  if (server) {
+    conn->server = 1;
+    conn->unsent_max_remote_stream_id_bidi = conn->max_remote_stream_id_bidi =
+        ngtcp2_nth_client_bidi_id(settings->max_bidi_streams);
+
+    conn->unsent_max_remote_stream_id_uni = conn->max_remote_stream_id_uni =
+        ngtcp2_nth_client_uni_id(settings->max_uni_streams);
+
+    conn->state = NGTCP2_CS_SERVER_INITIAL;
+    conn->next_local_stream_id_bidi = 1;
+    conn->next_local_stream_id_uni = 3;
+  } else {
+    conn->unsent_max_remote_stream_id_bidi = conn->max_remote_stream_id_bidi =
+        ngtcp2_nth_server_bidi_id(settings->max_bidi_streams);
+
+    conn->unsent_max_remote_stream_id_uni = conn->max_remote_stream_id_uni =
+        ngtcp2_nth_server_uni_id(settings->max_uni_streams);
+
+    conn->state = NGTCP2_CS_CLIENT_INITIAL;
+    conn->rcid = *dcid;
+    conn->next_local_stream_id_bidi = 0;
+    conn->next_local_stream_id_uni = 2;
+  }
 
   return 0;
 
+fail_recorder:
+  pktns_free(&conn->pktns, mem);
 fail_pktns_init:
-  pktns_free(&(*pconn)->hs_pktns, mem);
+  pktns_del(conn->hs_pktns, mem);
 fail_hs_pktns_init:
-  pktns_free(&(*pconn)->in_pktns, mem);
+  pktns_del(conn->in_pktns, mem);
 fail_in_pktns_init:
-  ngtcp2_ringbuf_free(&(*pconn)->tx_crypto_data);
-fail_tx_crypto_data_init:
-  ngtcp2_ringbuf_free(&(*pconn)->rx_path_challenge);
-fail_rx_path_challenge_init:
-  ngtcp2_ringbuf_free(&(*pconn)->tx_path_challenge);
-fail_tx_path_challenge_init:
-  ngtcp2_idtr_free(&(*pconn)->remote_uni_idtr);
+  ngtcp2_ringbuf_free(&conn->tx_crypto_data);
+  ngtcp2_ringbuf_free(&conn->rx_path_challenge);
+  ngtcp2_ringbuf_free(&conn->tx_path_challenge);
+  ngtcp2_idtr_free(&conn->remote_uni_idtr);
 fail_remote_uni_idtr_init:
-  ngtcp2_idtr_free(&(*pconn)->remote_bidi_idtr);
+  ngtcp2_idtr_free(&conn->remote_bidi_idtr);
 fail_remote_bidi_idtr_init:
-  ngtcp2_map_free(&(*pconn)->strms);
+  ngtcp2_map_free(&conn->strms);
 fail_strms_init:
-  ngtcp2_strm_free(&(*pconn)->crypto);
+  ngtcp2_strm_free(&conn->crypto);
 fail_crypto_init:
-  ngtcp2_mem_free(mem, *pconn);
-fail_conn:
   return rv;
 }
 
-int ngtcp2_conn_client_new(ngtcp2_conn **pconn, const ngtcp2_cid *dcid,
-                           const ngtcp2_cid *scid, uint32_t version,
-                           const ngtcp2_conn_callbacks *callbacks,
-                           const ngtcp2_settings *settings, void *user_data) {
+static int conn_new(ngtcp2_conn **pconn, const ngtcp2_cid *dcid,
+                    const ngtcp2_cid *scid, uint32_t version,
+                    const ngtcp2_conn_callbacks *callbacks,
+                    const ngtcp2_settings *settings, ngtcp2_mem *mem,
+                    void *user_data, int server) {
   int rv;
-  rv = conn_new(pconn, dcid, scid, version, callbacks, settings, user_data, 0);
+
+  if (mem == NULL) {
+    mem = ngtcp2_mem_default();
+  }
+
+  *pconn = ngtcp2_mem_calloc(mem, 1, sizeof(ngtcp2_conn));
+  if (*pconn == NULL) {
+    return NGTCP2_ERR_NOMEM;
+  }
+
+  ngtcp2_mem_acct_init(&(*pconn)->macct, mem);
+  /* The connection object is allocated before macct exists, but it
+     is a part of the memory which the connection holds. */
+  (*pconn)->macct.nbytes[NGTCP2_MEM_SUBSYS_CONN] = sizeof(ngtcp2_conn);
+  (*pconn)->macct.total = sizeof(ngtcp2_conn);
+
+  rv = conn_init(*pconn, dcid, scid, version, callbacks, settings,
+                 conn_mem(*pconn, NGTCP2_MEM_SUBSYS_CONN), user_data, server);
   if (rv != 0) {
+    ngtcp2_mem_free(mem, *pconn);
     return rv;
   }
-  (*pconn)->unsent_max_remote_stream_id_bidi =
-      (*pconn)->max_remote_stream_id_bidi =
-          ngtcp2_nth_server_bidi_id(settings->max_bidi_streams);
 
-  (*pconn)->unsent_max_remote_stream_id_uni =
-      (*pconn)->max_remote_stream_id_uni =
-          ngtcp2_nth_server_uni_id(settings->max_uni_streams);
-
-  (*pconn)->state = NGTCP2_CS_CLIENT_INITIAL;
-  (*pconn)->rcid = *dcid;
-  (*pconn)->next_local_stream_id_bidi = 0;
-  (*pconn)->next_local_stream_id_uni = 2;
   return 0;
 }
 
-int ngtcp2_conn_server_new(ngtcp2_conn **pconn, const ngtcp2_cid *dcid,
+int ngtcp2_conn_client_new(ngtcp2_conn **pconn, const ngtcp2_cid *dcid,
                            const ngtcp2_cid *scid, uint32_t version,
                            const ngtcp2_conn_callbacks *callbacks,
-                           const ngtcp2_settings *settings, void *user_data) {
-  int rv;
-  rv = conn_new(pconn, dcid, scid, version, callbacks, settings, user_data, 1);
-  if (rv != 0) {
-    return rv;
-  }
-  (*pconn)->server = 1;
-  (*pconn)->unsent_max_remote_stream_id_bidi =
-      (*pconn)->max_remote_stream_id_bidi =
-          ngtcp2_nth_client_bidi_id(settings->max_bidi_streams);
-
-  (*pconn)->unsent_max_remote_stream_id_uni =
-      (*pconn)->max_remote_stream_id_uni =
-          ngtcp2_nth_client_uni_id(settings->max_uni_streams);
+                           const ngtcp2_settings *settings, ngtcp2_mem *mem,
+                           void *user_data) {
+  return conn_new(pconn, dcid, scid, version, callbacks, settings, mem,
+                  user_data, 0);
+}
 
-  (*pconn)->state = NGTCP2_CS_SERVER_INITIAL;
-  (*pconn)->next_local_stream_id_bidi = 1;
-  (*pconn)->next_local_stream_id_uni = 3;
-  return 0;
+int ngtcp2_conn_server_new(ngtcp2_conn **pconn, const ngtcp2_cid *dcid,
+                           const ngtcp2_cid *scid, uint32_t version,
+                           const ngtcp2_conn_callbacks *callbacks,
+                           const ngtcp2_settings *settings, ngtcp2_mem *mem,
+                           void *user_data) {
+  return conn_new(pconn, dcid, scid, version, callbacks, settings, mem,
+                  user_data, 1);
 }
 
 static void delete_buffed_pkts(ngtcp2_pkt_chain *pc, ngtcp2_mem *mem) {
@@ -355,6 +490,57 @@ static void delete_frq(ngtcp2_frame_chain *frc, ngtcp2_mem *mem) {
   }
 }
 
+/*
+ * conn_alloc_strm returns an ngtcp2_strm object taken from
+ * conn->strm_pool, or newly allocated if the pool is empty.  It
+ * returns NULL if it fails to allocate memory.
+ */
+static ngtcp2_strm *conn_alloc_strm(ngtcp2_conn *conn) {
+  ngtcp2_strm *strm = conn->strm_pool;
+
+  if (strm == NULL) {
+    return ngtcp2_mem_malloc(conn_mem(conn, NGTCP2_MEM_SUBSYS_STRM),
+                             sizeof(ngtcp2_strm));
+  }
+
+  conn->strm_pool = strm->fc_next;
+  --conn->nstrm_pool;
+
+  return strm;
+}
+
+/*
+ * conn_free_strm returns |strm|, which must have been freed by
+ * ngtcp2_strm_free, to conn->strm_pool.  If the pool is full, it
+ * deallocates |strm| instead.
+ */
+static void conn_free_strm(ngtcp2_conn *conn, ngtcp2_strm *strm) {
+  if (conn->nstrm_pool == NGTCP2_STRM_POOL_MAX) {
+    ngtcp2_mem_free(conn->mem, strm);
+    return;
+  }
+
+  strm->fc_next = conn->strm_pool;
+  conn->strm_pool = strm;
+  ++conn->nstrm_pool;
+}
+
+/*
+ * conn_release_strm_pool deallocates all objects in
+ * conn->strm_pool.
+ */
+static void conn_release_strm_pool(ngtcp2_conn *conn) {
+  ngtcp2_strm *strm, *next;
+
+  for (strm = conn->strm_pool; strm; strm = next) {
+    next = strm->fc_next;
+    ngtcp2_mem_free(conn->mem, strm);
+  }
+
+  conn->strm_pool = NULL;
+  conn->nstrm_pool = 0;
+}
+
 static int delete_strms_each(ngtcp2_map_entry *ent, void *ptr) {
   ngtcp2_mem *mem = ptr;
   ngtcp2_strm *s = ngtcp2_struct_of(ent, ngtcp2_strm, me);
@@ -375,13 +561,11 @@ static void delete_early_rtb(ngtcp2_rtb_entry *ent, ngtcp2_mem *mem) {
   }
 }
 
-void ngtcp2_conn_del(ngtcp2_conn *conn) {
-  if (conn == NULL) {
-    return;
-  }
-
-  free(conn->decrypt_buf.base);
-
+/*
+ * conn_free frees the resources of |conn| except for the ones which
+ * ngtcp2_conn_reset carries over to the next connection.
+ */
+static void conn_free(ngtcp2_conn *conn) {
   delete_buffed_pkts(conn->buffed_rx_ppkts, conn->mem);
   delete_buffed_pkts(conn->buffed_rx_hs_pkts, conn->mem);
 
@@ -390,8 +574,8 @@ void ngtcp2_conn_del(ngtcp2_conn *conn) {
   delete_frq(conn->frq, conn->mem);
 
   pktns_free(&conn->pktns, conn->mem);
-  pktns_free(&conn->hs_pktns, conn->mem);
-  pktns_free(&conn->in_pktns, conn->mem);
+  pktns_del(conn->hs_pktns, conn->mem);
+  pktns_del(conn->in_pktns, conn->mem);
 
   delete_early_rtb(conn->early_rtb, conn->mem);
 
@@ -406,39 +590,77 @@ void ngtcp2_conn_del(ngtcp2_conn *conn) {
   ngtcp2_map_free(&conn->strms);
 
   ngtcp2_strm_free(&conn->crypto);
-
-  ngtcp2_mem_free(conn->mem, conn);
 }
 
 /*
- * conn_ensure_ack_blks makes sure that |(*pfr)->ack.blks| can contain
- * at least |n| ngtcp2_ack_blk.  |*pfr| points to the ngtcp2_frame
- * object.  |*pnum_blks_max| is the number of ngtpc2_ack_blk which
- * |*pfr| can contain.
- *
- * This function returns 0 if it succeeds, or one of the following
- * negative error codes:
- *
- * NGTCP2_ERR_NOMEM
- *     Out of memory.
+ * conn_destroy frees the resources which ngtcp2_conn_reset carries
+ * over, and |conn| itself.
  */
-static int conn_ensure_ack_blks(ngtcp2_conn *conn, ngtcp2_frame **pfr,
-                                size_t *pnum_blks_max, size_t n) {
-  ngtcp2_frame *fr;
+static void conn_destroy(ngtcp2_conn *conn) {
+  ngtcp2_mem_free(conn->mem, conn->decrypt_buf.base);
+  conn_release_strm_pool(conn);
+  ngtcp2_mem_free(conn->mem, conn->recorder.records);
 
-  if (n <= *pnum_blks_max) {
-    return 0;
+  ngtcp2_mem_free(conn->macct.parent, conn);
+}
+
+void ngtcp2_conn_del(ngtcp2_conn *conn) {
+  if (conn == NULL) {
+    return;
   }
 
-  *pnum_blks_max *= 2;
-  fr = ngtcp2_mem_realloc(conn->mem, *pfr,
-                          sizeof(ngtcp2_ack) +
-                              sizeof(ngtcp2_ack_blk) * (*pnum_blks_max - 1));
-  if (fr == NULL) {
-    return NGTCP2_ERR_NOMEM;
+  conn_free(conn);
+  conn_destroy(conn);
+}
+
+int ngtcp2_conn_reset(ngtcp2_conn *conn, const ngtcp2_cid *dcid,
+                      const ngtcp2_cid *scid, uint32_t version,
+                      const ngtcp2_conn_callbacks *callbacks,
+                      const ngtcp2_settings *settings, void *user_data) {
+  ngtcp2_mem *mem = conn->mem;
+  ngtcp2_mem_acct macct;
+  int server = conn->server;
+  ngtcp2_array decrypt_buf = conn->decrypt_buf;
+  ngtcp2_strm *strm_pool = conn->strm_pool;
+  size_t nstrm_pool = conn->nstrm_pool;
+  ngtcp2_trace_record *records = conn->recorder.records;
+  int rv;
+
+  if (settings->flight_recorder_len &
+      (settings->flight_recorder_len - 1)) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
   }
 
-  *pfr = fr;
+  conn_free(conn);
+
+  if (records && (settings->trace || conn->recorder.mask + 1 !=
+                                         settings->flight_recorder_len)) {
+    ngtcp2_mem_free(mem, records);
+    records = NULL;
+  }
+
+  /* macct refers to conn itself, and it still counts the memory
+     carried over. */
+  macct = conn->macct;
+
+  memset(conn, 0, sizeof(*conn));
+
+  conn->macct = macct;
+  conn->mem = mem;
+  conn->decrypt_buf = decrypt_buf;
+  conn->strm_pool = strm_pool;
+  conn->nstrm_pool = nstrm_pool;
+  if (records) {
+    ngtcp2_trace_ring_init(&conn->recorder, records,
+                           settings->flight_recorder_len);
+  }
+
+  rv = conn_init(conn, dcid, scid, version, callbacks, settings, mem,
+                 user_data, server);
+  if (rv != 0) {
+    conn_destroy(conn);
+    return rv;
+  }
 
   return 0;
 }
@@ -467,8 +689,8 @@ static uint64_t conn_compute_ack_delay(ngtcp2_conn *conn) {
  * calling this function, and check it after this function returns.
  * If |nodelay| is nonzero, delayed ACK timer is ignored.
  *
- * The memory for ACK frame is dynamically allocated by this function.
- * A caller is responsible to free it.
+ * The ACK frame is owned by |acktr|, and it is valid until |acktr| is
+ * modified.  A caller must not free it.
  *
  * Call ngtcp2_acktr_commit_ack after a created ACK frame is
  * successfully serialized into a packet.
@@ -482,19 +704,7 @@ static uint64_t conn_compute_ack_delay(ngtcp2_conn *conn) {
 static int conn_create_ack_frame(ngtcp2_conn *conn, ngtcp2_frame **pfr,
                                  ngtcp2_acktr *acktr, ngtcp2_tstamp ts,
                                  int nodelay, uint8_t ack_delay_exponent) {
-  uint64_t first_pkt_num;
-  uint64_t last_pkt_num;
-  ngtcp2_ack_blk *blk;
-  int initial = 1;
-  uint64_t gap;
-  ngtcp2_ksl_it it;
-  ngtcp2_acktr_entry *rpkt;
   ngtcp2_frame *fr;
-  ngtcp2_ack *ack;
-  /* TODO Measure an actual size of ACK bloks to find the best default
-     value. */
-  size_t num_blks_max = 8;
-  size_t blk_idx;
   int rv;
   uint64_t max_ack_delay = (nodelay || !ngtcp2_acktr_delayed_ack(acktr))
                                ? 0
@@ -504,84 +714,14 @@ static int conn_create_ack_frame(ngtcp2_conn *conn, ngtcp2_frame **pfr,
     return 0;
   }
 
-  it = ngtcp2_acktr_get(acktr);
-  if (ngtcp2_ksl_it_end(&it)) {
-    ngtcp2_acktr_commit_ack(acktr);
-    return 0;
+  rv = ngtcp2_acktr_create_ack_frame(acktr, &fr, ts, ack_delay_exponent);
+  if (rv != 0) {
+    return rv;
   }
 
-  fr = ngtcp2_mem_malloc(conn->mem, sizeof(ngtcp2_ack) +
-                                        sizeof(ngtcp2_ack_blk) * num_blks_max);
   if (fr == NULL) {
-    return NGTCP2_ERR_NOMEM;
-  }
-
-  ack = &fr->ack;
-
-  rpkt = ngtcp2_ksl_it_get(&it);
-  first_pkt_num = last_pkt_num = rpkt->pkt_num;
-
-  ack->type = NGTCP2_FRAME_ACK;
-  ack->largest_ack = first_pkt_num;
-  ack->ack_delay_unscaled = ts - rpkt->tstamp;
-  ack->ack_delay = (ack->ack_delay_unscaled / 1000) >> ack_delay_exponent;
-  ack->num_blks = 0;
-
-  ngtcp2_ksl_it_next(&it);
-
-  for (; !ngtcp2_ksl_it_end(&it); ngtcp2_ksl_it_next(&it)) {
-    rpkt = ngtcp2_ksl_it_get(&it);
-    if (rpkt->pkt_num + 1 == last_pkt_num) {
-      last_pkt_num = rpkt->pkt_num;
-      continue;
-    }
-
-    if (initial) {
-      initial = 0;
-      ack->first_ack_blklen = first_pkt_num - last_pkt_num;
-    } else {
-      blk_idx = ack->num_blks++;
-      rv = conn_ensure_ack_blks(conn, &fr, &num_blks_max, ack->num_blks);
-      if (rv != 0) {
-        ngtcp2_mem_free(conn->mem, fr);
-        return rv;
-      }
-      ack = &fr->ack;
-      blk = &ack->blks[blk_idx];
-      blk->gap = gap;
-      blk->blklen = first_pkt_num - last_pkt_num;
-    }
-
-    gap = last_pkt_num - rpkt->pkt_num - 2;
-    first_pkt_num = last_pkt_num = rpkt->pkt_num;
-
-    if (ack->num_blks == NGTCP2_MAX_ACK_BLKS - 1) {
-      break;
-    }
-  }
-
-  if (initial) {
-    ack->first_ack_blklen = first_pkt_num - last_pkt_num;
-  } else {
-    blk_idx = ack->num_blks++;
-    rv = conn_ensure_ack_blks(conn, &fr, &num_blks_max, ack->num_blks);
-    if (rv != 0) {
-      ngtcp2_mem_free(conn->mem, fr);
-      return rv;
-    }
-    ack = &fr->ack;
-    blk = &ack->blks[blk_idx];
-    blk->gap = gap;
-    blk->blklen = first_pkt_num - last_pkt_num;
-  }
-
-  /* TODO Just remove entries which cannot fit into a single ACK frame
-     for now. */
-  if (!ngtcp2_ksl_it_end(&it)) {
-    rv = ngtcp2_acktr_forget(acktr, ngtcp2_ksl_it_get(&it));
-    if (rv != 0) {
-      return rv;
-    }
+    ngtcp2_acktr_commit_ack(acktr);
+    return 0;
   }
 
   *pfr = fr;
@@ -618,7 +758,7 @@ static void conn_on_pkt_sent(ngtcp2_conn *conn, ngtcp2_rtb *rtb,
      retransmittable packet (non-ACK only packet). */
   ngtcp2_rtb_add(rtb, ent);
 
-  if (ngtcp2_pkt_handshake_pkt(&ent->hd)) {
+  if (ngtcp2_rtb_entry_handshake_pkt(ent)) {
     conn->rcs.last_hs_tx_pkt_ts = ent->ts;
   } else {
     conn->rcs.last_tx_pkt_ts = ent->ts;
@@ -649,6 +789,73 @@ static size_t rtb_select_pkt_numlen(ngtcp2_rtb *rtb, uint64_t pkt_num) {
   return 1;
 }
 
+/*
+ * conn_stats_pkt_type returns ngtcp2_stats_pkt_type which |hd|
+ * belongs to.
+ */
+static ngtcp2_stats_pkt_type conn_stats_pkt_type(const ngtcp2_pkt_hd *hd) {
+  if (!(hd->flags & NGTCP2_PKT_FLAG_LONG_FORM)) {
+    return NGTCP2_STATS_PKT_SHORT;
+  }
+
+  switch (hd->type) {
+  case NGTCP2_PKT_INITIAL:
+    return NGTCP2_STATS_PKT_INITIAL;
+  case NGTCP2_PKT_0RTT_PROTECTED:
+    return NGTCP2_STATS_PKT_0RTT_PROTECTED;
+  default:
+    return NGTCP2_STATS_PKT_HANDSHAKE;
+  }
+}
+
+/*
+ * conn_on_pkt_written updates statistics after a packet described by
+ * |hd| whose length is |pktlen| is written.
+ */
+static void conn_on_pkt_written(ngtcp2_conn *conn, const ngtcp2_pkt_hd *hd,
+                                size_t pktlen) {
+  ngtcp2_stats_pkt_type type = conn_stats_pkt_type(hd);
+
+  ++conn->stats.pkts_sent[type];
+  conn->stats.bytes_sent[type] += pktlen;
+
+  ngtcp2_log_tx_pkt(&conn->log, hd, pktlen);
+}
+
+/*
+ * conn_on_pkt_decrypted updates statistics after a packet described
+ * by |hd| whose length is |pktlen| is successfully decrypted.
+ */
+static void conn_on_pkt_decrypted(ngtcp2_conn *conn, const ngtcp2_pkt_hd *hd,
+                                  size_t pktlen) {
+  ngtcp2_stats_pkt_type type = conn_stats_pkt_type(hd);
+
+  ++conn->stats.pkts_recv[type];
+  conn->stats.bytes_recv[type] += pktlen;
+
+  ngtcp2_log_rx_pkt(&conn->log, hd, pktlen);
+}
+
+/*
+ * conn_update_fc_blocked records the time during which sending stream
+ * data is blocked by flow control.  |blocked| is nonzero if stream
+ * data cannot be sent at |ts| because of flow control.
+ */
+static void conn_update_fc_blocked(ngtcp2_conn *conn, int blocked,
+                                   ngtcp2_tstamp ts) {
+  if (blocked) {
+    if (conn->fc_blocked_ts == UINT64_MAX) {
+      conn->fc_blocked_ts = ts;
+    }
+    return;
+  }
+
+  if (conn->fc_blocked_ts != UINT64_MAX) {
+    conn->stats.fc_blocked_duration += ts - conn->fc_blocked_ts;
+    conn->fc_blocked_ts = UINT64_MAX;
+  }
+}
+
 /*
  * conn_retransmit_pkt writes QUIC packet in the buffer pointed by
  * |dest| whose length is |destlen| to retransmit lost packet.
@@ -668,7 +875,7 @@ static ssize_t conn_retransmit_pkt(ngtcp2_conn *conn, uint8_t *dest,
                                    ngtcp2_rtb_entry *ent, ngtcp2_tstamp ts) {
   int rv;
   ngtcp2_ppe ppe;
-  ngtcp2_pkt_hd hd = ent->hd;
+  ngtcp2_pkt_hd hd;
   ngtcp2_frame_chain **pfrc, *frc;
   ngtcp2_frame *ackfr;
   ngtcp2_frame localfr;
@@ -677,10 +884,8 @@ static ssize_t conn_retransmit_pkt(ngtcp2_conn *conn, uint8_t *dest,
   ngtcp2_crypto_ctx ctx;
   ngtcp2_strm *strm;
 
-  /* This is required because ent->hd may have old client version. */
-  hd.version = conn->version;
-  if (hd.flags & NGTCP2_PKT_FLAG_LONG_FORM) {
-    switch (hd.type) {
+  if (ent->pkt_flags & NGTCP2_PKT_FLAG_LONG_FORM) {
+    switch (ent->pkt_type) {
     case NGTCP2_PKT_INITIAL:
       ctx.aead_overhead = NGTCP2_INITIAL_AEAD_OVERHEAD;
       ctx.encrypt = conn->callbacks.in_encrypt;
@@ -703,7 +908,7 @@ static ssize_t conn_retransmit_pkt(ngtcp2_conn *conn, uint8_t *dest,
       assert(0);
     }
   } else {
-    assert(hd.type == NGTCP2_PKT_SHORT);
+    assert(ent->pkt_type == NGTCP2_PKT_SHORT);
 
     ctx.aead_overhead = conn->aead_overhead;
     ctx.encrypt = conn->callbacks.encrypt;
@@ -713,8 +918,17 @@ static ssize_t conn_retransmit_pkt(ngtcp2_conn *conn, uint8_t *dest,
 
   ctx.user_data = conn;
 
-  hd.pkt_num = pktns->last_tx_pkt_num + 1;
-  hd.pkt_numlen = rtb_select_pkt_numlen(&pktns->rtb, hd.pkt_num);
+  /* ent does not remember connection IDs.  Client keeps sending
+     Initial packet to the DCID it chose randomly. */
+  ngtcp2_pkt_hd_init(
+      &hd, ent->pkt_flags, ent->pkt_type,
+      (!conn->server && ent->pkt_type == NGTCP2_PKT_INITIAL &&
+       (ent->pkt_flags & NGTCP2_PKT_FLAG_LONG_FORM))
+          ? &conn->rcid
+          : &conn->dcid,
+      &conn->scid, pktns->last_tx_pkt_num + 1,
+      rtb_select_pkt_numlen(&pktns->rtb, pktns->last_tx_pkt_num + 1),
+      conn->version, 0);
 
   ngtcp2_ppe_init(&ppe, dest, destlen, &ctx);
 
@@ -803,7 +1017,6 @@ static ssize_t conn_retransmit_pkt(ngtcp2_conn *conn, uint8_t *dest,
   if (ackfr) {
     rv = conn_ppe_write_frame(conn, &ppe, &hd, ackfr);
     if (rv != 0) {
-      ngtcp2_mem_free(conn->mem, ackfr);
       if (rv != NGTCP2_ERR_NOBUF) {
         return rv;
       }
@@ -811,12 +1024,13 @@ static ssize_t conn_retransmit_pkt(ngtcp2_conn *conn, uint8_t *dest,
       ngtcp2_acktr_commit_ack(&pktns->acktr);
       ngtcp2_acktr_add_ack(&pktns->acktr, hd.pkt_num, &ackfr->ack, ts,
                            0 /* ack_only */);
+      ++conn->stats.acks_sent;
     }
   }
 
   assert(!*pfrc);
 
-  ent->hd = hd;
+  ent->pkt_num = hd.pkt_num;
 
   if (!conn->server && hd.type == NGTCP2_PKT_INITIAL) {
     localfr.type = NGTCP2_FRAME_PADDING;
@@ -830,6 +1044,10 @@ static ssize_t conn_retransmit_pkt(ngtcp2_conn *conn, uint8_t *dest,
     return nwrite;
   }
 
+  conn_on_pkt_written(conn, &hd, (size_t)nwrite);
+  ++conn->stats.pkts_retransmitted;
+  conn->stats.bytes_retransmitted += (uint64_t)nwrite;
+
   ++pktns->last_tx_pkt_num;
 
   return nwrite;
@@ -870,8 +1088,8 @@ static ssize_t conn_retransmit_pktns(ngtcp2_conn *conn, uint8_t *dest,
 
     ngtcp2_rtb_lost_pop(&pktns->rtb);
 
-    if (ent->hd.flags & NGTCP2_PKT_FLAG_LONG_FORM) {
-      switch (ent->hd.type) {
+    if (ent->pkt_flags & NGTCP2_PKT_FLAG_LONG_FORM) {
+      switch (ent->pkt_type) {
       case NGTCP2_PKT_INITIAL:
       case NGTCP2_PKT_0RTT_PROTECTED:
       case NGTCP2_PKT_HANDSHAKE:
@@ -907,7 +1125,7 @@ static ssize_t conn_retransmit_pktns(ngtcp2_conn *conn, uint8_t *dest,
       return nwrite;
     }
 
-    ent->pktlen = (size_t)nwrite;
+    ent->pktlen = (uint32_t)nwrite;
     ent->ts = ts;
     conn_on_pkt_sent(conn, &pktns->rtb, ent);
 
@@ -938,14 +1156,16 @@ static ssize_t conn_retransmit(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
                                ngtcp2_tstamp ts) {
   ssize_t nwrite;
 
-  nwrite = conn_retransmit_pktns(conn, dest, destlen, &conn->in_pktns, ts);
-  if (nwrite) {
-    return nwrite;
-  }
+  if (conn->in_pktns) {
+    nwrite = conn_retransmit_pktns(conn, dest, destlen, conn->in_pktns, ts);
+    if (nwrite) {
+      return nwrite;
+    }
 
-  nwrite = conn_retransmit_pktns(conn, dest, destlen, &conn->hs_pktns, ts);
-  if (nwrite) {
-    return nwrite;
+    nwrite = conn_retransmit_pktns(conn, dest, destlen, conn->hs_pktns, ts);
+    if (nwrite) {
+      return nwrite;
+    }
   }
 
   return conn_retransmit_pktns(conn, dest, destlen, &conn->pktns, ts);
@@ -961,6 +1181,7 @@ static ssize_t conn_retransmit_unacked(ngtcp2_conn *conn, uint8_t *dest,
   ssize_t nwrite;
   ngtcp2_frame_chain *nfrc;
   ngtcp2_rtb_entry *nent;
+  ngtcp2_pkt_hd hd;
   int rv;
   ngtcp2_ksl_it it;
   ngtcp2_rtb *rtb = &conn->pktns.rtb;
@@ -974,19 +1195,24 @@ static ssize_t conn_retransmit_unacked(ngtcp2_conn *conn, uint8_t *dest,
     }
 
     /* TODO It would be better to avoid copy here.*/
-    nfrc = ngtcp2_frame_chain_list_copy(ent->frc, conn->mem);
+    nfrc = ngtcp2_frame_chain_list_copy(
+        ent->frc, conn_mem(conn, NGTCP2_MEM_SUBSYS_FRAME));
     if (!nfrc) {
       return NGTCP2_ERR_NOMEM;
     }
 
-    rv = ngtcp2_rtb_entry_new(&nent, &ent->hd, nfrc, ts, 0,
-                              NGTCP2_RTB_FLAG_PROBE, conn->mem);
+    ngtcp2_pkt_hd_init(&hd, ent->pkt_flags, ent->pkt_type, NULL, NULL,
+                       ent->pkt_num, 0, 0, 0);
+
+    rv = ngtcp2_rtb_entry_new(&nent, &hd, nfrc, ts, 0,
+                              NGTCP2_RTB_FLAG_PROBE,
+                              conn_mem(conn, NGTCP2_MEM_SUBSYS_RTB));
     if (rv != 0) {
       ngtcp2_frame_chain_list_del(nfrc, conn->mem);
       return rv;
     }
 
-    nent->src_pkt_num = (int64_t)ent->hd.pkt_num;
+    nent->src_pkt_num = (int64_t)ent->pkt_num;
 
     nwrite = conn_retransmit_pkt(conn, dest, destlen, &conn->pktns, nent, ts);
     if (nwrite < 0) {
@@ -998,7 +1224,7 @@ static ssize_t conn_retransmit_unacked(ngtcp2_conn *conn, uint8_t *dest,
       continue;
     }
 
-    nent->pktlen = (size_t)nwrite;
+    nent->pktlen = (uint32_t)nwrite;
     nent->ts = ts;
     conn_on_pkt_sent(conn, rtb, nent);
 
@@ -1059,15 +1285,15 @@ static ssize_t conn_create_crypto_frame(ngtcp2_conn *conn,
     return 0;
   }
 
-  rv = ngtcp2_frame_chain_extralen_new(pfrc, sizeof(ngtcp2_vec) * (datacnt - 1),
-                                       conn->mem);
+  rv = ngtcp2_frame_chain_extralen_new(pfrc, NGTCP2_FRAME_CRYPTO,
+                                       sizeof(ngtcp2_vec) * (datacnt - 1),
+                                       conn_mem(conn, NGTCP2_MEM_SUBSYS_FRAME));
   if (rv != 0) {
     return (ssize_t)rv;
   }
 
   fr = &(*pfrc)->fr.crypto;
 
-  fr->type = NGTCP2_FRAME_CRYPTO;
   fr->ordered_offset = conn->crypto.tx_offset;
   fr->offset = pktns->crypto_tx_offset;
   fr->datacnt = datacnt;
@@ -1095,6 +1321,10 @@ static ssize_t conn_create_crypto_frame(ngtcp2_conn *conn,
     }
   }
 
+  if (conn->in_pktns == NULL) {
+    ngtcp2_ringbuf_release(rb);
+  }
+
   return (ssize_t)nwrite;
 }
 
@@ -1141,16 +1371,16 @@ static ssize_t conn_write_handshake_pkt(ngtcp2_conn *conn, uint8_t *dest,
 
   switch (type) {
   case NGTCP2_PKT_INITIAL:
-    assert(conn->in_pktns.tx_ckm);
-    pktns = &conn->in_pktns;
+    assert(conn->in_pktns->tx_ckm);
+    pktns = conn->in_pktns;
     ctx.ckm = pktns->tx_ckm;
     ctx.aead_overhead = NGTCP2_INITIAL_AEAD_OVERHEAD;
     ctx.encrypt = conn->callbacks.in_encrypt;
     ctx.encrypt_pn = conn->callbacks.in_encrypt_pn;
     break;
   case NGTCP2_PKT_HANDSHAKE:
-    assert(conn->hs_pktns.tx_ckm);
-    pktns = &conn->hs_pktns;
+    assert(conn->hs_pktns->tx_ckm);
+    pktns = conn->hs_pktns;
     ctx.ckm = pktns->tx_ckm;
     ctx.aead_overhead = conn->aead_overhead;
     ctx.encrypt = conn->callbacks.encrypt;
@@ -1198,7 +1428,6 @@ static ssize_t conn_write_handshake_pkt(ngtcp2_conn *conn, uint8_t *dest,
     if (ackfr) {
       rv = ngtcp2_ppe_encode_frame(&ppe, ackfr);
       if (rv != 0) {
-        ngtcp2_mem_free(conn->mem, ackfr);
         return rv;
       }
 
@@ -1208,6 +1437,7 @@ static ssize_t conn_write_handshake_pkt(ngtcp2_conn *conn, uint8_t *dest,
 
       ack_ent = ngtcp2_acktr_add_ack(&pktns->acktr, hd.pkt_num, &ackfr->ack, ts,
                                      0 /* ack_only */);
+      ++conn->stats.acks_sent;
     }
   }
 
@@ -1246,7 +1476,8 @@ static ssize_t conn_write_handshake_pkt(ngtcp2_conn *conn, uint8_t *dest,
 
       if (pr_encoded) {
         rv = ngtcp2_rtb_entry_new(&rtbent, &hd, NULL, ts, (size_t)spktlen,
-                                  NGTCP2_RTB_FLAG_NONE, conn->mem);
+                                  NGTCP2_RTB_FLAG_NONE,
+                                  conn_mem(conn, NGTCP2_MEM_SUBSYS_RTB));
         if (rv != 0) {
           return rv;
         }
@@ -1254,6 +1485,8 @@ static ssize_t conn_write_handshake_pkt(ngtcp2_conn *conn, uint8_t *dest,
         conn_on_pkt_sent(conn, &pktns->rtb, rtbent);
       }
 
+      conn_on_pkt_written(conn, &hd, (size_t)spktlen);
+
       ++pktns->last_tx_pkt_num;
 
       return spktlen;
@@ -1315,7 +1548,8 @@ static ssize_t conn_write_handshake_pkt(ngtcp2_conn *conn, uint8_t *dest,
 
   if (frc_head || pr_encoded) {
     rv = ngtcp2_rtb_entry_new(&rtbent, &hd, frc_head, ts, (size_t)spktlen,
-                              NGTCP2_RTB_FLAG_NONE, conn->mem);
+                              NGTCP2_RTB_FLAG_NONE,
+                              conn_mem(conn, NGTCP2_MEM_SUBSYS_RTB));
     if (rv != 0) {
       goto fail;
     }
@@ -1325,6 +1559,8 @@ static ssize_t conn_write_handshake_pkt(ngtcp2_conn *conn, uint8_t *dest,
     ack_ent->ack_only = 1;
   }
 
+  conn_on_pkt_written(conn, &hd, (size_t)spktlen);
+
   ++pktns->last_tx_pkt_num;
 
   return spktlen;
@@ -1364,6 +1600,7 @@ static ssize_t conn_write_handshake_ack_pkt(ngtcp2_conn *conn, uint8_t *dest,
   ngtcp2_frame *ackfr;
   ngtcp2_crypto_ctx ctx;
   uint8_t type;
+  ssize_t spktlen;
 
   if (!pktns->tx_ckm) {
     return 0;
@@ -1379,13 +1616,13 @@ static ssize_t conn_write_handshake_ack_pkt(ngtcp2_conn *conn, uint8_t *dest,
     return 0;
   }
 
-  if (pktns == &conn->in_pktns) {
+  if (pktns == conn->in_pktns) {
     ctx.aead_overhead = NGTCP2_INITIAL_AEAD_OVERHEAD;
     ctx.encrypt = conn->callbacks.in_encrypt;
     ctx.encrypt_pn = conn->callbacks.in_encrypt_pn;
     type = NGTCP2_PKT_INITIAL;
   } else {
-    assert(pktns == &conn->hs_pktns);
+    assert(pktns == conn->hs_pktns);
     ctx.aead_overhead = conn->aead_overhead;
     ctx.encrypt = conn->callbacks.encrypt;
     ctx.encrypt_pn = conn->callbacks.encrypt_pn;
@@ -1405,12 +1642,12 @@ static ssize_t conn_write_handshake_ack_pkt(ngtcp2_conn *conn, uint8_t *dest,
 
   rv = ngtcp2_ppe_encode_hd(&ppe, &hd);
   if (rv != 0) {
-    goto fail;
+    return rv;
   }
 
   rv = ngtcp2_ppe_encode_frame(&ppe, ackfr);
   if (rv != 0) {
-    goto fail;
+    return rv;
   }
 
   ngtcp2_log_tx_fr(&conn->log, &hd, ackfr);
@@ -1419,14 +1656,16 @@ static ssize_t conn_write_handshake_ack_pkt(ngtcp2_conn *conn, uint8_t *dest,
 
   ngtcp2_acktr_add_ack(&pktns->acktr, hd.pkt_num, &ackfr->ack, ts,
                        1 /* ack_only*/);
+  ++conn->stats.acks_sent;
 
   ++pktns->last_tx_pkt_num;
 
-  return ngtcp2_ppe_final(&ppe, NULL);
+  spktlen = ngtcp2_ppe_final(&ppe, NULL);
+  if (spktlen >= 0) {
+    conn_on_pkt_written(conn, &hd, (size_t)spktlen);
+  }
 
-fail:
-  ngtcp2_mem_free(conn->mem, ackfr);
-  return rv;
+  return spktlen;
 }
 
 /*
@@ -1438,8 +1677,12 @@ static ssize_t conn_write_handshake_ack_pkts(ngtcp2_conn *conn, uint8_t *dest,
                                              size_t destlen, ngtcp2_tstamp ts) {
   ssize_t in_nwrite, hs_nwrite;
 
+  if (conn->in_pktns == NULL) {
+    return 0;
+  }
+
   in_nwrite =
-      conn_write_handshake_ack_pkt(conn, dest, destlen, &conn->in_pktns, ts);
+      conn_write_handshake_ack_pkt(conn, dest, destlen, conn->in_pktns, ts);
   if (in_nwrite < 0) {
     return in_nwrite;
   }
@@ -1448,7 +1691,7 @@ static ssize_t conn_write_handshake_ack_pkts(ngtcp2_conn *conn, uint8_t *dest,
   destlen -= (size_t)in_nwrite;
 
   hs_nwrite =
-      conn_write_handshake_ack_pkt(conn, dest, destlen, &conn->hs_pktns, ts);
+      conn_write_handshake_ack_pkt(conn, dest, destlen, conn->hs_pktns, ts);
   if (hs_nwrite < 0) {
     if (ngtcp2_err_is_fatal((int)hs_nwrite)) {
       return hs_nwrite;
@@ -1698,6 +1941,7 @@ static ssize_t conn_write_pkt(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
   int ack_only;
   ngtcp2_pktns *pktns = &conn->pktns;
   size_t left;
+  int mem_exhausted;
 
   if (data_strm) {
     ndatalen =
@@ -1706,16 +1950,21 @@ static ssize_t conn_write_pkt(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
     if (ndatalen || (datalen == 0 && fin)) {
       send_stream = 1;
     }
+    conn_update_fc_blocked(conn, datalen > 0 && ndatalen == 0, ts);
   }
 
+  /* Flow control windows are not extended while memory is exhausted,
+     so that the remote endpoint cannot make us buffer more. */
+  mem_exhausted = conn_mem_exhausted(conn);
+
   if ((conn->frq || send_stream || conn_should_send_max_data(conn) ||
        ngtcp2_ringbuf_len(&conn->tx_crypto_data)) &&
-      conn->unsent_max_rx_offset > conn->max_rx_offset) {
-    rv = ngtcp2_frame_chain_new(&nfrc, conn->mem);
+      conn->unsent_max_rx_offset > conn->max_rx_offset && !mem_exhausted) {
+    rv = ngtcp2_frame_chain_new(&nfrc, NGTCP2_FRAME_MAX_DATA,
+                                conn_mem(conn, NGTCP2_MEM_SUBSYS_FRAME));
     if (rv != 0) {
       return rv;
     }
-    nfrc->fr.type = NGTCP2_FRAME_MAX_DATA;
     nfrc->fr.max_data.max_data = conn->unsent_max_rx_offset;
     nfrc->next = conn->frq;
     conn->frq = nfrc;
@@ -1723,13 +1972,13 @@ static ssize_t conn_write_pkt(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
     conn->max_rx_offset = conn->unsent_max_rx_offset;
   }
 
-  while (conn->fc_strms) {
+  while (conn->fc_strms && !mem_exhausted) {
     strm = conn->fc_strms;
-    rv = ngtcp2_frame_chain_new(&nfrc, conn->mem);
+    rv = ngtcp2_frame_chain_new(&nfrc, NGTCP2_FRAME_MAX_STREAM_DATA,
+                                conn_mem(conn, NGTCP2_MEM_SUBSYS_FRAME));
     if (rv != 0) {
       return rv;
     }
-    nfrc->fr.type = NGTCP2_FRAME_MAX_STREAM_DATA;
     nfrc->fr.max_stream_data.stream_id = strm->stream_id;
     nfrc->fr.max_stream_data.max_stream_data = strm->unsent_max_rx_offset;
     nfrc->next = conn->frq;
@@ -1760,9 +2009,11 @@ static ssize_t conn_write_pkt(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
   }
 
   ackfr = NULL;
+  NGTCP2_PHASE_BEGIN(&conn->phase, NGTCP2_PHASE_WRITE_ACK);
   rv = conn_create_ack_frame(conn, &ackfr, &pktns->acktr, ts,
                              !ack_only /* nodelay */,
                              conn->local_settings.ack_delay_exponent);
+  NGTCP2_PHASE_END(&conn->phase, NGTCP2_PHASE_WRITE_ACK);
   if (rv != 0) {
     return rv;
   }
@@ -1787,21 +2038,20 @@ static ssize_t conn_write_pkt(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
 
   rv = ngtcp2_ppe_encode_hd(&ppe, &hd);
   if (rv != 0) {
-    goto fail;
+    return rv;
   }
 
   if (ackfr) {
     rv = conn_ppe_write_frame(conn, &ppe, &hd, ackfr);
     if (rv != 0) {
-      goto fail;
+      return rv;
     }
     ngtcp2_acktr_commit_ack(&pktns->acktr);
     pkt_empty = 0;
 
     ack_ent = ngtcp2_acktr_add_ack(&pktns->acktr, hd.pkt_num, &ackfr->ack, ts,
                                    0 /*ack_only*/);
-    /* Now ackfr is owned by conn->acktr. */
-    ackfr = NULL;
+    ++conn->stats.acks_sent;
   }
 
   for (pfrc = &conn->frq; *pfrc;) {
@@ -1842,11 +2092,11 @@ static ssize_t conn_write_pkt(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
   if (rv != NGTCP2_ERR_NOBUF && *pfrc == NULL &&
       conn->unsent_max_remote_stream_id_bidi >
           conn->max_remote_stream_id_bidi) {
-    rv = ngtcp2_frame_chain_new(&nfrc, conn->mem);
+    rv = ngtcp2_frame_chain_new(&nfrc, NGTCP2_FRAME_MAX_STREAM_ID,
+                                conn_mem(conn, NGTCP2_MEM_SUBSYS_FRAME));
     if (rv != 0) {
       return rv;
     }
-    nfrc->fr.type = NGTCP2_FRAME_MAX_STREAM_ID;
     nfrc->fr.max_stream_id.max_stream_id =
         conn->unsent_max_remote_stream_id_bidi;
     *pfrc = nfrc;
@@ -1864,11 +2114,11 @@ static ssize_t conn_write_pkt(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
 
   if (rv != NGTCP2_ERR_NOBUF && *pfrc == NULL &&
       conn->unsent_max_remote_stream_id_uni > conn->max_remote_stream_id_uni) {
-    rv = ngtcp2_frame_chain_new(&nfrc, conn->mem);
+    rv = ngtcp2_frame_chain_new(&nfrc, NGTCP2_FRAME_MAX_STREAM_ID,
+                                conn_mem(conn, NGTCP2_MEM_SUBSYS_FRAME));
     if (rv != 0) {
       return rv;
     }
-    nfrc->fr.type = NGTCP2_FRAME_MAX_STREAM_ID;
     nfrc->fr.max_stream_id.max_stream_id =
         conn->unsent_max_remote_stream_id_uni;
     *pfrc = nfrc;
@@ -1925,12 +2175,12 @@ static ssize_t conn_write_pkt(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
 
     fin = fin && ndatalen == datalen;
 
-    rv = ngtcp2_frame_chain_new(&nfrc, conn->mem);
+    rv = ngtcp2_frame_chain_new(&nfrc, NGTCP2_FRAME_STREAM,
+                                conn_mem(conn, NGTCP2_MEM_SUBSYS_FRAME));
     if (rv != 0) {
       return rv;
     }
 
-    nfrc->fr.type = NGTCP2_FRAME_STREAM;
     nfrc->fr.stream.flags = 0;
     nfrc->fr.stream.fin = fin;
     nfrc->fr.stream.stream_id = data_strm->stream_id;
@@ -1957,14 +2207,17 @@ static ssize_t conn_write_pkt(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
     return rv;
   }
 
+  NGTCP2_PHASE_BEGIN(&conn->phase, NGTCP2_PHASE_WRITE_ENCRYPT);
   nwrite = ngtcp2_ppe_final(&ppe, NULL);
+  NGTCP2_PHASE_END(&conn->phase, NGTCP2_PHASE_WRITE_ENCRYPT);
   if (nwrite < 0) {
     return nwrite;
   }
 
   if (*pfrc != conn->frq) {
     rv = ngtcp2_rtb_entry_new(&ent, &hd, NULL, ts, (size_t)nwrite,
-                              NGTCP2_RTB_FLAG_NONE, conn->mem);
+                              NGTCP2_RTB_FLAG_NONE,
+                              conn_mem(conn, NGTCP2_MEM_SUBSYS_RTB));
     if (rv != 0) {
       return rv;
     }
@@ -1991,13 +2244,11 @@ static ssize_t conn_write_pkt(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
     *pdatalen = (ssize_t)ndatalen;
   }
 
+  conn_on_pkt_written(conn, &hd, (size_t)nwrite);
+
   ++pktns->last_tx_pkt_num;
 
   return nwrite;
-
-fail:
-  ngtcp2_mem_free(conn->mem, ackfr);
-  return rv;
 }
 
 /*
@@ -2027,14 +2278,14 @@ static ssize_t conn_write_single_frame_pkt(ngtcp2_conn *conn, uint8_t *dest,
 
   switch (type) {
   case NGTCP2_PKT_INITIAL:
-    pktns = &conn->in_pktns;
+    pktns = conn->in_pktns;
     ctx.aead_overhead = NGTCP2_INITIAL_AEAD_OVERHEAD;
     ctx.encrypt = conn->callbacks.in_encrypt;
     ctx.encrypt_pn = conn->callbacks.in_encrypt_pn;
     flags = NGTCP2_PKT_FLAG_LONG_FORM;
     break;
   case NGTCP2_PKT_HANDSHAKE:
-    pktns = &conn->hs_pktns;
+    pktns = conn->hs_pktns;
     ctx.aead_overhead = conn->aead_overhead;
     ctx.encrypt = conn->callbacks.encrypt;
     ctx.encrypt_pn = conn->callbacks.encrypt_pn;
@@ -2084,8 +2335,11 @@ static ssize_t conn_write_single_frame_pkt(ngtcp2_conn *conn, uint8_t *dest,
   if (fr->type == NGTCP2_FRAME_ACK) {
     ngtcp2_acktr_add_ack(&pktns->acktr, hd.pkt_num, &fr->ack, ts,
                          1 /* ack_only */);
+    ++conn->stats.acks_sent;
   }
 
+  conn_on_pkt_written(conn, &hd, (size_t)nwrite);
+
   ++pktns->last_tx_pkt_num;
 
   return nwrite;
@@ -2127,7 +2381,6 @@ static ssize_t conn_write_protected_ack_pkt(ngtcp2_conn *conn, uint8_t *dest,
   spktlen = conn_write_single_frame_pkt(conn, dest, destlen, 0 /* Short */,
                                         ackfr, ts);
   if (spktlen < 0) {
-    ngtcp2_mem_free(conn->mem, ackfr);
     return spktlen;
   }
 
@@ -2168,11 +2421,6 @@ static int conn_process_early_rtb(ngtcp2_conn *conn) {
       ent = next;
     }
   } else {
-    /* 0-RTT packet has initial random DCID */
-    for (ent = conn->early_rtb; ent; ent = ent->next) {
-      ent->hd.dcid = conn->dcid;
-    }
-
     ngtcp2_rtb_insert_range(rtb, conn->early_rtb);
   }
   conn->early_rtb = NULL;
@@ -2190,8 +2438,10 @@ static ssize_t conn_write_probe_pkt(ngtcp2_conn *conn, uint8_t *dest,
                   "transmit probe pkt left=%zu", conn->rcs.probe_pkt_left);
 
   /* a probe packet is not blocked by cwnd. */
+  NGTCP2_PHASE_BEGIN(&conn->phase, NGTCP2_PHASE_WRITE_PKT);
   nwrite = conn_write_pkt(conn, dest, destlen, pdatalen, strm, fin, data,
                           datalen, ts);
+  NGTCP2_PHASE_END(&conn->phase, NGTCP2_PHASE_WRITE_PKT);
   if (nwrite == 0) {
     nwrite = conn_retransmit_unacked(conn, dest, destlen, ts);
   }
@@ -2261,8 +2511,11 @@ ssize_t ngtcp2_conn_write_pkt(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
       return NGTCP2_ERR_CONGESTION;
     }
 
-    return conn_write_pkt(conn, dest, ngtcp2_min(destlen, cwnd), NULL, NULL, 0,
-                          NULL, 0, ts);
+    NGTCP2_PHASE_BEGIN(&conn->phase, NGTCP2_PHASE_WRITE_PKT);
+    nwrite = conn_write_pkt(conn, dest, ngtcp2_min(destlen, cwnd), NULL, NULL,
+                            0, NULL, 0, ts);
+    NGTCP2_PHASE_END(&conn->phase, NGTCP2_PHASE_WRITE_PKT);
+    return nwrite;
   case NGTCP2_CS_CLOSING:
     return NGTCP2_ERR_CLOSING;
   case NGTCP2_CS_DRAINING:
@@ -2357,6 +2610,8 @@ static int conn_recv_ack(ngtcp2_conn *conn, ngtcp2_pktns *pktns,
     return rv;
   }
 
+  ++conn->stats.acks_recv;
+
   rv = ngtcp2_acktr_recv_ack(&pktns->acktr, fr, conn, ts);
   if (rv != 0) {
     return rv;
@@ -2448,7 +2703,7 @@ static int conn_recv_max_stream_data(ngtcp2_conn *conn,
       return 0;
     }
 
-    strm = ngtcp2_mem_malloc(conn->mem, sizeof(ngtcp2_strm));
+    strm = conn_alloc_strm(conn);
     if (strm == NULL) {
       return NGTCP2_ERR_NOMEM;
     }
@@ -2480,11 +2735,12 @@ static int conn_buffer_pkt(ngtcp2_conn *conn, ngtcp2_pkt_chain **ppc,
        ppc = &(*ppc)->next, ++i)
     ;
 
-  if (i == NGTCP2_MAX_NUM_BUFFED_RX_PKTS) {
+  if (i == NGTCP2_MAX_NUM_BUFFED_RX_PKTS || conn_mem_exhausted(conn)) {
     return 0;
   }
 
-  rv = ngtcp2_pkt_chain_new(&pc, pkt, pktlen, ts, conn->mem);
+  rv = ngtcp2_pkt_chain_new(&pc, pkt, pktlen, ts,
+                            conn_mem(conn, NGTCP2_MEM_SUBSYS_PKT));
   if (rv != 0) {
     return rv;
   }
@@ -2711,15 +2967,23 @@ static void conn_recv_connection_close(ngtcp2_conn *conn) {
   conn->state = NGTCP2_CS_DRAINING;
 }
 
-static void conn_recv_path_challenge(ngtcp2_conn *conn,
-                                     ngtcp2_path_challenge *fr,
-                                     ngtcp2_tstamp ts) {
+static int conn_recv_path_challenge(ngtcp2_conn *conn,
+                                    ngtcp2_path_challenge *fr,
+                                    ngtcp2_tstamp ts) {
   ngtcp2_path_challenge_entry *ent;
+  int rv;
+
+  rv = ngtcp2_ringbuf_reserve(&conn->rx_path_challenge);
+  if (rv != 0) {
+    return rv;
+  }
 
   ent = ngtcp2_ringbuf_push_front(&conn->rx_path_challenge);
   ent->ts = ts;
   assert(sizeof(ent->data) == sizeof(fr->data));
   ngtcp2_cpymem(ent->data, fr->data, sizeof(ent->data));
+
+  return 0;
 }
 
 static void conn_recv_path_response(ngtcp2_conn *conn,
@@ -2762,6 +3026,26 @@ static void conn_update_rx_bw(ngtcp2_conn *conn, size_t datalen,
   }
 }
 
+/*
+ * conn_is_own_scid returns nonzero if |cid| is one of the source
+ * connection IDs which a local endpoint has issued.
+ */
+static int conn_is_own_scid(ngtcp2_conn *conn, const ngtcp2_cid *cid) {
+  size_t i;
+
+  if (ngtcp2_cid_eq(&conn->scid, cid)) {
+    return 1;
+  }
+
+  for (i = 0; i < conn->nscid_pool; ++i) {
+    if (ngtcp2_cid_eq(&conn->scid_pool[i], cid)) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
 static ssize_t conn_recv_pkt(ngtcp2_conn *conn, const uint8_t *pkt,
                              size_t pktlen, ngtcp2_tstamp ts);
 
@@ -2947,19 +3231,19 @@ static ssize_t conn_recv_handshake_pkt(ngtcp2_conn *conn, const uint8_t *pkt,
       return (ssize_t)pktlen;
     }
 
-    pktns = &conn->in_pktns;
+    pktns = conn->in_pktns;
     encrypt_pn = conn->callbacks.in_encrypt_pn;
     decrypt = conn->callbacks.in_decrypt;
     aead_overhead = NGTCP2_INITIAL_AEAD_OVERHEAD;
     if (conn->server && conn->early_ckm) {
       max_crypto_rx_offset = conn->early_crypto_rx_offset_base;
     } else {
-      max_crypto_rx_offset = conn->hs_pktns.crypto_rx_offset_base;
+      max_crypto_rx_offset = conn->hs_pktns->crypto_rx_offset_base;
     }
 
     break;
   case NGTCP2_PKT_HANDSHAKE:
-    if (!conn->hs_pktns.rx_ckm) {
+    if (!conn->hs_pktns->rx_ckm) {
       rv = conn_buffer_handshake_pkt(conn, pkt, pktlen, ts);
       if (rv != 0) {
         return rv;
@@ -2967,7 +3251,7 @@ static ssize_t conn_recv_handshake_pkt(ngtcp2_conn *conn, const uint8_t *pkt,
       return (ssize_t)pktlen;
     }
 
-    pktns = &conn->hs_pktns;
+    pktns = conn->hs_pktns;
     encrypt_pn = conn->callbacks.encrypt_pn;
     decrypt = conn->callbacks.decrypt;
     aead_overhead = conn->aead_overhead;
@@ -3013,6 +3297,8 @@ static ssize_t conn_recv_handshake_pkt(ngtcp2_conn *conn, const uint8_t *pkt,
     return (int)nwrite;
   }
 
+  conn_on_pkt_decrypted(conn, &hd, hdpktlen + payloadlen);
+
   payload = conn->decrypt_buf.base;
   payloadlen = (size_t)nwrite;
 
@@ -3078,6 +3364,9 @@ static ssize_t conn_recv_handshake_pkt(ngtcp2_conn *conn, const uint8_t *pkt,
       rv = conn_recv_crypto(conn, pktns->crypto_rx_offset_base,
                             max_crypto_rx_offset, &fr->crypto);
       if (rv != 0) {
+        if (rv == NGTCP2_ERR_DISCARD_PKT) {
+          return (ssize_t)pktlen;
+        }
         return rv;
       }
       require_ack = 1;
@@ -3089,7 +3378,10 @@ static ssize_t conn_recv_handshake_pkt(ngtcp2_conn *conn, const uint8_t *pkt,
       }
       return NGTCP2_ERR_PROTO;
     case NGTCP2_FRAME_PATH_CHALLENGE:
-      conn_recv_path_challenge(conn, &fr->path_challenge, ts);
+      rv = conn_recv_path_challenge(conn, &fr->path_challenge, ts);
+      if (rv != 0) {
+        return rv;
+      }
       require_ack = 1;
       break;
     case NGTCP2_FRAME_PATH_RESPONSE:
@@ -3151,9 +3443,9 @@ int ngtcp2_conn_init_stream(ngtcp2_conn *conn, ngtcp2_strm *strm,
   rv = ngtcp2_strm_init(strm, stream_id, NGTCP2_STRM_FLAG_NONE,
                         conn->local_settings.max_stream_data,
                         conn->remote_settings.max_stream_data, stream_user_data,
-                        conn->mem);
+                        conn_mem(conn, NGTCP2_MEM_SUBSYS_ROB));
   if (rv != 0) {
-    ngtcp2_mem_free(conn->mem, strm);
+    conn_free_strm(conn, strm);
     return rv;
   }
 
@@ -3162,7 +3454,7 @@ int ngtcp2_conn_init_stream(ngtcp2_conn *conn, ngtcp2_strm *strm,
     assert(rv != NGTCP2_ERR_INVALID_ARGUMENT);
 
     ngtcp2_strm_free(strm);
-    ngtcp2_mem_free(conn->mem, strm);
+    conn_free_strm(conn, strm);
     return rv;
   }
 
@@ -3220,7 +3512,10 @@ static int conn_emit_pending_stream_data(ngtcp2_conn *conn, ngtcp2_strm *strm,
  * |rx_offset_base| is the offset in the entire TLS handshake stream.
  * fr->offset specifies the offset in each encryption level.
  * |max_rx_offset| is, if it is nonzero, the maximum offset in the
- * entire TLS handshake stream that |fr| can carry.
+ * entire TLS handshake stream that |fr| can carry.  Out of order
+ * data is not buffered while memory is exhausted, and this function
+ * returns NGTCP2_ERR_DISCARD_PKT so that the packet is not
+ * acknowledged.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
@@ -3254,6 +3549,10 @@ static int conn_recv_crypto(ngtcp2_conn *conn, uint64_t rx_offset_base,
     return 0;
   }
 
+  if (rx_offset_base + fr->offset > rx_offset && conn_mem_exhausted(conn)) {
+    return NGTCP2_ERR_DISCARD_PKT;
+  }
+
   crypto->last_rx_offset = ngtcp2_max(crypto->last_rx_offset, fr_end_offset);
 
   /* TODO Before dispatching incoming data to TLS stack, make sure
@@ -3282,6 +3581,12 @@ static int conn_recv_crypto(ngtcp2_conn *conn, uint64_t rx_offset_base,
     if (rv != 0) {
       return rv;
     }
+
+    /* Post handshake messages are rare, and do not need to keep
+       reorder buffer. */
+    if (conn->in_pktns == NULL) {
+      ngtcp2_rob_release(&crypto->rob);
+    }
   } else {
     rv = ngtcp2_strm_recv_reordering(crypto, fr->data[0].base, fr->data[0].len,
                                      rx_offset_base + fr->offset);
@@ -3353,7 +3658,7 @@ static int conn_recv_stream(ngtcp2_conn *conn, const ngtcp2_stream *fr) {
     }
     assert(0 == rv);
 
-    strm = ngtcp2_mem_malloc(conn->mem, sizeof(ngtcp2_strm));
+    strm = conn_alloc_strm(conn);
     if (strm == NULL) {
       return NGTCP2_ERR_NOMEM;
     }
@@ -3373,6 +3678,13 @@ static int conn_recv_stream(ngtcp2_conn *conn, const ngtcp2_stream *fr) {
     return NGTCP2_ERR_FLOW_CONTROL;
   }
 
+  /* Out of order data is not buffered while memory is exhausted.
+     The packet is discarded without acknowledgement, and the remote
+     endpoint retransmits it. */
+  if (fr->offset > ngtcp2_strm_rx_offset(strm) && conn_mem_exhausted(conn)) {
+    return NGTCP2_ERR_DISCARD_PKT;
+  }
+
   if (strm->last_rx_offset < fr_end_offset) {
     size_t datalen = fr_end_offset - strm->last_rx_offset;
 
@@ -3486,12 +3798,12 @@ static int conn_rst_stream(ngtcp2_conn *conn, ngtcp2_strm *strm,
   int rv;
   ngtcp2_frame_chain *frc;
 
-  rv = ngtcp2_frame_chain_new(&frc, conn->mem);
+  rv = ngtcp2_frame_chain_new(&frc, NGTCP2_FRAME_RST_STREAM,
+                              conn_mem(conn, NGTCP2_MEM_SUBSYS_FRAME));
   if (rv != 0) {
     return rv;
   }
 
-  frc->fr.type = NGTCP2_FRAME_RST_STREAM;
   frc->fr.rst_stream.stream_id = strm->stream_id;
   frc->fr.rst_stream.app_error_code = app_error_code;
   frc->fr.rst_stream.final_offset = strm->tx_offset;
@@ -3508,12 +3820,12 @@ static int conn_stop_sending(ngtcp2_conn *conn, ngtcp2_strm *strm,
   int rv;
   ngtcp2_frame_chain *frc;
 
-  rv = ngtcp2_frame_chain_new(&frc, conn->mem);
+  rv = ngtcp2_frame_chain_new(&frc, NGTCP2_FRAME_STOP_SENDING,
+                              conn_mem(conn, NGTCP2_MEM_SUBSYS_FRAME));
   if (rv != 0) {
     return rv;
   }
 
-  frc->fr.type = NGTCP2_FRAME_STOP_SENDING;
   frc->fr.stop_sending.stream_id = strm->stream_id;
   frc->fr.stop_sending.app_error_code = app_error_code;
 
@@ -3754,11 +4066,11 @@ static int conn_recv_delayed_handshake_pkt(ngtcp2_conn *conn,
   }
   switch (hd->type) {
   case NGTCP2_PKT_INITIAL:
-    pktns = &conn->in_pktns;
+    pktns = conn->in_pktns;
     decrypt = conn->callbacks.in_decrypt;
     break;
   case NGTCP2_PKT_HANDSHAKE:
-    pktns = &conn->hs_pktns;
+    pktns = conn->hs_pktns;
     decrypt = conn->callbacks.decrypt;
     break;
   default:
@@ -3777,6 +4089,8 @@ static int conn_recv_delayed_handshake_pkt(ngtcp2_conn *conn,
     return (int)nwrite;
   }
 
+  conn_on_pkt_decrypted(conn, hd, adlen + payloadlen);
+
   payload = conn->decrypt_buf.base;
   payloadlen = (size_t)nwrite;
 
@@ -3889,9 +4203,15 @@ static ssize_t conn_recv_pkt(ngtcp2_conn *conn, const uint8_t *pkt,
       return (ssize_t)pktlen;
     }
 
+    /* Initial, Handshake and 0-RTT packets are no longer useful
+       after the handshake is confirmed. */
+    if (conn->in_pktns == NULL) {
+      return (ssize_t)pktlen;
+    }
+
     switch (hd.type) {
     case NGTCP2_PKT_INITIAL:
-      pktns = &conn->in_pktns;
+      pktns = conn->in_pktns;
       ckm = pktns->rx_ckm;
       encrypt_pn = conn->callbacks.in_encrypt_pn;
       aead_overhead = NGTCP2_INITIAL_AEAD_OVERHEAD;
@@ -3899,11 +4219,11 @@ static ssize_t conn_recv_pkt(ngtcp2_conn *conn, const uint8_t *pkt,
       if (conn->server && conn->early_ckm) {
         max_crypto_rx_offset = conn->early_crypto_rx_offset_base;
       } else {
-        max_crypto_rx_offset = conn->hs_pktns.crypto_rx_offset_base;
+        max_crypto_rx_offset = conn->hs_pktns->crypto_rx_offset_base;
       }
       break;
     case NGTCP2_PKT_HANDSHAKE:
-      pktns = &conn->hs_pktns;
+      pktns = conn->hs_pktns;
       ckm = pktns->rx_ckm;
       encrypt_pn = conn->callbacks.encrypt_pn;
       aead_overhead = conn->aead_overhead;
@@ -3919,7 +4239,7 @@ static ssize_t conn_recv_pkt(ngtcp2_conn *conn, const uint8_t *pkt,
       encrypt_pn = conn->callbacks.encrypt_pn;
       aead_overhead = conn->aead_overhead;
       crypto_rx_offset_base = conn->early_crypto_rx_offset_base;
-      max_crypto_rx_offset = conn->hs_pktns.crypto_rx_offset_base;
+      max_crypto_rx_offset = conn->hs_pktns->crypto_rx_offset_base;
       break;
     default:
       return (ssize_t)pktlen;
@@ -3938,8 +4258,10 @@ static ssize_t conn_recv_pkt(ngtcp2_conn *conn, const uint8_t *pkt,
     max_crypto_rx_offset = 0;
   }
 
+  NGTCP2_PHASE_BEGIN(&conn->phase, NGTCP2_PHASE_RECV_DECRYPT_PN);
   nwrite = conn_decrypt_pn(conn, &hd, plain_hdpkt, pkt, pktlen, (size_t)nread,
                            ckm, encrypt_pn, aead_overhead);
+  NGTCP2_PHASE_END(&conn->phase, NGTCP2_PHASE_RECV_DECRYPT_PN);
   if (nwrite < 0) {
     return (ssize_t)nwrite;
   }
@@ -3981,9 +4303,11 @@ static ssize_t conn_recv_pkt(ngtcp2_conn *conn, const uint8_t *pkt,
     return rv;
   }
 
+  NGTCP2_PHASE_BEGIN(&conn->phase, NGTCP2_PHASE_RECV_DECRYPT);
   nwrite = conn_decrypt_pkt(conn, conn->decrypt_buf.base, payloadlen, payload,
                             payloadlen, plain_hdpkt, hdpktlen, hd.pkt_num, ckm,
                             conn->callbacks.decrypt);
+  NGTCP2_PHASE_END(&conn->phase, NGTCP2_PHASE_RECV_DECRYPT);
   if (nwrite < 0) {
     if (nwrite != NGTCP2_ERR_TLS_DECRYPT ||
         (hd.flags & NGTCP2_PKT_FLAG_LONG_FORM)) {
@@ -3998,18 +4322,23 @@ static ssize_t conn_recv_pkt(ngtcp2_conn *conn, const uint8_t *pkt,
     }
     return (int)nwrite;
   }
+
+  conn_on_pkt_decrypted(conn, &hd, hdpktlen + payloadlen);
+
   payload = conn->decrypt_buf.base;
   payloadlen = (size_t)nwrite;
 
   if (!(hd.flags & NGTCP2_PKT_FLAG_LONG_FORM)) {
-    if (!ngtcp2_cid_eq(&conn->scid, &hd.dcid)) {
+    if (!conn_is_own_scid(conn, &hd.dcid)) {
       return (ssize_t)pktlen;
     }
     conn->flags |= NGTCP2_CONN_FLAG_RECV_PROTECTED_PKT;
   }
 
   for (; payloadlen;) {
+    NGTCP2_PHASE_BEGIN(&conn->phase, NGTCP2_PHASE_RECV_DECODE_FRAME);
     nread = ngtcp2_pkt_decode_frame(fr, payload, payloadlen);
+    NGTCP2_PHASE_END(&conn->phase, NGTCP2_PHASE_RECV_DECODE_FRAME);
     if (nread < 0) {
       return (int)nread;
     }
@@ -4040,14 +4369,25 @@ static ssize_t conn_recv_pkt(ngtcp2_conn *conn, const uint8_t *pkt,
 
     switch (fr->type) {
     case NGTCP2_FRAME_ACK:
+      NGTCP2_PHASE_BEGIN(&conn->phase, NGTCP2_PHASE_RECV_ACK);
       rv = conn_recv_ack(conn, pktns, &hd, &fr->ack, ts);
+      NGTCP2_PHASE_END(&conn->phase, NGTCP2_PHASE_RECV_ACK);
       if (rv != 0) {
         return rv;
       }
+      if (!(hd.flags & NGTCP2_PKT_FLAG_LONG_FORM) &&
+          fr->ack.largest_ack >= conn->confirm_pkt_num) {
+        conn->flags |= NGTCP2_CONN_FLAG_HANDSHAKE_CONFIRMED;
+      }
       break;
     case NGTCP2_FRAME_STREAM:
+      NGTCP2_PHASE_BEGIN(&conn->phase, NGTCP2_PHASE_RECV_STREAM);
       rv = conn_recv_stream(conn, &fr->stream);
+      NGTCP2_PHASE_END(&conn->phase, NGTCP2_PHASE_RECV_STREAM);
       if (rv != 0) {
+        if (rv == NGTCP2_ERR_DISCARD_PKT) {
+          return (ssize_t)pktlen;
+        }
         return rv;
       }
       conn_update_rx_bw(conn, fr->stream.datalen, ts);
@@ -4056,6 +4396,9 @@ static ssize_t conn_recv_pkt(ngtcp2_conn *conn, const uint8_t *pkt,
       rv = conn_recv_crypto(conn, crypto_rx_offset_base, max_crypto_rx_offset,
                             &fr->crypto);
       if (rv != 0) {
+        if (rv == NGTCP2_ERR_DISCARD_PKT) {
+          return (ssize_t)pktlen;
+        }
         return rv;
       }
       break;
@@ -4148,9 +4491,65 @@ static int conn_process_buffered_handshake_pkt(ngtcp2_conn *conn,
   return 0;
 }
 
+/*
+ * conn_issue_new_connection_id asks application for additional source
+ * connection IDs, and queues NEW_CONNECTION_ID frames to advertise
+ * them to the remote endpoint.  It does nothing if
+ * get_new_connection_id callback is not set, or zero-length
+ * connection ID is used.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory.
+ * NGTCP2_ERR_CALLBACK_FAILURE
+ *     User callback failed.
+ */
+static int conn_issue_new_connection_id(ngtcp2_conn *conn) {
+  int rv;
+  ngtcp2_frame_chain *frc;
+  ngtcp2_new_connection_id *fr;
+
+  if (!conn->callbacks.get_new_connection_id || conn->scid.datalen == 0) {
+    return 0;
+  }
+
+  for (; conn->nscid_pool < NGTCP2_MAX_SCID_POOL_SIZE;) {
+    rv = ngtcp2_frame_chain_new(&frc, NGTCP2_FRAME_NEW_CONNECTION_ID,
+                                conn_mem(conn, NGTCP2_MEM_SUBSYS_FRAME));
+    if (rv != 0) {
+      return rv;
+    }
+
+    fr = &frc->fr.new_connection_id;
+    fr->seq = (uint16_t)(conn->nscid_pool + 1);
+
+    rv = conn_call_get_new_connection_id(conn, &fr->cid,
+                                         fr->stateless_reset_token,
+                                         conn->scid.datalen);
+    if (rv != 0) {
+      ngtcp2_frame_chain_del(frc, conn->mem);
+      return rv;
+    }
+
+    if (fr->cid.datalen != conn->scid.datalen) {
+      ngtcp2_frame_chain_del(frc, conn->mem);
+      return NGTCP2_ERR_CALLBACK_FAILURE;
+    }
+
+    conn->scid_pool[conn->nscid_pool++] = fr->cid;
+
+    frc->next = conn->frq;
+    conn->frq = frc;
+  }
+
+  return 0;
+}
+
 /*
  * conn_handshake_completed is called once cryptographic handshake has
- * completed.
+ * completed.  |ts| is the current timestamp.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
@@ -4158,14 +4557,27 @@ static int conn_process_buffered_handshake_pkt(ngtcp2_conn *conn,
  * NGTCP2_ERR_CALLBACK_FAILURE
  *     User callback failed.
  */
-static int conn_handshake_completed(ngtcp2_conn *conn) {
+static int conn_handshake_completed(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
   int rv;
 
+  conn->stats.handshake_duration = ts - conn->local_settings.initial_ts;
+
+  if (!conn->server) {
+    /* Client might have sent 0-RTT packets which server acknowledges
+       before it completes the handshake. */
+    conn->confirm_pkt_num = conn->pktns.last_tx_pkt_num + 1;
+  }
+
   rv = conn_call_handshake_completed(conn);
   if (rv != 0) {
     return rv;
   }
 
+  rv = conn_issue_new_connection_id(conn);
+  if (rv != 0) {
+    return rv;
+  }
+
   if (conn->max_local_stream_id_bidi > 0) {
     rv = conn_call_extend_max_stream_id(conn, conn->max_local_stream_id_bidi);
     if (rv != 0) {
@@ -4182,6 +4594,37 @@ static int conn_handshake_completed(ngtcp2_conn *conn) {
   return 0;
 }
 
+/*
+ * conn_maybe_discard_handshake_state frees Initial and Handshake
+ * packet number spaces, which are not used after the handshake is
+ * confirmed.  It does nothing until the pending acknowledgements in
+ * them are sent.  The packets in flight in them are forgotten without
+ * being declared lost.  The buffers of crypto stream are released if
+ * they are empty.
+ */
+static void conn_maybe_discard_handshake_state(ngtcp2_conn *conn) {
+  if (conn->in_pktns == NULL ||
+      (conn->in_pktns->acktr.flags & NGTCP2_ACKTR_FLAG_ACTIVE_ACK) ||
+      (conn->hs_pktns->acktr.flags & NGTCP2_ACKTR_FLAG_ACTIVE_ACK)) {
+    return;
+  }
+
+  conn->hs_nlost += conn->in_pktns->rtb.nlost + conn->hs_pktns->rtb.nlost;
+  conn->hs_nspurious_lost += conn->in_pktns->rtb.nspurious_lost +
+                             conn->hs_pktns->rtb.nspurious_lost;
+
+  pktns_del(conn->in_pktns, conn->mem);
+  conn->in_pktns = NULL;
+  pktns_del(conn->hs_pktns, conn->mem);
+  conn->hs_pktns = NULL;
+
+  ngtcp2_ringbuf_release(&conn->tx_crypto_data);
+  ngtcp2_rob_release(&conn->crypto.rob);
+
+  ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_CON,
+                  "discarded Initial and Handshake state");
+}
+
 /*
  * conn_recv_cpkt processes compound packet after handshake.  The
  * buffer pointed by |pkt| might contain multiple packets.  The Short
@@ -4235,10 +4678,15 @@ int ngtcp2_conn_recv(ngtcp2_conn *conn, const uint8_t *pkt, size_t pktlen,
   case NGTCP2_CS_DRAINING:
     return NGTCP2_ERR_DRAINING;
   case NGTCP2_CS_POST_HANDSHAKE:
+    NGTCP2_PHASE_BEGIN(&conn->phase, NGTCP2_PHASE_RECV);
     rv = conn_recv_cpkt(conn, pkt, pktlen, ts);
+    NGTCP2_PHASE_END(&conn->phase, NGTCP2_PHASE_RECV);
     if (rv != 0) {
       break;
     }
+    if (conn->flags & NGTCP2_CONN_FLAG_HANDSHAKE_CONFIRMED) {
+      conn_maybe_discard_handshake_state(conn);
+    }
     if (conn->state == NGTCP2_CS_DRAINING) {
       return NGTCP2_ERR_DRAINING;
     }
@@ -4270,8 +4718,9 @@ static void conn_handle_delayed_ack_expiry(ngtcp2_conn *conn,
 }
 
 static int conn_check_pkt_num_exhausted(ngtcp2_conn *conn) {
-  return conn->in_pktns.last_tx_pkt_num == NGTCP2_MAX_PKT_NUM ||
-         conn->hs_pktns.last_tx_pkt_num == NGTCP2_MAX_PKT_NUM ||
+  return (conn->in_pktns &&
+          (conn->in_pktns->last_tx_pkt_num == NGTCP2_MAX_PKT_NUM ||
+           conn->hs_pktns->last_tx_pkt_num == NGTCP2_MAX_PKT_NUM)) ||
          conn->pktns.last_tx_pkt_num == NGTCP2_MAX_PKT_NUM;
 }
 
@@ -4282,7 +4731,7 @@ static ssize_t conn_handshake(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
   ssize_t res = 0, nwrite;
   uint64_t cwnd;
   size_t origlen = destlen;
-  ngtcp2_pktns *hs_pktns = &conn->hs_pktns;
+  ngtcp2_pktns *hs_pktns = conn->hs_pktns;
 
   conn->log.last_ts = ts;
 
@@ -4370,7 +4819,7 @@ static ssize_t conn_handshake(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
       return NGTCP2_ERR_REQUIRED_TRANSPORT_PARAM;
     }
 
-    rv = conn_handshake_completed(conn);
+    rv = conn_handshake_completed(conn, ts);
     if (rv != 0) {
       return (ssize_t)rv;
     }
@@ -4486,7 +4935,7 @@ static ssize_t conn_handshake(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
       return NGTCP2_ERR_REQUIRED_TRANSPORT_PARAM;
     }
 
-    rv = conn_handshake_completed(conn);
+    rv = conn_handshake_completed(conn, ts);
     if (rv != 0) {
       return (ssize_t)rv;
     }
@@ -4500,7 +4949,7 @@ static ssize_t conn_handshake(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
       return (ssize_t)rv;
     }
 
-    conn->hs_pktns.acktr.flags |= NGTCP2_ACKTR_FLAG_PENDING_FINISHED_ACK;
+    conn->hs_pktns->acktr.flags |= NGTCP2_ACKTR_FLAG_PENDING_FINISHED_ACK;
 
     return res;
   case NGTCP2_CS_CLOSING:
@@ -4572,18 +5021,20 @@ static ssize_t conn_write_stream_early(ngtcp2_conn *conn, uint8_t *dest,
   ndatalen = ngtcp2_min(ndatalen, strm->max_tx_offset - strm->tx_offset);
   ndatalen = ngtcp2_min(ndatalen, conn->max_tx_offset - conn->tx_offset);
 
+  conn_update_fc_blocked(conn, datalen > 0 && ndatalen == 0, ts);
+
   if (datalen > 0 && ndatalen == 0) {
     return NGTCP2_ERR_STREAM_DATA_BLOCKED;
   }
 
   fin = fin && ndatalen == datalen;
 
-  rv = ngtcp2_frame_chain_new(&frc, conn->mem);
+  rv = ngtcp2_frame_chain_new(&frc, NGTCP2_FRAME_STREAM,
+                              conn_mem(conn, NGTCP2_MEM_SUBSYS_FRAME));
   if (rv != 0) {
     return rv;
   }
 
-  frc->fr.type = NGTCP2_FRAME_STREAM;
   frc->fr.stream.flags = 0;
   frc->fr.stream.fin = fin;
   frc->fr.stream.stream_id = strm->stream_id;
@@ -4613,7 +5064,8 @@ static ssize_t conn_write_stream_early(ngtcp2_conn *conn, uint8_t *dest,
   }
 
   rv = ngtcp2_rtb_entry_new(&ent, &hd, frc, ts, (size_t)nwrite,
-                            NGTCP2_RTB_FLAG_NONE, conn->mem);
+                            NGTCP2_RTB_FLAG_NONE,
+                            conn_mem(conn, NGTCP2_MEM_SUBSYS_RTB));
   if (rv != 0) {
     ngtcp2_frame_chain_del(frc, conn->mem);
     return rv;
@@ -4622,8 +5074,8 @@ static ssize_t conn_write_stream_early(ngtcp2_conn *conn, uint8_t *dest,
   /* Retransmission of 0-RTT packet is postponed until handshake
      completes.  This covers the case that 0-RTT data is rejected by
      the peer.  0-RTT packet is retransmitted as a Short packet. */
-  ent->hd.flags &= (uint8_t)~NGTCP2_PKT_FLAG_LONG_FORM;
-  ent->hd.type = NGTCP2_PKT_SHORT;
+  ent->pkt_flags &= (uint8_t)~NGTCP2_PKT_FLAG_LONG_FORM;
+  ent->pkt_type = NGTCP2_PKT_SHORT;
 
   ngtcp2_list_insert(ent, &conn->early_rtb);
 
@@ -4649,7 +5101,7 @@ ssize_t ngtcp2_conn_client_handshake(ngtcp2_conn *conn, uint8_t *dest,
                                      uint64_t stream_id, uint8_t fin,
                                      const uint8_t *data, size_t datalen,
                                      ngtcp2_tstamp ts) {
-  ngtcp2_strm *strm;
+  ngtcp2_strm *strm = NULL;
   int send_stream = 0;
   ssize_t spktlen, early_spktlen;
   uint64_t cwnd;
@@ -4734,7 +5186,8 @@ int ngtcp2_conn_sched_ack(ngtcp2_conn *conn, ngtcp2_acktr *acktr,
   ngtcp2_acktr_entry *rpkt;
   int rv;
 
-  rv = ngtcp2_acktr_entry_new(&rpkt, pkt_num, ts, conn->mem);
+  rv = ngtcp2_acktr_entry_new(&rpkt, pkt_num, ts,
+                              conn_mem(conn, NGTCP2_MEM_SUBSYS_ACKTR));
   if (rv != 0) {
     return rv;
   }
@@ -4800,7 +5253,11 @@ int ngtcp2_conn_set_initial_tx_keys(ngtcp2_conn *conn, const uint8_t *key,
                                     size_t keylen, const uint8_t *iv,
                                     size_t ivlen, const uint8_t *pn,
                                     size_t pnlen) {
-  ngtcp2_pktns *pktns = &conn->in_pktns;
+  ngtcp2_pktns *pktns = conn->in_pktns;
+
+  if (pktns == NULL) {
+    return NGTCP2_ERR_INVALID_STATE;
+  }
 
   if (pktns->tx_ckm) {
     ngtcp2_crypto_km_del(pktns->tx_ckm, conn->mem);
@@ -4815,7 +5272,11 @@ int ngtcp2_conn_set_initial_rx_keys(ngtcp2_conn *conn, const uint8_t *key,
                                     size_t keylen, const uint8_t *iv,
                                     size_t ivlen, const uint8_t *pn,
                                     size_t pnlen) {
-  ngtcp2_pktns *pktns = &conn->in_pktns;
+  ngtcp2_pktns *pktns = conn->in_pktns;
+
+  if (pktns == NULL) {
+    return NGTCP2_ERR_INVALID_STATE;
+  }
 
   if (pktns->rx_ckm) {
     ngtcp2_crypto_km_del(pktns->rx_ckm, conn->mem);
@@ -4830,7 +5291,11 @@ int ngtcp2_conn_set_handshake_tx_keys(ngtcp2_conn *conn, const uint8_t *key,
                                       size_t keylen, const uint8_t *iv,
                                       size_t ivlen, const uint8_t *pn,
                                       size_t pnlen) {
-  ngtcp2_pktns *pktns = &conn->hs_pktns;
+  ngtcp2_pktns *pktns = conn->hs_pktns;
+
+  if (pktns == NULL) {
+    return NGTCP2_ERR_INVALID_STATE;
+  }
 
   if (pktns->tx_ckm) {
     ngtcp2_crypto_km_del(pktns->tx_ckm, conn->mem);
@@ -4845,14 +5310,18 @@ int ngtcp2_conn_set_handshake_rx_keys(ngtcp2_conn *conn, const uint8_t *key,
                                       size_t keylen, const uint8_t *iv,
                                       size_t ivlen, const uint8_t *pn,
                                       size_t pnlen) {
-  ngtcp2_pktns *pktns = &conn->hs_pktns;
+  ngtcp2_pktns *pktns = conn->hs_pktns;
+
+  if (pktns == NULL) {
+    return NGTCP2_ERR_INVALID_STATE;
+  }
 
   if (pktns->rx_ckm) {
     ngtcp2_crypto_km_del(pktns->rx_ckm, conn->mem);
     pktns->rx_ckm = NULL;
   }
 
-  conn->hs_pktns.crypto_rx_offset_base = conn->crypto.last_rx_offset;
+  conn->hs_pktns->crypto_rx_offset_base = conn->crypto.last_rx_offset;
 
   return ngtcp2_crypto_km_new(&pktns->rx_ckm, key, keylen, iv, ivlen, pn, pnlen,
                               conn->mem);
@@ -5117,7 +5586,7 @@ int ngtcp2_conn_open_bidi_stream(ngtcp2_conn *conn, uint64_t *pstream_id,
     return NGTCP2_ERR_STREAM_ID_BLOCKED;
   }
 
-  strm = ngtcp2_mem_malloc(conn->mem, sizeof(ngtcp2_strm));
+  strm = conn_alloc_strm(conn);
   if (strm == NULL) {
     return NGTCP2_ERR_NOMEM;
   }
@@ -5143,7 +5612,7 @@ int ngtcp2_conn_open_uni_stream(ngtcp2_conn *conn, uint64_t *pstream_id,
     return NGTCP2_ERR_STREAM_ID_BLOCKED;
   }
 
-  strm = ngtcp2_mem_malloc(conn->mem, sizeof(ngtcp2_strm));
+  strm = conn_alloc_strm(conn);
   if (strm == NULL) {
     return NGTCP2_ERR_NOMEM;
   }
@@ -5236,8 +5705,10 @@ ssize_t ngtcp2_conn_write_stream(ngtcp2_conn *conn, uint8_t *dest,
       return NGTCP2_ERR_CONGESTION;
     }
 
+    NGTCP2_PHASE_BEGIN(&conn->phase, NGTCP2_PHASE_WRITE_PKT);
     nwrite = conn_write_pkt(conn, dest, destlen = ngtcp2_min(destlen, cwnd),
                             pdatalen, strm, fin, data, datalen, ts);
+    NGTCP2_PHASE_END(&conn->phase, NGTCP2_PHASE_WRITE_PKT);
     if (nwrite) {
       return nwrite;
     }
@@ -5265,6 +5736,55 @@ ssize_t ngtcp2_conn_write_stream(ngtcp2_conn *conn, uint8_t *dest,
                                  0 /* require_padding */, ts);
 }
 
+ssize_t ngtcp2_conn_write_stream_source(ngtcp2_conn *conn, uint8_t *dest,
+                                        size_t destlen, ssize_t *pdatalen,
+                                        uint64_t stream_id, ngtcp2_tstamp ts) {
+  int rv;
+  ngtcp2_strm *strm;
+  size_t maxlen;
+  const uint8_t *data = NULL;
+  size_t datalen = 0;
+  uint8_t fin = 0;
+
+  if (pdatalen) {
+    *pdatalen = -1;
+  }
+
+  switch (conn->state) {
+  case NGTCP2_CS_CLOSING:
+    return NGTCP2_ERR_CLOSING;
+  case NGTCP2_CS_DRAINING:
+    return NGTCP2_ERR_DRAINING;
+  }
+
+  strm = ngtcp2_conn_find_stream(conn, stream_id);
+  if (strm == NULL) {
+    return NGTCP2_ERR_STREAM_NOT_FOUND;
+  }
+
+  if (strm->flags & NGTCP2_STRM_FLAG_SHUT_WR) {
+    return NGTCP2_ERR_STREAM_SHUT_WR;
+  }
+
+  /* A packet never carries more than destlen bytes of stream data,
+     and the data beyond the flow control window is not sent. */
+  maxlen = destlen;
+  maxlen = (size_t)ngtcp2_min(maxlen, strm->max_tx_offset - strm->tx_offset);
+  maxlen = (size_t)ngtcp2_min(maxlen, conn->max_tx_offset - conn->tx_offset);
+
+  rv = conn_call_read_stream_data(conn, strm, maxlen, &data, &datalen, &fin);
+  if (rv != 0) {
+    return rv;
+  }
+
+  if (datalen == 0 && !fin) {
+    return 0;
+  }
+
+  return ngtcp2_conn_write_stream(conn, dest, destlen, pdatalen, stream_id,
+                                  fin, data, datalen, ts);
+}
+
 ssize_t ngtcp2_conn_write_connection_close(ngtcp2_conn *conn, uint8_t *dest,
                                            size_t destlen, uint16_t error_code,
                                            ngtcp2_tstamp ts) {
@@ -5295,7 +5815,7 @@ ssize_t ngtcp2_conn_write_connection_close(ngtcp2_conn *conn, uint8_t *dest,
 
   if (conn->state == NGTCP2_CS_POST_HANDSHAKE) {
     pkt_type = 0;
-  } else if (conn->hs_pktns.tx_ckm) {
+  } else if (conn->hs_pktns->tx_ckm) {
     pkt_type = NGTCP2_PKT_HANDSHAKE;
   } else {
     return NGTCP2_ERR_INVALID_STATE;
@@ -5411,7 +5931,7 @@ int ngtcp2_conn_close_stream(ngtcp2_conn *conn, ngtcp2_strm *strm,
   }
 
   ngtcp2_strm_free(strm);
-  ngtcp2_mem_free(conn->mem, strm);
+  conn_free_strm(conn, strm);
 
   return 0;
 }
@@ -5540,10 +6060,14 @@ void ngtcp2_conn_extend_max_offset(ngtcp2_conn *conn, size_t datalen) {
 }
 
 size_t ngtcp2_conn_get_bytes_in_flight(ngtcp2_conn *conn) {
-  ngtcp2_pktns *in_pktns = &conn->in_pktns;
-  ngtcp2_pktns *hs_pktns = &conn->hs_pktns;
+  ngtcp2_pktns *in_pktns = conn->in_pktns;
+  ngtcp2_pktns *hs_pktns = conn->hs_pktns;
   ngtcp2_pktns *pktns = &conn->pktns;
 
+  if (in_pktns == NULL) {
+    return pktns->rtb.bytes_in_flight;
+  }
+
   return in_pktns->rtb.bytes_in_flight + hs_pktns->rtb.bytes_in_flight +
          pktns->rtb.bytes_in_flight;
 }
@@ -5599,16 +6123,142 @@ void ngtcp2_conn_get_rcvry_stat(ngtcp2_conn *conn, ngtcp2_rcvry_stat *rcs) {
   *rcs = conn->rcs;
 }
 
+const ngtcp2_trace_ring *ngtcp2_conn_get_trace(ngtcp2_conn *conn) {
+  return conn->log.trace;
+}
+
+int ngtcp2_conn_dump_trace(ngtcp2_conn *conn, int fmt, ngtcp2_printf print,
+                           void *user_data) {
+  const ngtcp2_trace_ring *ring = conn->log.trace;
+  char buf[NGTCP2_TRACE_BUFLEN];
+  size_t i, len;
+  ssize_t nwrite;
+
+  if (ring == NULL) {
+    return 0;
+  }
+
+  len = ngtcp2_trace_ring_len(ring);
+
+  for (i = 0; i < len; ++i) {
+    nwrite =
+        ngtcp2_trace_format(buf, sizeof(buf), ngtcp2_trace_ring_get(ring, i),
+                            conn->local_settings.initial_ts, fmt);
+    if (nwrite < 0) {
+      return (int)nwrite;
+    }
+
+    print(user_data, "%s\n", buf);
+  }
+
+  return 0;
+}
+
+int ngtcp2_conn_get_stats(ngtcp2_conn *conn, int version,
+                          ngtcp2_conn_stats *stats) {
+  ngtcp2_conn_stats *cs = &conn->stats;
+
+  switch (version) {
+  case 1:
+    break;
+  default:
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  cs->pkts_lost = conn->hs_nlost + conn->pktns.rtb.nlost;
+  cs->pkts_spurious_lost =
+      conn->hs_nspurious_lost + conn->pktns.rtb.nspurious_lost;
+  if (conn->in_pktns) {
+    cs->pkts_lost += conn->in_pktns->rtb.nlost + conn->hs_pktns->rtb.nlost;
+    cs->pkts_spurious_lost += conn->in_pktns->rtb.nspurious_lost +
+                              conn->hs_pktns->rtb.nspurious_lost;
+  }
+  cs->cwnd = conn->ccs.cwnd;
+  cs->ssthresh = conn->ccs.ssthresh;
+
+  *stats = *cs;
+
+  return 0;
+}
+
+size_t ngtcp2_conn_get_mem_usage(ngtcp2_conn *conn,
+                                 ngtcp2_mem_subsys subsys) {
+  if ((size_t)subsys >= NGTCP2_MEM_SUBSYS_MAX) {
+    return 0;
+  }
+
+  return conn->macct.nbytes[subsys];
+}
+
+size_t ngtcp2_conn_get_total_mem_usage(ngtcp2_conn *conn) {
+  return conn->macct.total;
+}
+
+int ngtcp2_conn_get_phase_hist(ngtcp2_conn *conn, int phase,
+                               ngtcp2_phase_hist *hist) {
+  if (phase < 0 || phase >= NGTCP2_PHASE_MAX) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+#ifdef PHASE_TIMING
+  *hist = conn->phase.hist[phase];
+
+  return 0;
+#else  /* !PHASE_TIMING */
+  (void)conn;
+  (void)hist;
+
+  return NGTCP2_ERR_INVALID_STATE;
+#endif /* !PHASE_TIMING */
+}
+
+static int strm_release_each(ngtcp2_map_entry *ent, void *ptr) {
+  ngtcp2_strm *strm = ngtcp2_struct_of(ent, ngtcp2_strm, me);
+
+  (void)ptr;
+
+  ngtcp2_rob_release(&strm->rob);
+
+  return 0;
+}
+
+int ngtcp2_conn_hibernate(ngtcp2_conn *conn) {
+  ngtcp2_pktns *pktns = &conn->pktns;
+
+  if (conn->state != NGTCP2_CS_POST_HANDSHAKE || conn->in_pktns ||
+      !ngtcp2_rtb_empty(&pktns->rtb) || pktns->rtb.lost || conn->frq ||
+      conn->fc_strms || conn->buffed_rx_ppkts || conn->early_rtb ||
+      ngtcp2_ringbuf_len(&conn->tx_crypto_data) ||
+      (pktns->acktr.flags & NGTCP2_ACKTR_FLAG_ACTIVE_ACK)) {
+    return NGTCP2_ERR_INVALID_STATE;
+  }
+
+  ngtcp2_mem_free(conn->mem, conn->decrypt_buf.base);
+  conn->decrypt_buf.base = NULL;
+  conn->decrypt_buf.len = 0;
+
+  ngtcp2_acktr_compact(&pktns->acktr);
+
+  ngtcp2_map_each(&conn->strms, strm_release_each, NULL);
+  ngtcp2_map_release(&conn->strms);
+  conn_release_strm_pool(conn);
+
+  ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_CON, "hibernated");
+
+  return 0;
+}
+
 void ngtcp2_conn_set_loss_detection_alarm(ngtcp2_conn *conn) {
   ngtcp2_rcvry_stat *rcs = &conn->rcs;
   uint64_t alarm_duration;
   ngtcp2_rtb_entry *ent;
   ngtcp2_ksl_it it;
-  ngtcp2_pktns *in_pktns = &conn->in_pktns;
-  ngtcp2_pktns *hs_pktns = &conn->hs_pktns;
+  ngtcp2_pktns *in_pktns = conn->in_pktns;
+  ngtcp2_pktns *hs_pktns = conn->hs_pktns;
   ngtcp2_pktns *pktns = &conn->pktns;
 
-  if (!ngtcp2_rtb_empty(&in_pktns->rtb) || !ngtcp2_rtb_empty(&hs_pktns->rtb) ||
+  if ((in_pktns && (!ngtcp2_rtb_empty(&in_pktns->rtb) ||
+                    !ngtcp2_rtb_empty(&hs_pktns->rtb))) ||
       pktns->rtb.nearly_pkt) {
     if (rcs->smoothed_rtt < 1e-09) {
       alarm_duration = 2 * NGTCP2_DEFAULT_INITIAL_RTT;
@@ -5671,8 +6321,8 @@ void ngtcp2_conn_set_loss_detection_alarm(ngtcp2_conn *conn) {
 int ngtcp2_conn_on_loss_detection_alarm(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
   ngtcp2_rcvry_stat *rcs = &conn->rcs;
   int rv;
-  ngtcp2_pktns *in_pktns = &conn->in_pktns;
-  ngtcp2_pktns *hs_pktns = &conn->hs_pktns;
+  ngtcp2_pktns *in_pktns = conn->in_pktns;
+  ngtcp2_pktns *hs_pktns = conn->hs_pktns;
   ngtcp2_pktns *pktns = &conn->pktns;
 
   conn->log.last_ts = ts;
@@ -5684,21 +6334,25 @@ int ngtcp2_conn_on_loss_detection_alarm(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
   ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_RCV,
                   "loss detection alarm fired");
 
-  if (!ngtcp2_rtb_empty(&in_pktns->rtb) || !ngtcp2_rtb_empty(&hs_pktns->rtb) ||
+  if ((in_pktns && (!ngtcp2_rtb_empty(&in_pktns->rtb) ||
+                    !ngtcp2_rtb_empty(&hs_pktns->rtb))) ||
       pktns->rtb.nearly_pkt) {
-    rv = ngtcp2_rtb_mark_pkt_lost(&in_pktns->rtb);
-    if (rv != 0) {
-      return rv;
-    }
-    rv = ngtcp2_rtb_mark_pkt_lost(&hs_pktns->rtb);
-    if (rv != 0) {
-      return rv;
+    if (in_pktns) {
+      rv = ngtcp2_rtb_mark_pkt_lost(&in_pktns->rtb);
+      if (rv != 0) {
+        return rv;
+      }
+      rv = ngtcp2_rtb_mark_pkt_lost(&hs_pktns->rtb);
+      if (rv != 0) {
+        return rv;
+      }
     }
     rv = ngtcp2_rtb_mark_0rtt_pkt_lost(&pktns->rtb);
     if (rv != 0) {
       return rv;
     }
     ++rcs->handshake_count;
+    ++conn->stats.handshake_timeout_count;
   } else if (rcs->loss_time) {
     rv = ngtcp2_rtb_detect_lost_pkt(&pktns->rtb, rcs,
                                     (uint64_t)conn->largest_ack,
@@ -5709,17 +6363,21 @@ int ngtcp2_conn_on_loss_detection_alarm(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
   } else if (rcs->tlp_count < NGTCP2_MAX_TLP_COUNT) {
     rcs->probe_pkt_left = 1;
     ++rcs->tlp_count;
+    ++conn->stats.tlp_count;
   } else {
     rcs->probe_pkt_left = 2;
     if (rcs->rto_count == 0) {
       rcs->largest_sent_before_rto = pktns->last_tx_pkt_num;
     }
     ++rcs->rto_count;
+    ++conn->stats.rto_count;
   }
 
   ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_RCV,
                   "handshake_count=%zu tlp_count=%zu rto_count=%zu",
                   rcs->handshake_count, rcs->tlp_count, rcs->rto_count);
+  ngtcp2_log_loss_timer(&conn->log, rcs->handshake_count, rcs->tlp_count,
+                        rcs->rto_count);
 
   ngtcp2_conn_set_loss_detection_alarm(conn);
 
@@ -5732,14 +6390,20 @@ int ngtcp2_conn_submit_crypto_data(ngtcp2_conn *conn, const uint8_t *data,
   ngtcp2_ringbuf *rb = &conn->tx_crypto_data;
   ngtcp2_crypto_data *cdata;
   size_t len;
-  ngtcp2_pktns *in_pktns = &conn->in_pktns;
-  ngtcp2_pktns *hs_pktns = &conn->hs_pktns;
+  ngtcp2_pktns *in_pktns = conn->in_pktns;
+  ngtcp2_pktns *hs_pktns = conn->hs_pktns;
   ngtcp2_pktns *pktns = &conn->pktns;
+  int rv;
 
   if (datalen == 0) {
     return 0;
   }
 
+  rv = ngtcp2_ringbuf_reserve(rb);
+  if (rv != 0) {
+    return rv;
+  }
+
   assert(!ngtcp2_ringbuf_full(rb));
 
   if (pktns->tx_ckm) {
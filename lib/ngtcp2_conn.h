@@ -41,6 +41,7 @@
 #include "ngtcp2_str.h"
 #include "ngtcp2_pkt.h"
 #include "ngtcp2_log.h"
+#include "ngtcp2_phase.h"
 
 typedef enum {
   /* Client specific handshake states */
@@ -103,6 +104,15 @@ typedef enum {
    here because crypto stream is unbounded. */
 #define NGTCP2_MAX_RX_HANDSHAKE_CRYPTO_DATA 65536
 
+/* NGTCP2_MAX_SCID_POOL_SIZE is the maximum number of additional
+   source connection IDs which a local endpoint issues to the remote
+   endpoint with NEW_CONNECTION_ID frame. */
+#define NGTCP2_MAX_SCID_POOL_SIZE 3
+
+/* NGTCP2_STRM_POOL_MAX is the maximum number of ngtcp2_strm objects
+   which a connection keeps for reuse after streams are closed. */
+#define NGTCP2_STRM_POOL_MAX 16
+
 struct ngtcp2_pkt_chain;
 typedef struct ngtcp2_pkt_chain ngtcp2_pkt_chain;
 
@@ -180,6 +190,13 @@ typedef enum {
   /* NGTCP2_CONN_FLAG_SADDR_VERIFIED is set when source address is
      verified. */
   NGTCP2_CONN_FLAG_SADDR_VERIFIED = 0x40,
+  /* NGTCP2_CONN_FLAG_HANDSHAKE_CONFIRMED is set when an ACK frame in
+     Short packet acknowledges a Short packet.  The remote endpoint
+     processes Short packets only after it completes the handshake,
+     and it cannot send one before it receives all Handshake packets
+     from the local endpoint, so Initial and Handshake packet number
+     spaces are no longer needed. */
+  NGTCP2_CONN_FLAG_HANDSHAKE_CONFIRMED = 0x80,
 } ngtcp2_conn_flag;
 
 typedef struct {
@@ -231,12 +248,26 @@ struct ngtcp2_conn {
      check that duplicated Initial or 0-RTT packet are indeed sent to
      this connection. */
   ngtcp2_cid rcid;
-  ngtcp2_pktns in_pktns;
-  ngtcp2_pktns hs_pktns;
+  /* scid_pool contains the additional source connection IDs which
+     have been issued to the remote endpoint.  The sequence number of
+     scid_pool[i] is i + 1. */
+  ngtcp2_cid scid_pool[NGTCP2_MAX_SCID_POOL_SIZE];
+  size_t nscid_pool;
+  /* in_pktns and hs_pktns are Initial and Handshake packet number
+     spaces.  They are freed, and become NULL when the handshake is
+     confirmed. */
+  ngtcp2_pktns *in_pktns;
+  ngtcp2_pktns *hs_pktns;
   ngtcp2_pktns pktns;
   ngtcp2_strm crypto;
   ngtcp2_map strms;
   ngtcp2_strm *fc_strms;
+  /* strm_pool is a list of ngtcp2_strm objects, linked by fc_next,
+     which are freed by closed streams and reused by new streams.
+     nstrm_pool is the number of objects in strm_pool, and it never
+     exceeds NGTCP2_STRM_POOL_MAX. */
+  ngtcp2_strm *strm_pool;
+  size_t nstrm_pool;
   ngtcp2_idtr remote_bidi_idtr;
   ngtcp2_idtr remote_uni_idtr;
   ngtcp2_rcvry_stat rcs;
@@ -316,7 +347,11 @@ struct ngtcp2_conn {
   double rx_bw;
   size_t probe_pkt_left;
   ngtcp2_frame_chain *frq;
+  /* mem is the allocator of macct for NGTCP2_MEM_SUBSYS_CONN. */
   ngtcp2_mem *mem;
+  /* macct counts the memory allocated for this connection per
+     subsystem.  It includes the ngtcp2_conn object itself. */
+  ngtcp2_mem_acct macct;
   void *user_data;
   uint32_t version;
   /* flags is bitwise OR of zero or more of ngtcp2_conn_flag. */
@@ -338,6 +373,31 @@ struct ngtcp2_conn {
   ngtcp2_settings remote_settings;
   /* decrypt_buf is a buffer which is used to write decrypted data. */
   ngtcp2_array decrypt_buf;
+  /* stats is the statistics of this connection.  Some of the fields
+     are filled when ngtcp2_conn_get_stats is called. */
+  ngtcp2_conn_stats stats;
+  /* fc_blocked_ts is the timestamp when sending stream data is
+     blocked by flow control.  It is UINT64_MAX if it is not
+     blocked. */
+  ngtcp2_tstamp fc_blocked_ts;
+  /* recorder is the flight recorder which this connection owns.  Its
+     records field is NULL unless
+     ngtcp2_settings.flight_recorder_len is nonzero, and
+     ngtcp2_settings.trace is NULL. */
+  ngtcp2_trace_ring recorder;
+  /* hs_nlost and hs_nspurious_lost are the number of lost, and
+     spuriously lost packets in the discarded Initial and Handshake
+     packet number spaces. */
+  uint64_t hs_nlost;
+  uint64_t hs_nspurious_lost;
+  /* confirm_pkt_num is the smallest packet number of Short packet
+     whose acknowledgement confirms the handshake. */
+  uint64_t confirm_pkt_num;
+#ifdef PHASE_TIMING
+  /* phase is the phase timer, which is shared by the retransmission
+     buffers of all packet number spaces. */
+  ngtcp2_phase_timer phase;
+#endif /* PHASE_TIMING */
 };
 
 /*
@@ -92,6 +92,8 @@ const char *ngtcp2_strerror(int liberr) {
     return "ERR_PKT_ENCODING";
   case NGTCP2_ERR_CONGESTION:
     return "ERR_CONGESTION";
+  case NGTCP2_ERR_DISCARD_PKT:
+    return "ERR_DISCARD_PKT";
   case NGTCP2_ERR_CALLBACK_FAILURE:
     return "ERR_CALLBACK_FAILURE";
   case NGTCP2_ERR_INTERNAL:
@@ -47,13 +47,8 @@ void ngtcp2_gaptr_gap_del(ngtcp2_gaptr_gap *g, ngtcp2_mem *mem) {
 }
 
 int ngtcp2_gaptr_init(ngtcp2_gaptr *gaptr, ngtcp2_mem *mem) {
-  int rv;
-
-  rv = ngtcp2_gaptr_gap_new(&gaptr->gap, 0, UINT64_MAX, mem);
-  if (rv != 0) {
-    return rv;
-  }
-
+  gaptr->gap = NULL;
+  gaptr->offset = 0;
   gaptr->mem = mem;
 
   return 0;
@@ -89,6 +84,19 @@ int ngtcp2_gaptr_push(ngtcp2_gaptr *gaptr, uint64_t offset, size_t datalen) {
   ngtcp2_gaptr_gap **pg;
   ngtcp2_range m, l, r, q = {offset, offset + datalen};
 
+  if (gaptr->gap == NULL) {
+    if (offset <= gaptr->offset) {
+      gaptr->offset = ngtcp2_max(gaptr->offset, offset + datalen);
+      return 0;
+    }
+
+    rv = ngtcp2_gaptr_gap_new(&gaptr->gap, gaptr->offset, UINT64_MAX,
+                              gaptr->mem);
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
   for (pg = &gaptr->gap; *pg;) {
     m = ngtcp2_range_intersect(&q, &(*pg)->range);
     if (ngtcp2_range_len(&m)) {
@@ -118,6 +126,17 @@ int ngtcp2_gaptr_push(ngtcp2_gaptr *gaptr, uint64_t offset, size_t datalen) {
     }
     pg = &((*pg)->next);
   }
+
+  if (gaptr->gap == NULL) {
+    gaptr->offset = UINT64_MAX;
+  } else if (gaptr->gap->next == NULL &&
+             gaptr->gap->range.end == UINT64_MAX) {
+    /* The gaps in the middle have been filled in. */
+    gaptr->offset = gaptr->gap->range.begin;
+    ngtcp2_gaptr_gap_del(gaptr->gap, gaptr->mem);
+    gaptr->gap = NULL;
+  }
+
   return 0;
 }
 
@@ -125,5 +144,5 @@ uint64_t ngtcp2_gaptr_first_gap_offset(ngtcp2_gaptr *gaptr) {
   if (gaptr->gap) {
     return gaptr->gap->range.begin;
   }
-  return UINT64_MAX;
+  return gaptr->offset;
 }
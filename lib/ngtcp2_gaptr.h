@@ -78,14 +78,20 @@ void ngtcp2_gaptr_gap_del(ngtcp2_gaptr_gap *g, ngtcp2_mem *mem);
  */
 typedef struct {
   /* gap maintains the range of offset which is not received
-     yet. Initially, its range is [0, UINT64_MAX). */
+     yet. Initially, its range is [0, UINT64_MAX).  It is NULL while
+     the only gap is [offset, UINT64_MAX), which is the case until
+     data is pushed out of order, so that in-order data does not
+     allocate any gap. */
   ngtcp2_gaptr_gap *gap;
+  /* offset is the beginning of the only gap if gap is NULL. */
+  uint64_t offset;
   /* mem is custom memory allocator */
   ngtcp2_mem *mem;
 } ngtcp2_gaptr;
 
 /*
- * ngtcp2_gaptr_init initializes |gaptr|.
+ * ngtcp2_gaptr_init initializes |gaptr|.  No memory is allocated
+ * until data is pushed out of order.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
@@ -30,6 +30,7 @@
 #include <errno.h>
 
 #include "ngtcp2_str.h"
+#include "ngtcp2_trace.h"
 
 void ngtcp2_log_init(ngtcp2_log *log, const ngtcp2_cid *scid,
                      ngtcp2_printf log_printf, ngtcp2_tstamp ts,
@@ -42,6 +43,104 @@ void ngtcp2_log_init(ngtcp2_log *log, const ngtcp2_cid *scid,
   log->log_printf = log_printf;
   log->ts = log->last_ts = ts;
   log->user_data = user_data;
+  log->trace = NULL;
+}
+
+/*
+ * trace_push returns a record in log->trace for event |ev| of a
+ * packet described by |hd|.  a, b, c, and frame_type are zeroed.
+ */
+static ngtcp2_trace_record *trace_push(ngtcp2_log *log, uint8_t ev,
+                                       const ngtcp2_pkt_hd *hd) {
+  ngtcp2_trace_record *rec = ngtcp2_trace_ring_push(log->trace);
+
+  rec->ts = log->last_ts;
+  rec->pkt_num = hd ? hd->pkt_num : 0;
+  rec->a = rec->b = 0;
+  rec->c = 0;
+  rec->event = ev;
+  rec->pkt_type = hd ? hd->type : 0;
+  rec->flags = (hd && (hd->flags & NGTCP2_PKT_FLAG_LONG_FORM))
+                   ? NGTCP2_TRACE_FLAG_LONG_FORM
+                   : NGTCP2_TRACE_FLAG_NONE;
+  rec->frame_type = 0;
+
+  return rec;
+}
+
+static uint32_t trace_u32(uint64_t n) {
+  return n > UINT32_MAX ? UINT32_MAX : (uint32_t)n;
+}
+
+static void trace_fr(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
+                     const ngtcp2_frame *fr, uint8_t ev) {
+  ngtcp2_trace_record *rec = trace_push(log, ev, hd);
+  size_t i;
+
+  rec->frame_type = fr->type;
+
+  switch (fr->type) {
+  case NGTCP2_FRAME_ACK:
+    rec->a = fr->ack.largest_ack;
+    rec->b = fr->ack.ack_delay_unscaled;
+    rec->c = trace_u32(fr->ack.num_blks);
+    break;
+  case NGTCP2_FRAME_PADDING:
+    rec->c = trace_u32(fr->padding.len);
+    break;
+  case NGTCP2_FRAME_RST_STREAM:
+    rec->a = fr->rst_stream.stream_id;
+    rec->b = fr->rst_stream.final_offset;
+    rec->c = fr->rst_stream.app_error_code;
+    break;
+  case NGTCP2_FRAME_CONNECTION_CLOSE:
+    rec->c = fr->connection_close.error_code;
+    break;
+  case NGTCP2_FRAME_APPLICATION_CLOSE:
+    rec->c = fr->application_close.app_error_code;
+    break;
+  case NGTCP2_FRAME_MAX_DATA:
+    rec->a = fr->max_data.max_data;
+    break;
+  case NGTCP2_FRAME_MAX_STREAM_DATA:
+    rec->a = fr->max_stream_data.stream_id;
+    rec->b = fr->max_stream_data.max_stream_data;
+    break;
+  case NGTCP2_FRAME_MAX_STREAM_ID:
+    rec->a = fr->max_stream_id.max_stream_id;
+    break;
+  case NGTCP2_FRAME_BLOCKED:
+    rec->a = fr->blocked.offset;
+    break;
+  case NGTCP2_FRAME_STREAM_BLOCKED:
+    rec->a = fr->stream_blocked.stream_id;
+    rec->b = fr->stream_blocked.offset;
+    break;
+  case NGTCP2_FRAME_STREAM_ID_BLOCKED:
+    rec->a = fr->stream_id_blocked.stream_id;
+    break;
+  case NGTCP2_FRAME_NEW_CONNECTION_ID:
+    rec->a = fr->new_connection_id.seq;
+    break;
+  case NGTCP2_FRAME_STOP_SENDING:
+    rec->a = fr->stop_sending.stream_id;
+    rec->c = fr->stop_sending.app_error_code;
+    break;
+  case NGTCP2_FRAME_CRYPTO:
+    rec->b = fr->crypto.offset;
+    for (i = 0; i < fr->crypto.datacnt; ++i) {
+      rec->c += trace_u32(fr->crypto.data[i].len);
+    }
+    break;
+  case NGTCP2_FRAME_STREAM:
+    rec->a = fr->stream.stream_id;
+    rec->b = fr->stream.offset;
+    rec->c = trace_u32(fr->stream.datalen);
+    if (fr->stream.fin) {
+      rec->flags |= NGTCP2_TRACE_FLAG_FIN;
+    }
+    break;
+  }
 }
 
 /*
@@ -462,6 +561,10 @@ static void log_fr(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
 
 void ngtcp2_log_rx_fr(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
                       const ngtcp2_frame *fr) {
+  if (log->trace) {
+    trace_fr(log, hd, fr, NGTCP2_TRACE_EVENT_FRM_RECV);
+  }
+
   if (!log->log_printf) {
     return;
   }
@@ -471,6 +574,10 @@ void ngtcp2_log_rx_fr(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
 
 void ngtcp2_log_tx_fr(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
                       const ngtcp2_frame *fr) {
+  if (log->trace) {
+    trace_fr(log, hd, fr, NGTCP2_TRACE_EVENT_FRM_SENT);
+  }
+
   if (!log->log_printf) {
     return;
   }
@@ -594,18 +701,29 @@ void ngtcp2_log_remote_tp(ngtcp2_log *log, uint8_t exttype,
                   NGTCP2_LOG_TP_HD_FIELDS, params->ack_delay_exponent);
 }
 
-void ngtcp2_log_pkt_lost(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
-                         ngtcp2_tstamp sent_ts) {
+void ngtcp2_log_pkt_lost(ngtcp2_log *log, uint64_t pkt_num, uint8_t type,
+                         uint8_t flags, ngtcp2_tstamp sent_ts) {
+  ngtcp2_trace_record *rec;
+
+  if (log->trace) {
+    rec = trace_push(log, NGTCP2_TRACE_EVENT_PKT_LOST, NULL);
+    rec->pkt_num = pkt_num;
+    rec->pkt_type = type;
+    rec->flags = (flags & NGTCP2_PKT_FLAG_LONG_FORM)
+                     ? NGTCP2_TRACE_FLAG_LONG_FORM
+                     : NGTCP2_TRACE_FLAG_NONE;
+    rec->a = sent_ts;
+  }
+
   if (!log->log_printf) {
     return;
   }
 
   ngtcp2_log_info(log, NGTCP2_LOG_EVENT_RCV,
                   "packet lost type=%s(0x%02x) %" PRIu64 " sent_ts=%" PRIu64,
-                  (hd->flags & NGTCP2_PKT_FLAG_LONG_FORM)
-                      ? strpkttype_long(hd->type)
-                      : "Short",
-                  hd->type, hd->pkt_num, sent_ts);
+                  (flags & NGTCP2_PKT_FLAG_LONG_FORM) ? strpkttype_long(type)
+                                                      : "Short",
+                  type, pkt_num, sent_ts);
 }
 
 void ngtcp2_log_rx_pkt_hd(ngtcp2_log *log, const ngtcp2_pkt_hd *hd) {
@@ -627,6 +745,52 @@ void ngtcp2_log_rx_pkt_hd(ngtcp2_log *log, const ngtcp2_pkt_hd *hd) {
       hd->type, hd->len);
 }
 
+void ngtcp2_log_tx_pkt(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
+                       size_t pktlen) {
+  if (!log->trace) {
+    return;
+  }
+
+  trace_push(log, NGTCP2_TRACE_EVENT_PKT_SENT, hd)->a = pktlen;
+}
+
+void ngtcp2_log_rx_pkt(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
+                       size_t pktlen) {
+  if (!log->trace) {
+    return;
+  }
+
+  trace_push(log, NGTCP2_TRACE_EVENT_PKT_RECV, hd)->a = pktlen;
+}
+
+void ngtcp2_log_cc(ngtcp2_log *log, uint64_t cwnd, uint64_t ssthresh,
+                   size_t bytes_in_flight) {
+  ngtcp2_trace_record *rec;
+
+  if (!log->trace) {
+    return;
+  }
+
+  rec = trace_push(log, NGTCP2_TRACE_EVENT_CC, NULL);
+  rec->a = cwnd;
+  rec->b = ssthresh;
+  rec->c = trace_u32(bytes_in_flight);
+}
+
+void ngtcp2_log_loss_timer(ngtcp2_log *log, size_t handshake_count,
+                           size_t tlp_count, size_t rto_count) {
+  ngtcp2_trace_record *rec;
+
+  if (!log->trace) {
+    return;
+  }
+
+  rec = trace_push(log, NGTCP2_TRACE_EVENT_LOSS_TIMER, NULL);
+  rec->a = handshake_count;
+  rec->b = tlp_count;
+  rec->c = trace_u32(rto_count);
+}
+
 void ngtcp2_log_info(ngtcp2_log *log, ngtcp2_log_event ev, const char *fmt,
                      ...) {
   va_list ap;
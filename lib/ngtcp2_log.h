@@ -59,6 +59,9 @@ struct ngtcp2_log {
   void *user_data;
   /* scid is SCID encoded as NULL-terminated hex string. */
   uint8_t scid[NGTCP2_MAX_CIDLEN * 2 + 1];
+  /* trace is a sink to write binary event records.  NULL means no
+     tracing. */
+  ngtcp2_trace_ring *trace;
 };
 
 typedef struct ngtcp2_log ngtcp2_log;
@@ -84,9 +87,25 @@ void ngtcp2_log_rx_sr(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
 void ngtcp2_log_remote_tp(ngtcp2_log *log, uint8_t exttype,
                           const ngtcp2_transport_params *params);
 
-void ngtcp2_log_pkt_lost(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
-                         ngtcp2_tstamp sent_ts);
+void ngtcp2_log_pkt_lost(ngtcp2_log *log, uint64_t pkt_num, uint8_t type,
+                         uint8_t flags, ngtcp2_tstamp sent_ts);
 
 void ngtcp2_log_rx_pkt_hd(ngtcp2_log *log, const ngtcp2_pkt_hd *hd);
 
+/*
+ * The following functions only write binary event records to
+ * log->trace.
+ */
+void ngtcp2_log_tx_pkt(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
+                       size_t pktlen);
+
+void ngtcp2_log_rx_pkt(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
+                       size_t pktlen);
+
+void ngtcp2_log_cc(ngtcp2_log *log, uint64_t cwnd, uint64_t ssthresh,
+                   size_t bytes_in_flight);
+
+void ngtcp2_log_loss_timer(ngtcp2_log *log, size_t handshake_count,
+                           size_t tlp_count, size_t rto_count);
+
 #endif /* NGTCP2_LOG_H */
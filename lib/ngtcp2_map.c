@@ -29,17 +29,14 @@
 
 #include "ngtcp2_conv.h"
 
-#define INITIAL_TABLE_LENGTH 256
+/* The table is allocated with INITIAL_TABLE_LENGTH buckets on the
+   first insertion. */
+#define INITIAL_TABLE_LENGTH 16
 
 int ngtcp2_map_init(ngtcp2_map *map, ngtcp2_mem *mem) {
   map->mem = mem;
-  map->tablelen = INITIAL_TABLE_LENGTH;
-  map->table =
-      ngtcp2_mem_calloc(mem, map->tablelen, sizeof(ngtcp2_map_entry *));
-  if (map->table == NULL) {
-    return NGTCP2_ERR_NOMEM;
-  }
-
+  map->tablelen = 0;
+  map->table = NULL;
   map->size = 0;
 
   return 0;
@@ -47,6 +44,16 @@ int ngtcp2_map_init(ngtcp2_map *map, ngtcp2_mem *mem) {
 
 void ngtcp2_map_free(ngtcp2_map *map) { ngtcp2_mem_free(map->mem, map->table); }
 
+void ngtcp2_map_release(ngtcp2_map *map) {
+  if (map->size) {
+    return;
+  }
+
+  ngtcp2_mem_free(map->mem, map->table);
+  map->table = NULL;
+  map->tablelen = 0;
+}
+
 void ngtcp2_map_each_free(ngtcp2_map *map,
                           int (*func)(ngtcp2_map_entry *entry, void *ptr),
                           void *ptr) {
@@ -154,7 +161,8 @@ int ngtcp2_map_insert(ngtcp2_map *map, ngtcp2_map_entry *new_entry) {
   int rv;
   /* Load factor is 0.75 */
   if ((map->size + 1) * 4 > map->tablelen * 3) {
-    rv = resize(map, map->tablelen * 2);
+    rv = resize(map,
+                map->tablelen ? map->tablelen * 2 : INITIAL_TABLE_LENGTH);
     if (rv != 0) {
       return rv;
     }
@@ -170,6 +178,11 @@ int ngtcp2_map_insert(ngtcp2_map *map, ngtcp2_map_entry *new_entry) {
 ngtcp2_map_entry *ngtcp2_map_find(ngtcp2_map *map, key_type key) {
   uint32_t h;
   ngtcp2_map_entry *entry;
+
+  if (map->size == 0) {
+    return NULL;
+  }
+
   h = hash(key, map->tablelen);
   for (entry = map->table[h]; entry; entry = entry->next) {
     if (entry->key == key) {
@@ -183,6 +196,10 @@ int ngtcp2_map_remove(ngtcp2_map *map, key_type key) {
   uint32_t h;
   ngtcp2_map_entry **dst;
 
+  if (map->size == 0) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
   h = hash(key, map->tablelen);
 
   for (dst = &map->table[h]; *dst; dst = &(*dst)->next) {
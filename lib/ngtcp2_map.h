@@ -51,7 +51,8 @@ typedef struct {
 } ngtcp2_map;
 
 /*
- * Initializes the map |map|.
+ * Initializes the map |map|.  The hash table is not allocated until
+ * the first entry is inserted.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
@@ -68,6 +69,12 @@ int ngtcp2_map_init(ngtcp2_map *map, ngtcp2_mem *mem);
  */
 void ngtcp2_map_free(ngtcp2_map *map);
 
+/*
+ * ngtcp2_map_release frees the hash table of |map| if |map| is empty.
+ * The table is allocated again when the next entry is inserted.
+ */
+void ngtcp2_map_release(ngtcp2_map *map);
+
 /*
  * Deallocates each entries using |func| function and any resources
  * allocated for |map|. The |func| function is responsible for freeing
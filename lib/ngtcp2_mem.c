@@ -25,6 +25,8 @@
  */
 #include "ngtcp2_mem.h"
 
+#include <string.h>
+
 static void *default_malloc(size_t size, void *mem_user_data) {
   (void)mem_user_data;
 
@@ -73,3 +75,126 @@ void *ngtcp2_mem_calloc(ngtcp2_mem *mem, size_t nmemb, size_t size) {
 void *ngtcp2_mem_realloc(ngtcp2_mem *mem, void *ptr, size_t size) {
   return mem->realloc(ptr, size, mem->mem_user_data);
 }
+
+/*
+ * mem_acct_hd precedes each allocation made through ngtcp2_mem_acct.
+ */
+typedef union {
+  struct {
+    size_t size;
+    ngtcp2_mem_subsys subsys;
+  } s;
+  /* align keeps the allocation suitably aligned. */
+  uint64_t align[2];
+} mem_acct_hd;
+
+static void *mem_acct_malloc(size_t size, void *mem_user_data) {
+  ngtcp2_mem_acct_sub *sub = mem_user_data;
+  ngtcp2_mem_acct *acct = sub->acct;
+  mem_acct_hd *hd;
+
+  if (size > SIZE_MAX - sizeof(mem_acct_hd)) {
+    return NULL;
+  }
+
+  size += sizeof(mem_acct_hd);
+
+  hd = ngtcp2_mem_malloc(acct->parent, size);
+  if (hd == NULL) {
+    return NULL;
+  }
+
+  hd->s.size = size;
+  hd->s.subsys = sub->subsys;
+  acct->nbytes[sub->subsys] += size;
+  acct->total += size;
+
+  return hd + 1;
+}
+
+static void mem_acct_free(void *ptr, void *mem_user_data) {
+  ngtcp2_mem_acct *acct = ((ngtcp2_mem_acct_sub *)mem_user_data)->acct;
+  mem_acct_hd *hd;
+
+  if (ptr == NULL) {
+    return;
+  }
+
+  hd = (mem_acct_hd *)ptr - 1;
+  acct->nbytes[hd->s.subsys] -= hd->s.size;
+  acct->total -= hd->s.size;
+
+  ngtcp2_mem_free(acct->parent, hd);
+}
+
+static void *mem_acct_calloc(size_t nmemb, size_t size, void *mem_user_data) {
+  void *p;
+
+  if (size && nmemb > SIZE_MAX / size) {
+    return NULL;
+  }
+
+  p = mem_acct_malloc(nmemb * size, mem_user_data);
+  if (p == NULL) {
+    return NULL;
+  }
+
+  return memset(p, 0, nmemb * size);
+}
+
+static void *mem_acct_realloc(void *ptr, size_t size, void *mem_user_data) {
+  ngtcp2_mem_acct *acct = ((ngtcp2_mem_acct_sub *)mem_user_data)->acct;
+  mem_acct_hd *hd;
+  size_t oldsize;
+  ngtcp2_mem_subsys subsys;
+
+  if (ptr == NULL) {
+    return mem_acct_malloc(size, mem_user_data);
+  }
+
+  if (size > SIZE_MAX - sizeof(mem_acct_hd)) {
+    return NULL;
+  }
+
+  size += sizeof(mem_acct_hd);
+
+  hd = (mem_acct_hd *)ptr - 1;
+  oldsize = hd->s.size;
+  subsys = hd->s.subsys;
+
+  hd = ngtcp2_mem_realloc(acct->parent, hd, size);
+  if (hd == NULL) {
+    return NULL;
+  }
+
+  hd->s.size = size;
+  acct->nbytes[subsys] = acct->nbytes[subsys] - oldsize + size;
+  acct->total = acct->total - oldsize + size;
+
+  return hd + 1;
+}
+
+void ngtcp2_mem_acct_init(ngtcp2_mem_acct *acct, ngtcp2_mem *parent) {
+  size_t i;
+  ngtcp2_mem_acct_sub *sub;
+
+  memset(acct, 0, sizeof(*acct));
+
+  acct->parent = parent;
+
+  for (i = 0; i < NGTCP2_MEM_SUBSYS_MAX; ++i) {
+    sub = &acct->subs[i];
+    sub->mem.mem_user_data = sub;
+    sub->mem.malloc = mem_acct_malloc;
+    sub->mem.free = mem_acct_free;
+    sub->mem.calloc = mem_acct_calloc;
+    sub->mem.realloc = mem_acct_realloc;
+    sub->acct = acct;
+    sub->subsys = (ngtcp2_mem_subsys)i;
+  }
+}
+
+ngtcp2_mem *ngtcp2_mem_acct_get(ngtcp2_mem_acct *acct,
+                                ngtcp2_mem_subsys subsys) {
+  return &acct->subs[subsys].mem;
+}
@@ -43,4 +43,48 @@ void ngtcp2_mem_free2(ngtcp2_free free_func, void *ptr, void *mem_user_data);
 void *ngtcp2_mem_calloc(ngtcp2_mem *mem, size_t nmemb, size_t size);
 void *ngtcp2_mem_realloc(ngtcp2_mem *mem, void *ptr, size_t size);
 
+struct ngtcp2_mem_acct;
+typedef struct ngtcp2_mem_acct ngtcp2_mem_acct;
+
+/*
+ * ngtcp2_mem_acct_sub is the allocator which ngtcp2_mem_acct gives
+ * to one subsystem.
+ */
+typedef struct {
+  ngtcp2_mem mem;
+  ngtcp2_mem_acct *acct;
+  ngtcp2_mem_subsys subsys;
+} ngtcp2_mem_acct_sub;
+
+/*
+ * ngtcp2_mem_acct counts the number of bytes allocated per subsystem.
+ * Each allocation is prefixed with a header which records its size
+ * and subsystem, so that it can be freed through the allocator of any
+ * subsystem.  The header is included in the count.
+ */
+struct ngtcp2_mem_acct {
+  /* parent is the allocator which actually allocates memory. */
+  ngtcp2_mem *parent;
+  ngtcp2_mem_acct_sub subs[NGTCP2_MEM_SUBSYS_MAX];
+  /* nbytes is the number of bytes currently allocated per
+     subsystem. */
+  size_t nbytes[NGTCP2_MEM_SUBSYS_MAX];
+  /* total is the sum of nbytes. */
+  size_t total;
+};
+
+/*
+ * ngtcp2_mem_acct_init initializes |acct| which allocates memory from
+ * |parent|.  |acct| must not be moved after this call because the
+ * allocators refer to it.
+ */
+void ngtcp2_mem_acct_init(ngtcp2_mem_acct *acct, ngtcp2_mem *parent);
+
+/*
+ * ngtcp2_mem_acct_get returns the allocator which counts allocations
+ * for |subsys|.
+ */
+ngtcp2_mem *ngtcp2_mem_acct_get(ngtcp2_mem_acct *acct,
+                                ngtcp2_mem_subsys subsys);
+
 #endif /* NGTCP2_MEM_H */
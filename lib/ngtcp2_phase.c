@@ -0,0 +1,108 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2018 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "ngtcp2_phase.h"
+
+#ifdef PHASE_TIMING
+
+#  include <string.h>
+
+#  if defined(__x86_64__) || defined(__i386__)
+#    include <x86intrin.h>
+#  elif !defined(__aarch64__)
+#    include <time.h>
+#  endif
+
+/*
+ * phase_now returns the current value of CPU cycle counter, or
+ * monotonic clock in nanoseconds if the counter is not available.
+ */
+static uint64_t phase_now(void) {
+#  if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#  elif defined(__aarch64__)
+  uint64_t v;
+  __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(v));
+  return v;
+#  else
+  struct timespec tp;
+  clock_gettime(CLOCK_MONOTONIC, &tp);
+  return (uint64_t)tp.tv_sec * 1000000000 + (uint64_t)tp.tv_nsec;
+#  endif
+}
+
+void ngtcp2_phase_timer_init(ngtcp2_phase_timer *pt) {
+  size_t i;
+
+  memset(pt, 0, sizeof(*pt));
+
+  for (i = 0; i < NGTCP2_PHASE_MAX; ++i) {
+    pt->hist[i].min = UINT64_MAX;
+  }
+}
+
+void ngtcp2_phase_begin(ngtcp2_phase_timer *pt, ngtcp2_phase phase) {
+  if (pt == NULL) {
+    return;
+  }
+
+  pt->start[phase] = phase_now();
+}
+
+/*
+ * phase_hist_bucket returns the index of the bucket which |v| falls
+ * in.
+ */
+static size_t phase_hist_bucket(uint64_t v) {
+  size_t i = 0;
+
+  for (; v > 1 && i < NGTCP2_PHASE_HIST_NBUCKETS - 1; v >>= 1, ++i)
+    ;
+
+  return i;
+}
+
+void ngtcp2_phase_end(ngtcp2_phase_timer *pt, ngtcp2_phase phase) {
+  ngtcp2_phase_hist *h;
+  uint64_t d;
+
+  if (pt == NULL) {
+    return;
+  }
+
+  h = &pt->hist[phase];
+  d = phase_now() - pt->start[phase];
+
+  ++h->count;
+  h->sum += d;
+  if (d < h->min) {
+    h->min = d;
+  }
+  if (d > h->max) {
+    h->max = d;
+  }
+  ++h->buckets[phase_hist_bucket(d)];
+}
+
+#endif /* PHASE_TIMING */
@@ -0,0 +1,72 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2018 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NGTCP2_PHASE_H
+#define NGTCP2_PHASE_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <ngtcp2/ngtcp2.h>
+
+#ifdef PHASE_TIMING
+
+/*
+ * ngtcp2_phase_timer keeps the histograms of all phases, and the
+ * start time of the phases which are being timed.
+ */
+typedef struct {
+  ngtcp2_phase_hist hist[NGTCP2_PHASE_MAX];
+  uint64_t start[NGTCP2_PHASE_MAX];
+} ngtcp2_phase_timer;
+
+/*
+ * ngtcp2_phase_timer_init initializes |pt|.
+ */
+void ngtcp2_phase_timer_init(ngtcp2_phase_timer *pt);
+
+/*
+ * ngtcp2_phase_begin starts timing |phase|.  It does nothing if |pt|
+ * is NULL.
+ */
+void ngtcp2_phase_begin(ngtcp2_phase_timer *pt, ngtcp2_phase phase);
+
+/*
+ * ngtcp2_phase_end stops timing |phase|, and adds the elapsed time to
+ * its histogram.  It does nothing if |pt| is NULL.
+ */
+void ngtcp2_phase_end(ngtcp2_phase_timer *pt, ngtcp2_phase phase);
+
+#  define NGTCP2_PHASE_BEGIN(PT, PHASE) ngtcp2_phase_begin((PT), (PHASE))
+#  define NGTCP2_PHASE_END(PT, PHASE) ngtcp2_phase_end((PT), (PHASE))
+
+#else /* !PHASE_TIMING */
+
+#  define NGTCP2_PHASE_BEGIN(PT, PHASE)
+#  define NGTCP2_PHASE_END(PT, PHASE)
+
+#endif /* !PHASE_TIMING */
+
+#endif /* NGTCP2_PHASE_H */
@@ -25,6 +25,7 @@
 #include "ngtcp2_ringbuf.h"
 
 #include <assert.h>
+#include <string.h>
 
 #include "ngtcp2_macro.h"
 
@@ -39,6 +40,7 @@ int ngtcp2_ringbuf_init(ngtcp2_ringbuf *rb, size_t nmemb, size_t size,
 
   rb->mem = mem;
   rb->nmemb = nmemb;
+  rb->max_nmemb = nmemb;
   rb->size = size;
   rb->first = 0;
   rb->len = 0;
@@ -46,6 +48,19 @@ int ngtcp2_ringbuf_init(ngtcp2_ringbuf *rb, size_t nmemb, size_t size,
   return 0;
 }
 
+void ngtcp2_ringbuf_init_growable(ngtcp2_ringbuf *rb, size_t max_nmemb,
+                                  size_t size, ngtcp2_mem *mem) {
+  assert(1 == __builtin_popcount((unsigned int)max_nmemb));
+
+  rb->buf = NULL;
+  rb->mem = mem;
+  rb->nmemb = 0;
+  rb->max_nmemb = max_nmemb;
+  rb->size = size;
+  rb->first = 0;
+  rb->len = 0;
+}
+
 void ngtcp2_ringbuf_free(ngtcp2_ringbuf *rb) {
   if (rb == NULL) {
     return;
@@ -54,6 +69,55 @@ void ngtcp2_ringbuf_free(ngtcp2_ringbuf *rb) {
   ngtcp2_mem_free(rb->mem, rb->buf);
 }
 
+/* NGTCP2_RINGBUF_MIN_NMEMB is the capacity of the buffer which
+   ngtcp2_ringbuf_reserve allocates first. */
+#define NGTCP2_RINGBUF_MIN_NMEMB 4
+
+int ngtcp2_ringbuf_reserve(ngtcp2_ringbuf *rb) {
+  uint8_t *buf;
+  size_t nmemb, n;
+
+  if (rb->len < rb->nmemb || rb->nmemb == rb->max_nmemb) {
+    return 0;
+  }
+
+  nmemb = rb->nmemb ? rb->nmemb * 2
+                    : ngtcp2_min(NGTCP2_RINGBUF_MIN_NMEMB, rb->max_nmemb);
+
+  buf = ngtcp2_mem_malloc(rb->mem, nmemb * rb->size);
+  if (buf == NULL) {
+    return NGTCP2_ERR_NOMEM;
+  }
+
+  if (rb->len) {
+    /* Elements from first to the end of the buffer, and then the
+       wrapped ones. */
+    n = rb->nmemb - rb->first;
+    memcpy(buf, rb->buf + rb->first * rb->size, n * rb->size);
+    memcpy(buf + n * rb->size, rb->buf, rb->first * rb->size);
+  }
+
+  ngtcp2_mem_free(rb->mem, rb->buf);
+
+  rb->buf = buf;
+  rb->nmemb = nmemb;
+  rb->first = 0;
+
+  return 0;
+}
+
+void ngtcp2_ringbuf_release(ngtcp2_ringbuf *rb) {
+  if (rb->len || rb->nmemb == 0) {
+    return;
+  }
+
+  ngtcp2_mem_free(rb->mem, rb->buf);
+
+  rb->buf = NULL;
+  rb->nmemb = 0;
+  rb->first = 0;
+}
+
 void *ngtcp2_ringbuf_push_front(ngtcp2_ringbuf *rb) {
   rb->first = (rb->first - 1) & (rb->nmemb - 1);
   rb->len = ngtcp2_min(rb->nmemb, rb->len + 1);
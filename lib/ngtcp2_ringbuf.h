@@ -40,6 +40,9 @@ typedef struct {
   /* nmemb is the number of elements that can be stored in this ring
      buffer. */
   size_t nmemb;
+  /* max_nmemb is the number of elements up to which
+     ngtcp2_ringbuf_reserve grows the buffer. */
+  size_t max_nmemb;
   /* size is the size of each element. */
   size_t size;
   /* first is the offset to the first element. */
@@ -62,12 +65,41 @@ typedef struct {
 int ngtcp2_ringbuf_init(ngtcp2_ringbuf *rb, size_t nmemb, size_t size,
                         ngtcp2_mem *mem);
 
+/*
+ * ngtcp2_ringbuf_init_growable initializes |rb| without allocating
+ * memory.  The buffer is allocated, and doubled up to |max_nmemb|
+ * elements by ngtcp2_ringbuf_reserve.  |max_nmemb| and |size| must
+ * be power of 2.
+ */
+void ngtcp2_ringbuf_init_growable(ngtcp2_ringbuf *rb, size_t max_nmemb,
+                                  size_t size, ngtcp2_mem *mem);
+
 /*
  * ngtcp2_ringbuf_free frees resources allocated for |rb|.  This
  * function does not free the memory pointed by |rb|.
  */
 void ngtcp2_ringbuf_free(ngtcp2_ringbuf *rb);
 
+/*
+ * ngtcp2_ringbuf_reserve grows |rb| if it is full, and its capacity
+ * is less than max_nmemb, so that the next push does not overwrite
+ * an element.  Push must not be made to |rb| whose capacity is 0.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory.
+ */
+int ngtcp2_ringbuf_reserve(ngtcp2_ringbuf *rb);
+
+/*
+ * ngtcp2_ringbuf_release frees the buffer of |rb| if it is empty.
+ * After this call, ngtcp2_ringbuf_reserve must be called before
+ * push.
+ */
+void ngtcp2_ringbuf_release(ngtcp2_ringbuf *rb);
+
 /* ngtcp2_ringbuf_push_front moves the offset to the first element in
    the buffer backward, and returns the pointer to the element.
    Caller can store data to the buffer pointed by the returned
@@ -66,15 +66,28 @@ void ngtcp2_rob_data_del(ngtcp2_rob_data *d, ngtcp2_mem *mem) {
 }
 
 int ngtcp2_rob_init(ngtcp2_rob *rob, size_t chunk, ngtcp2_mem *mem) {
+  rob->gappsl.head = NULL;
+  rob->chunk = chunk;
+  rob->mem = mem;
+  rob->offset = 0;
+
+  return 0;
+}
+
+/*
+ * rob_init_psl initializes gappsl and datapsl of |rob| with the gap
+ * [rob->offset, UINT64_MAX).
+ */
+static int rob_init_psl(ngtcp2_rob *rob) {
   int rv;
   ngtcp2_rob_gap *g;
 
-  rv = ngtcp2_psl_init(&rob->gappsl, mem);
+  rv = ngtcp2_psl_init(&rob->gappsl, rob->mem);
   if (rv != 0) {
     goto fail_gappsl_psl_init;
   }
 
-  rv = ngtcp2_rob_gap_new(&g, 0, UINT64_MAX, mem);
+  rv = ngtcp2_rob_gap_new(&g, rob->offset, UINT64_MAX, rob->mem);
   if (rv != 0) {
     goto fail_rob_gap_new;
   }
@@ -84,22 +97,20 @@ int ngtcp2_rob_init(ngtcp2_rob *rob, size_t chunk, ngtcp2_mem *mem) {
     goto fail_gappsl_psl_insert;
   }
 
-  rv = ngtcp2_psl_init(&rob->datapsl, mem);
+  rv = ngtcp2_psl_init(&rob->datapsl, rob->mem);
   if (rv != 0) {
     goto fail_datapsl_psl_init;
   }
 
-  rob->chunk = chunk;
-  rob->mem = mem;
-
   return 0;
 
 fail_datapsl_psl_init:
 fail_gappsl_psl_insert:
-  ngtcp2_rob_gap_del(g, mem);
+  ngtcp2_rob_gap_del(g, rob->mem);
 fail_rob_gap_new:
   ngtcp2_psl_free(&rob->gappsl);
 fail_gappsl_psl_init:
+  rob->gappsl.head = NULL;
   return rv;
 }
 
@@ -107,7 +118,7 @@ void ngtcp2_rob_free(ngtcp2_rob *rob) {
   static const ngtcp2_range r = {0, 0};
   ngtcp2_psl_it it;
 
-  if (rob == NULL) {
+  if (rob == NULL || rob->gappsl.head == NULL) {
     return;
   }
 
@@ -125,6 +136,32 @@ void ngtcp2_rob_free(ngtcp2_rob *rob) {
   ngtcp2_psl_free(&rob->gappsl);
 }
 
+void ngtcp2_rob_release(ngtcp2_rob *rob) {
+  ngtcp2_psl_it it;
+  ngtcp2_rob_gap *g;
+
+  if (rob->gappsl.head == NULL) {
+    return;
+  }
+
+  it = ngtcp2_psl_begin(&rob->datapsl);
+  if (!ngtcp2_psl_it_end(&it)) {
+    return;
+  }
+
+  it = ngtcp2_psl_begin(&rob->gappsl);
+  g = ngtcp2_psl_it_get(&it);
+  if (g->range.end != UINT64_MAX) {
+    return;
+  }
+
+  rob->offset = g->range.begin;
+
+  ngtcp2_rob_free(rob);
+
+  rob->gappsl.head = NULL;
+}
+
 static int rob_write_data(ngtcp2_rob *rob, uint64_t offset, const uint8_t *data,
                           size_t len) {
   size_t n;
@@ -169,6 +206,13 @@ int ngtcp2_rob_push(ngtcp2_rob *rob, uint64_t offset, const uint8_t *data,
   ngtcp2_range m, l, r, q = {offset, offset + datalen};
   ngtcp2_psl_it it;
 
+  if (rob->gappsl.head == NULL) {
+    rv = rob_init_psl(rob);
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
   it = ngtcp2_psl_lower_bound(&rob->gappsl, &q);
 
   for (; !ngtcp2_psl_it_end(&it);) {
@@ -229,6 +273,11 @@ int ngtcp2_rob_remove_prefix(ngtcp2_rob *rob, uint64_t offset) {
   ngtcp2_psl_it it;
   int rv;
 
+  if (rob->gappsl.head == NULL) {
+    rob->offset = ngtcp2_max(rob->offset, offset);
+    return 0;
+  }
+
   it = ngtcp2_psl_begin(&rob->gappsl);
 
   for (; !ngtcp2_psl_it_end(&it);) {
@@ -272,6 +321,10 @@ size_t ngtcp2_rob_data_at(ngtcp2_rob *rob, const uint8_t **pdest,
   ngtcp2_rob_data *d;
   ngtcp2_psl_it it;
 
+  if (rob->gappsl.head == NULL) {
+    return 0;
+  }
+
   it = ngtcp2_psl_begin(&rob->gappsl);
   if (ngtcp2_psl_it_end(&it)) {
     return 0;
@@ -319,9 +372,15 @@ int ngtcp2_rob_pop(ngtcp2_rob *rob, uint64_t offset, size_t len) {
 }
 
 uint64_t ngtcp2_rob_first_gap_offset(ngtcp2_rob *rob) {
-  ngtcp2_psl_it it = ngtcp2_psl_begin(&rob->gappsl);
+  ngtcp2_psl_it it;
   ngtcp2_rob_gap *g;
 
+  if (rob->gappsl.head == NULL) {
+    return rob->offset;
+  }
+
+  it = ngtcp2_psl_begin(&rob->gappsl);
+
   if (ngtcp2_psl_it_end(&it)) {
     return UINT64_MAX;
   }
@@ -114,7 +114,9 @@ void ngtcp2_rob_data_del(ngtcp2_rob_data *d, ngtcp2_mem *mem);
  */
 typedef struct {
   /* gappsl maintains the range of offset which is not received
-     yet. Initially, its range is [0, UINT64_MAX). */
+     yet. Initially, its range is [0, UINT64_MAX).  gappsl and datapsl
+     are initialized by the first ngtcp2_rob_push.  Until then,
+     gappsl.head is NULL, and the only gap is [offset, UINT64_MAX). */
   ngtcp2_psl gappsl;
   /* datapsl maintains the list of buffers which store received data
      ordered by stream offset. */
@@ -123,11 +125,14 @@ typedef struct {
   ngtcp2_mem *mem;
   /* chunk is the size of each buffer in data field */
   size_t chunk;
+  /* offset is the beginning of the only gap while gappsl is not
+     initialized. */
+  uint64_t offset;
 } ngtcp2_rob;
 
 /*
  * ngtcp2_rob_init initializes |rob|.  |chunk| is the size of buffer
- * per chunk.
+ * per chunk.  No memory is allocated until data is pushed.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
@@ -137,6 +142,13 @@ typedef struct {
  */
 int ngtcp2_rob_init(ngtcp2_rob *rob, size_t chunk, ngtcp2_mem *mem);
 
+/*
+ * ngtcp2_rob_release frees the memory allocated for |rob| if it
+ * buffers no data, and has only one gap which extends to UINT64_MAX.
+ * |rob| remains usable.
+ */
+void ngtcp2_rob_release(ngtcp2_rob *rob);
+
 /*
  * ngtcp2_rob_free frees resources allocated for |rob|.
  */
@@ -25,35 +25,87 @@
 #include "ngtcp2_rtb.h"
 
 #include <assert.h>
+#include <stddef.h>
 #include <string.h>
 
 #include "ngtcp2_macro.h"
 #include "ngtcp2_conn.h"
 #include "ngtcp2_log.h"
 
-int ngtcp2_frame_chain_new(ngtcp2_frame_chain **pfrc, ngtcp2_mem *mem) {
-  *pfrc = ngtcp2_mem_malloc(mem, sizeof(ngtcp2_frame_chain));
-  if (*pfrc == NULL) {
-    return NGTCP2_ERR_NOMEM;
+/*
+ * frame_len returns the size of the member of ngtcp2_frame which
+ * |type| selects.
+ */
+static size_t frame_len(uint8_t type) {
+  switch (type) {
+  case NGTCP2_FRAME_PADDING:
+    return sizeof(ngtcp2_padding);
+  case NGTCP2_FRAME_RST_STREAM:
+    return sizeof(ngtcp2_rst_stream);
+  case NGTCP2_FRAME_CONNECTION_CLOSE:
+    return sizeof(ngtcp2_connection_close);
+  case NGTCP2_FRAME_APPLICATION_CLOSE:
+    return sizeof(ngtcp2_application_close);
+  case NGTCP2_FRAME_MAX_DATA:
+    return sizeof(ngtcp2_max_data);
+  case NGTCP2_FRAME_MAX_STREAM_DATA:
+    return sizeof(ngtcp2_max_stream_data);
+  case NGTCP2_FRAME_MAX_STREAM_ID:
+    return sizeof(ngtcp2_max_stream_id);
+  case NGTCP2_FRAME_PING:
+    return sizeof(ngtcp2_ping);
+  case NGTCP2_FRAME_BLOCKED:
+    return sizeof(ngtcp2_blocked);
+  case NGTCP2_FRAME_STREAM_BLOCKED:
+    return sizeof(ngtcp2_stream_blocked);
+  case NGTCP2_FRAME_STREAM_ID_BLOCKED:
+    return sizeof(ngtcp2_stream_id_blocked);
+  case NGTCP2_FRAME_NEW_CONNECTION_ID:
+    return sizeof(ngtcp2_new_connection_id);
+  case NGTCP2_FRAME_STOP_SENDING:
+    return sizeof(ngtcp2_stop_sending);
+  case NGTCP2_FRAME_PATH_CHALLENGE:
+    return sizeof(ngtcp2_path_challenge);
+  case NGTCP2_FRAME_PATH_RESPONSE:
+    return sizeof(ngtcp2_path_response);
+  case NGTCP2_FRAME_STREAM:
+    return sizeof(ngtcp2_stream);
+  case NGTCP2_FRAME_CRYPTO:
+    return sizeof(ngtcp2_crypto);
+  default:
+    return sizeof(ngtcp2_frame);
   }
+}
 
-  ngtcp2_frame_chain_init(*pfrc);
-
-  return 0;
+int ngtcp2_frame_chain_new(ngtcp2_frame_chain **pfrc, uint8_t type,
+                           ngtcp2_mem *mem) {
+  return ngtcp2_frame_chain_extralen_new(pfrc, type, 0, mem);
 }
 
-int ngtcp2_frame_chain_extralen_new(ngtcp2_frame_chain **pfrc, size_t extralen,
-                                    ngtcp2_mem *mem) {
-  *pfrc = ngtcp2_mem_malloc(mem, sizeof(ngtcp2_frame_chain) + extralen);
+int ngtcp2_frame_chain_extralen_new(ngtcp2_frame_chain **pfrc, uint8_t type,
+                                    size_t extralen, ngtcp2_mem *mem) {
+  *pfrc = ngtcp2_mem_malloc(mem, offsetof(ngtcp2_frame_chain, fr) +
+                                     frame_len(type) + extralen);
   if (*pfrc == NULL) {
     return NGTCP2_ERR_NOMEM;
   }
 
   ngtcp2_frame_chain_init(*pfrc);
+  (*pfrc)->fr.type = type;
 
   return 0;
 }
 
+size_t ngtcp2_frame_chain_objlen(const ngtcp2_frame_chain *frc) {
+  size_t len = offsetof(ngtcp2_frame_chain, fr) + frame_len(frc->fr.type);
+
+  if (frc->fr.type == NGTCP2_FRAME_CRYPTO && frc->fr.crypto.datacnt > 1) {
+    len += sizeof(ngtcp2_vec) * (frc->fr.crypto.datacnt - 1);
+  }
+
+  return len;
+}
+
 void ngtcp2_frame_chain_del(ngtcp2_frame_chain *frc, ngtcp2_mem *mem) {
   ngtcp2_mem_free(mem, frc);
 }
@@ -63,17 +115,18 @@ void ngtcp2_frame_chain_init(ngtcp2_frame_chain *frc) { frc->next = NULL; }
 ngtcp2_frame_chain *ngtcp2_frame_chain_list_copy(ngtcp2_frame_chain *frc,
                                                  ngtcp2_mem *mem) {
   ngtcp2_frame_chain *nfrc = NULL, **pfrc = &nfrc;
-  int rv;
+  size_t len;
 
   for (; frc; frc = frc->next) {
-    rv = ngtcp2_frame_chain_new(pfrc, mem);
-    if (rv != 0) {
-      *pfrc = NULL;
-      ngtcp2_frame_chain_del(nfrc, mem);
+    len = ngtcp2_frame_chain_objlen(frc);
+
+    *pfrc = ngtcp2_mem_malloc(mem, len);
+    if (*pfrc == NULL) {
+      ngtcp2_frame_chain_list_del(nfrc, mem);
       return NULL;
     }
 
-    memcpy(&(*pfrc)->fr, &frc->fr, sizeof((*pfrc)->fr));
+    memcpy(*pfrc, frc, len);
 
     pfrc = &(*pfrc)->next;
   }
@@ -101,10 +154,12 @@ int ngtcp2_rtb_entry_new(ngtcp2_rtb_entry **pent, const ngtcp2_pkt_hd *hd,
     return NGTCP2_ERR_NOMEM;
   }
 
-  (*pent)->hd = *hd;
   (*pent)->frc = frc;
+  (*pent)->pkt_num = hd->pkt_num;
   (*pent)->ts = ts;
-  (*pent)->pktlen = pktlen;
+  (*pent)->pktlen = (uint32_t)pktlen;
+  (*pent)->pkt_type = hd->type;
+  (*pent)->pkt_flags = hd->flags;
   (*pent)->src_pkt_num = -1;
   (*pent)->flags = flags;
 
@@ -129,6 +184,13 @@ void ngtcp2_rtb_entry_del(ngtcp2_rtb_entry *ent, ngtcp2_mem *mem) {
   ngtcp2_mem_free(mem, ent);
 }
 
+int ngtcp2_rtb_entry_handshake_pkt(const ngtcp2_rtb_entry *ent) {
+  return (ent->pkt_flags & NGTCP2_PKT_FLAG_LONG_FORM) &&
+         (ent->pkt_type == NGTCP2_PKT_INITIAL ||
+          ent->pkt_type == NGTCP2_PKT_HANDSHAKE ||
+          ent->pkt_type == NGTCP2_PKT_0RTT_PROTECTED);
+}
+
 static int greater(int64_t lhs, int64_t rhs) { return lhs > rhs; }
 
 void ngtcp2_rtb_init(ngtcp2_rtb *rtb, ngtcp2_cc_stat *ccs, ngtcp2_log *log,
@@ -141,6 +203,14 @@ void ngtcp2_rtb_init(ngtcp2_rtb *rtb, ngtcp2_cc_stat *ccs, ngtcp2_log *log,
   rtb->bytes_in_flight = 0;
   rtb->largest_acked_tx_pkt_num = -1;
   rtb->nearly_pkt = 0;
+  rtb->nlost = 0;
+  rtb->nspurious_lost = 0;
+  memset(rtb->lost_hist, 0xff, sizeof(rtb->lost_hist));
+  rtb->lost_hist_next = 0;
+  rtb->nlost_hist = 0;
+#ifdef PHASE_TIMING
+  rtb->phase = NULL;
+#endif /* PHASE_TIMING */
 }
 
 static void rtb_entry_list_free(ngtcp2_rtb_entry *ent, ngtcp2_mem *mem) {
@@ -174,15 +244,15 @@ void ngtcp2_rtb_free(ngtcp2_rtb *rtb) {
 static void rtb_on_add(ngtcp2_rtb *rtb, ngtcp2_rtb_entry *ent) {
   rtb->bytes_in_flight += ent->pktlen;
 
-  if ((ent->hd.flags & NGTCP2_PKT_FLAG_LONG_FORM) &&
-      ent->hd.type == NGTCP2_PKT_0RTT_PROTECTED) {
+  if ((ent->pkt_flags & NGTCP2_PKT_FLAG_LONG_FORM) &&
+      ent->pkt_type == NGTCP2_PKT_0RTT_PROTECTED) {
     ++rtb->nearly_pkt;
   }
 }
 
 static void rtb_on_remove(ngtcp2_rtb *rtb, ngtcp2_rtb_entry *ent) {
-  if ((ent->hd.flags & NGTCP2_PKT_FLAG_LONG_FORM) &&
-      ent->hd.type == NGTCP2_PKT_0RTT_PROTECTED) {
+  if ((ent->pkt_flags & NGTCP2_PKT_FLAG_LONG_FORM) &&
+      ent->pkt_type == NGTCP2_PKT_0RTT_PROTECTED) {
     assert(rtb->nearly_pkt);
     --rtb->nearly_pkt;
   }
@@ -193,7 +263,7 @@ static void rtb_on_remove(ngtcp2_rtb *rtb, ngtcp2_rtb_entry *ent) {
 
 void ngtcp2_rtb_add(ngtcp2_rtb *rtb, ngtcp2_rtb_entry *ent) {
   ent->next = NULL;
-  ngtcp2_ksl_insert(&rtb->ents, NULL, (int64_t)ent->hd.pkt_num, ent);
+  ngtcp2_ksl_insert(&rtb->ents, NULL, (int64_t)ent->pkt_num, ent);
   rtb_on_add(rtb, ent);
 }
 
@@ -206,7 +276,7 @@ void ngtcp2_rtb_insert_range(ngtcp2_rtb *rtb, ngtcp2_rtb_entry *head) {
 
     ent->next = NULL;
 
-    ngtcp2_ksl_insert(&rtb->ents, NULL, (int64_t)ent->hd.pkt_num, ent);
+    ngtcp2_ksl_insert(&rtb->ents, NULL, (int64_t)ent->pkt_num, ent);
     rtb_on_add(rtb, ent);
   }
 }
@@ -232,7 +302,7 @@ static int rtb_remove(ngtcp2_rtb *rtb, ngtcp2_ksl_it *it,
                       ngtcp2_rtb_entry *ent) {
   int rv;
 
-  rv = ngtcp2_ksl_remove(&rtb->ents, it, (int64_t)ent->hd.pkt_num);
+  rv = ngtcp2_ksl_remove(&rtb->ents, it, (int64_t)ent->pkt_num);
   if (rv != 0) {
     return rv;
   }
@@ -323,14 +393,15 @@ static void rtb_on_retransmission_timeout_verified(ngtcp2_rtb *rtb) {
   ccs->cwnd = NGTCP2_MIN_CWND;
   ngtcp2_log_info(rtb->log, NGTCP2_LOG_EVENT_RCV,
                   "retransmission timeout verified cwnd=%lu", ccs->cwnd);
+  ngtcp2_log_cc(rtb->log, ccs->cwnd, ccs->ssthresh, rtb->bytes_in_flight);
 }
 
 static void rtb_on_pkt_acked_cc(ngtcp2_rtb *rtb, ngtcp2_rtb_entry *ent) {
   ngtcp2_cc_stat *ccs = rtb->ccs;
 
   /* bytes_in_flight is reduced in rtb_on_remove */
-  if (!ngtcp2_pkt_handshake_pkt(&ent->hd) &&
-      rtb_in_rcvry(rtb, ent->hd.pkt_num)) {
+  if (!ngtcp2_rtb_entry_handshake_pkt(ent) &&
+      rtb_in_rcvry(rtb, ent->pkt_num)) {
     return;
   }
 
@@ -338,15 +409,17 @@ static void rtb_on_pkt_acked_cc(ngtcp2_rtb *rtb, ngtcp2_rtb_entry *ent) {
     ccs->cwnd += ent->pktlen;
     ngtcp2_log_info(rtb->log, NGTCP2_LOG_EVENT_RCV,
                     "packet %" PRIu64 " acked, slow start cwnd=%lu",
-                    ent->hd.pkt_num, ccs->cwnd);
+                    ent->pkt_num, ccs->cwnd);
+    ngtcp2_log_cc(rtb->log, ccs->cwnd, ccs->ssthresh, rtb->bytes_in_flight);
     return;
   }
 
   ccs->cwnd += NGTCP2_DEFAULT_MSS * ent->pktlen / ccs->cwnd;
 
   ngtcp2_log_info(rtb->log, NGTCP2_LOG_EVENT_RCV,
-                  "packet %" PRIu64 " acked, cwnd=%lu", ent->hd.pkt_num,
+                  "packet %" PRIu64 " acked, cwnd=%lu", ent->pkt_num,
                   ccs->cwnd);
+  ngtcp2_log_cc(rtb->log, ccs->cwnd, ccs->ssthresh, rtb->bytes_in_flight);
 }
 
 /*
@@ -377,8 +450,8 @@ static int rtb_on_pkt_acked(ngtcp2_rtb *rtb, ngtcp2_rcvry_stat *rcs,
     }
   }
   rtb_on_pkt_acked_cc(rtb, ent);
-  if (!ngtcp2_pkt_handshake_pkt(&ent->hd) && rcs->rto_count &&
-      ent->hd.pkt_num > rcs->largest_sent_before_rto) {
+  if (!ngtcp2_rtb_entry_handshake_pkt(ent) && rcs->rto_count &&
+      ent->pkt_num > rcs->largest_sent_before_rto) {
     rtb_on_retransmission_timeout_verified(rtb);
   }
 
@@ -390,6 +463,58 @@ static int rtb_on_pkt_acked(ngtcp2_rtb *rtb, ngtcp2_rcvry_stat *rcs,
   return 0;
 }
 
+/*
+ * ack_covers returns nonzero if |fr| acknowledges |pkt_num|.  |fr|
+ * must be validated by ngtcp2_pkt_validate_ack.
+ */
+static int ack_covers(const ngtcp2_ack *fr, uint64_t pkt_num) {
+  uint64_t largest_ack = fr->largest_ack;
+  uint64_t min_ack = largest_ack - fr->first_ack_blklen;
+  size_t i;
+
+  if (pkt_num > largest_ack) {
+    return 0;
+  }
+
+  if (min_ack <= pkt_num) {
+    return 1;
+  }
+
+  for (i = 0; i < fr->num_blks; ++i) {
+    largest_ack = min_ack - fr->blks[i].gap - 2;
+    if (pkt_num > largest_ack) {
+      return 0;
+    }
+    min_ack = largest_ack - fr->blks[i].blklen;
+    if (min_ack <= pkt_num) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * rtb_detect_spurious_loss counts the recently lost packets which
+ * |fr| acknowledges.
+ */
+static void rtb_detect_spurious_loss(ngtcp2_rtb *rtb, const ngtcp2_ack *fr) {
+  size_t i;
+
+  for (i = 0; i < NGTCP2_RTB_LOST_HISTLEN; ++i) {
+    if (rtb->lost_hist[i] == UINT64_MAX ||
+        !ack_covers(fr, rtb->lost_hist[i])) {
+      continue;
+    }
+
+    ++rtb->nspurious_lost;
+    rtb->lost_hist[i] = UINT64_MAX;
+    if (--rtb->nlost_hist == 0) {
+      return;
+    }
+  }
+}
+
 int ngtcp2_rtb_recv_ack(ngtcp2_rtb *rtb, const ngtcp2_ack *fr,
                         ngtcp2_conn *conn, ngtcp2_tstamp ts) {
   ngtcp2_rtb_entry *ent;
@@ -399,10 +524,17 @@ int ngtcp2_rtb_recv_ack(ngtcp2_rtb *rtb, const ngtcp2_ack *fr,
   ngtcp2_ksl_it it;
   int64_t key;
 
+  NGTCP2_PHASE_BEGIN(rtb->phase, NGTCP2_PHASE_RTB_RECV_ACK);
+
   /* Assume that ngtcp2_pkt_validate_ack(fr) returns 0 */
+  if (rtb->nlost_hist) {
+    rtb_detect_spurious_loss(rtb, fr);
+  }
+
   it = ngtcp2_ksl_lower_bound(&rtb->ents, (int64_t)largest_ack);
 
   if (ngtcp2_ksl_it_end(&it)) {
+    NGTCP2_PHASE_END(rtb->phase, NGTCP2_PHASE_RTB_RECV_ACK);
     return 0;
   }
 
@@ -413,7 +545,9 @@ int ngtcp2_rtb_recv_ack(ngtcp2_rtb *rtb, const ngtcp2_ack *fr,
     if (min_ack <= (uint64_t)key && (uint64_t)key <= largest_ack) {
       ent = ngtcp2_ksl_it_get(&it);
       if (conn) {
+        NGTCP2_PHASE_BEGIN(rtb->phase, NGTCP2_PHASE_RTB_ACKED_STREAM_DATA);
         rv = call_acked_stream_offset(ent, conn);
+        NGTCP2_PHASE_END(rtb->phase, NGTCP2_PHASE_RTB_ACKED_STREAM_DATA);
         if (rv != 0) {
           return rv;
         }
@@ -455,7 +589,10 @@ int ngtcp2_rtb_recv_ack(ngtcp2_rtb *rtb, const ngtcp2_ack *fr,
       ent = ngtcp2_ksl_it_get(&it);
       if (conn) {
         if (conn->callbacks.acked_stream_data_offset) {
+          NGTCP2_PHASE_BEGIN(rtb->phase,
+                             NGTCP2_PHASE_RTB_ACKED_STREAM_DATA);
           rv = call_acked_stream_offset(ent, conn);
+          NGTCP2_PHASE_END(rtb->phase, NGTCP2_PHASE_RTB_ACKED_STREAM_DATA);
           if (rv != 0) {
             return rv;
           }
@@ -477,6 +614,8 @@ int ngtcp2_rtb_recv_ack(ngtcp2_rtb *rtb, const ngtcp2_ack *fr,
     ++i;
   }
 
+  NGTCP2_PHASE_END(rtb->phase, NGTCP2_PHASE_RTB_RECV_ACK);
+
   return 0;
 }
 
@@ -484,7 +623,7 @@ static int pkt_lost(ngtcp2_rcvry_stat *rcs, const ngtcp2_rtb_entry *ent,
                     uint64_t delay_until_lost, uint64_t largest_ack,
                     ngtcp2_tstamp ts) {
   uint64_t time_since_sent = ts - ent->ts;
-  uint64_t delta = largest_ack - ent->hd.pkt_num;
+  uint64_t delta = largest_ack - ent->pkt_num;
 
   if (time_since_sent > delay_until_lost || delta > rcs->reordering_threshold) {
     return 1;
@@ -513,6 +652,19 @@ static uint64_t compute_pkt_loss_delay(const ngtcp2_rcvry_stat *rcs,
   return UINT64_MAX;
 }
 
+/*
+ * rtb_on_pkt_lost records that |ent| is declared lost.
+ */
+static void rtb_on_pkt_lost(ngtcp2_rtb *rtb, ngtcp2_rtb_entry *ent) {
+  ++rtb->nlost;
+
+  if (rtb->lost_hist[rtb->lost_hist_next] == UINT64_MAX) {
+    ++rtb->nlost_hist;
+  }
+  rtb->lost_hist[rtb->lost_hist_next] = ent->pkt_num;
+  rtb->lost_hist_next = (rtb->lost_hist_next + 1) % NGTCP2_RTB_LOST_HISTLEN;
+}
+
 int ngtcp2_rtb_detect_lost_pkt(ngtcp2_rtb *rtb, ngtcp2_rcvry_stat *rcs,
                                uint64_t largest_ack, uint64_t last_tx_pkt_num,
                                ngtcp2_tstamp ts) {
@@ -522,6 +674,8 @@ int ngtcp2_rtb_detect_lost_pkt(ngtcp2_rtb *rtb, ngtcp2_rcvry_stat *rcs,
   ngtcp2_ksl_it it;
   int rv;
 
+  NGTCP2_PHASE_BEGIN(rtb->phase, NGTCP2_PHASE_RTB_DETECT_LOST);
+
   rcs->loss_time = 0;
   delay_until_lost = compute_pkt_loss_delay(rcs, largest_ack, last_tx_pkt_num);
   pdest = &rtb->lost;
@@ -534,7 +688,7 @@ int ngtcp2_rtb_detect_lost_pkt(ngtcp2_rtb *rtb, ngtcp2_rcvry_stat *rcs,
 
       /* OnPacketsLost in recovery draft */
       /* TODO I'm not sure we should do this for handshake packets. */
-      if (!rtb_in_rcvry(rtb, ent->hd.pkt_num)) {
+      if (!rtb_in_rcvry(rtb, ent->pkt_num)) {
         ccs->eor_pkt_num = last_tx_pkt_num;
         ccs->cwnd =
             (uint64_t)((double)ccs->cwnd * NGTCP2_LOSS_REDUCTION_FACTOR);
@@ -544,6 +698,8 @@ int ngtcp2_rtb_detect_lost_pkt(ngtcp2_rtb *rtb, ngtcp2_rcvry_stat *rcs,
         ngtcp2_log_info(rtb->log, NGTCP2_LOG_EVENT_RCV,
                         "reduce cwnd because of packet loss cwnd=%lu",
                         ccs->cwnd);
+        ngtcp2_log_cc(rtb->log, ccs->cwnd, ccs->ssthresh,
+                      rtb->bytes_in_flight);
       }
 
       for (; !ngtcp2_ksl_it_end(&it);) {
@@ -558,17 +714,23 @@ int ngtcp2_rtb_detect_lost_pkt(ngtcp2_rtb *rtb, ngtcp2_rcvry_stat *rcs,
           /* We don't care if probe packet is lost. */
           ngtcp2_rtb_entry_del(ent, rtb->mem);
         } else {
-          ngtcp2_log_pkt_lost(rtb->log, &ent->hd, ent->ts);
+          ngtcp2_log_pkt_lost(rtb->log, ent->pkt_num, ent->pkt_type,
+                              ent->pkt_flags, ent->ts);
+          rtb_on_pkt_lost(rtb, ent);
 
           /* TODO Reconsider the order of conn->lost */
           ngtcp2_list_insert(ent, pdest);
         }
       }
 
+      NGTCP2_PHASE_END(rtb->phase, NGTCP2_PHASE_RTB_DETECT_LOST);
+
       return 0;
     }
   }
 
+  NGTCP2_PHASE_END(rtb->phase, NGTCP2_PHASE_RTB_DETECT_LOST);
+
   return 0;
 }
 
@@ -582,7 +744,9 @@ int ngtcp2_rtb_mark_pkt_lost(ngtcp2_rtb *rtb) {
   for (; !ngtcp2_ksl_it_end(&it);) {
     ent = ngtcp2_ksl_it_get(&it);
 
-    ngtcp2_log_pkt_lost(rtb->log, &ent->hd, ent->ts);
+    ngtcp2_log_pkt_lost(rtb->log, ent->pkt_num, ent->pkt_type, ent->pkt_flags,
+                        ent->ts);
+    rtb_on_pkt_lost(rtb, ent);
 
     rtb_on_remove(rtb, ent);
     rv = ngtcp2_ksl_remove(&rtb->ents, &it, ngtcp2_ksl_it_key(&it));
@@ -605,13 +769,15 @@ int ngtcp2_rtb_mark_0rtt_pkt_lost(ngtcp2_rtb *rtb) {
   for (; !ngtcp2_ksl_it_end(&it);) {
     ent = ngtcp2_ksl_it_get(&it);
 
-    if (!(ent->hd.flags & NGTCP2_PKT_FLAG_LONG_FORM) ||
-        ent->hd.type != NGTCP2_PKT_0RTT_PROTECTED) {
+    if (!(ent->pkt_flags & NGTCP2_PKT_FLAG_LONG_FORM) ||
+        ent->pkt_type != NGTCP2_PKT_0RTT_PROTECTED) {
       ngtcp2_ksl_it_next(&it);
       continue;
     }
 
-    ngtcp2_log_pkt_lost(rtb->log, &ent->hd, ent->ts);
+    ngtcp2_log_pkt_lost(rtb->log, ent->pkt_num, ent->pkt_type, ent->pkt_flags,
+                        ent->ts);
+    rtb_on_pkt_lost(rtb, ent);
 
     rtb_on_remove(rtb, ent);
     rv = ngtcp2_ksl_remove(&rtb->ents, &it, ngtcp2_ksl_it_key(&it));
@@ -32,6 +32,7 @@
 #include <ngtcp2/ngtcp2.h>
 
 #include "ngtcp2_ksl.h"
+#include "ngtcp2_phase.h"
 
 struct ngtcp2_cc_stat;
 typedef struct ngtcp2_cc_stat ngtcp2_cc_stat;
@@ -46,7 +47,11 @@ struct ngtcp2_log;
 typedef struct ngtcp2_log ngtcp2_log;
 
 /*
- * ngtcp2_frame_chain chains frames in a single packet.
+ * ngtcp2_frame_chain chains frames in a single packet.  fr.type tells
+ * the type of the frame, and ngtcp2_frame_chain is allocated with
+ * just enough space for the member of fr which fr.type selects,
+ * rather than the largest member of ngtcp2_frame.  Only that member
+ * may be accessed, and fr must not be copied as a whole.
  */
 struct ngtcp2_frame_chain {
   ngtcp2_frame_chain *next;
@@ -54,8 +59,9 @@ struct ngtcp2_frame_chain {
 };
 
 /*
- * ngtcp2_frame_chain_new allocates ngtcp2_frame_chain object and
- * assigns its pointer to |*pfrc|.
+ * ngtcp2_frame_chain_new allocates ngtcp2_frame_chain object which
+ * holds a frame of type |type|, and assigns its pointer to |*pfrc|.
+ * (*pfrc)->fr.type is set to |type|.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
@@ -63,15 +69,22 @@ struct ngtcp2_frame_chain {
  * NGTCP2_ERR_NOMEM
  *     Out of memory.
  */
-int ngtcp2_frame_chain_new(ngtcp2_frame_chain **pfrc, ngtcp2_mem *mem);
+int ngtcp2_frame_chain_new(ngtcp2_frame_chain **pfrc, uint8_t type,
+                           ngtcp2_mem *mem);
 
 /*
  * ngtcp2_frame_chain_extralen_new works like ngtcp2_frame_chain_new,
- * but it allocates extra memory |extralen| in order to extend
- * ngtcp2_frame.
+ * but it allocates extra memory |extralen| in order to extend the
+ * frame.
  */
-int ngtcp2_frame_chain_extralen_new(ngtcp2_frame_chain **pfrc, size_t extralen,
-                                    ngtcp2_mem *mem);
+int ngtcp2_frame_chain_extralen_new(ngtcp2_frame_chain **pfrc, uint8_t type,
+                                    size_t extralen, ngtcp2_mem *mem);
+
+/*
+ * ngtcp2_frame_chain_objlen returns the number of bytes allocated for
+ * |frc|.
+ */
+size_t ngtcp2_frame_chain_objlen(const ngtcp2_frame_chain *frc);
 
 /*
  * ngtcp2_frame_chain_del deallocates |frc|.  It also deallocates the
@@ -113,21 +126,30 @@ typedef struct ngtcp2_rtb_entry ngtcp2_rtb_entry;
 
 /*
  * ngtcp2_rtb_entry is an object stored in ngtcp2_rtb.  It corresponds
- * to the one packet which is waiting for its ACK.
+ * to the one packet which is waiting for its ACK.  It only remembers
+ * the parts of the packet header which loss recovery needs.  The
+ * connection IDs and version of a retransmitted packet are taken
+ * from ngtcp2_conn.
  */
 struct ngtcp2_rtb_entry {
   ngtcp2_rtb_entry *next;
-
-  ngtcp2_pkt_hd hd;
+  /* frc is the list of retransmittable frames included in the
+     packet. */
   ngtcp2_frame_chain *frc;
+  /* pkt_num is the packet number of the packet. */
+  uint64_t pkt_num;
   /* ts is the time point when a packet included in this entry is sent
      to a peer. */
   ngtcp2_tstamp ts;
-  /* pktlen is the length of QUIC packet */
-  size_t pktlen;
   /* src_pkt_num is a packet number of a original packet if this entry
      includes a probe packet duplicating original. */
   int64_t src_pkt_num;
+  /* pktlen is the length of QUIC packet */
+  uint32_t pktlen;
+  /* pkt_type is the type of the packet. */
+  uint8_t pkt_type;
+  /* pkt_flags is the flags of the packet header. */
+  uint8_t pkt_flags;
   /* flags is bitwise-OR of zero or more of ngtcp2_rtb_flag. */
   uint8_t flags;
 };
@@ -135,7 +157,8 @@ struct ngtcp2_rtb_entry {
 /*
  * ngtcp2_rtb_entry_new allocates ngtcp2_rtb_entry object, and assigns
  * its pointer to |*pent|.  On success, |*pent| takes ownership of
- * |frc|.
+ * |frc|.  Only the packet number, type and flags of |hd| are
+ * remembered.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
@@ -153,6 +176,20 @@ int ngtcp2_rtb_entry_new(ngtcp2_rtb_entry **pent, const ngtcp2_pkt_hd *hd,
  */
 void ngtcp2_rtb_entry_del(ngtcp2_rtb_entry *ent, ngtcp2_mem *mem);
 
+/*
+ * ngtcp2_rtb_entry_handshake_pkt returns nonzero if |ent| is a packet
+ * sent in handshake phase.  It is ngtcp2_pkt_handshake_pkt for
+ * ngtcp2_rtb_entry.
+ */
+int ngtcp2_rtb_entry_handshake_pkt(const ngtcp2_rtb_entry *ent);
+
+/*
+ * NGTCP2_RTB_LOST_HISTLEN is the number of the packet numbers of
+ * recently lost packets which ngtcp2_rtb remembers to detect spurious
+ * losses.
+ */
+#define NGTCP2_RTB_LOST_HISTLEN 16
+
 /*
  * ngtcp2_rtb tracks sent packets, and its ACK timeout for
  * retransmission.
@@ -174,6 +211,23 @@ typedef struct {
   int64_t largest_acked_tx_pkt_num;
   /* nearly_pkt is the number of 0-RTT Protected packet in ents. */
   size_t nearly_pkt;
+  /* nlost is the number of packets declared lost. */
+  uint64_t nlost;
+  /* nspurious_lost is the number of packets which were declared lost,
+     and then acknowledged. */
+  uint64_t nspurious_lost;
+  /* lost_hist is a ring buffer of the packet numbers of recently lost
+     packets.  UINT64_MAX denotes an unused slot. */
+  uint64_t lost_hist[NGTCP2_RTB_LOST_HISTLEN];
+  /* lost_hist_next is the index to lost_hist which the next lost
+     packet is written to. */
+  size_t lost_hist_next;
+  /* nlost_hist is the number of used slots in lost_hist. */
+  size_t nlost_hist;
+#ifdef PHASE_TIMING
+  /* phase is the phase timer of the connection.  It may be NULL. */
+  ngtcp2_phase_timer *phase;
+#endif /* PHASE_TIMING */
 } ngtcp2_rtb;
 
 /*
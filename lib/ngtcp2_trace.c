@@ -0,0 +1,343 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2018 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "ngtcp2_trace.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+#include "ngtcp2_pkt.h"
+
+int ngtcp2_trace_ring_init(ngtcp2_trace_ring *ring,
+                           ngtcp2_trace_record *records, size_t nrecords) {
+  if (nrecords == 0 || (nrecords & (nrecords - 1))) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  ring->records = records;
+  ring->mask = nrecords - 1;
+  ring->next = 0;
+
+  return 0;
+}
+
+ngtcp2_trace_record *ngtcp2_trace_ring_push(ngtcp2_trace_ring *ring) {
+  return &ring->records[(size_t)(ring->next++) & ring->mask];
+}
+
+size_t ngtcp2_trace_ring_len(const ngtcp2_trace_ring *ring) {
+  if (ring->next > ring->mask) {
+    return ring->mask + 1;
+  }
+  return (size_t)ring->next;
+}
+
+const ngtcp2_trace_record *
+ngtcp2_trace_ring_get(const ngtcp2_trace_ring *ring, size_t idx) {
+  uint64_t first = ring->next - ngtcp2_trace_ring_len(ring);
+
+  return &ring->records[(size_t)(first + idx) & ring->mask];
+}
+
+/*
+ * trace_frame_desc describes how frame event is formatted.  a, b, and
+ * c are the names of ngtcp2_trace_record fields.  NULL means that the
+ * field is not used.
+ */
+typedef struct {
+  const char *name;
+  const char *qlog_name;
+  const char *a;
+  const char *b;
+  const char *c;
+} trace_frame_desc;
+
+static const trace_frame_desc *get_frame_desc(uint8_t type) {
+  static const trace_frame_desc descs[] = {
+      {"PADDING", "padding", NULL, NULL, "length"},
+      {"RST_STREAM", "rst_stream", "stream_id", "final_offset", "error_code"},
+      {"CONNECTION_CLOSE", "connection_close", NULL, NULL, "error_code"},
+      {"APPLICATION_CLOSE", "application_close", NULL, NULL, "error_code"},
+      {"MAX_DATA", "max_data", "maximum", NULL, NULL},
+      {"MAX_STREAM_DATA", "max_stream_data", "stream_id", "maximum", NULL},
+      {"MAX_STREAM_ID", "max_stream_id", "maximum", NULL, NULL},
+      {"PING", "ping", NULL, NULL, NULL},
+      {"BLOCKED", "blocked", "offset", NULL, NULL},
+      {"STREAM_BLOCKED", "stream_blocked", "stream_id", "offset", NULL},
+      {"STREAM_ID_BLOCKED", "stream_id_blocked", "stream_id", NULL, NULL},
+      {"NEW_CONNECTION_ID", "new_connection_id", "sequence_number", NULL,
+       NULL},
+      {"STOP_SENDING", "stop_sending", "stream_id", NULL, "error_code"},
+      {"ACK", "ack", "largest_acknowledged", "ack_delay", "num_blks"},
+      {"PATH_CHALLENGE", "path_challenge", NULL, NULL, NULL},
+      {"PATH_RESPONSE", "path_response", NULL, NULL, NULL},
+  };
+  static const trace_frame_desc stream_desc = {"STREAM", "stream", "stream_id",
+                                               "offset", "length"};
+  static const trace_frame_desc crypto_desc = {"CRYPTO", "crypto", NULL,
+                                               "offset", "length"};
+  static const trace_frame_desc unknown_desc = {"(unknown)", "unknown", NULL,
+                                                NULL, NULL};
+
+  if (type < sizeof(descs) / sizeof(descs[0])) {
+    return &descs[type];
+  }
+  if ((type & ~(NGTCP2_STREAM_FIN_BIT | NGTCP2_STREAM_LEN_BIT |
+                NGTCP2_STREAM_OFF_BIT)) == NGTCP2_FRAME_STREAM) {
+    return &stream_desc;
+  }
+  if (type == NGTCP2_FRAME_CRYPTO) {
+    return &crypto_desc;
+  }
+  return &unknown_desc;
+}
+
+static const char *strpkttype(const ngtcp2_trace_record *rec) {
+  if (!(rec->flags & NGTCP2_TRACE_FLAG_LONG_FORM)) {
+    return "Short";
+  }
+
+  switch (rec->pkt_type) {
+  case NGTCP2_PKT_INITIAL:
+    return "Initial";
+  case NGTCP2_PKT_HANDSHAKE:
+    return "Handshake";
+  case NGTCP2_PKT_0RTT_PROTECTED:
+    return "0RTT";
+  default:
+    return "(unknown)";
+  }
+}
+
+static const char *qlog_pkttype(const ngtcp2_trace_record *rec) {
+  if (!(rec->flags & NGTCP2_TRACE_FLAG_LONG_FORM)) {
+    return "1RTT";
+  }
+
+  switch (rec->pkt_type) {
+  case NGTCP2_PKT_INITIAL:
+    return "initial";
+  case NGTCP2_PKT_HANDSHAKE:
+    return "handshake";
+  case NGTCP2_PKT_0RTT_PROTECTED:
+    return "0RTT";
+  default:
+    return "unknown";
+  }
+}
+
+/*
+ * trace_buf is a cursor to the output buffer of ngtcp2_trace_format.
+ */
+typedef struct {
+  char *p;
+  char *end;
+  /* nobuf is nonzero if the output has been truncated. */
+  int nobuf;
+} trace_buf;
+
+static void tbuf_printf(trace_buf *b, const char *fmt, ...) {
+  va_list ap;
+  int n;
+
+  if (b->nobuf) {
+    return;
+  }
+
+  va_start(ap, fmt);
+  n = vsnprintf(b->p, (size_t)(b->end - b->p), fmt, ap);
+  va_end(ap);
+
+  if (n < 0 || n >= b->end - b->p) {
+    b->nobuf = 1;
+    return;
+  }
+
+  b->p += n;
+}
+
+static void format_text(trace_buf *b, const ngtcp2_trace_record *rec,
+                        ngtcp2_tstamp base_ts) {
+  uint64_t t = (rec->ts - base_ts) / 1000;
+  const trace_frame_desc *desc;
+  const char *dir;
+
+  tbuf_printf(b, "I%08" PRIu64 ".%03" PRIu64 " ", t / 1000, t % 1000);
+
+  switch (rec->event) {
+  case NGTCP2_TRACE_EVENT_PKT_SENT:
+  case NGTCP2_TRACE_EVENT_PKT_RECV:
+    tbuf_printf(b, "pkt %s %" PRIu64 " %s(0x%02x) len=%" PRIu64,
+                rec->event == NGTCP2_TRACE_EVENT_PKT_SENT ? "tx" : "rx",
+                rec->pkt_num, strpkttype(rec), rec->pkt_type, rec->a);
+    return;
+  case NGTCP2_TRACE_EVENT_PKT_LOST:
+    tbuf_printf(b, "rcv lost %" PRIu64 " %s(0x%02x) sent_ts=%" PRIu64,
+                rec->pkt_num, strpkttype(rec), rec->pkt_type, rec->a);
+    return;
+  case NGTCP2_TRACE_EVENT_FRM_SENT:
+  case NGTCP2_TRACE_EVENT_FRM_RECV:
+    dir = rec->event == NGTCP2_TRACE_EVENT_FRM_SENT ? "tx" : "rx";
+    desc = get_frame_desc(rec->frame_type);
+    tbuf_printf(b, "frm %s %" PRIu64 " %s(0x%02x) %s(0x%02x)", dir,
+                rec->pkt_num, strpkttype(rec), rec->pkt_type, desc->name,
+                rec->frame_type);
+    if (desc->a) {
+      tbuf_printf(b, " %s=%" PRIu64, desc->a, rec->a);
+    }
+    if (desc->b) {
+      tbuf_printf(b, " %s=%" PRIu64, desc->b, rec->b);
+    }
+    if (desc->c) {
+      tbuf_printf(b, " %s=%" PRIu32, desc->c, rec->c);
+    }
+    if (rec->flags & NGTCP2_TRACE_FLAG_FIN) {
+      tbuf_printf(b, " fin=1");
+    }
+    return;
+  case NGTCP2_TRACE_EVENT_CC:
+    tbuf_printf(b,
+                "rcv cwnd=%" PRIu64 " ssthresh=%" PRIu64
+                " bytes_in_flight=%" PRIu32,
+                rec->a, rec->b, rec->c);
+    return;
+  case NGTCP2_TRACE_EVENT_LOSS_TIMER:
+    tbuf_printf(b,
+                "rcv loss detection alarm fired handshake_count=%" PRIu64
+                " tlp_count=%" PRIu64 " rto_count=%" PRIu32,
+                rec->a, rec->b, rec->c);
+    return;
+  default:
+    tbuf_printf(b, "(unknown event 0x%02x)", rec->event);
+    return;
+  }
+}
+
+static void format_qlog(trace_buf *b, const ngtcp2_trace_record *rec,
+                        ngtcp2_tstamp base_ts) {
+  uint64_t t = (rec->ts - base_ts) / 1000;
+  const trace_frame_desc *desc;
+  const char *name;
+
+  tbuf_printf(b, "{\"time\":%" PRIu64 ".%03" PRIu64 ",", t / 1000, t % 1000);
+
+  switch (rec->event) {
+  case NGTCP2_TRACE_EVENT_PKT_SENT:
+  case NGTCP2_TRACE_EVENT_PKT_RECV:
+  case NGTCP2_TRACE_EVENT_PKT_LOST:
+    switch (rec->event) {
+    case NGTCP2_TRACE_EVENT_PKT_SENT:
+      name = "transport:packet_sent";
+      break;
+    case NGTCP2_TRACE_EVENT_PKT_RECV:
+      name = "transport:packet_received";
+      break;
+    default:
+      name = "recovery:packet_lost";
+      break;
+    }
+    tbuf_printf(b,
+                "\"name\":\"%s\",\"data\":{\"header\":{\"packet_type\":\"%s\","
+                "\"packet_number\":%" PRIu64 "}",
+                name, qlog_pkttype(rec), rec->pkt_num);
+    if (rec->event != NGTCP2_TRACE_EVENT_PKT_LOST) {
+      tbuf_printf(b, ",\"raw\":{\"length\":%" PRIu64 "}", rec->a);
+    }
+    tbuf_printf(b, "}}");
+    return;
+  case NGTCP2_TRACE_EVENT_FRM_SENT:
+  case NGTCP2_TRACE_EVENT_FRM_RECV:
+    desc = get_frame_desc(rec->frame_type);
+    tbuf_printf(b,
+                "\"name\":\"transport:frame_%s\",\"data\":{\"header\":{"
+                "\"packet_type\":\"%s\",\"packet_number\":%" PRIu64
+                "},\"frame\":{\"frame_type\":\"%s\"",
+                rec->event == NGTCP2_TRACE_EVENT_FRM_SENT ? "sent" : "received",
+                qlog_pkttype(rec), rec->pkt_num, desc->qlog_name);
+    if (desc->a) {
+      tbuf_printf(b, ",\"%s\":%" PRIu64, desc->a, rec->a);
+    }
+    if (desc->b) {
+      tbuf_printf(b, ",\"%s\":%" PRIu64, desc->b, rec->b);
+    }
+    if (desc->c) {
+      tbuf_printf(b, ",\"%s\":%" PRIu32, desc->c, rec->c);
+    }
+    if (rec->flags & NGTCP2_TRACE_FLAG_FIN) {
+      tbuf_printf(b, ",\"fin\":true");
+    }
+    tbuf_printf(b, "}}}");
+    return;
+  case NGTCP2_TRACE_EVENT_CC:
+    tbuf_printf(b,
+                "\"name\":\"recovery:metrics_updated\",\"data\":{"
+                "\"congestion_window\":%" PRIu64 ",\"ssthresh\":%" PRIu64
+                ",\"bytes_in_flight\":%" PRIu32 "}}",
+                rec->a, rec->b, rec->c);
+    return;
+  case NGTCP2_TRACE_EVENT_LOSS_TIMER:
+    tbuf_printf(b,
+                "\"name\":\"recovery:loss_timer_updated\",\"data\":{"
+                "\"event_type\":\"expired\",\"handshake_count\":%" PRIu64
+                ",\"tlp_count\":%" PRIu64 ",\"rto_count\":%" PRIu32 "}}",
+                rec->a, rec->b, rec->c);
+    return;
+  default:
+    tbuf_printf(b, "\"name\":\"unknown\",\"data\":{\"event\":%u}}",
+                rec->event);
+    return;
+  }
+}
+
+ssize_t ngtcp2_trace_format(char *dest, size_t destlen,
+                            const ngtcp2_trace_record *rec,
+                            ngtcp2_tstamp base_ts, int fmt) {
+  trace_buf b;
+
+  if (destlen == 0) {
+    return NGTCP2_ERR_NOBUF;
+  }
+
+  b.p = dest;
+  b.end = dest + destlen;
+  b.nobuf = 0;
+
+  switch (fmt) {
+  case NGTCP2_TRACE_FORMAT_TEXT:
+    format_text(&b, rec, base_ts);
+    break;
+  case NGTCP2_TRACE_FORMAT_QLOG:
+    format_qlog(&b, rec, base_ts);
+    break;
+  default:
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  if (b.nobuf) {
+    return NGTCP2_ERR_NOBUF;
+  }
+
+  return b.p - dest;
+}
@@ -43,6 +43,10 @@
 #include "ngtcp2_conv_test.h"
 #include "ngtcp2_psl_test.h"
 #include "ngtcp2_ksl_test.h"
+#include "ngtcp2_cid_test.h"
+#include "ngtcp2_trace_test.h"
+#include "ngtcp2_gaptr_test.h"
+#include "ngtcp2_arena_test.h"
 
 static int init_suite1(void) { return 0; }
 
@@ -136,20 +140,26 @@ int main() {
       !CU_add_test(pSuite, "rob_data_at", test_ngtcp2_rob_data_at) ||
       !CU_add_test(pSuite, "rob_remove_prefix",
                    test_ngtcp2_rob_remove_prefix) ||
+      !CU_add_test(pSuite, "rob_release", test_ngtcp2_rob_release) ||
       !CU_add_test(pSuite, "acktr_add", test_ngtcp2_acktr_add) ||
       !CU_add_test(pSuite, "acktr_eviction", test_ngtcp2_acktr_eviction) ||
       !CU_add_test(pSuite, "acktr_forget", test_ngtcp2_acktr_forget) ||
       !CU_add_test(pSuite, "acktr_recv_ack", test_ngtcp2_acktr_recv_ack) ||
+      !CU_add_test(pSuite, "acktr_create_ack_frame",
+                   test_ngtcp2_acktr_create_ack_frame) ||
       !CU_add_test(pSuite, "encode_transport_params",
                    test_ngtcp2_encode_transport_params) ||
       !CU_add_test(pSuite, "rtb_add", test_ngtcp2_rtb_add) ||
       !CU_add_test(pSuite, "rtb_recv_ack", test_ngtcp2_rtb_recv_ack) ||
       !CU_add_test(pSuite, "rtb_insert_range", test_ngtcp2_rtb_insert_range) ||
+      !CU_add_test(pSuite, "frame_chain_list_copy",
+                   test_ngtcp2_frame_chain_list_copy) ||
       !CU_add_test(pSuite, "idtr_open", test_ngtcp2_idtr_open) ||
       !CU_add_test(pSuite, "ringbuf_push_front",
                    test_ngtcp2_ringbuf_push_front) ||
       !CU_add_test(pSuite, "ringbuf_pop_front",
                    test_ngtcp2_ringbuf_pop_front) ||
+      !CU_add_test(pSuite, "ringbuf_reserve", test_ngtcp2_ringbuf_reserve) ||
       !CU_add_test(pSuite, "conn_stream_open_close",
                    test_ngtcp2_conn_stream_open_close) ||
       !CU_add_test(pSuite, "conn_stream_rx_flow_control",
@@ -203,7 +213,36 @@ int main() {
       !CU_add_test(pSuite, "conn_recv_compound_pkt",
                    test_ngtcp2_conn_recv_compound_pkt) ||
       !CU_add_test(pSuite, "conn_pkt_payloadlen",
-                   test_ngtcp2_conn_pkt_payloadlen)) {
+                   test_ngtcp2_conn_pkt_payloadlen) ||
+      !CU_add_test(pSuite, "conn_new_connection_id",
+                   test_ngtcp2_conn_new_connection_id) ||
+      !CU_add_test(pSuite, "conn_write_stream_source",
+                   test_ngtcp2_conn_write_stream_source) ||
+      !CU_add_test(pSuite, "conn_get_stats", test_ngtcp2_conn_get_stats) ||
+      !CU_add_test(pSuite, "conn_flight_recorder",
+                   test_ngtcp2_conn_flight_recorder) ||
+      !CU_add_test(pSuite, "conn_get_phase_hist",
+                   test_ngtcp2_conn_get_phase_hist) ||
+      !CU_add_test(pSuite, "conn_discard_handshake_state",
+                   test_ngtcp2_conn_discard_handshake_state) ||
+      !CU_add_test(pSuite, "conn_idle_heap_usage",
+                   test_ngtcp2_conn_idle_heap_usage) ||
+      !CU_add_test(pSuite, "conn_hibernate", test_ngtcp2_conn_hibernate) ||
+      !CU_add_test(pSuite, "conn_stream_pool",
+                   test_ngtcp2_conn_stream_pool) ||
+      !CU_add_test(pSuite, "conn_arena", test_ngtcp2_conn_arena) ||
+      !CU_add_test(pSuite, "conn_mem_budget", test_ngtcp2_conn_mem_budget) ||
+      !CU_add_test(pSuite, "conn_reset", test_ngtcp2_conn_reset) ||
+      !CU_add_test(pSuite, "cid_encode_routable",
+                   test_ngtcp2_cid_encode_routable) ||
+      !CU_add_test(pSuite, "cid_encode_routable_cipher",
+                   test_ngtcp2_cid_encode_routable_cipher) ||
+      !CU_add_test(pSuite, "cid_routable_collision",
+                   test_ngtcp2_cid_routable_collision) ||
+      !CU_add_test(pSuite, "trace_ring", test_ngtcp2_trace_ring) ||
+      !CU_add_test(pSuite, "trace_format", test_ngtcp2_trace_format) ||
+      !CU_add_test(pSuite, "gaptr_push", test_ngtcp2_gaptr_push) ||
+      !CU_add_test(pSuite, "arena_alloc", test_ngtcp2_arena_alloc)) {
     CU_cleanup_registry();
     return (int)CU_get_error();
   }
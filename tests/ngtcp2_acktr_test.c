@@ -24,6 +24,8 @@
  */
 #include "ngtcp2_acktr_test.h"
 
+#include <string.h>
+
 #include <CUnit/CUnit.h>
 
 #include "ngtcp2_acktr.h"
@@ -200,15 +202,15 @@ void test_ngtcp2_acktr_recv_ack(void) {
   ngtcp2_acktr acktr;
   ngtcp2_mem *mem = ngtcp2_mem_default();
   size_t i;
-  ngtcp2_ack *fr, ackfr;
+  ngtcp2_frame *fr;
+  ngtcp2_ack *ack, ackfr;
   uint64_t rpkt_nums[] = {
       4500, 4499, 4497, 4496, 4494, 4493, 4491, 4490, 4488, 4487, 4483,
   };
   ngtcp2_acktr_entry *ent;
-  uint64_t pkt_num;
-  ngtcp2_ack_blk *blks;
   ngtcp2_log log;
   ngtcp2_ksl_it it;
+  int rv;
 
   ngtcp2_log_init(&log, NULL, NULL, 0, NULL);
   ngtcp2_acktr_init(&acktr, 0 /* delayed_ack */, &log, mem);
@@ -218,59 +220,197 @@ void test_ngtcp2_acktr_recv_ack(void) {
     ngtcp2_acktr_add(&acktr, ent, 1, 999 + i);
   }
 
-  for (pkt_num = 998; pkt_num <= 999; ++pkt_num) {
-    fr = ngtcp2_mem_malloc(mem, sizeof(ngtcp2_max_frame));
-    fr->type = NGTCP2_FRAME_ACK;
-    fr->largest_ack = 4500;
-    fr->ack_delay = 0;
-    fr->first_ack_blklen = 1; /* 4499 */
-    fr->num_blks = 3;
-    blks = fr->blks;
-    blks[0].gap = 4;    /* 4498, (4497), (4496), 4495, (4494) */
-    blks[0].blklen = 2; /* (4493), 4492, (4491) */
-    blks[1].gap = 1;    /* (4490), 4489 */
-    blks[1].blklen = 1; /* (4488), (4487) */
-    blks[2].gap = 3;    /* 4486, 4485, 4484, (4483) */
-    blks[2].blklen = 1; /* 4482, 4481 */
-
-    ngtcp2_acktr_add_ack(&acktr, pkt_num, fr, 1000000009, 0 /* ack_only */);
-  }
+  rv = ngtcp2_acktr_create_ack_frame(&acktr, &fr, 1000000009, 0);
+
+  CU_ASSERT(0 == rv);
+
+  ack = &fr->ack;
+
+  CU_ASSERT(NGTCP2_FRAME_ACK == ack->type);
+  CU_ASSERT(4500 == ack->largest_ack);
+  CU_ASSERT(1000000008 == ack->ack_delay_unscaled);
+  CU_ASSERT(1 == ack->first_ack_blklen);
+  CU_ASSERT(5 == ack->num_blks);
+  CU_ASSERT(0 == ack->blks[0].gap);
+  CU_ASSERT(1 == ack->blks[0].blklen);
+  CU_ASSERT(2 == ack->blks[4].gap);
+  CU_ASSERT(0 == ack->blks[4].blklen);
+
+  ngtcp2_acktr_add_ack(&acktr, 998, ack, 1000000009, 0 /* ack_only */);
+
+  ngtcp2_acktr_entry_new(&ent, 4501, 1, mem);
+  ngtcp2_acktr_add(&acktr, ent, 1, 1000000010);
 
   ackfr.type = NGTCP2_FRAME_ACK;
-  ackfr.largest_ack = 999;
+  ackfr.largest_ack = 998;
   ackfr.ack_delay = 0;
   ackfr.first_ack_blklen = 0;
   ackfr.num_blks = 0;
 
-  ngtcp2_acktr_recv_ack(&acktr, &ackfr, NULL, 1000000009);
+  rv = ngtcp2_acktr_recv_ack(&acktr, &ackfr, NULL, 1000000011);
 
+  CU_ASSERT(0 == rv);
   CU_ASSERT(0 == ngtcp2_ringbuf_len(&acktr.acks));
-  CU_ASSERT(5 == ngtcp2_ksl_len(&acktr.ents));
+  CU_ASSERT(1 == ngtcp2_ksl_len(&acktr.ents));
 
   it = ngtcp2_acktr_get(&acktr);
   ent = ngtcp2_ksl_it_get(&it);
 
-  CU_ASSERT(4497 == ent->pkt_num);
+  CU_ASSERT(4501 == ent->pkt_num);
 
-  ngtcp2_ksl_it_next(&it);
-  ent = ngtcp2_ksl_it_get(&it);
+  ngtcp2_acktr_create_ack_frame(&acktr, &fr, 1000000011, 0);
+  ack = &fr->ack;
 
-  CU_ASSERT(4496 == ent->pkt_num);
+  CU_ASSERT(4501 == ack->largest_ack);
+  CU_ASSERT(0 == ack->first_ack_blklen);
+  CU_ASSERT(0 == ack->num_blks);
 
-  ngtcp2_ksl_it_next(&it);
-  ent = ngtcp2_ksl_it_get(&it);
+  /* 4502 arrives after the ACK frame which acknowledges 4503 and 4501
+     is sent. */
+  ngtcp2_acktr_entry_new(&ent, 4503, 1, mem);
+  ngtcp2_acktr_add(&acktr, ent, 1, 1000000012);
 
-  CU_ASSERT(4494 == ent->pkt_num);
+  ngtcp2_acktr_create_ack_frame(&acktr, &fr, 1000000012, 0);
+  ack = &fr->ack;
 
-  ngtcp2_ksl_it_next(&it);
-  ent = ngtcp2_ksl_it_get(&it);
+  CU_ASSERT(4503 == ack->largest_ack);
+  CU_ASSERT(0 == ack->first_ack_blklen);
+  CU_ASSERT(1 == ack->num_blks);
+  CU_ASSERT(0 == ack->blks[0].gap);
+  CU_ASSERT(0 == ack->blks[0].blklen);
 
-  CU_ASSERT(4490 == ent->pkt_num);
+  ngtcp2_acktr_add_ack(&acktr, 999, ack, 1000000012, 0 /* ack_only */);
 
-  ngtcp2_ksl_it_next(&it);
+  ngtcp2_acktr_entry_new(&ent, 4502, 1, mem);
+  ngtcp2_acktr_add(&acktr, ent, 1, 1000000013);
+
+  ackfr.largest_ack = 999;
+
+  rv = ngtcp2_acktr_recv_ack(&acktr, &ackfr, NULL, 1000000014);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == ngtcp2_ringbuf_len(&acktr.acks));
+  CU_ASSERT(2 == ngtcp2_ksl_len(&acktr.ents));
+
+  ngtcp2_acktr_create_ack_frame(&acktr, &fr, 1000000014, 0);
+  ack = &fr->ack;
+
+  CU_ASSERT(4502 == ack->largest_ack);
+  CU_ASSERT(1 == ack->first_ack_blklen);
+  CU_ASSERT(0 == ack->num_blks);
+
+  ngtcp2_acktr_free(&acktr);
+}
+
+void test_ngtcp2_acktr_create_ack_frame(void) {
+  ngtcp2_acktr acktr;
+  ngtcp2_t_mem tmem;
+  ngtcp2_mem *mem;
+  ngtcp2_acktr_ack expected;
+  ngtcp2_frame *fr;
+  ngtcp2_ack *ack;
+  ngtcp2_acktr_entry *ent;
+  ngtcp2_log log;
+  ngtcp2_ksl_it it;
+  uint64_t pkt_num, r = 1;
+  size_t i, nbytes, nents;
+  int rv;
+
+  ngtcp2_t_mem_init(&tmem);
+  mem = &tmem.mem;
+
+  ngtcp2_log_init(&log, NULL, NULL, 0, NULL);
+  ngtcp2_acktr_init(&acktr, 0 /* delayed_ack */, &log, mem);
+
+  /* Only NGTCP2_ACKTR_MAX_ACK_BLKS most recent ranges are kept. */
+  for (i = 0; i < NGTCP2_ACKTR_MAX_ACK_BLKS + 4; ++i) {
+    ngtcp2_acktr_entry_new(&ent, i * 2, 1, mem);
+    ngtcp2_acktr_add(&acktr, ent, 1, 1);
+  }
+
+  nbytes = tmem.nbytes;
+
+  rv = ngtcp2_acktr_create_ack_frame(&acktr, &fr, 1000001, 0);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(nbytes == tmem.nbytes);
+
+  ack = &fr->ack;
+
+  CU_ASSERT((NGTCP2_ACKTR_MAX_ACK_BLKS + 3) * 2 == ack->largest_ack);
+  CU_ASSERT(1000 == ack->ack_delay);
+  CU_ASSERT(0 == ack->first_ack_blklen);
+  CU_ASSERT(NGTCP2_ACKTR_MAX_ACK_BLKS - 1 == ack->num_blks);
+  CU_ASSERT(NGTCP2_ACKTR_MAX_ACK_BLKS == ngtcp2_ksl_len(&acktr.ents));
+
+  it = ngtcp2_ksl_end(&acktr.ents);
+  ngtcp2_ksl_it_prev(&it);
   ent = ngtcp2_ksl_it_get(&it);
 
-  CU_ASSERT(4483 == ent->pkt_num);
+  CU_ASSERT(8 == ent->pkt_num);
+
+  /* A packet which fills a gap */
+  ngtcp2_acktr_entry_new(&ent, ack->largest_ack - 1, 1, mem);
+  ngtcp2_acktr_add(&acktr, ent, 1, 1);
+
+  rv = ngtcp2_acktr_create_ack_frame(&acktr, &fr, 1000001, 0);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(2 == ack->first_ack_blklen);
+  CU_ASSERT(NGTCP2_ACKTR_MAX_ACK_BLKS - 2 == ack->num_blks);
 
   ngtcp2_acktr_free(&acktr);
+
+  /* Packets arrive with gaps and reordering.  The incrementally
+     updated ACK frame must be the same as the one built from
+     scratch. */
+  ngtcp2_acktr_init(&acktr, 0 /* delayed_ack */, &log, mem);
+
+  for (i = 0, pkt_num = 100; i < 1000; ++i) {
+    r = r * 1103515245 + 12345;
+    if ((r >> 16) % 5 == 0) {
+      ngtcp2_acktr_entry_new(&ent, pkt_num - (r >> 20) % 8, 1, mem);
+    } else {
+      pkt_num += 1 + (r >> 16) % 3;
+      ngtcp2_acktr_entry_new(&ent, pkt_num, 1, mem);
+    }
+
+    rv = ngtcp2_acktr_add(&acktr, ent, 1, 1);
+    if (rv != 0) {
+      CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
+      ngtcp2_acktr_entry_del(ent, mem);
+    }
+
+    if ((r >> 24) % 7 == 0 && ngtcp2_ksl_len(&acktr.ents) > 2) {
+      it = ngtcp2_ksl_end(&acktr.ents);
+      ngtcp2_ksl_it_prev(&it);
+      ngtcp2_ksl_it_prev(&it);
+      ngtcp2_acktr_forget(&acktr, ngtcp2_ksl_it_get(&it));
+    }
+
+    rv = ngtcp2_acktr_create_ack_frame(&acktr, &fr, 1, 0);
+
+    CU_ASSERT(0 == rv);
+
+    memcpy(&expected, fr, sizeof(expected));
+    nents = ngtcp2_ksl_len(&acktr.ents);
+
+    acktr.flags |= NGTCP2_ACKTR_FLAG_ACK_DIRTY;
+    rv = ngtcp2_acktr_create_ack_frame(&acktr, &fr, 1, 0);
+
+    CU_ASSERT(0 == rv);
+    CU_ASSERT(nents == ngtcp2_ksl_len(&acktr.ents));
+
+    ack = &fr->ack;
+
+    CU_ASSERT(expected.ackfr.ack.largest_ack == ack->largest_ack);
+    CU_ASSERT(expected.ackfr.ack.first_ack_blklen == ack->first_ack_blklen);
+    CU_ASSERT(expected.ackfr.ack.num_blks == ack->num_blks);
+    CU_ASSERT(0 == memcmp(expected.ackfr.ack.blks, ack->blks,
+                          sizeof(ngtcp2_ack_blk) * ack->num_blks));
+  }
+
+  ngtcp2_acktr_free(&acktr);
+
+  CU_ASSERT(0 == tmem.nbytes);
 }
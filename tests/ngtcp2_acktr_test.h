@@ -33,5 +33,6 @@ void test_ngtcp2_acktr_add(void);
 void test_ngtcp2_acktr_eviction(void);
 void test_ngtcp2_acktr_forget(void);
 void test_ngtcp2_acktr_recv_ack(void);
+void test_ngtcp2_acktr_create_ack_frame(void);
 
 #endif /* NGTCP2_ACKTR_TEST_H */
@@ -0,0 +1,124 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2018 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "ngtcp2_arena_test.h"
+
+#include <string.h>
+
+#include <CUnit/CUnit.h>
+
+#include "ngtcp2_arena.h"
+#include "ngtcp2_test_helper.h"
+
+void test_ngtcp2_arena_alloc(void) {
+  ngtcp2_arena *arena;
+  ngtcp2_t_mem tmem;
+  ngtcp2_mem *mem;
+  uint8_t *p, *q, *r, *large;
+  size_t nbytes;
+  int rv;
+
+  ngtcp2_t_mem_init(&tmem);
+
+  rv = ngtcp2_arena_new(&arena, 1024, &tmem.mem);
+
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
+
+  rv = ngtcp2_arena_new(&arena, 0, &tmem.mem);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(sizeof(ngtcp2_arena) == tmem.nbytes);
+
+  mem = ngtcp2_arena_get_mem(arena);
+
+  /* The first allocation allocates a slab, and the following ones
+     are carved from it. */
+  p = ngtcp2_mem_malloc(mem, 10);
+  memset(p, 0xff, 10);
+
+  CU_ASSERT(1 == arena->nslab);
+  CU_ASSERT(0 == (uintptr_t)p % 16);
+
+  nbytes = tmem.nbytes;
+  q = ngtcp2_mem_calloc(mem, 3, 10);
+
+  CU_ASSERT(nbytes == tmem.nbytes);
+  CU_ASSERT(0 == (uintptr_t)q % 16);
+  CU_ASSERT(0 == q[0]);
+  CU_ASSERT(0 == q[29]);
+
+  /* Freed block is reused by the next allocation of the same size
+     class. */
+  ngtcp2_mem_free(mem, p);
+  r = ngtcp2_mem_malloc(mem, 16);
+
+  CU_ASSERT(p == r);
+
+  /* realloc keeps the block as long as its size class fits. */
+  q = ngtcp2_mem_realloc(mem, q, 32);
+
+  CU_ASSERT(NULL != q);
+  CU_ASSERT(0 == q[0]);
+
+  p = ngtcp2_mem_realloc(mem, q, 100);
+
+  CU_ASSERT(p != q);
+  CU_ASSERT(0 == p[0]);
+  CU_ASSERT(0 == p[29]);
+
+  /* Large block is allocated from the backing allocator. */
+  nbytes = tmem.nbytes;
+  large = ngtcp2_mem_malloc(mem, 8192);
+
+  CU_ASSERT(NULL != large);
+  CU_ASSERT(tmem.nbytes > nbytes + 8192);
+  CU_ASSERT(0 == (uintptr_t)large % 16);
+
+  memset(large, 0xff, 8192);
+  large = ngtcp2_mem_realloc(mem, large, 16384);
+
+  CU_ASSERT(NULL != large);
+  CU_ASSERT(0xff == large[8191]);
+
+  ngtcp2_mem_free(mem, large);
+
+  CU_ASSERT(nbytes == tmem.nbytes);
+
+  /* Fill more than one slab. */
+  for (;;) {
+    p = ngtcp2_mem_malloc(mem, 1000);
+    if (arena->nslab == 2) {
+      break;
+    }
+  }
+
+  large = ngtcp2_mem_malloc(mem, 2000);
+
+  CU_ASSERT(NULL != large);
+
+  /* Everything including outstanding blocks are freed at once. */
+  ngtcp2_arena_del(arena);
+
+  CU_ASSERT(0 == tmem.nbytes);
+}
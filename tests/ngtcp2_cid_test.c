@@ -0,0 +1,264 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2018 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "ngtcp2_cid_test.h"
+
+#include <stdlib.h>
+
+#include <CUnit/CUnit.h>
+
+#include "ngtcp2_cid.h"
+#include "ngtcp2_test_helper.h"
+
+static const uint8_t toy_key[NGTCP2_CID_BLOCKLEN] = {
+    0x6b, 0x1f, 0xd0, 0x93, 0x2e, 0x44, 0xa7, 0x58,
+    0x0c, 0xe1, 0x72, 0x3d, 0xb9, 0x05, 0x8a, 0xf6,
+};
+
+/*
+ * toy_encrypt is an invertible permutation of a block which stands in
+ * for a real block cipher.  It rotates the block by 5 bytes and mixes
+ * it with toy_key.
+ */
+static int toy_encrypt(uint8_t *dest, const uint8_t *src, void *user_data) {
+  size_t i;
+  (void)user_data;
+
+  for (i = 0; i < NGTCP2_CID_BLOCKLEN; ++i) {
+    dest[i] = src[(i + 5) % NGTCP2_CID_BLOCKLEN] ^ toy_key[i];
+  }
+
+  return 0;
+}
+
+static int toy_decrypt(uint8_t *dest, const uint8_t *src, void *user_data) {
+  size_t i;
+  (void)user_data;
+
+  for (i = 0; i < NGTCP2_CID_BLOCKLEN; ++i) {
+    dest[(i + 5) % NGTCP2_CID_BLOCKLEN] = src[i] ^ toy_key[i];
+  }
+
+  return 0;
+}
+
+static int fail_cipher(uint8_t *dest, const uint8_t *src, void *user_data) {
+  (void)dest;
+  (void)src;
+  (void)user_data;
+
+  return -1;
+}
+
+void test_ngtcp2_cid_encode_routable(void) {
+  ngtcp2_cid_routing rt;
+  ngtcp2_cid cid;
+  uint8_t rand[NGTCP2_MAX_CIDLEN];
+  uint32_t server_id;
+  int rv;
+
+  memset(&rt, 0, sizeof(rt));
+  memset(rand, 0xff, sizeof(rand));
+
+  rt.config_id = 2;
+  rt.server_idlen = 2;
+  rt.cidlen = 8;
+
+  rv = ngtcp2_cid_encode_routable(&cid, &rt, 0xabcd, rand);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(8 == cid.datalen);
+  CU_ASSERT(0xbf == cid.data[0]);
+  CU_ASSERT(0xab == cid.data[1]);
+  CU_ASSERT(0xcd == cid.data[2]);
+
+  rv = ngtcp2_cid_decode_routable(&server_id, &rt, cid.data, cid.datalen);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0xabcd == server_id);
+
+  /* Server ID does not fit in server_idlen */
+  rv = ngtcp2_cid_encode_routable(&cid, &rt, 0x10000, rand);
+
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
+
+  /* 4 bytes server ID */
+  rt.server_idlen = 4;
+
+  rv = ngtcp2_cid_encode_routable(&cid, &rt, 0xfedcba98, rand);
+
+  CU_ASSERT(0 == rv);
+
+  rv = ngtcp2_cid_decode_routable(&server_id, &rt, cid.data, cid.datalen);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0xfedcba98 == server_id);
+
+  /* Length mismatch */
+  rv = ngtcp2_cid_decode_routable(&server_id, &rt, cid.data, cid.datalen - 1);
+
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
+
+  /* config_id mismatch */
+  rt.config_id = 1;
+  rv = ngtcp2_cid_decode_routable(&server_id, &rt, cid.data, cid.datalen);
+
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
+
+  /* No room for nonce */
+  rt.server_idlen = 4;
+  rt.cidlen = 5;
+
+  rv = ngtcp2_cid_encode_routable(&cid, &rt, 0, rand);
+
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
+
+  /* Bad config_id */
+  rt.cidlen = NGTCP2_MAX_CIDLEN;
+  rt.config_id = NGTCP2_CID_MAX_CONFIG_ID + 1;
+
+  rv = ngtcp2_cid_encode_routable(&cid, &rt, 0, rand);
+
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
+}
+
+void test_ngtcp2_cid_encode_routable_cipher(void) {
+  ngtcp2_cid_routing rt;
+  ngtcp2_cid cid;
+  uint8_t rand[NGTCP2_MAX_CIDLEN];
+  uint32_t server_id;
+  int rv;
+
+  memset(&rt, 0, sizeof(rt));
+  memset(rand, 0, sizeof(rand));
+
+  rt.config_id = 1;
+  rt.server_idlen = 3;
+  rt.cidlen = 1 + NGTCP2_CID_BLOCKLEN;
+  rt.encrypt = toy_encrypt;
+  rt.decrypt = toy_decrypt;
+
+  rv = ngtcp2_cid_encode_routable(&cid, &rt, 0x123456, rand);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 + NGTCP2_CID_BLOCKLEN == cid.datalen);
+  CU_ASSERT(0x40 == cid.data[0]);
+  /* Server ID must not appear in plaintext */
+  CU_ASSERT(0 != memcmp(cid.data + 1, "\x12\x34\x56", 3));
+
+  rv = ngtcp2_cid_decode_routable(&server_id, &rt, cid.data, cid.datalen);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0x123456 == server_id);
+
+  /* cidlen must match the block length */
+  rt.cidlen = NGTCP2_MAX_CIDLEN;
+
+  rv = ngtcp2_cid_encode_routable(&cid, &rt, 0x123456, rand);
+
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
+
+  /* decrypt is required */
+  rt.cidlen = 1 + NGTCP2_CID_BLOCKLEN;
+  rt.decrypt = NULL;
+
+  rv = ngtcp2_cid_encode_routable(&cid, &rt, 0x123456, rand);
+
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
+
+  /* cipher failure */
+  rt.encrypt = fail_cipher;
+  rt.decrypt = fail_cipher;
+
+  rv = ngtcp2_cid_encode_routable(&cid, &rt, 0x123456, rand);
+
+  CU_ASSERT(NGTCP2_ERR_CALLBACK_FAILURE == rv);
+
+  cid.data[0] = 0x40;
+  rv = ngtcp2_cid_decode_routable(&server_id, &rt, cid.data, cid.datalen);
+
+  CU_ASSERT(NGTCP2_ERR_CALLBACK_FAILURE == rv);
+}
+
+static int cid_less(const void *lhs, const void *rhs) {
+  const ngtcp2_cid *a = lhs, *b = rhs;
+
+  return memcmp(a->data, b->data, a->datalen);
+}
+
+void test_ngtcp2_cid_routable_collision(void) {
+  ngtcp2_cid_routing rt;
+  ngtcp2_cid cids[256 * 4];
+  uint8_t rand[NGTCP2_MAX_CIDLEN];
+  uint32_t server_id;
+  size_t i, j, n;
+  int rv;
+  int cipher;
+
+  memset(&rt, 0, sizeof(rt));
+
+  rt.server_idlen = 1;
+
+  for (cipher = 0; cipher < 2; ++cipher) {
+    if (cipher) {
+      rt.cidlen = 1 + NGTCP2_CID_BLOCKLEN;
+      rt.encrypt = toy_encrypt;
+      rt.decrypt = toy_decrypt;
+    } else {
+      rt.cidlen = NGTCP2_MIN_CIDLEN;
+      rt.encrypt = NULL;
+      rt.decrypt = NULL;
+    }
+
+    n = 0;
+
+    /* The same nonce for different server IDs, and different nonces
+       for the same server ID must produce distinct connection IDs. */
+    for (i = 0; i < 4; ++i) {
+      for (j = 0; j < 256; ++j) {
+        memset(rand, 0, sizeof(rand));
+        rand[2] = (uint8_t)j;
+
+        rv = ngtcp2_cid_encode_routable(&cids[n], &rt, (uint32_t)(i * 61),
+                                        rand);
+
+        CU_ASSERT(0 == rv);
+
+        rv = ngtcp2_cid_decode_routable(&server_id, &rt, cids[n].data,
+                                        cids[n].datalen);
+
+        CU_ASSERT(0 == rv);
+        CU_ASSERT(i * 61 == server_id);
+
+        ++n;
+      }
+    }
+
+    qsort(cids, n, sizeof(cids[0]), cid_less);
+
+    for (i = 1; i < n; ++i) {
+      CU_ASSERT(!ngtcp2_cid_eq(&cids[i - 1], &cids[i]));
+    }
+  }
+}
@@ -25,6 +25,7 @@
 #include "ngtcp2_conn_test.h"
 
 #include <assert.h>
+#include <stdio.h>
 
 #include <CUnit/CUnit.h>
 
@@ -34,6 +35,8 @@
 #include "ngtcp2_pkt.h"
 #include "ngtcp2_cid.h"
 #include "ngtcp2_conv.h"
+#include "ngtcp2_macro.h"
+#include "ngtcp2_arena.h"
 
 static ssize_t null_encrypt(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
                             const uint8_t *plaintext, size_t plaintextlen,
@@ -257,10 +260,52 @@ static int genrand(ngtcp2_conn *conn, uint8_t *dest, size_t destlen,
   return 0;
 }
 
+static int get_new_connection_id(ngtcp2_conn *conn, ngtcp2_cid *cid,
+                                 uint8_t *token, size_t cidlen,
+                                 void *user_data) {
+  (void)user_data;
+
+  memset(cid->data, (int)(conn->nscid_pool + 1), cidlen);
+  cid->datalen = cidlen;
+  memset(token, 0, NGTCP2_STATELESS_RESET_TOKENLEN);
+
+  return 0;
+}
+
+typedef struct {
+  const uint8_t *data;
+  size_t datalen;
+} stream_source;
+
+static int read_stream_data(ngtcp2_conn *conn, uint64_t stream_id,
+                            uint64_t offset, size_t maxlen,
+                            const uint8_t **pdata, size_t *pdatalen,
+                            uint8_t *pfin, void *user_data,
+                            void *stream_user_data) {
+  stream_source *src = user_data;
+  size_t len;
+  (void)conn;
+  (void)stream_id;
+  (void)stream_user_data;
+
+  assert(offset <= src->datalen);
+
+  len = ngtcp2_min(maxlen, src->datalen - (size_t)offset);
+
+  *pdata = src->data + offset;
+  *pdatalen = len;
+  *pfin = offset + len == src->datalen;
+
+  return 0;
+}
+
 static void server_default_settings(ngtcp2_settings *settings) {
   size_t i;
 
   settings->log_printf = NULL;
+  settings->trace = NULL;
+  settings->flight_recorder_len = 0;
+  settings->max_mem = 0;
   settings->initial_ts = 0;
   settings->max_stream_data = 65535;
   settings->max_data = 128 * 1024;
@@ -276,6 +321,9 @@ static void server_default_settings(ngtcp2_settings *settings) {
 
 static void client_default_settings(ngtcp2_settings *settings) {
   settings->log_printf = NULL;
+  settings->trace = NULL;
+  settings->flight_recorder_len = 0;
+  settings->max_mem = 0;
   settings->initial_ts = 0;
   settings->max_stream_data = 65535;
   settings->max_data = 128 * 1024;
@@ -305,7 +353,7 @@ static void setup_default_server(ngtcp2_conn **pconn) {
   server_default_settings(&settings);
 
   ngtcp2_conn_server_new(pconn, &dcid, &scid, NGTCP2_PROTO_VER_MAX, &cb,
-                         &settings, NULL);
+                         &settings, NULL, NULL);
   ngtcp2_conn_set_handshake_tx_keys(*pconn, null_key, sizeof(null_key), null_iv,
                                     sizeof(null_iv), null_pn, sizeof(null_pn));
   ngtcp2_conn_set_handshake_rx_keys(*pconn, null_key, sizeof(null_key), null_iv,
@@ -327,7 +375,7 @@ static void setup_default_server(ngtcp2_conn **pconn) {
   (*pconn)->max_tx_offset = (*pconn)->remote_settings.max_data;
 }
 
-static void setup_default_client(ngtcp2_conn **pconn) {
+static void setup_default_client_mem(ngtcp2_conn **pconn, ngtcp2_mem *mem) {
   ngtcp2_conn_callbacks cb;
   ngtcp2_settings settings;
   ngtcp2_cid dcid, scid;
@@ -346,7 +394,7 @@ static void setup_default_client(ngtcp2_conn **pconn) {
   client_default_settings(&settings);
 
   ngtcp2_conn_client_new(pconn, &dcid, &scid, NGTCP2_PROTO_VER_MAX, &cb,
-                         &settings, NULL);
+                         &settings, mem, NULL);
   ngtcp2_conn_set_handshake_tx_keys(*pconn, null_key, sizeof(null_key), null_iv,
                                     sizeof(null_iv), null_pn, sizeof(null_pn));
   ngtcp2_conn_set_handshake_rx_keys(*pconn, null_key, sizeof(null_key), null_iv,
@@ -368,6 +416,10 @@ static void setup_default_client(ngtcp2_conn **pconn) {
   (*pconn)->max_tx_offset = (*pconn)->remote_settings.max_data;
 }
 
+static void setup_default_client(ngtcp2_conn **pconn) {
+  setup_default_client_mem(pconn, NULL);
+}
+
 static void setup_handshake_server(ngtcp2_conn **pconn) {
   ngtcp2_conn_callbacks cb;
   ngtcp2_settings settings;
@@ -389,7 +441,7 @@ static void setup_handshake_server(ngtcp2_conn **pconn) {
   server_default_settings(&settings);
 
   ngtcp2_conn_server_new(pconn, &dcid, &scid, NGTCP2_PROTO_VER_MAX, &cb,
-                         &settings, NULL);
+                         &settings, NULL, NULL);
   ngtcp2_conn_set_initial_tx_keys(*pconn, null_key, sizeof(null_key), null_iv,
                                   sizeof(null_iv), null_pn, sizeof(null_pn));
   ngtcp2_conn_set_initial_rx_keys(*pconn, null_key, sizeof(null_key), null_iv,
@@ -418,7 +470,7 @@ static void setup_handshake_client(ngtcp2_conn **pconn) {
   client_default_settings(&settings);
 
   ngtcp2_conn_client_new(pconn, &rcid, &scid, NGTCP2_PROTO_VER_MAX, &cb,
-                         &settings, NULL);
+                         &settings, NULL, NULL);
   ngtcp2_conn_set_initial_tx_keys(*pconn, null_key, sizeof(null_key), null_iv,
                                   sizeof(null_iv), null_pn, sizeof(null_pn));
   ngtcp2_conn_set_initial_rx_keys(*pconn, null_key, sizeof(null_key), null_iv,
@@ -446,7 +498,7 @@ static void setup_early_server(ngtcp2_conn **pconn) {
   server_default_settings(&settings);
 
   ngtcp2_conn_server_new(pconn, &dcid, &scid, NGTCP2_PROTO_VER_MAX, &cb,
-                         &settings, NULL);
+                         &settings, NULL, NULL);
   ngtcp2_conn_set_initial_tx_keys(*pconn, null_key, sizeof(null_key), null_iv,
                                   sizeof(null_iv), null_pn, sizeof(null_pn));
   ngtcp2_conn_set_initial_rx_keys(*pconn, null_key, sizeof(null_key), null_iv,
@@ -486,7 +538,7 @@ static void setup_early_client(ngtcp2_conn **pconn) {
   client_default_settings(&settings);
 
   ngtcp2_conn_client_new(pconn, &dcid, &scid, NGTCP2_PROTO_VER_MAX, &cb,
-                         &settings, NULL);
+                         &settings, NULL, NULL);
   ngtcp2_conn_set_initial_tx_keys(*pconn, null_key, sizeof(null_key), null_iv,
                                   sizeof(null_iv), null_pn, sizeof(null_pn));
   ngtcp2_conn_set_initial_rx_keys(*pconn, null_key, sizeof(null_key), null_iv,
@@ -1760,19 +1812,19 @@ void test_ngtcp2_conn_recv_server_stateless_retry(void) {
 
   /* fr = &fra[1]; */
   /* fr->type = NGTCP2_FRAME_ACK; */
-  /* fr->ack.largest_ack = conn->in_pktns.last_tx_pkt_num; */
+  /* fr->ack.largest_ack = conn->in_pktns->last_tx_pkt_num; */
   /* fr->ack.ack_delay = 0; */
   /* fr->ack.first_ack_blklen = 0; */
   /* fr->ack.num_blks = 0; */
 
   /* pktlen = write_handshake_pkt( */
   /*     conn, buf, sizeof(buf), NGTCP2_PKT_RETRY, &conn->scid, &conn->dcid, */
-  /*     conn->in_pktns.last_tx_pkt_num, conn->version, fra, arraylen(fra)); */
+  /*     conn->in_pktns->last_tx_pkt_num, conn->version, fra, arraylen(fra)); */
 
   /* spktlen = ngtcp2_conn_handshake(conn, buf, sizeof(buf), buf, pktlen, 2); */
 
   /* CU_ASSERT(spktlen > 0); */
-  /* CU_ASSERT(1 == conn->in_pktns.last_tx_pkt_num); */
+  /* CU_ASSERT(1 == conn->in_pktns->last_tx_pkt_num); */
 
   /* ngtcp2_conn_del(conn); */
 }
@@ -1801,8 +1853,8 @@ void test_ngtcp2_conn_recv_delayed_handshake_pkt(void) {
   rv = ngtcp2_conn_recv(conn, buf, pktlen, 1);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(1 == ngtcp2_ksl_len(&conn->hs_pktns.acktr.ents));
-  CU_ASSERT(conn->hs_pktns.acktr.flags & NGTCP2_ACKTR_FLAG_ACTIVE_ACK);
+  CU_ASSERT(1 == ngtcp2_ksl_len(&conn->hs_pktns->acktr.ents));
+  CU_ASSERT(conn->hs_pktns->acktr.flags & NGTCP2_ACKTR_FLAG_ACTIVE_ACK);
 
   ngtcp2_conn_del(conn);
 
@@ -1845,8 +1897,8 @@ void test_ngtcp2_conn_recv_delayed_handshake_pkt(void) {
   rv = ngtcp2_conn_recv(conn, buf, pktlen, 1);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(1 == ngtcp2_ksl_len(&conn->hs_pktns.acktr.ents));
-  CU_ASSERT(!conn->hs_pktns.acktr.flags);
+  CU_ASSERT(1 == ngtcp2_ksl_len(&conn->hs_pktns->acktr.ents));
+  CU_ASSERT(!conn->hs_pktns->acktr.flags);
 
   ngtcp2_conn_del(conn);
 }
@@ -2039,6 +2091,7 @@ void test_ngtcp2_conn_retransmit_protected(void) {
   ngtcp2_rtb_entry *ent;
   uint64_t stream_id, stream_id_a, stream_id_b;
   ngtcp2_ksl_it it;
+  ngtcp2_pkt_hd hd;
 
   /* Retransmit a packet completely */
   setup_default_client(&conn);
@@ -2063,6 +2116,13 @@ void test_ngtcp2_conn_retransmit_protected(void) {
   it = ngtcp2_rtb_head(&conn->pktns.rtb);
 
   CU_ASSERT(ent == ngtcp2_ksl_it_get(&it));
+  CU_ASSERT(conn->pktns.last_tx_pkt_num == ent->pkt_num);
+  CU_ASSERT(NGTCP2_PKT_SHORT == ent->pkt_type);
+
+  /* Connection ID is taken from conn, not from ent. */
+  CU_ASSERT(ngtcp2_pkt_decode_hd_short(&hd, buf, (size_t)spktlen,
+                                       conn->dcid.datalen) > 0);
+  CU_ASSERT(ngtcp2_cid_eq(&conn->dcid, &hd.dcid));
 
   ngtcp2_conn_del(conn);
 
@@ -2898,7 +2958,7 @@ void test_ngtcp2_conn_recv_compound_pkt(void) {
 
   CU_ASSERT(spktlen > 0);
 
-  it = ngtcp2_acktr_get(&conn->in_pktns.acktr);
+  it = ngtcp2_acktr_get(&conn->in_pktns->acktr);
   ackent = ngtcp2_ksl_it_get(&it);
 
   CU_ASSERT(ackent->pkt_num == pkt_num);
@@ -2939,7 +2999,7 @@ void test_ngtcp2_conn_recv_compound_pkt(void) {
 
   CU_ASSERT(ackent->pkt_num == pkt_num);
 
-  it = ngtcp2_acktr_get(&conn->hs_pktns.acktr);
+  it = ngtcp2_acktr_get(&conn->hs_pktns->acktr);
   ackent = ngtcp2_ksl_it_get(&it);
 
   CU_ASSERT(ackent->pkt_num == pkt_num - 1);
@@ -2978,7 +3038,903 @@ void test_ngtcp2_conn_pkt_payloadlen(void) {
   spktlen = ngtcp2_conn_handshake(conn, buf, sizeof(buf), buf, pktlen, ++t);
 
   CU_ASSERT(spktlen == 0);
-  CU_ASSERT(0 == ngtcp2_ksl_len(&conn->in_pktns.acktr.ents));
+  CU_ASSERT(0 == ngtcp2_ksl_len(&conn->in_pktns->acktr.ents));
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_new_connection_id(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ssize_t spktlen;
+  ngtcp2_frame fr;
+  ngtcp2_frame_chain *frc;
+  ngtcp2_cid cid;
+  uint64_t pkt_num = 1;
+  ngtcp2_tstamp t = 0;
+  size_t i;
+  int rv;
+
+  setup_handshake_server(&conn);
+  conn->callbacks.get_new_connection_id = get_new_connection_id;
+  conn->state = NGTCP2_CS_SERVER_WAIT_HANDSHAKE;
+  conn->flags |= NGTCP2_CONN_FLAG_HANDSHAKE_COMPLETED |
+                 NGTCP2_CONN_FLAG_TRANSPORT_PARAM_RECVED;
+  ngtcp2_conn_update_tx_keys(conn, null_key, sizeof(null_key), null_iv,
+                             sizeof(null_iv), null_pn, sizeof(null_pn));
+  ngtcp2_conn_update_rx_keys(conn, null_key, sizeof(null_key), null_iv,
+                             sizeof(null_iv), null_pn, sizeof(null_pn));
+
+  spktlen = ngtcp2_conn_handshake(conn, buf, sizeof(buf), NULL, 0, ++t);
+
+  CU_ASSERT(spktlen >= 0);
+  CU_ASSERT(NGTCP2_CS_POST_HANDSHAKE == conn->state);
+  CU_ASSERT(NGTCP2_MAX_SCID_POOL_SIZE == conn->nscid_pool);
+
+  i = 0;
+  for (frc = conn->frq; frc; frc = frc->next) {
+    CU_ASSERT(NGTCP2_FRAME_NEW_CONNECTION_ID == frc->fr.type);
+    CU_ASSERT(NGTCP2_MAX_SCID_POOL_SIZE - i == frc->fr.new_connection_id.seq);
+    CU_ASSERT(ngtcp2_cid_eq(&conn->scid_pool[NGTCP2_MAX_SCID_POOL_SIZE - i - 1],
+                            &frc->fr.new_connection_id.cid));
+    ++i;
+  }
+
+  CU_ASSERT(NGTCP2_MAX_SCID_POOL_SIZE == i);
+
+  /* Short packet which carries issued connection ID is accepted. */
+  fr.type = NGTCP2_FRAME_PING;
+
+  pktlen = write_single_frame_pkt(conn, buf, sizeof(buf), &conn->scid_pool[1],
+                                  ++pkt_num, &fr);
+  rv = ngtcp2_conn_recv(conn, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(pkt_num == conn->pktns.max_rx_pkt_num);
+
+  /* Unknown connection ID is ignored. */
+  memset(cid.data, 0x77, conn->scid.datalen);
+  cid.datalen = conn->scid.datalen;
+
+  pktlen = write_single_frame_pkt(conn, buf, sizeof(buf), &cid, ++pkt_num, &fr);
+  rv = ngtcp2_conn_recv(conn, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(pkt_num - 1 == conn->pktns.max_rx_pkt_num);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_write_stream_source(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ssize_t spktlen;
+  int rv;
+  ngtcp2_frame fr;
+  ngtcp2_strm *strm;
+  ssize_t nwrite;
+  uint64_t stream_id;
+  stream_source src;
+
+  src.data = null_data;
+  src.datalen = 3000;
+
+  setup_default_client(&conn);
+
+  conn->callbacks.read_stream_data = read_stream_data;
+  conn->user_data = &src;
+  conn->remote_settings.max_stream_data = 2047;
+
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+
+  CU_ASSERT(0 == rv);
+
+  strm = ngtcp2_conn_find_stream(conn, stream_id);
+
+  /* Only the data which fits in the packet is taken. */
+  spktlen = ngtcp2_conn_write_stream_source(conn, buf, 1200, &nwrite,
+                                            stream_id, 1);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(nwrite > 0);
+  CU_ASSERT(nwrite < 1200);
+  CU_ASSERT((uint64_t)nwrite == strm->tx_offset);
+
+  /* The data beyond the flow control window is not asked. */
+  spktlen = ngtcp2_conn_write_stream_source(conn, buf, sizeof(buf), &nwrite,
+                                            stream_id, 2);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(2047 == strm->tx_offset);
+  CU_ASSERT(!(strm->flags & NGTCP2_STRM_FLAG_SHUT_WR));
+
+  spktlen = ngtcp2_conn_write_stream_source(conn, buf, sizeof(buf), &nwrite,
+                                            stream_id, 3);
+
+  CU_ASSERT(0 == spktlen);
+  CU_ASSERT(-1 == nwrite);
+
+  fr.type = NGTCP2_FRAME_MAX_STREAM_DATA;
+  fr.max_stream_data.stream_id = stream_id;
+  fr.max_stream_data.max_stream_data = 4096;
+
+  pktlen = write_single_frame_pkt(conn, buf, sizeof(buf), &conn->scid, 1, &fr);
+
+  rv = ngtcp2_conn_recv(conn, buf, pktlen, 4);
+
+  CU_ASSERT(0 == rv);
+
+  spktlen = ngtcp2_conn_write_stream_source(conn, buf, sizeof(buf), &nwrite,
+                                            stream_id, 5);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(3000 - 2047 == nwrite);
+  CU_ASSERT(3000 == strm->tx_offset);
+  CU_ASSERT(strm->flags & NGTCP2_STRM_FLAG_SHUT_WR);
+
+  spktlen = ngtcp2_conn_write_stream_source(conn, buf, sizeof(buf), &nwrite,
+                                            stream_id, 6);
+
+  CU_ASSERT(NGTCP2_ERR_STREAM_SHUT_WR == spktlen);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_get_stats(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ssize_t spktlen;
+  int rv;
+  ngtcp2_frame fr;
+  ngtcp2_conn_stats stats;
+  ngtcp2_rtb_entry *ent;
+  ngtcp2_ksl_it it;
+  uint64_t stream_id;
+  uint64_t pkt_num;
+  uint64_t bytes_sent, bytes_recv;
+  ngtcp2_tstamp t = 0;
+
+  setup_default_client(&conn);
+
+  conn->max_tx_offset = 1024;
+
+  rv = ngtcp2_conn_get_stats(conn, 0, &stats);
+
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
+
+  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  spktlen = ngtcp2_conn_write_stream(conn, buf, sizeof(buf), NULL, stream_id, 0,
+                                     null_data, 1024, ++t);
+
+  CU_ASSERT(spktlen > 0);
+
+  bytes_sent = (uint64_t)spktlen;
+
+  rv = ngtcp2_conn_get_stats(conn, NGTCP2_CONN_STATS_VERSION, &stats);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == stats.pkts_sent[NGTCP2_STATS_PKT_SHORT]);
+  CU_ASSERT(bytes_sent == stats.bytes_sent[NGTCP2_STATS_PKT_SHORT]);
+  CU_ASSERT(0 == stats.pkts_sent[NGTCP2_STATS_PKT_INITIAL]);
+  CU_ASSERT(conn->ccs.cwnd == stats.cwnd);
+  CU_ASSERT(UINT64_MAX == stats.ssthresh);
+
+  /* Sending more data is blocked by connection level flow control
+     until MAX_DATA is received. */
+  spktlen = ngtcp2_conn_write_stream(conn, buf, sizeof(buf), NULL, stream_id, 0,
+                                     null_data, 1, 2);
+
+  CU_ASSERT(NGTCP2_ERR_STREAM_DATA_BLOCKED == spktlen);
+
+  fr.type = NGTCP2_FRAME_MAX_DATA;
+  fr.max_data.max_data = 2048;
+
+  pktlen = write_single_frame_pkt(conn, buf, sizeof(buf), &conn->scid, 1, &fr);
+  rv = ngtcp2_conn_recv(conn, buf, pktlen, 3);
+
+  CU_ASSERT(0 == rv);
+
+  bytes_recv = pktlen;
+
+  spktlen = ngtcp2_conn_write_stream(conn, buf, sizeof(buf), NULL, stream_id, 0,
+                                     null_data, 1, 100);
+
+  CU_ASSERT(spktlen > 0);
+
+  bytes_sent += (uint64_t)spktlen;
+  t = 100;
+
+  /* Declare the first packet lost, and then acknowledge it. */
+  it = ngtcp2_rtb_head(&conn->pktns.rtb);
+  ngtcp2_ksl_it_next(&it);
+  ent = ngtcp2_ksl_it_get(&it);
+  pkt_num = ent->pkt_num;
+  ngtcp2_rtb_detect_lost_pkt(&conn->pktns.rtb, &conn->rcs, 1000000007,
+                             1000000007, ++t);
+
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = pkt_num;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
+
+  pktlen = write_single_frame_pkt(conn, buf, sizeof(buf), &conn->scid, 2, &fr);
+  rv = ngtcp2_conn_recv(conn, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+
+  bytes_recv += pktlen;
+
+  rv = ngtcp2_conn_get_stats(conn, NGTCP2_CONN_STATS_VERSION, &stats);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(2 == stats.pkts_sent[NGTCP2_STATS_PKT_SHORT]);
+  CU_ASSERT(bytes_sent == stats.bytes_sent[NGTCP2_STATS_PKT_SHORT]);
+  CU_ASSERT(2 == stats.pkts_recv[NGTCP2_STATS_PKT_SHORT]);
+  CU_ASSERT(bytes_recv == stats.bytes_recv[NGTCP2_STATS_PKT_SHORT]);
+  CU_ASSERT(1 == stats.acks_recv);
+  CU_ASSERT(2 == stats.pkts_lost);
+  CU_ASSERT(1 == stats.pkts_spurious_lost);
+  CU_ASSERT(100 - 2 == stats.fc_blocked_duration);
+  CU_ASSERT(0 == stats.handshake_duration);
+
+  ngtcp2_conn_del(conn);
+}
+
+static void count_trace_lines(void *user_data, const char *fmt, ...) {
+  (void)fmt;
+
+  ++*(size_t *)user_data;
+}
+
+void test_ngtcp2_conn_flight_recorder(void) {
+  ngtcp2_conn *conn;
+  ngtcp2_conn_callbacks cb;
+  ngtcp2_settings settings;
+  ngtcp2_cid dcid, scid;
+  const ngtcp2_trace_ring *ring;
+  const ngtcp2_trace_record *rec;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ngtcp2_frame fr;
+  size_t i, nlines;
+  int rv;
+
+  dcid_init(&dcid);
+  scid_init(&scid);
+
+  memset(&cb, 0, sizeof(cb));
+  cb.decrypt = null_decrypt;
+  cb.encrypt_pn = null_encrypt_pn;
+  client_default_settings(&settings);
+
+  settings.flight_recorder_len = 6;
+
+  rv = ngtcp2_conn_client_new(&conn, &dcid, &scid, NGTCP2_PROTO_VER_MAX, &cb,
+                              &settings, NULL, NULL);
+
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
+
+  settings.flight_recorder_len = 8;
+
+  rv = ngtcp2_conn_client_new(&conn, &dcid, &scid, NGTCP2_PROTO_VER_MAX, &cb,
+                              &settings, NULL, NULL);
+
+  CU_ASSERT(0 == rv);
+
+  ngtcp2_conn_update_rx_keys(conn, null_key, sizeof(null_key), null_iv,
+                             sizeof(null_iv), null_pn, sizeof(null_pn));
+  ngtcp2_conn_set_aead_overhead(conn, NGTCP2_FAKE_AEAD_OVERHEAD);
+  conn->state = NGTCP2_CS_POST_HANDSHAKE;
+
+  ring = ngtcp2_conn_get_trace(conn);
+
+  CU_ASSERT(NULL != ring);
+  CU_ASSERT(0 == ngtcp2_trace_ring_len(ring));
+
+  fr.type = NGTCP2_FRAME_PING;
+
+  /* Each packet records the packet and its frame. */
+  for (i = 0; i < 5; ++i) {
+    pktlen = write_single_frame_pkt(conn, buf, sizeof(buf), &conn->scid, i,
+                                    &fr);
+    rv = ngtcp2_conn_recv(conn, buf, pktlen, i + 1);
+
+    CU_ASSERT(0 == rv);
+  }
+
+  CU_ASSERT(8 == ngtcp2_trace_ring_len(ring));
+
+  rec = ngtcp2_trace_ring_get(ring, 7);
+
+  CU_ASSERT(NGTCP2_TRACE_EVENT_FRM_RECV == rec->event);
+  CU_ASSERT(NGTCP2_FRAME_PING == rec->frame_type);
+  CU_ASSERT(4 == rec->pkt_num);
+  CU_ASSERT(5 == rec->ts);
+
+  nlines = 0;
+  rv = ngtcp2_conn_dump_trace(conn, NGTCP2_TRACE_FORMAT_TEXT,
+                              count_trace_lines, &nlines);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(8 == nlines);
 
   ngtcp2_conn_del(conn);
 }
+
+void test_ngtcp2_conn_get_phase_hist(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ssize_t spktlen;
+  int rv;
+  ngtcp2_frame fr;
+  ngtcp2_phase_hist hist;
+  uint64_t stream_id;
+#ifdef PHASE_TIMING
+  uint64_t n;
+  size_t i;
+#endif /* PHASE_TIMING */
+
+  setup_default_client(&conn);
+
+  rv = ngtcp2_conn_get_phase_hist(conn, NGTCP2_PHASE_MAX, &hist);
+
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
+
+  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  spktlen = ngtcp2_conn_write_stream(conn, buf, sizeof(buf), NULL, stream_id, 0,
+                                     null_data, 100, 1);
+
+  CU_ASSERT(spktlen > 0);
+
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = conn->pktns.last_tx_pkt_num;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
+
+  pktlen = write_single_frame_pkt(conn, buf, sizeof(buf), &conn->scid, 0, &fr);
+  rv = ngtcp2_conn_recv(conn, buf, pktlen, 2);
+
+  CU_ASSERT(0 == rv);
+
+  rv = ngtcp2_conn_get_phase_hist(conn, NGTCP2_PHASE_RECV, &hist);
+
+#ifdef PHASE_TIMING
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == hist.count);
+  CU_ASSERT(hist.min == hist.max);
+  CU_ASSERT(hist.sum == hist.max);
+
+  n = 0;
+  for (i = 0; i < NGTCP2_PHASE_HIST_NBUCKETS; ++i) {
+    n += hist.buckets[i];
+  }
+
+  CU_ASSERT(1 == n);
+
+  rv = ngtcp2_conn_get_phase_hist(conn, NGTCP2_PHASE_WRITE_PKT, &hist);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == hist.count);
+
+  rv = ngtcp2_conn_get_phase_hist(conn, NGTCP2_PHASE_WRITE_ENCRYPT, &hist);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == hist.count);
+
+  rv = ngtcp2_conn_get_phase_hist(conn, NGTCP2_PHASE_RTB_RECV_ACK, &hist);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == hist.count);
+
+  rv = ngtcp2_conn_get_phase_hist(conn, NGTCP2_PHASE_RTB_ACKED_STREAM_DATA,
+                                  &hist);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == hist.count);
+
+  rv = ngtcp2_conn_get_phase_hist(conn, NGTCP2_PHASE_RECV_STREAM, &hist);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == hist.count);
+  CU_ASSERT(UINT64_MAX == hist.min);
+#else  /* !PHASE_TIMING */
+  CU_ASSERT(NGTCP2_ERR_INVALID_STATE == rv);
+#endif /* !PHASE_TIMING */
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_discard_handshake_state(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  uint8_t hsbuf[2048];
+  size_t pktlen, hspktlen;
+  ssize_t spktlen;
+  int rv;
+  ngtcp2_frame fr;
+  uint64_t stream_id;
+  ngtcp2_conn_stats stats;
+
+  setup_default_client(&conn);
+
+  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  spktlen = ngtcp2_conn_write_stream(conn, buf, sizeof(buf), NULL, stream_id, 0,
+                                     null_data, 100, 1);
+
+  CU_ASSERT(spktlen > 0);
+
+  conn->confirm_pkt_num = conn->pktns.last_tx_pkt_num;
+
+  fr.type = NGTCP2_FRAME_PING;
+
+  hspktlen = write_single_frame_handshake_pkt(
+      conn, hsbuf, sizeof(hsbuf), NGTCP2_PKT_HANDSHAKE, &conn->scid,
+      &conn->dcid, 1, NGTCP2_PROTO_VER_MAX, &fr);
+
+  /* PING does not confirm handshake. */
+  pktlen = write_single_frame_pkt(conn, buf, sizeof(buf), &conn->scid, 0, &fr);
+  rv = ngtcp2_conn_recv(conn, buf, pktlen, 2);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL != conn->in_pktns);
+  CU_ASSERT(NULL != conn->hs_pktns);
+
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = conn->pktns.last_tx_pkt_num;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
+
+  pktlen = write_single_frame_pkt(conn, buf, sizeof(buf), &conn->scid, 1, &fr);
+  rv = ngtcp2_conn_recv(conn, buf, pktlen, 3);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(conn->flags & NGTCP2_CONN_FLAG_HANDSHAKE_CONFIRMED);
+  CU_ASSERT(NULL == conn->in_pktns);
+  CU_ASSERT(NULL == conn->hs_pktns);
+  CU_ASSERT(NULL == conn->tx_crypto_data.buf);
+
+  /* Late Handshake packet is ignored. */
+  rv = ngtcp2_conn_recv(conn, hsbuf, hspktlen, 4);
+
+  CU_ASSERT(0 == rv);
+
+  rv = ngtcp2_conn_set_handshake_rx_keys(conn, null_key, sizeof(null_key),
+                                         null_iv, sizeof(null_iv), null_pn,
+                                         sizeof(null_pn));
+
+  CU_ASSERT(NGTCP2_ERR_INVALID_STATE == rv);
+
+  spktlen = ngtcp2_conn_write_stream(conn, buf, sizeof(buf), NULL, stream_id, 0,
+                                     null_data, 100, 5);
+
+  CU_ASSERT(spktlen > 0);
+
+  rv = ngtcp2_conn_get_stats(conn, NGTCP2_CONN_STATS_VERSION, &stats);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == stats.pkts_recv[NGTCP2_STATS_PKT_HANDSHAKE]);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_idle_heap_usage(void) {
+  ngtcp2_conn *conn;
+  ngtcp2_t_mem tmem;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ssize_t spktlen;
+  int rv;
+  ngtcp2_frame fr;
+
+  ngtcp2_t_mem_init(&tmem);
+
+  setup_default_client_mem(&conn, &tmem.mem);
+
+  fr.type = NGTCP2_FRAME_PING;
+
+  pktlen = write_single_frame_pkt(conn, buf, sizeof(buf), &conn->scid, 0, &fr);
+  rv = ngtcp2_conn_recv(conn, buf, pktlen, 1);
+
+  CU_ASSERT(0 == rv);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, buf, sizeof(buf), 2);
+
+  CU_ASSERT(spktlen > 0);
+
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = conn->pktns.last_tx_pkt_num;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
+
+  pktlen = write_single_frame_pkt(conn, buf, sizeof(buf), &conn->scid, 1, &fr);
+  rv = ngtcp2_conn_recv(conn, buf, pktlen, 3);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL == conn->in_pktns);
+
+  fprintf(stderr, "heap bytes per idle connection: %zu\n", tmem.nbytes);
+
+  /* ngtcp2_conn itself, 2 crypto_km, decrypt_buf, and the acktr and
+     rtb of Short packet are left. */
+  CU_ASSERT(tmem.nbytes <= sizeof(ngtcp2_conn) + 4096);
+
+  ngtcp2_conn_del(conn);
+
+  CU_ASSERT(0 == tmem.nbytes);
+}
+
+void test_ngtcp2_conn_stream_pool(void) {
+  ngtcp2_conn *conn;
+  ngtcp2_t_mem tmem;
+  ngtcp2_strm *strm, *strms[NGTCP2_STRM_POOL_MAX + 1];
+  uint64_t stream_id;
+  size_t nbytes, i;
+  int rv;
+
+  ngtcp2_t_mem_init(&tmem);
+
+  setup_default_client_mem(&conn, &tmem.mem);
+
+  conn->max_local_stream_id_bidi =
+      ngtcp2_nth_client_bidi_id(NGTCP2_STRM_POOL_MAX + 2);
+
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+
+  CU_ASSERT(0 == rv);
+
+  strm = ngtcp2_conn_find_stream(conn, stream_id);
+  rv = ngtcp2_conn_close_stream(conn, strm, 0);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(strm == conn->strm_pool);
+  CU_ASSERT(1 == conn->nstrm_pool);
+
+  /* Closed stream object is reused without allocating memory */
+  nbytes = tmem.nbytes;
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(strm == ngtcp2_conn_find_stream(conn, stream_id));
+  CU_ASSERT(0 == conn->nstrm_pool);
+  CU_ASSERT(nbytes == tmem.nbytes);
+
+  strms[0] = strm;
+  for (i = 1; i < NGTCP2_STRM_POOL_MAX + 1; ++i) {
+    rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+
+    CU_ASSERT(0 == rv);
+
+    strms[i] = ngtcp2_conn_find_stream(conn, stream_id);
+  }
+
+  for (i = 0; i < NGTCP2_STRM_POOL_MAX + 1; ++i) {
+    rv = ngtcp2_conn_close_stream(conn, strms[i], 0);
+
+    CU_ASSERT(0 == rv);
+  }
+
+  CU_ASSERT(NGTCP2_STRM_POOL_MAX == conn->nstrm_pool);
+
+  ngtcp2_conn_del(conn);
+
+  CU_ASSERT(0 == tmem.nbytes);
+}
+
+void test_ngtcp2_conn_arena(void) {
+  ngtcp2_conn *conn;
+  ngtcp2_t_mem tmem;
+  ngtcp2_arena *arena;
+  ngtcp2_strm *strm;
+  uint64_t stream_id;
+  size_t i;
+  int rv;
+
+  ngtcp2_t_mem_init(&tmem);
+
+  rv = ngtcp2_arena_new(&arena, 0, &tmem.mem);
+
+  CU_ASSERT(0 == rv);
+
+  setup_default_client_mem(&conn, ngtcp2_arena_get_mem(arena));
+
+  conn->max_local_stream_id_bidi = ngtcp2_nth_client_bidi_id(32);
+
+  for (i = 0; i < 32; ++i) {
+    rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+
+    CU_ASSERT(0 == rv);
+
+    if (i % 2) {
+      strm = ngtcp2_conn_find_stream(conn, stream_id);
+      rv = ngtcp2_conn_close_stream(conn, strm, 0);
+
+      CU_ASSERT(0 == rv);
+    }
+  }
+
+  /* Connection and streams are carved from slabs except for the
+     objects larger than the largest size class. */
+  CU_ASSERT(arena->nslab > 0);
+
+  ngtcp2_conn_del(conn);
+
+  CU_ASSERT(NULL == arena->large);
+
+  ngtcp2_arena_del(arena);
+
+  CU_ASSERT(0 == tmem.nbytes);
+}
+
+void test_ngtcp2_conn_mem_budget(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ssize_t spktlen;
+  int rv;
+  ngtcp2_frame fr;
+  ngtcp2_strm *strm;
+  ngtcp2_ksl_it it;
+  size_t i, sum, nrob;
+
+  setup_default_server(&conn);
+
+  sum = 0;
+  for (i = 0; i < NGTCP2_MEM_SUBSYS_MAX; ++i) {
+    sum += ngtcp2_conn_get_mem_usage(conn, (ngtcp2_mem_subsys)i);
+  }
+
+  CU_ASSERT(sum == ngtcp2_conn_get_total_mem_usage(conn));
+  CU_ASSERT(sizeof(ngtcp2_conn) <
+            ngtcp2_conn_get_mem_usage(conn, NGTCP2_MEM_SUBSYS_CONN));
+  CU_ASSERT(0 == ngtcp2_conn_get_mem_usage(conn, NGTCP2_MEM_SUBSYS_STRM));
+  CU_ASSERT(0 == ngtcp2_conn_get_mem_usage(conn, NGTCP2_MEM_SUBSYS_MAX));
+
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.flags = 0;
+  fr.stream.stream_id = 0;
+  fr.stream.fin = 0;
+  fr.stream.offset = 0;
+  fr.stream.datalen = 100;
+  fr.stream.data = null_data;
+
+  pktlen = write_single_frame_pkt(conn, buf, sizeof(buf), &conn->scid, 1, &fr);
+  rv = ngtcp2_conn_recv(conn, buf, pktlen, 1);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 < ngtcp2_conn_get_mem_usage(conn, NGTCP2_MEM_SUBSYS_STRM));
+
+  strm = ngtcp2_conn_find_stream(conn, 0);
+  conn->local_settings.max_mem = ngtcp2_conn_get_total_mem_usage(conn);
+  nrob = ngtcp2_conn_get_mem_usage(conn, NGTCP2_MEM_SUBSYS_ROB);
+
+  /* Out of order data is not buffered, and the packet is not
+     acknowledged. */
+  fr.stream.offset = 200;
+
+  pktlen = write_single_frame_pkt(conn, buf, sizeof(buf), &conn->scid, 2, &fr);
+  rv = ngtcp2_conn_recv(conn, buf, pktlen, 2);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(100 == strm->last_rx_offset);
+  CU_ASSERT(nrob == ngtcp2_conn_get_mem_usage(conn, NGTCP2_MEM_SUBSYS_ROB));
+
+  it = ngtcp2_acktr_get(&conn->pktns.acktr);
+
+  CU_ASSERT(1 == ((ngtcp2_acktr_entry *)ngtcp2_ksl_it_get(&it))->pkt_num);
+
+  /* In order data is still accepted. */
+  fr.stream.offset = 100;
+
+  pktlen = write_single_frame_pkt(conn, buf, sizeof(buf), &conn->scid, 3, &fr);
+  rv = ngtcp2_conn_recv(conn, buf, pktlen, 3);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(200 == ngtcp2_strm_rx_offset(strm));
+
+  /* Flow control window is not extended. */
+  conn->local_settings.max_stream_data = 256;
+  rv = ngtcp2_conn_extend_max_stream_offset(conn, 0, 200);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(strm == conn->fc_strms);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, buf, sizeof(buf), 4);
+
+  CU_ASSERT(spktlen >= 0);
+  CU_ASSERT(strm == conn->fc_strms);
+  CU_ASSERT(65535 == strm->max_rx_offset);
+
+  /* Everything resumes when the limit is lifted. */
+  conn->local_settings.max_mem = 0;
+
+  spktlen = ngtcp2_conn_write_pkt(conn, buf, sizeof(buf), 5);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(NULL == conn->fc_strms);
+  CU_ASSERT(65535 + 200 == strm->max_rx_offset);
+
+  fr.stream.offset = 300;
+
+  pktlen = write_single_frame_pkt(conn, buf, sizeof(buf), &conn->scid, 4, &fr);
+  rv = ngtcp2_conn_recv(conn, buf, pktlen, 6);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(400 == strm->last_rx_offset);
+  CU_ASSERT(nrob < ngtcp2_conn_get_mem_usage(conn, NGTCP2_MEM_SUBSYS_ROB));
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_reset(void) {
+  ngtcp2_conn *conn, *oconn;
+  ngtcp2_t_mem tmem;
+  ngtcp2_conn_callbacks cb;
+  ngtcp2_settings settings;
+  ngtcp2_cid dcid, scid;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ngtcp2_frame fr;
+  uint64_t stream_id;
+  uint8_t *decrypt_buf;
+  ngtcp2_strm *strm;
+  int rv;
+
+  ngtcp2_t_mem_init(&tmem);
+
+  setup_default_client_mem(&conn, &tmem.mem);
+
+  fr.type = NGTCP2_FRAME_PING;
+
+  pktlen = write_single_frame_pkt(conn, buf, sizeof(buf), &conn->scid, 0, &fr);
+  rv = ngtcp2_conn_recv(conn, buf, pktlen, 1);
+
+  CU_ASSERT(0 == rv);
+
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+
+  CU_ASSERT(0 == rv);
+
+  strm = ngtcp2_conn_find_stream(conn, stream_id);
+  rv = ngtcp2_conn_close_stream(conn, strm, 0);
+
+  CU_ASSERT(0 == rv);
+
+  oconn = conn;
+  decrypt_buf = conn->decrypt_buf.base;
+  cb = conn->callbacks;
+  settings = conn->local_settings;
+  dcid_init(&dcid);
+  scid_init(&scid);
+  scid.data[0] ^= 0xff;
+
+  /* Invalid settings leave conn unchanged */
+  settings.flight_recorder_len = 3;
+
+  rv = ngtcp2_conn_reset(conn, &dcid, &scid, NGTCP2_PROTO_VER_MAX, &cb,
+                         &settings, NULL);
+
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
+  CU_ASSERT(NGTCP2_CS_POST_HANDSHAKE == conn->state);
+
+  settings.flight_recorder_len = 0;
+
+  rv = ngtcp2_conn_reset(conn, &dcid, &scid, NGTCP2_PROTO_VER_MAX, &cb,
+                         &settings, NULL);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(oconn == conn);
+  CU_ASSERT(!conn->server);
+  CU_ASSERT(NGTCP2_CS_CLIENT_INITIAL == conn->state);
+  CU_ASSERT(ngtcp2_cid_eq(&scid, &conn->scid));
+  CU_ASSERT(NULL != conn->in_pktns);
+  CU_ASSERT(NULL != conn->hs_pktns);
+  CU_ASSERT(0 == ngtcp2_map_size(&conn->strms));
+  CU_ASSERT(decrypt_buf == conn->decrypt_buf.base);
+  CU_ASSERT(strm == conn->strm_pool);
+  CU_ASSERT(1 == conn->nstrm_pool);
+  CU_ASSERT(&tmem.mem == conn->macct.parent);
+  CU_ASSERT(tmem.nbytes == ngtcp2_conn_get_total_mem_usage(conn));
+
+  ngtcp2_conn_del(conn);
+
+  CU_ASSERT(0 == tmem.nbytes);
+}
+
+void test_ngtcp2_conn_hibernate(void) {
+  ngtcp2_conn *conn;
+  ngtcp2_t_mem tmem;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ssize_t spktlen;
+  int rv;
+  ngtcp2_frame fr;
+  size_t nbytes;
+  uint64_t stream_id;
+  ssize_t ndatalen;
+
+  ngtcp2_t_mem_init(&tmem);
+
+  setup_default_client_mem(&conn, &tmem.mem);
+
+  /* Handshake is not confirmed yet */
+  rv = ngtcp2_conn_hibernate(conn);
+
+  CU_ASSERT(NGTCP2_ERR_INVALID_STATE == rv);
+
+  fr.type = NGTCP2_FRAME_PING;
+
+  pktlen = write_single_frame_pkt(conn, buf, sizeof(buf), &conn->scid, 0, &fr);
+  rv = ngtcp2_conn_recv(conn, buf, pktlen, 1);
+
+  CU_ASSERT(0 == rv);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, buf, sizeof(buf), 2);
+
+  CU_ASSERT(spktlen > 0);
+
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = conn->pktns.last_tx_pkt_num;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
+
+  pktlen = write_single_frame_pkt(conn, buf, sizeof(buf), &conn->scid, 1, &fr);
+  rv = ngtcp2_conn_recv(conn, buf, pktlen, 3);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL == conn->in_pktns);
+
+  nbytes = tmem.nbytes;
+  rv = ngtcp2_conn_hibernate(conn);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL == conn->decrypt_buf.base);
+  CU_ASSERT(tmem.nbytes + 2048 <= nbytes);
+
+  fprintf(stderr, "heap bytes per hibernated connection: %zu\n",
+          tmem.nbytes);
+
+  /* Next packet restores the buffers */
+  fr.type = NGTCP2_FRAME_PING;
+
+  pktlen = write_single_frame_pkt(conn, buf, sizeof(buf), &conn->scid, 2, &fr);
+  rv = ngtcp2_conn_recv(conn, buf, pktlen, 4);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL != conn->decrypt_buf.base);
+
+  /* ACK is pending */
+  rv = ngtcp2_conn_hibernate(conn);
+
+  CU_ASSERT(NGTCP2_ERR_INVALID_STATE == rv);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, buf, sizeof(buf), 5);
+
+  CU_ASSERT(spktlen > 0);
+
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+
+  CU_ASSERT(0 == rv);
+
+  spktlen = ngtcp2_conn_write_stream(conn, buf, sizeof(buf), &ndatalen,
+                                     stream_id, 0, null_data, 111, 6);
+
+  CU_ASSERT(spktlen > 0);
+
+  /* Stream data is in flight */
+  rv = ngtcp2_conn_hibernate(conn);
+
+  CU_ASSERT(NGTCP2_ERR_INVALID_STATE == rv);
+
+  ngtcp2_conn_del(conn);
+
+  CU_ASSERT(0 == tmem.nbytes);
+}
@@ -57,5 +57,17 @@ void test_ngtcp2_conn_send_early_data(void);
 void test_ngtcp2_conn_recv_early_data(void);
 void test_ngtcp2_conn_recv_compound_pkt(void);
 void test_ngtcp2_conn_pkt_payloadlen(void);
+void test_ngtcp2_conn_new_connection_id(void);
+void test_ngtcp2_conn_write_stream_source(void);
+void test_ngtcp2_conn_get_stats(void);
+void test_ngtcp2_conn_flight_recorder(void);
+void test_ngtcp2_conn_get_phase_hist(void);
+void test_ngtcp2_conn_discard_handshake_state(void);
+void test_ngtcp2_conn_idle_heap_usage(void);
+void test_ngtcp2_conn_hibernate(void);
+void test_ngtcp2_conn_stream_pool(void);
+void test_ngtcp2_conn_arena(void);
+void test_ngtcp2_conn_mem_budget(void);
+void test_ngtcp2_conn_reset(void);
 
 #endif /* NGTCP2_CONN_TEST_H */
@@ -0,0 +1,91 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2017 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "ngtcp2_gaptr_test.h"
+
+#include <CUnit/CUnit.h>
+
+#include "ngtcp2_gaptr.h"
+#include "ngtcp2_test_helper.h"
+
+void test_ngtcp2_gaptr_push(void) {
+  ngtcp2_gaptr gaptr;
+  ngtcp2_t_mem tmem;
+  int rv;
+
+  ngtcp2_t_mem_init(&tmem);
+  ngtcp2_gaptr_init(&gaptr, &tmem.mem);
+
+  CU_ASSERT(0 == ngtcp2_gaptr_first_gap_offset(&gaptr));
+
+  /* In-order data does not allocate any gap */
+  rv = ngtcp2_gaptr_push(&gaptr, 0, 1000);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1000 == ngtcp2_gaptr_first_gap_offset(&gaptr));
+  CU_ASSERT(0 == tmem.nbytes);
+
+  /* Retransmitted data overlaps the received data */
+  rv = ngtcp2_gaptr_push(&gaptr, 500, 1000);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1500 == ngtcp2_gaptr_first_gap_offset(&gaptr));
+  CU_ASSERT(0 == tmem.nbytes);
+
+  rv = ngtcp2_gaptr_push(&gaptr, 0, 100);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1500 == ngtcp2_gaptr_first_gap_offset(&gaptr));
+
+  /* Out-of-order data */
+  rv = ngtcp2_gaptr_push(&gaptr, 3000, 500);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1500 == ngtcp2_gaptr_first_gap_offset(&gaptr));
+  CU_ASSERT(NULL != gaptr.gap);
+  CU_ASSERT(1500 == gaptr.gap->range.begin);
+  CU_ASSERT(3000 == gaptr.gap->range.end);
+  CU_ASSERT(3500 == gaptr.gap->next->range.begin);
+  CU_ASSERT(UINT64_MAX == gaptr.gap->next->range.end);
+
+  rv = ngtcp2_gaptr_push(&gaptr, 2000, 100);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1500 == ngtcp2_gaptr_first_gap_offset(&gaptr));
+
+  rv = ngtcp2_gaptr_push(&gaptr, 1500, 500);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(2100 == ngtcp2_gaptr_first_gap_offset(&gaptr));
+
+  /* Filling in the last gap in the middle frees the gaps */
+  rv = ngtcp2_gaptr_push(&gaptr, 2100, 900);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(3500 == ngtcp2_gaptr_first_gap_offset(&gaptr));
+  CU_ASSERT(NULL == gaptr.gap);
+  CU_ASSERT(0 == tmem.nbytes);
+
+  ngtcp2_gaptr_free(&gaptr);
+}
@@ -89,3 +89,71 @@ void test_ngtcp2_ringbuf_pop_front(void) {
 
   ngtcp2_ringbuf_free(&rb);
 }
+
+void test_ngtcp2_ringbuf_reserve(void) {
+  ngtcp2_ringbuf rb;
+  ngtcp2_mem *mem = ngtcp2_mem_default();
+  size_t i;
+  int rv;
+
+  ngtcp2_ringbuf_init_growable(&rb, 16, sizeof(ints), mem);
+
+  CU_ASSERT(NULL == rb.buf);
+  CU_ASSERT(0 == rb.nmemb);
+
+  /* Wrap the elements around before the buffer grows. */
+  for (i = 0; i < 6; ++i) {
+    rv = ngtcp2_ringbuf_reserve(&rb);
+
+    CU_ASSERT(0 == rv);
+
+    ((ints *)ngtcp2_ringbuf_push_back(&rb))->a = (int32_t)i;
+
+    if (i == 2) {
+      ngtcp2_ringbuf_pop_front(&rb);
+      ngtcp2_ringbuf_pop_front(&rb);
+    }
+  }
+
+  CU_ASSERT(4 == rb.nmemb);
+  CU_ASSERT(4 == ngtcp2_ringbuf_len(&rb));
+
+  rv = ngtcp2_ringbuf_reserve(&rb);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(8 == rb.nmemb);
+
+  for (i = 0; i < 4; ++i) {
+    CU_ASSERT((int32_t)(i + 2) ==
+              ((ints *)ngtcp2_ringbuf_get(&rb, i))->a);
+  }
+
+  for (i = 4; i < 16; ++i) {
+    rv = ngtcp2_ringbuf_reserve(&rb);
+
+    CU_ASSERT(0 == rv);
+
+    ngtcp2_ringbuf_push_back(&rb);
+  }
+
+  CU_ASSERT(16 == rb.nmemb);
+  CU_ASSERT(ngtcp2_ringbuf_full(&rb));
+
+  /* The capacity does not exceed max_nmemb. */
+  rv = ngtcp2_ringbuf_reserve(&rb);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(16 == rb.nmemb);
+
+  ngtcp2_ringbuf_release(&rb);
+
+  CU_ASSERT(NULL != rb.buf);
+
+  ngtcp2_ringbuf_resize(&rb, 0);
+  ngtcp2_ringbuf_release(&rb);
+
+  CU_ASSERT(NULL == rb.buf);
+  CU_ASSERT(0 == rb.nmemb);
+
+  ngtcp2_ringbuf_free(&rb);
+}
@@ -31,5 +31,6 @@
 
 void test_ngtcp2_ringbuf_push_front(void);
 void test_ngtcp2_ringbuf_pop_front(void);
+void test_ngtcp2_ringbuf_reserve(void);
 
 #endif /* NGTCP2_RINGBUF_TEST_H */
@@ -551,3 +551,55 @@ void test_ngtcp2_rob_remove_prefix(void) {
 
   ngtcp2_rob_free(&rob);
 }
+
+void test_ngtcp2_rob_release(void) {
+  ngtcp2_mem *mem = ngtcp2_mem_default();
+  ngtcp2_rob rob;
+  uint8_t data[256];
+  const uint8_t *p;
+  size_t len;
+  int rv;
+
+  ngtcp2_rob_init(&rob, 16, mem);
+
+  CU_ASSERT(NULL == rob.gappsl.head);
+
+  rv = ngtcp2_rob_remove_prefix(&rob, 10);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL == rob.gappsl.head);
+  CU_ASSERT(10 == ngtcp2_rob_first_gap_offset(&rob));
+  CU_ASSERT(0 == ngtcp2_rob_data_at(&rob, &p, 10));
+
+  rv = ngtcp2_rob_push(&rob, 12, &data[12], 4);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL != rob.gappsl.head);
+  CU_ASSERT(10 == ngtcp2_rob_first_gap_offset(&rob));
+
+  /* rob has data, and more than one gap. */
+  ngtcp2_rob_release(&rob);
+
+  CU_ASSERT(NULL != rob.gappsl.head);
+
+  rv = ngtcp2_rob_push(&rob, 10, &data[10], 2);
+
+  CU_ASSERT(0 == rv);
+
+  len = ngtcp2_rob_data_at(&rob, &p, 10);
+
+  CU_ASSERT(6 == len);
+
+  ngtcp2_rob_pop(&rob, 10, len);
+  ngtcp2_rob_release(&rob);
+
+  CU_ASSERT(NULL == rob.gappsl.head);
+  CU_ASSERT(16 == ngtcp2_rob_first_gap_offset(&rob));
+
+  rv = ngtcp2_rob_push(&rob, 20, &data[20], 1);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(16 == ngtcp2_rob_first_gap_offset(&rob));
+
+  ngtcp2_rob_free(&rob);
+}
@@ -33,5 +33,6 @@ void test_ngtcp2_rob_push(void);
 void test_ngtcp2_rob_push_random(void);
 void test_ngtcp2_rob_data_at(void);
 void test_ngtcp2_rob_remove_prefix(void);
+void test_ngtcp2_rob_release(void);
 
 #endif /* NGTCP2_ROB_TEST_H */
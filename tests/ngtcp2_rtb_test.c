@@ -24,6 +24,8 @@
  */
 #include "ngtcp2_rtb_test.h"
 
+#include <stddef.h>
+
 #include <CUnit/CUnit.h>
 
 #include "ngtcp2_rtb.h"
@@ -82,17 +84,17 @@ void test_ngtcp2_rtb_add(void) {
   ent = ngtcp2_ksl_it_get(&it);
 
   /* Check the top of the queue */
-  CU_ASSERT(1000000009 == ent->hd.pkt_num);
+  CU_ASSERT(1000000009 == ent->pkt_num);
 
   ngtcp2_ksl_it_next(&it);
   ent = ngtcp2_ksl_it_get(&it);
 
-  CU_ASSERT(1000000008 == ent->hd.pkt_num);
+  CU_ASSERT(1000000008 == ent->pkt_num);
 
   ngtcp2_ksl_it_next(&it);
   ent = ngtcp2_ksl_it_get(&it);
 
-  CU_ASSERT(1000000007 == ent->hd.pkt_num);
+  CU_ASSERT(1000000007 == ent->pkt_num);
 
   ngtcp2_ksl_it_next(&it);
 
@@ -133,7 +135,7 @@ static void assert_rtb_entry_not_found(ngtcp2_rtb *rtb, uint64_t pkt_num) {
 
   for (; !ngtcp2_ksl_it_end(&it); ngtcp2_ksl_it_next(&it)) {
     ent = ngtcp2_ksl_it_get(&it);
-    CU_ASSERT(ent->hd.pkt_num != pkt_num);
+    CU_ASSERT(ent->pkt_num != pkt_num);
   }
 }
 
@@ -307,42 +309,42 @@ void test_ngtcp2_rtb_insert_range(void) {
   it = ngtcp2_rtb_head(&rtb);
   ent = ngtcp2_ksl_it_get(&it);
 
-  CU_ASSERT(901 == ent->hd.pkt_num);
+  CU_ASSERT(901 == ent->pkt_num);
 
   ngtcp2_ksl_it_next(&it);
   ent = ngtcp2_ksl_it_get(&it);
 
-  CU_ASSERT(900 == ent->hd.pkt_num);
+  CU_ASSERT(900 == ent->pkt_num);
 
   ngtcp2_ksl_it_next(&it);
   ent = ngtcp2_ksl_it_get(&it);
 
-  CU_ASSERT(899 == ent->hd.pkt_num);
+  CU_ASSERT(899 == ent->pkt_num);
 
   ngtcp2_ksl_it_next(&it);
   ent = ngtcp2_ksl_it_get(&it);
 
-  CU_ASSERT(898 == ent->hd.pkt_num);
+  CU_ASSERT(898 == ent->pkt_num);
 
   ngtcp2_ksl_it_next(&it);
   ent = ngtcp2_ksl_it_get(&it);
 
-  CU_ASSERT(897 == ent->hd.pkt_num);
+  CU_ASSERT(897 == ent->pkt_num);
 
   ngtcp2_ksl_it_next(&it);
   ent = ngtcp2_ksl_it_get(&it);
 
-  CU_ASSERT(896 == ent->hd.pkt_num);
+  CU_ASSERT(896 == ent->pkt_num);
 
   ngtcp2_ksl_it_next(&it);
   ent = ngtcp2_ksl_it_get(&it);
 
-  CU_ASSERT(790 == ent->hd.pkt_num);
+  CU_ASSERT(790 == ent->pkt_num);
 
   ngtcp2_ksl_it_next(&it);
   ent = ngtcp2_ksl_it_get(&it);
 
-  CU_ASSERT(788 == ent->hd.pkt_num);
+  CU_ASSERT(788 == ent->pkt_num);
 
   ngtcp2_ksl_it_next(&it);
 
@@ -350,3 +352,53 @@ void test_ngtcp2_rtb_insert_range(void) {
 
   ngtcp2_rtb_free(&rtb);
 }
+
+void test_ngtcp2_frame_chain_list_copy(void) {
+  ngtcp2_frame_chain *frc, *nfrc, *head;
+  ngtcp2_crypto *fr;
+  ngtcp2_mem *mem = ngtcp2_mem_default();
+  uint8_t data[3];
+  int rv;
+
+  rv = ngtcp2_frame_chain_new(&frc, NGTCP2_FRAME_PING, mem);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGTCP2_FRAME_PING == frc->fr.type);
+  CU_ASSERT(ngtcp2_frame_chain_objlen(frc) < sizeof(ngtcp2_frame_chain));
+
+  head = frc;
+
+  rv = ngtcp2_frame_chain_extralen_new(&frc, NGTCP2_FRAME_CRYPTO,
+                                       sizeof(ngtcp2_vec) * 2, mem);
+
+  CU_ASSERT(0 == rv);
+
+  fr = &frc->fr.crypto;
+  fr->ordered_offset = 0;
+  fr->offset = 0;
+  fr->datacnt = 3;
+  fr->data[0].base = data;
+  fr->data[0].len = 1;
+  fr->data[1].base = data;
+  fr->data[1].len = 2;
+  fr->data[2].base = data;
+  fr->data[2].len = 3;
+
+  CU_ASSERT(offsetof(ngtcp2_frame_chain, fr) + sizeof(ngtcp2_crypto) +
+                sizeof(ngtcp2_vec) * 2 ==
+            ngtcp2_frame_chain_objlen(frc));
+
+  head->next = frc;
+
+  nfrc = ngtcp2_frame_chain_list_copy(head, mem);
+
+  CU_ASSERT(NULL != nfrc);
+  CU_ASSERT(NGTCP2_FRAME_PING == nfrc->fr.type);
+  CU_ASSERT(NGTCP2_FRAME_CRYPTO == nfrc->next->fr.type);
+  CU_ASSERT(3 == nfrc->next->fr.crypto.datacnt);
+  CU_ASSERT(3 == nfrc->next->fr.crypto.data[2].len);
+  CU_ASSERT(NULL == nfrc->next->next);
+
+  ngtcp2_frame_chain_list_del(nfrc, mem);
+  ngtcp2_frame_chain_list_del(head, mem);
+}
@@ -26,6 +26,7 @@
 
 #include <string.h>
 #include <assert.h>
+#include <stdlib.h>
 
 #include "ngtcp2_conv.h"
 #include "ngtcp2_pkt.h"
@@ -192,11 +193,11 @@ size_t write_single_frame_handshake_pkt(ngtcp2_conn *conn, uint8_t *out,
   ctx.encrypt_pn = null_encrypt_pn;
   switch (pkt_type) {
   case NGTCP2_PKT_INITIAL:
-    ctx.ckm = conn->in_pktns.rx_ckm;
+    ctx.ckm = conn->in_pktns->rx_ckm;
     ctx.aead_overhead = NGTCP2_INITIAL_AEAD_OVERHEAD;
     break;
   case NGTCP2_PKT_HANDSHAKE:
-    ctx.ckm = conn->hs_pktns.rx_ckm;
+    ctx.ckm = conn->hs_pktns->rx_ckm;
     ctx.aead_overhead = NGTCP2_FAKE_AEAD_OVERHEAD;
     break;
   case NGTCP2_PKT_0RTT_PROTECTED:
@@ -238,11 +239,11 @@ size_t write_handshake_pkt(ngtcp2_conn *conn, uint8_t *out, size_t outlen,
   ctx.encrypt_pn = null_encrypt_pn;
   switch (pkt_type) {
   case NGTCP2_PKT_INITIAL:
-    ctx.ckm = conn->in_pktns.rx_ckm;
+    ctx.ckm = conn->in_pktns->rx_ckm;
     ctx.aead_overhead = NGTCP2_INITIAL_AEAD_OVERHEAD;
     break;
   case NGTCP2_PKT_HANDSHAKE:
-    ctx.ckm = conn->hs_pktns.rx_ckm;
+    ctx.ckm = conn->hs_pktns->rx_ckm;
     ctx.aead_overhead = NGTCP2_FAKE_AEAD_OVERHEAD;
     break;
   case NGTCP2_PKT_0RTT_PROTECTED:
@@ -381,3 +382,82 @@ ssize_t pkt_decode_hd_short(ngtcp2_pkt_hd *dest, const uint8_t *pkt,
 
   return nread + (ssize_t)n;
 }
+
+/*
+ * t_mem_hdr is placed in front of each allocation made through
+ * ngtcp2_t_mem in order to remember its size.
+ */
+typedef union {
+  size_t size;
+  /* The following fields keep the allocation suitably aligned. */
+  long double ld;
+  uint64_t u64;
+  void *p;
+} t_mem_hdr;
+
+static void *t_mem_malloc(size_t size, void *mem_user_data) {
+  ngtcp2_t_mem *tmem = mem_user_data;
+  t_mem_hdr *hdr = malloc(sizeof(t_mem_hdr) + size);
+
+  if (hdr == NULL) {
+    return NULL;
+  }
+
+  hdr->size = size;
+  tmem->nbytes += size;
+
+  return hdr + 1;
+}
+
+static void t_mem_free(void *ptr, void *mem_user_data) {
+  ngtcp2_t_mem *tmem = mem_user_data;
+  t_mem_hdr *hdr;
+
+  if (ptr == NULL) {
+    return;
+  }
+
+  hdr = (t_mem_hdr *)ptr - 1;
+  tmem->nbytes -= hdr->size;
+
+  free(hdr);
+}
+
+static void *t_mem_calloc(size_t nmemb, size_t size, void *mem_user_data) {
+  void *p = t_mem_malloc(nmemb * size, mem_user_data);
+
+  if (p == NULL) {
+    return NULL;
+  }
+
+  return memset(p, 0, nmemb * size);
+}
+
+static void *t_mem_realloc(void *ptr, size_t size, void *mem_user_data) {
+  void *p;
+  size_t oldsize;
+
+  if (ptr == NULL) {
+    return t_mem_malloc(size, mem_user_data);
+  }
+
+  p = t_mem_malloc(size, mem_user_data);
+  if (p == NULL) {
+    return NULL;
+  }
+
+  oldsize = ((t_mem_hdr *)ptr - 1)->size;
+  memcpy(p, ptr, oldsize < size ? oldsize : size);
+  t_mem_free(ptr, mem_user_data);
+
+  return p;
+}
+
+void ngtcp2_t_mem_init(ngtcp2_t_mem *tmem) {
+  tmem->mem.mem_user_data = tmem;
+  tmem->mem.malloc = t_mem_malloc;
+  tmem->mem.free = t_mem_free;
+  tmem->mem.calloc = t_mem_calloc;
+  tmem->mem.realloc = t_mem_realloc;
+  tmem->nbytes = 0;
+}
@@ -170,4 +170,20 @@ ssize_t pkt_decode_hd_long(ngtcp2_pkt_hd *dest, const uint8_t *pkt,
 ssize_t pkt_decode_hd_short(ngtcp2_pkt_hd *dest, const uint8_t *pkt,
                             size_t pktlen, size_t dcidlen);
 
+/*
+ * ngtcp2_t_mem is an allocator which keeps track of the number of
+ * bytes allocated through |mem|, and not freed yet.
+ */
+typedef struct {
+  ngtcp2_mem mem;
+  /* nbytes is the number of bytes currently allocated. */
+  size_t nbytes;
+} ngtcp2_t_mem;
+
+/*
+ * ngtcp2_t_mem_init initializes |tmem|.  Pass &tmem->mem to the
+ * library.
+ */
+void ngtcp2_t_mem_init(ngtcp2_t_mem *tmem);
+
 #endif /* NGTCP2_TEST_HELPER_H */
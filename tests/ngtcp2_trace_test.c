@@ -0,0 +1,124 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2017 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "ngtcp2_trace_test.h"
+
+#include <string.h>
+
+#include <CUnit/CUnit.h>
+
+#include "ngtcp2_trace.h"
+#include "ngtcp2_test_helper.h"
+
+void test_ngtcp2_trace_ring(void) {
+  ngtcp2_trace_ring ring;
+  ngtcp2_trace_record records[8];
+  ngtcp2_trace_record *rec;
+  size_t i;
+
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT ==
+            ngtcp2_trace_ring_init(&ring, records, 0));
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT ==
+            ngtcp2_trace_ring_init(&ring, records, 6));
+  CU_ASSERT(0 == ngtcp2_trace_ring_init(&ring, records, 8));
+  CU_ASSERT(0 == ngtcp2_trace_ring_len(&ring));
+
+  for (i = 0; i < 5; ++i) {
+    rec = ngtcp2_trace_ring_push(&ring);
+    rec->pkt_num = i;
+  }
+
+  CU_ASSERT(5 == ngtcp2_trace_ring_len(&ring));
+  CU_ASSERT(0 == ngtcp2_trace_ring_get(&ring, 0)->pkt_num);
+  CU_ASSERT(4 == ngtcp2_trace_ring_get(&ring, 4)->pkt_num);
+
+  /* The oldest records are overwritten. */
+  for (; i < 19; ++i) {
+    rec = ngtcp2_trace_ring_push(&ring);
+    rec->pkt_num = i;
+  }
+
+  CU_ASSERT(8 == ngtcp2_trace_ring_len(&ring));
+
+  for (i = 0; i < 8; ++i) {
+    CU_ASSERT(11 + i == ngtcp2_trace_ring_get(&ring, i)->pkt_num);
+  }
+}
+
+void test_ngtcp2_trace_format(void) {
+  ngtcp2_trace_record rec;
+  char buf[256];
+  ssize_t n;
+
+  memset(&rec, 0, sizeof(rec));
+  rec.ts = 1000 + 12345678;
+  rec.pkt_num = 7;
+  rec.event = NGTCP2_TRACE_EVENT_FRM_SENT;
+  rec.pkt_type = NGTCP2_PKT_SHORT;
+  rec.flags = NGTCP2_TRACE_FLAG_FIN;
+  rec.frame_type = NGTCP2_FRAME_STREAM | 0x07;
+  rec.a = 4;
+  rec.b = 100;
+  rec.c = 1000;
+
+  n = ngtcp2_trace_format(buf, sizeof(buf), &rec, 1000,
+                          NGTCP2_TRACE_FORMAT_TEXT);
+
+  CU_ASSERT(0 == strcmp("I00000012.345 frm tx 7 Short(0x00) STREAM(0x17) "
+                        "stream_id=4 offset=100 length=1000 fin=1",
+                        buf));
+  CU_ASSERT((ssize_t)strlen(buf) == n);
+
+  n = ngtcp2_trace_format(buf, sizeof(buf), &rec, 1000,
+                          NGTCP2_TRACE_FORMAT_QLOG);
+
+  CU_ASSERT(0 == strcmp("{\"time\":12.345,\"name\":\"transport:frame_sent\","
+                        "\"data\":{\"header\":{\"packet_type\":\"1RTT\","
+                        "\"packet_number\":7},\"frame\":{\"frame_type\":"
+                        "\"stream\",\"stream_id\":4,\"offset\":100,"
+                        "\"length\":1000,\"fin\":true}}}",
+                        buf));
+  CU_ASSERT((ssize_t)strlen(buf) == n);
+
+  memset(&rec, 0, sizeof(rec));
+  rec.ts = 2000000;
+  rec.pkt_num = 1;
+  rec.event = NGTCP2_TRACE_EVENT_PKT_SENT;
+  rec.pkt_type = NGTCP2_PKT_INITIAL;
+  rec.flags = NGTCP2_TRACE_FLAG_LONG_FORM;
+  rec.a = 1200;
+
+  n = ngtcp2_trace_format(buf, sizeof(buf), &rec, 0,
+                          NGTCP2_TRACE_FORMAT_TEXT);
+
+  CU_ASSERT(0 == strcmp("I00000002.000 pkt tx 1 Initial(0x7f) len=1200", buf));
+
+  n = ngtcp2_trace_format(buf, 10, &rec, 0, NGTCP2_TRACE_FORMAT_TEXT);
+
+  CU_ASSERT(NGTCP2_ERR_NOBUF == n);
+
+  n = ngtcp2_trace_format(buf, sizeof(buf), &rec, 0, 100);
+
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == n);
+}